@@ -0,0 +1,123 @@
+#include "AlignmentArena.h"
+
+#include <limits>
+#include <string.h>
+
+#include "../error.h"
+
+const char AlignmentArena::CIGAR_OPS[] = "MIDNSHP=X";
+
+uint32_t AlignmentArena::append_bytes(const std::string& str){
+  if (bytes_.size() + str.size() > std::numeric_limits<uint32_t>::max())
+    printErrorAndDie("Alignment arena exceeded the maximum buffer size");
+  uint32_t offset = bytes_.size();
+  bytes_.append(str);
+  return offset;
+}
+
+uint32_t AlignmentArena::pack_cigar_element(const CigarElement& element){
+  const char* op = strchr(CIGAR_OPS, element.get_type());
+  if (op == NULL || *op == '\0')
+    printErrorAndDie("Invalid CIGAR operation type in alignment arena");
+  return ((uint32_t)element.get_num() << 4) | (uint32_t)(op - CIGAR_OPS);
+}
+
+void AlignmentArena::append_hap_gen_info(const std::vector<bool>& hap_gen_info, Record& rec){
+  rec.hap_offset = hap_gen_info_.size();
+  rec.num_haps   = hap_gen_info.size();
+  hap_gen_info_.insert(hap_gen_info_.end(), hap_gen_info.begin(), hap_gen_info.end());
+}
+
+int32_t AlignmentArena::intern_name(const std::string& name){
+  auto name_iter = name_ids_.find(name);
+  if (name_iter == name_ids_.end()){
+    name_iter = name_ids_.insert(std::pair<std::string, int32_t>(name, names_.size())).first;
+    names_.push_back(&(name_iter->first));
+  }
+  return name_iter->second;
+}
+
+int32_t AlignmentArena::add(const Alignment& aln){
+  Record rec;
+  rec.start      = aln.get_start();
+  rec.stop       = aln.get_stop();
+  rec.rev_strand = aln.is_from_reverse_strand();
+
+  rec.seq_len    = aln.get_sequence().size();
+  rec.qual_len   = aln.get_base_qualities().size();
+  rec.aln_len    = aln.get_alignment().size();
+  rec.seq_offset = append_bytes(aln.get_sequence());
+  append_bytes(aln.get_base_qualities());
+  rec.aln_offset = append_bytes(aln.get_alignment());
+
+  const std::vector<CigarElement>& cigar_list = aln.get_cigar_list();
+  rec.cigar_offset = cigar_ops_.size();
+  rec.num_cigar    = cigar_list.size();
+  for (auto cigar_iter = cigar_list.begin(); cigar_iter != cigar_list.end(); cigar_iter++)
+    cigar_ops_.push_back(pack_cigar_element(*cigar_iter));
+
+  append_hap_gen_info(aln.get_hap_gen_info(), rec);
+  rec.name_id = intern_name(aln.get_name());
+  records_.push_back(rec);
+  return records_.size()-1;
+}
+
+int32_t AlignmentArena::add_with_alignment_of(int32_t source, const std::string& name, bool rev_strand, const std::string& base_qualities,
+					      const std::string& sequence, const std::vector<bool>& hap_gen_info){
+  Record rec     = records_[source];
+  rec.rev_strand = rev_strand;
+  rec.seq_len    = sequence.size();
+  rec.qual_len   = base_qualities.size();
+  rec.seq_offset = append_bytes(sequence);
+  append_bytes(base_qualities);
+  append_hap_gen_info(hap_gen_info, rec);
+  rec.name_id    = intern_name(name);
+  records_.push_back(rec);
+  return records_.size()-1;
+}
+
+void AlignmentArena::clear(){
+  records_.clear();
+  bytes_.clear();
+  cigar_ops_.clear();
+  hap_gen_info_.clear();
+  name_ids_.clear();
+  names_.clear();
+}
+
+void AlignmentArena::swap(AlignmentArena& other){
+  records_.swap(other.records_);
+  bytes_.swap(other.bytes_);
+  cigar_ops_.swap(other.cigar_ops_);
+  hap_gen_info_.swap(other.hap_gen_info_);
+  name_ids_.swap(other.name_ids_);
+  names_.swap(other.names_);
+}
+
+void AlignmentArena::get_cigar_list(int32_t index, std::vector<CigarElement>& cigar_list) const {
+  const Record& rec = records_[index];
+  cigar_list.clear();
+  for (uint32_t i = 0; i < rec.num_cigar; i++)
+    cigar_list.push_back(unpack_cigar_element(cigar_ops_[rec.cigar_offset + i]));
+}
+
+Alignment AlignmentArena::get_alignment(int32_t index) const {
+  const Record& rec = records_[index];
+  Alignment aln(rec.start, rec.stop, rec.rev_strand, *names_[rec.name_id],
+		bytes_.substr(rec.seq_offset + rec.seq_len, rec.qual_len),
+		bytes_.substr(rec.seq_offset, rec.seq_len),
+		bytes_.substr(rec.aln_offset, rec.aln_len));
+  std::vector<CigarElement> cigar_list;
+  get_cigar_list(index, cigar_list);
+  aln.set_cigar_list(cigar_list);
+  if (rec.num_haps > 0)
+    aln.set_hap_gen_info(std::vector<bool>(hap_gen_info_.begin() + rec.hap_offset, hap_gen_info_.begin() + rec.hap_offset + rec.num_haps));
+  return aln;
+}
+
+Alignment AlignmentArena::get_read(int32_t index) const {
+  const Record& rec = records_[index];
+  return Alignment(rec.start, rec.stop, rec.rev_strand, "",
+		   bytes_.substr(rec.seq_offset + rec.seq_len, rec.qual_len),
+		   bytes_.substr(rec.seq_offset, rec.seq_len), "");
+}
@@ -0,0 +1,99 @@
+#ifndef ALIGNMENT_ARENA_H_
+#define ALIGNMENT_ARENA_H_
+
+#include <assert.h>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "AlignmentData.h"
+
+/*
+ * Compact, append-only storage for the left-aligned reads used throughout genotyping. Rather than holding several heap-allocated
+ * strings and vectors per read, each read's sequence, base qualities and alignment string are appended to a single contiguous
+ * buffer and addressed by offsets, read names are interned (so that both mates share one copy) and CIGAR operations are packed into
+ * 32-bit integers using the BAM encoding. Reads that reuse another read's alignment share its alignment string and CIGAR operations.
+ * Sequences and base qualities are accessed in place, while full Alignment objects are only materialized on request
+ */
+class AlignmentArena {
+ private:
+  class Record {
+  public:
+    int32_t start, stop;
+    uint32_t seq_offset, aln_offset;  // Offsets of the sequence and alignment string in the byte buffer. Qualities follow the sequence
+    uint32_t seq_len, qual_len, aln_len;
+    uint32_t cigar_offset, num_cigar;
+    uint32_t hap_offset, num_haps;
+    int32_t name_id;
+    bool rev_strand;
+  };
+
+  std::vector<Record> records_;
+  std::string bytes_;                        // Sequences, base qualities and alignment strings of all reads
+  std::vector<uint32_t> cigar_ops_;          // Packed CIGAR operations of all reads (length << 4 | operation)
+  std::vector<bool> hap_gen_info_;           // Haplotype generation flags of all reads
+  std::map<std::string, int32_t> name_ids_;  // Interned read names
+  std::vector<const std::string*> names_;    // Interned name for each name ID
+
+  static const char CIGAR_OPS[];
+
+  uint32_t append_bytes(const std::string& str);
+
+  void append_hap_gen_info(const std::vector<bool>& hap_gen_info, Record& rec);
+
+  int32_t intern_name(const std::string& name);
+
+  static uint32_t pack_cigar_element(const CigarElement& element);
+
+  static CigarElement unpack_cigar_element(uint32_t op){
+    return CigarElement(CIGAR_OPS[op & 0xF], (int)(op >> 4));
+  }
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  AlignmentArena(const AlignmentArena& other);
+  AlignmentArena& operator=(const AlignmentArena& other);
+
+ public:
+  AlignmentArena(){}
+
+  // Copies the alignment into the arena and returns its index
+  int32_t add(const Alignment& aln);
+
+  // Adds a read with the provided sequence and base qualities whose alignment is identical to that of the read at index SOURCE,
+  // sharing the source's alignment string and CIGAR operations. Returns the new read's index
+  int32_t add_with_alignment_of(int32_t source, const std::string& name, bool rev_strand, const std::string& base_qualities,
+				const std::string& sequence, const std::vector<bool>& hap_gen_info);
+
+  void clear();
+
+  void swap(AlignmentArena& other);
+
+  unsigned int size() const { return records_.size(); }
+
+  int32_t get_start(int32_t index)                        const { return records_[index].start;                       }
+  int32_t get_stop(int32_t index)                         const { return records_[index].stop;                        }
+  bool is_from_reverse_strand(int32_t index)              const { return records_[index].rev_strand;                  }
+  const std::string& get_name(int32_t index)              const { return *names_[records_[index].name_id];            }
+  bool use_for_hap_generation(int32_t index, int region_index) const {
+    assert((uint32_t)region_index < records_[index].num_haps);
+    return hap_gen_info_[records_[index].hap_offset + region_index];
+  }
+
+  // The sequences and base qualities are stored in place and aren't null-terminated. They're invalidated by subsequent additions
+  const char* get_sequence(int32_t index)           const { return bytes_.data() + records_[index].seq_offset;                          }
+  const char* get_base_qualities(int32_t index)     const { return bytes_.data() + records_[index].seq_offset + records_[index].seq_len; }
+  uint32_t get_sequence_length(int32_t index)       const { return records_[index].seq_len;                                             }
+  uint32_t get_base_qualities_length(int32_t index) const { return records_[index].qual_len;                                            }
+
+  void get_cigar_list(int32_t index, std::vector<CigarElement>& cigar_list) const;
+
+  // Reconstructs the full alignment at the provided index
+  Alignment get_alignment(int32_t index) const;
+
+  // Reconstructs only the position, strand, sequence and base qualities of the read at the provided index,
+  // which is all that's needed to realign it to a haplotype
+  Alignment get_read(int32_t index) const;
+};
+
+#endif
@@ -125,6 +125,7 @@ class Alignment {
   inline const std::string& get_sequence()                 const { return sequence_;       }
   inline const std::string& get_alignment()                const { return alignment_;      }
   inline const std::vector<CigarElement>& get_cigar_list() const { return cigar_list_;     }
+  inline const std::vector<bool>& get_hap_gen_info()       const { return use_for_haps_;   }
   bool use_for_hap_generation(int region_index) const { return use_for_haps_[region_index]; }
   bool is_from_reverse_strand() const { return rev_strand_; }
 
@@ -2,6 +2,7 @@
 
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 
 #include "AlignmentModel.h"
 
@@ -17,7 +18,7 @@ double LOG_MATCH_TO_DEL[MAX_HOMOP_LEN+1];
   LOG_MATCH_TO_INS and LOG_MATCH_TO_DEL values are obtained by logging the values utilized in Dindel
   LOG_MATCH_TO_MATCH is equal to log(1-P(M->I)-P(M->D))
  */
-void init_alignment_model(){
+static void fill_transition_arrays(){
   // Values won't be used anyways as homopolymer length >= 1
   LOG_MATCH_TO_INS[0]   = 0;
   LOG_MATCH_TO_DEL[0]   = 0;
@@ -31,6 +32,13 @@ void init_alignment_model(){
   }
 }
 
+// The arrays only depend on the constants above, so they're filled once rather than each time a locus is genotyped
+static std::once_flag alignment_model_flag;
+
+void init_alignment_model(){
+  std::call_once(alignment_model_flag, fill_transition_arrays);
+}
+
 
 void print_alignment_model(std::ostream& out){
   out << "Match->Insertion transition probabilities:\n"
@@ -23,12 +23,14 @@ const double IMPOSSIBLE = -1000000000;
 // is above this threshold
 const double MIN_SNP_LOG_PROB_CORRECT = -0.0043648054;
 
-void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
+std::atomic<int64_t> HapAligner::next_read_id_(0);
+
+void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns, int64_t read_id,
 				  const char* seq_0, int seq_len, const double* base_log_wrong, const double* base_log_correct,
 				  double* match_matrix, double* insert_matrix, double* deletion_matrix,
 				  int* best_artifact_size, int* best_artifact_pos, double& left_prob){
   // NOTE: Input matrix structure: Row = Haplotype position, Column = Read index
-  double* L_log_probs = new double[seq_len];
+  double* L_log_probs = workspace_->get_buffer(HapAlignerWorkspace::L_LOG_PROBS, seq_len);
  
   // Initialize first row of matrix (each base position matched with leftmost haplotype base)
   left_prob = 0.0;
@@ -71,7 +73,7 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
       matrix_index                  = seq_len*(haplotype_index+block_len-1);  // Index into matrix for rightmost character in stutter block (column = 0)
       int num_stutter_artifacts     = (rep_info->max_insertion()-rep_info->max_deletion())/period + 1;
       StutterAlignerClass* stutter_aligner = haplotype->get_block(block_index)->get_stutter_aligner(block_option);
-      stutter_aligner->load_read(seq_len, seq_0+seq_len-1, base_log_wrong+seq_len-1, base_log_correct+seq_len-1);
+      stutter_aligner->load_read(read_id, seq_len, seq_0+seq_len-1, base_log_wrong+seq_len-1, base_log_correct+seq_len-1);
 
       std::vector<double> block_probs(num_stutter_artifacts); // Reuse in each iteration to avoid reallocation penalty
       int offset = seq_len-1;
@@ -164,7 +166,6 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
 
     }
   }
-  delete [] L_log_probs;
   assert(haplotype_index == haplotype->cur_size());
 }
 
@@ -582,10 +583,9 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
 			      double* prob_ptr, AlignmentTrace& trace){
   assert(seed_base != -1);
   assert(aln.get_sequence().size() == aln.get_base_qualities().size());
-	std::cout<<"HIIIIII"<<std::endl;
   // Extract probabilites related to base quality scores
-  double* base_log_wrong   = new double[aln.get_sequence().size()]; // log10(Prob(error))
-  double* base_log_correct = new double[aln.get_sequence().size()]; // log10(Prob(correct))
+  double* base_log_wrong   = workspace_->get_buffer(HapAlignerWorkspace::BASE_LOG_WRONG,   aln.get_sequence().size()); // log10(Prob(error))
+  double* base_log_correct = workspace_->get_buffer(HapAlignerWorkspace::BASE_LOG_CORRECT, aln.get_sequence().size()); // log10(Prob(correct))
   const std::string& qual_string = aln.get_base_qualities();
   for (unsigned int j = 0; j < qual_string.size(); j++){
     base_log_wrong[j]   = base_quality->log_prob_error(qual_string[j]);
@@ -596,19 +596,20 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
   const char* base_seq = aln.get_sequence().c_str();
   int base_seq_len     = (int)aln.get_sequence().size();
 
-  // Allocate scoring matrices based on the maximum haplotype size
+  // Obtain scoring matrices sized for the maximum haplotype size
   int max_hap_size          = fw_haplotype_->max_size();
   int num_hap_blocks        = fw_haplotype_->num_blocks();
-  double* l_match_matrix    = new double [seed_base*max_hap_size];
-  double* l_insert_matrix   = new double [seed_base*max_hap_size];
-  double* l_deletion_matrix = new double [seed_base*max_hap_size];
-  int* l_best_artifact_size = new int    [seed_base*num_hap_blocks];
-  int* l_best_artifact_pos  = new int    [seed_base*num_hap_blocks];
-  double* r_match_matrix    = new double [(base_seq_len-seed_base-1)*max_hap_size];
-  double* r_insert_matrix   = new double [(base_seq_len-seed_base-1)*max_hap_size];
-  double* r_deletion_matrix = new double [(base_seq_len-seed_base-1)*max_hap_size];
-  int* r_best_artifact_size = new int    [(base_seq_len-seed_base-1)*num_hap_blocks];
-  int* r_best_artifact_pos  = new int    [(base_seq_len-seed_base-1)*num_hap_blocks];
+  int r_seq_len             = base_seq_len-seed_base-1;
+  double* l_match_matrix    = workspace_->get_buffer(HapAlignerWorkspace::L_MATCH,         seed_base*max_hap_size);
+  double* l_insert_matrix   = workspace_->get_buffer(HapAlignerWorkspace::L_INSERT,        seed_base*max_hap_size);
+  double* l_deletion_matrix = workspace_->get_buffer(HapAlignerWorkspace::L_DELETION,      seed_base*max_hap_size);
+  int* l_best_artifact_size = workspace_->get_buffer(HapAlignerWorkspace::L_ARTIFACT_SIZE, seed_base*num_hap_blocks);
+  int* l_best_artifact_pos  = workspace_->get_buffer(HapAlignerWorkspace::L_ARTIFACT_POS,  seed_base*num_hap_blocks);
+  double* r_match_matrix    = workspace_->get_buffer(HapAlignerWorkspace::R_MATCH,         r_seq_len*max_hap_size);
+  double* r_insert_matrix   = workspace_->get_buffer(HapAlignerWorkspace::R_INSERT,        r_seq_len*max_hap_size);
+  double* r_deletion_matrix = workspace_->get_buffer(HapAlignerWorkspace::R_DELETION,      r_seq_len*max_hap_size);
+  int* r_best_artifact_size = workspace_->get_buffer(HapAlignerWorkspace::R_ARTIFACT_SIZE, r_seq_len*num_hap_blocks);
+  int* r_best_artifact_pos  = workspace_->get_buffer(HapAlignerWorkspace::R_ARTIFACT_POS,  r_seq_len*num_hap_blocks);
   double max_LL             = -100000000;
 
   // Reverse bases and quality scores for the right flank
@@ -620,6 +621,11 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
   // True iff we should reuse alignment information from the previous haplotype to accelerate computations
   bool reuse_alns = false;
 
+  // Stutter alignment tables only depend on the read segment and the block sequence, so
+  // we reuse them across haplotypes by assigning the left and right segments unique identifiers
+  int64_t l_read_id = next_read_id_.fetch_add(2);
+  int64_t r_read_id = l_read_id + 1;
+
   do {
     if (!realign_to_hap_[fw_haplotype_->cur_index()]){
       prob_ptr++;
@@ -629,10 +635,10 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
     // Perform alignment to current haplotype
     double l_prob, r_prob;
     int max_index;
-    align_seq_to_hap(fw_haplotype_, reuse_alns, base_seq, seed_base, base_log_wrong, base_log_correct,
+    align_seq_to_hap(fw_haplotype_, reuse_alns, l_read_id, base_seq, seed_base, base_log_wrong, base_log_correct,
 		     l_match_matrix, l_insert_matrix, l_deletion_matrix, l_best_artifact_size, l_best_artifact_pos, l_prob);
 
-    align_seq_to_hap(rev_haplotype_, reuse_alns, rev_rseq.c_str(), rev_rseq.size(), base_log_wrong+seed_base+1, base_log_correct+seed_base+1,
+    align_seq_to_hap(rev_haplotype_, reuse_alns, r_read_id, rev_rseq.c_str(), rev_rseq.size(), base_log_wrong+seed_base+1, base_log_correct+seed_base+1,
 		     r_match_matrix, r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, r_prob);
     
     double LL = compute_aln_logprob(base_seq_len, seed_base, base_seq[seed_base], base_log_wrong[seed_base], base_log_correct[seed_base],
@@ -701,20 +707,6 @@ void HapAligner::process_read(const Alignment& aln, int seed_base, const BaseQua
   } while (fw_haplotype_->next() && rev_haplotype_->next());
   fw_haplotype_->reset();
   rev_haplotype_->reset();
-
-  // Deallocate arrays and scoring matrices
-  delete [] l_match_matrix;
-  delete [] l_insert_matrix;
-  delete [] l_deletion_matrix;
-  delete [] l_best_artifact_size;
-  delete [] l_best_artifact_pos;
-  delete [] r_match_matrix;
-  delete [] r_insert_matrix;
-  delete [] r_deletion_matrix;
-  delete [] r_best_artifact_size;
-  delete [] r_best_artifact_pos;
-  delete [] base_log_wrong;
-  delete [] base_log_correct;
 }
 
 AlignmentTrace* HapAligner::trace_optimal_aln(const Alignment& orig_aln, int seed_base, int best_haplotype, const BaseQuality* base_quality){
@@ -2,14 +2,56 @@
 #define HAP_ALIGNER_H_
 
 #include <assert.h>
+#include <atomic>
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 #include "AlignmentData.h"
 #include "AlignmentTraceback.h"
 #include "../base_quality.h"
 #include "Haplotype.h"
 
+/**
+ * Reusable buffers for the base quality arrays and alignment matrices that are filled for each read.
+ * Buffers only ever grow, so sharing a workspace among successive aligners avoids reallocating them
+ * for every read and locus. A workspace must only be used by one thread at a time
+ **/
+class HapAlignerWorkspace {
+ public:
+  enum DoubleBuffer { BASE_LOG_WRONG, BASE_LOG_CORRECT, L_LOG_PROBS,
+		      L_MATCH, L_INSERT, L_DELETION, R_MATCH, R_INSERT, R_DELETION,
+		      POOL_ALN_PROBS, NUM_DOUBLE_BUFFERS };
+  enum IntBuffer    { L_ARTIFACT_SIZE, L_ARTIFACT_POS, R_ARTIFACT_SIZE, R_ARTIFACT_POS,
+		      POOL_SEED_POSITIONS, NUM_INT_BUFFERS };
+
+ private:
+  std::vector<double> double_buffers_[NUM_DOUBLE_BUFFERS];
+  std::vector<int> int_buffers_[NUM_INT_BUFFERS];
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  HapAlignerWorkspace(const HapAlignerWorkspace& other);
+  HapAlignerWorkspace& operator=(const HapAlignerWorkspace& other);
+
+ public:
+  HapAlignerWorkspace(){}
+
+  // Returns a buffer with space for at least SIZE values. Its contents are left over from its previous use
+  double* get_buffer(DoubleBuffer buffer, size_t size){
+    std::vector<double>& values = double_buffers_[buffer];
+    if (values.size() < size)
+      values.resize(size);
+    return values.data();
+  }
+
+  int* get_buffer(IntBuffer buffer, size_t size){
+    std::vector<int>& values = int_buffers_[buffer];
+    if (values.size() < size)
+      values.resize(size);
+    return values.data();
+  }
+};
+
 class HapAligner {
  private:
   Haplotype* fw_haplotype_;
@@ -19,11 +61,20 @@ class HapAligner {
   std::vector<int32_t> repeat_starts_;
   std::vector<int32_t> repeat_ends_;
 
+  // Buffers for the per-read arrays and matrices. Owned by the aligner iff OWNS_WORKSPACE is true
+  HapAlignerWorkspace* workspace_;
+  bool owns_workspace_;
+
+  // Source of the unique identifiers used to reuse each read segment's stutter alignment tables
+  // across haplotypes. Shared by all instances, as instances may share haplotype blocks. Atomic so that
+  // genotypers running on separate threads never hand out the same identifier
+  static std::atomic<int64_t> next_read_id_;
+
   /**
    * Align the sequence contained in SEQ_0 -> SEQ_N using the recursion
    * 0 -> 1 -> 2 ... N
    **/
-  void align_seq_to_hap(Haplotype* haplotype, bool reuse_alns,
+  void align_seq_to_hap(Haplotype* haplotype, bool reuse_alns, int64_t read_id,
 			const char* seq_0, int seq_len,
 			const double* base_log_wrong, const double* base_log_correct,
 			double* match_matrix, double* insert_matrix, double* deletion_matrix,
@@ -53,8 +104,11 @@ class HapAligner {
   HapAligner& operator=(const HapAligner& other);
 
  public:
-  HapAligner(Haplotype* haplotype, std::vector<bool>& realign_to_haplotype){
+  // If WORKSPACE is NULL, the aligner allocates its own workspace
+  HapAligner(Haplotype* haplotype, std::vector<bool>& realign_to_haplotype, HapAlignerWorkspace* workspace = NULL){
     assert(realign_to_haplotype.size() == haplotype->num_combs());
+    owns_workspace_ = (workspace == NULL);
+    workspace_      = (owns_workspace_ ? new HapAlignerWorkspace() : workspace);
     fw_haplotype_   = haplotype;
     rev_haplotype_  = haplotype->reverse(rev_blocks_);
     realign_to_hap_ = realign_to_haplotype;
@@ -73,8 +127,12 @@ class HapAligner {
       delete rev_blocks_[i];
     rev_blocks_.clear();
     delete rev_haplotype_;
+    if (owns_workspace_)
+      delete workspace_;
   }
 
+  HapAlignerWorkspace* workspace(){ return workspace_; }
+
   /** 
    * Returns the 0-based index into the sequence string that should be used as the seed for alignment or -1 if no valid seed exists
    **/
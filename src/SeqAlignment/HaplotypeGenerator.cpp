@@ -9,6 +9,11 @@
 #include "RepeatBlock.h"
 #include "../stringops.h"
 
+const int32_t HaplotypeGenerator::LEFT_PAD;
+const int32_t HaplotypeGenerator::RIGHT_PAD;
+const int32_t HaplotypeGenerator::MIN_REF_FLANK_LEN;
+const int32_t HaplotypeGenerator::REF_FLANK_LEN;
+
 void HaplotypeGenerator::trim(int ideal_min_length, int32_t& region_start, int32_t& region_end, std::vector<std::string>& sequences) const {
   int min_len = INT_MAX;
   for (unsigned int i = 0; i < sequences.size(); i++)
@@ -341,13 +346,13 @@ bool HaplotypeGenerator::fuse_haplotype_blocks(const std::string& chrom_seq){
     printErrorAndDie("Unable to fuse haplotype blocks, as previous additions failed");
   if (hap_blocks_.empty())
     printErrorAndDie("Unable to fuse haplotype blocks, as none have been added");
-  assert(REF_FLANK_LEN > 10);
+  assert(REF_FLANK_LEN > MIN_REF_FLANK_LEN);
   assert(hap_blocks_.front()->start() >= REF_FLANK_LEN);
   assert(hap_blocks_.back()->end() + REF_FLANK_LEN <= chrom_seq.size());
 
   // Trim boundaries so that the reference flanks aren't too long
-  int32_t min_start = std::min(hap_blocks_.front()->start()-10, std::max(hap_blocks_.front()->start() - REF_FLANK_LEN, min_aln_start_));
-  int32_t max_stop  = std::max(hap_blocks_.back()->end()+10,    std::min(hap_blocks_.back()->end()    + REF_FLANK_LEN, max_aln_stop_));
+  int32_t min_start = std::min(hap_blocks_.front()->start()-MIN_REF_FLANK_LEN, std::max(hap_blocks_.front()->start() - REF_FLANK_LEN, min_aln_start_));
+  int32_t max_stop  = std::max(hap_blocks_.back()->end()+MIN_REF_FLANK_LEN,    std::min(hap_blocks_.back()->end()    + REF_FLANK_LEN, max_aln_stop_));
 
   // Interleave the existing variant blocks with new reference-only haplotype blocks
   std::vector<HapBlock*> fused_blocks;
@@ -21,11 +21,7 @@ class HaplotypeGenerator {
   double MIN_READS_STRONG_SAMPLE;
   double MIN_STRONG_SAMPLES;
 
-  // When extracting alleles in regions, we pad by these amounts to improve the capture of proximal indels
-  int32_t LEFT_PAD, RIGHT_PAD;
-
   int32_t MIN_BLOCK_SPACING; // Minimum distance (bp) between variant haplotype blocks
-  int32_t REF_FLANK_LEN;     // Maximum length of reference sequences flanking the variant haplotype blocks
 
   bool finished_; // True iff the underlying haplotype blocks are ready for downstream use
   std::string failure_msg_;
@@ -49,6 +45,16 @@ class HaplotypeGenerator {
   HaplotypeGenerator& operator=(const HaplotypeGenerator& other);
 
  public:
+  // When extracting alleles in regions, we pad by these amounts to improve the capture of proximal indels.
+  // Trimming the candidate alleles can move each block boundary inwards by at most these amounts
+  static const int32_t LEFT_PAD  = 5;
+  static const int32_t RIGHT_PAD = 5;
+
+  // Minimum and maximum lengths of the reference sequences flanking the variant haplotype blocks.
+  // Within these bounds, the flanks only extend as far as the reads
+  static const int32_t MIN_REF_FLANK_LEN = 10;
+  static const int32_t REF_FLANK_LEN     = 35;
+
   HaplotypeGenerator(int32_t min_aln_start, int32_t max_aln_stop){
     finished_                = false;
     MIN_FRAC_READS           = 0.05;
@@ -56,10 +62,7 @@ class HaplotypeGenerator {
     MIN_FRAC_STRONG_SAMPLE   = 0.2;
     MIN_READS_STRONG_SAMPLE  = 2;
     MIN_STRONG_SAMPLES       = 1;
-    LEFT_PAD                 = 5;
-    RIGHT_PAD                = 5;
     MIN_BLOCK_SPACING        = 10;
-    REF_FLANK_LEN            = 35;
     min_aln_start_           = min_aln_start;
     max_aln_stop_            = max_aln_stop;
   }
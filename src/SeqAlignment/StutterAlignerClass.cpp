@@ -9,46 +9,64 @@
 #include "../mathops.h"
 #include "StutterAlignerClass.h"
 
-void StutterAlignerClass::load_read(const int base_seq_len,       const char* base_seq,
+void StutterAlignerClass::load_emission_probs(const int base_seq_len,       const char* base_seq,
+					      const double* base_log_wrong, const double* base_log_correct){
+  rev_log_correct_.resize(base_seq_len);
+  for (int k = 0; k < base_seq_len; k++)
+    rev_log_correct_[k] = base_log_correct[-k];
+
+  for (unsigned int c = 0; c < block_chars_.size(); c++){
+    std::vector<double>& emit_probs = emit_probs_[c];
+    emit_probs.resize(base_seq_len);
+    for (int k = 0; k < base_seq_len; k++)
+      emit_probs[k] = (base_seq[-k] == block_chars_[c] ? base_log_correct[-k] : base_log_wrong[-k]);
+  }
+}
+
+void StutterAlignerClass::load_read(const int64_t read_id,
+				    const int base_seq_len,       const char* base_seq,
 				    const double* base_log_wrong, const double* base_log_correct){
-  delete [] ins_probs_;
-  delete [] del_probs_;
-  delete [] match_probs_;
-  ins_probs_   = new double[base_seq_len*num_insertions_];
-  match_probs_ = new double[base_seq_len];
-  if (num_deletions_ != 0)
-    del_probs_ = new double[base_seq_len*num_deletions_];
-  else
-    del_probs_ = NULL;
-
-  int ins_index = 0, del_index = 0, match_index = 0;
-  for (int i = 0; i < base_seq_len; i++){
-    int j;
-    double log_prob = 0.0;
-    for (j = 0; j < std::min(base_seq_len-i, -max_deletion_); j++){
-      log_prob += (base_seq[-i-j] == block_seq_[-j] ? base_log_correct[-i-j] : base_log_wrong[-i-j]);
-      if ((j+1) % period_ == 0)
-	del_probs_[del_index++] = log_prob;
+  if (read_id >= 0 && read_id == loaded_read_id_)
+    return;
+  loaded_read_id_ = read_id;
+
+  // Resize the tables instead of reallocating them, as consecutive reads typically have similar lengths
+  ins_probs_.resize(base_seq_len*num_insertions_);
+  del_probs_.resize(base_seq_len*num_deletions_);
+  match_probs_.assign(base_seq_len, 0.0);
+  ins_sums_.assign(base_seq_len, 0.0);
+  load_emission_probs(base_seq_len, base_seq, base_log_wrong, base_log_correct);
+
+  // Each table entry is a sum along a diagonal of the read x block matrix. Rather than traversing each diagonal
+  // separately, we add one block position to every diagonal at a time so that the inner loops are contiguous and vectorizable.
+  // The additions for each entry occur in the same order as a diagonal traversal, so the sums are identical
+  double* match_sums = match_probs_.data();
+  for (int j = 0; j < block_len_; j++){
+    const double* emit_probs = emit_probs_[block_char_indices_[j]].data() + j;
+    for (int i = 0; i < base_seq_len-j; i++)
+      match_sums[i] += emit_probs[i];
+
+    // Deletion tables store the partial sums after each full repeat unit
+    if (j < -max_deletion_ && (j+1) % period_ == 0){
+      int del_index = (j+1)/period_ - 1;
+      for (int i = 0; i < base_seq_len; i++)
+	del_probs_[i*num_deletions_ + del_index] = match_sums[i];
     }
-    for (; j < -max_deletion_; j++)
-      if ((j+1) % period_ == 0)
-	del_index++;
-    for (; j < std::min(base_seq_len-i, block_len_); j++)
-      log_prob += (base_seq[-i-j] == block_seq_[-j] ? base_log_correct[-i-j] : base_log_wrong[-i-j]);
-    match_probs_[match_index++] = log_prob;
-
-    double log_ins_prob = 0.0;
-    for (j = 0; j < std::min(max_insertion_, base_seq_len-i); j++){
-      if (j % period_ < block_len_)
-	log_ins_prob += (base_seq[-i-j] == block_seq_[-(j%period_)] ? base_log_correct[-i-j] : base_log_wrong[-i-j]);
-      else
-	log_ins_prob += base_log_correct[-i-j]; // No base to match to, so assume observed without error. We could potentially match to upstream flank?
-      if ((j+1) % period_ == 0)
-	ins_probs_[ins_index++] = log_ins_prob;
+  }
+
+  // Inserted bases are compared to the first repeat unit. Bases beyond the block have no base to match to,
+  // so we assume they were observed without error. We could potentially match to upstream flank?
+  double* ins_sums = ins_sums_.data();
+  for (int j = 0; j < max_insertion_; j++){
+    const double* emit_probs = (j % period_ < block_len_ ? emit_probs_[block_char_indices_[j % period_]].data() : rev_log_correct_.data()) + j;
+    for (int i = 0; i < base_seq_len-j; i++)
+      ins_sums[i] += emit_probs[i];
+
+    if ((j+1) % period_ == 0){
+      int ins_index = (j+1)/period_ - 1;
+      for (int i = 0; i < base_seq_len; i++)
+	ins_probs_[i*num_insertions_ + ins_index] = ins_sums[i];
     }
-    for (; j < max_insertion_; j++)
-      if ((j+1) % period_ == 0)
-	ins_probs_[ins_index++] = log_ins_prob;
   }
 }
 
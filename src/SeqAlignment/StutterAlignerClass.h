@@ -1,8 +1,10 @@
 #ifndef STUTTER_ALIGNER_CLASS_H_
 #define STUTTER_ALIGNER_CLASS_H_
 
+#include <algorithm>
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 #include "RepeatStutterInfo.h"
 
@@ -18,9 +20,24 @@ class StutterAlignerClass {
   int num_insertions_, num_deletions_;
   int max_insertion_,  max_deletion_;
 
-  double* ins_probs_;
-  double* del_probs_;
-  double* match_probs_;
+  // Identifier of the read segment whose tables are currently loaded, or -1 if none has been loaded
+  int64_t loaded_read_id_;
+
+  // Index of each of the block's characters in the list of distinct block characters, in reverse order
+  std::vector<int> block_char_indices_;
+  std::vector<char> block_chars_;
+
+  // Log-probabilities of each base in the reversed read segment, given that it was generated by each distinct block character
+  std::vector< std::vector<double> > emit_probs_;
+  std::vector<double> rev_log_correct_;
+  std::vector<double> ins_sums_;
+
+  std::vector<double> ins_probs_;
+  std::vector<double> del_probs_;
+  std::vector<double> match_probs_;
+
+  void load_emission_probs(const int base_seq_len,       const char* base_seq,
+			   const double* base_log_wrong, const double* base_log_correct);
  
   double align_no_artifact_reverse(const int offset);
   
@@ -74,9 +91,15 @@ class StutterAlignerClass {
     if (max_deletion_ == 0) // We require this for insertion calculations
       upstream_match_lengths_.push_back(block_seq.empty() ? 0 : num_upstream_matches(block_seq, period));
 
-    ins_probs_   = NULL;
-    del_probs_   = NULL;
-    match_probs_ = NULL;
+    // Map each character in the reversed block sequence to a distinct character index
+    for (int i = block_len_-1; i >= 0; i--){
+      int char_index = std::find(block_chars_.begin(), block_chars_.end(), block_seq[i]) - block_chars_.begin();
+      if (char_index == block_chars_.size())
+	block_chars_.push_back(block_seq[i]);
+      block_char_indices_.push_back(char_index);
+    }
+    emit_probs_.resize(block_chars_.size());
+    loaded_read_id_ = -1;
   }
 
   ~StutterAlignerClass(){
@@ -88,13 +111,15 @@ class StutterAlignerClass {
     for (unsigned int i = 0; i < upstream_match_lengths_.size(); i++)
       delete [] upstream_match_lengths_[i];
     upstream_match_lengths_.clear();
-
-    delete [] ins_probs_;
-    delete [] del_probs_;
-    delete [] match_probs_;
   }
 
-  void load_read(const int base_seq_len,       const char* base_seq,
+  /* Precomputes the log-likelihoods of each possible stutter artifact for every suffix of the read segment.
+   * As these tables only depend on the read segment and this block's sequence, they're reused across
+   * all haplotypes containing this block sequence when the provided read identifier matches the previous invocation's.
+   * Read identifiers must therefore be unique for each segment of each read, or negative to force recomputation
+   */
+  void load_read(const int64_t read_id,
+		 const int base_seq_len,       const char* base_seq,
 		 const double* base_log_wrong, const double* base_log_correct);
   
   /* Returns the total log-likelihood of the base sequence given the block sequence and the associated quality scores.
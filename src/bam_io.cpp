@@ -1,6 +1,8 @@
 #include <sstream>
+#include <string.h>
 
 #include "bam_io.h"
+#include "binary_io.h"
 #include "error.h"
 #include "stringops.h"
 
@@ -39,6 +41,89 @@ void BamAlignment::ExtractSequenceFields(){
   built_ = true;
 }
 
+void BamAlignment::Serialize(std::ostream& out) const {
+  write_binary(out, b_->core);
+  write_binary<int32_t>(out, b_->l_data);
+  out.write((const char*)b_->data, b_->l_data);
+  write_binary_string(out, file_);
+  write_binary_string(out, ref_);
+  write_binary_string(out, mate_ref_);
+  write_binary(out, length_);
+  write_binary(out, pos_);
+  write_binary(out, end_pos_);
+  write_binary(out, hap_tag_);
+  write_binary(out, phase_set_);
+
+  // The sequence fields may have been trimmed or clipped, in which case they no longer match the underlying record
+  write_binary(out, built_);
+  if (built_){
+    write_binary_string(out, bases_);
+    write_binary_string(out, qualities_);
+    write_binary<uint32_t>(out, cigar_ops_.size());
+    for (auto cigar_iter = cigar_ops_.begin(); cigar_iter != cigar_ops_.end(); cigar_iter++){
+      write_binary(out, cigar_iter->Type);
+      write_binary(out, cigar_iter->Length);
+    }
+  }
+}
+
+bool BamAlignment::Deserialize(std::istream& in){
+  bam1_t record;
+  memset(&record, 0, sizeof(bam1_t));
+  int32_t l_data;
+  if (!read_binary(in, record.core) || !read_binary(in, l_data) || l_data < 0)
+    return false;
+  std::string data(l_data, '\0');
+  if (l_data != 0 && !in.read(&data[0], l_data))
+    return false;
+  record.l_data = l_data;
+  record.m_data = l_data;
+  record.data   = (uint8_t*)&data[0];
+  bam_copy1(b_, &record);
+
+  if (!read_binary_string(in, file_) || !read_binary_string(in, ref_) || !read_binary_string(in, mate_ref_))
+    return false;
+  if (!read_binary(in, length_) || !read_binary(in, pos_) || !read_binary(in, end_pos_) || !read_binary(in, hap_tag_) || !read_binary(in, phase_set_))
+    return false;
+  if (!read_binary(in, built_))
+    return false;
+  bases_.clear();
+  qualities_.clear();
+  cigar_ops_.clear();
+  if (built_){
+    uint32_t num_cigar_ops;
+    if (!read_binary_string(in, bases_) || !read_binary_string(in, qualities_) || !read_binary(in, num_cigar_ops))
+      return false;
+    for (uint32_t i = 0; i < num_cigar_ops; i++){
+      char type;
+      int32_t length;
+      if (!read_binary(in, type) || !read_binary(in, length))
+	return false;
+      cigar_ops_.push_back(CigarOp(type, length));
+    }
+  }
+  return true;
+}
+
+void BamAlignment::ExtractHaplotypeTags(){
+  hap_tag_   = -1;
+  phase_set_ = -1;
+
+  uint8_t* hap_data = bam_aux_get(b_, "HP");
+  if (hap_data == NULL)
+    return;
+  int64_t haplotype = bam_aux2i(hap_data);
+  if (haplotype != 1 && haplotype != 2)
+    return;
+  hap_tag_ = (int)haplotype;
+
+  // 10X BAMs and haplotagged long-read BAMs typically also contain a PS tag. Reads without one are treated as
+  // belonging to a single phase set
+  uint8_t* ps_data = bam_aux_get(b_, "PS");
+  if (ps_data != NULL)
+    phase_set_ = bam_aux2i(ps_data);
+}
+
 
 void BamHeader::parse_read_groups(const char *text){
   assert(read_groups_.empty());
@@ -270,13 +355,15 @@ bool BamCramReader::GetNextAlignment(BamAlignment& aln){
   }
 
   // Set up alignment instance variables
-  aln.built_    = false;
-  aln.file_     = path_;
-  aln.ref_      = header_->ref_name(aln.b_->core.tid);
-  aln.mate_ref_ = header_->ref_name(aln.b_->core.mtid);
-  aln.length_   = aln.b_->core.l_qseq;
-  aln.pos_      = aln.b_->core.pos;
-  aln.end_pos_  = bam_endpos(aln.b_);
+  aln.built_     = false;
+  aln.hap_tag_   = -1;
+  aln.phase_set_ = -1;
+  aln.file_      = path_;
+  aln.ref_       = header_->ref_name(aln.b_->core.tid);
+  aln.mate_ref_  = header_->ref_name(aln.b_->core.mtid);
+  aln.length_    = aln.b_->core.l_qseq;
+  aln.pos_       = aln.b_->core.pos;
+  aln.end_pos_   = bam_endpos(aln.b_);
 
   if (min_offset_ == 0){
     if (in_->is_cram){
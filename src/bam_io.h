@@ -53,19 +53,25 @@ public:
   bool built_;
   int32_t length_;
   int32_t pos_, end_pos_;
+  int hap_tag_;        // Haplotype (1 or 2) from the HP tag, or -1 if absent or not extracted
+  int64_t phase_set_;  // Phase set from the PS tag, or -1 if absent or not extracted
 
   BamAlignment(){
-    b_       = bam_init1();
-    built_   = false;
-    length_  = -1;
-    pos_     = 0;
-    end_pos_ = -1;
+    b_         = bam_init1();
+    built_     = false;
+    length_    = -1;
+    pos_       = 0;
+    end_pos_   = -1;
+    hap_tag_   = -1;
+    phase_set_ = -1;
   }
 
   BamAlignment(const BamAlignment &aln)
     : bases_(aln.bases_), qualities_(aln.qualities_), cigar_ops_(aln.cigar_ops_), file_(aln.file_), ref_(aln.ref_), mate_ref_(aln.mate_ref_){
     b_ = bam_init1();
     bam_copy1(b_, aln.b_);
+    hap_tag_   = aln.hap_tag_;
+    phase_set_ = aln.phase_set_;
     built_     = aln.built_;
     length_    = aln.length_;
     pos_       = aln.pos_;
@@ -84,6 +90,8 @@ public:
     bases_     = aln.bases_;
     qualities_ = aln.qualities_;
     cigar_ops_ = aln.cigar_ops_;
+    hap_tag_   = aln.hap_tag_;
+    phase_set_ = aln.phase_set_;
     return *this;
   }
 
@@ -202,6 +210,27 @@ public:
     return true; // TO DO: Check errno
   }  
 
+  /*
+   * Extract the haplotype (HP) and phase set (PS) tags directly from the record's aux data.
+   * The values are stored in the alignment so that they can later be queried without any tag lookups
+   */
+  void ExtractHaplotypeTags();
+
+  /* Write the alignment, including any modifications made to its sequence fields, to a binary stream */
+  void Serialize(std::ostream& out) const;
+
+  /*
+   * Overwrite the alignment with one previously written using Serialize().
+   * Returns false if the stream is exhausted or truncated
+   */
+  bool Deserialize(std::istream& in);
+
+  /* Haplotype (1 or 2) the read was assigned to, or -1 if it's untagged */
+  int HaplotypeTag()         const { return hap_tag_;   }
+
+  /* Phase set of the haplotype tag, or -1 if it's untagged */
+  int64_t PhaseSetTag()      const { return phase_set_; }
+
   bool IsDuplicate()         const { return (b_->core.flag & BAM_FDUP)         != 0;}
   bool IsFailedQC()          const { return (b_->core.flag & BAM_FQCFAIL)      != 0;}
   bool IsMapped()            const { return (b_->core.flag & BAM_FUNMAP)       == 0;}
@@ -13,6 +13,8 @@
 #include "stringops.h"
 #include "SeqAlignment/AlignmentOps.h"
 
+const int32_t BamProcessor::CONTIG_END_DIST;
+
 const std::string ALT_MAP_TAG           = "XA";
 const std::string PRIMARY_ALN_SCORE_TAG = "AS";
 const std::string SUBOPT_ALN_SCORE_TAG  = "XS";
@@ -224,6 +226,18 @@ void BamProcessor::read_and_filter_reads(BamCramMultiReader& reader, const std::
 	continue;
     assert(alignment.CigarData().size() > 0 && alignment.Ref().compare("*") != 0);
 
+    // Extract the haplotype tags while the record is in its raw form so that phasing doesn't require any further tag lookups
+    if (use_hap_tags_)
+      alignment.ExtractHaplotypeTags();
+
+    // In long-read mode, clip reads that overlap the region to a fixed window before applying any filters,
+    // so that the cost of all downstream analyses depends on the window size rather than the read length
+    if (long_reads_ && alignment.Position() < region_group.stop() && alignment.GetEndPosition() >= region_group.start()){
+      alignment.TrimAlignment(std::max(1, region_group.start()-LONG_READ_FLANK), region_group.stop()+LONG_READ_FLANK);
+      if (alignment.Length() == 0 || alignment.CigarData().size() == 0)
+	continue;
+    }
+
     // If requested, trim any reads that potentially overlap the STR regions
     if (alignment.Position() < region_group.stop() && alignment.GetEndPosition() >= region_group.start()){
       if (BASE_QUAL_TRIM > ' '){
@@ -534,8 +548,18 @@ void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string
 				   const std::map<std::string, std::string>& rg_to_sample, const std::map<std::string, std::string>& rg_to_library, const std::string& full_command,
 				   BamWriter* pass_writer, BamWriter* filt_writer, int32_t max_regions, const std::string& chrom){
   std::vector<Region> regions;
-  readRegions(region_file, max_regions, chrom, regions, full_logger());
-  orderRegions(regions);
+  std::vector<PlannedLocus> planned_loci;
+  if (locus_plan_ != NULL){
+    locus_plan_->read_loci(max_regions, chrom, planned_loci, full_logger());
+    for (auto locus_iter = planned_loci.begin(); locus_iter != planned_loci.end(); locus_iter++)
+      regions.push_back(locus_iter->region);
+  }
+  else {
+    readRegions(region_file, max_regions, chrom, regions, full_logger());
+    orderRegions(regions);
+  }
+  if (status_reporter_ != NULL)
+    status_reporter_->start(regions.size());
 
   FastaReader fasta_reader(fasta_file);
   const BamHeader* bam_header = reader.bam_header();
@@ -558,27 +582,49 @@ void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string
 
   std::string cur_chrom = "", chrom_seq = "";
   for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+    update_status(region_iter - regions.begin(), &(*region_iter), false);
     full_logger() << "" << "Processing region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << std::endl;
 
-    if (region_iter->stop() - region_iter->start() > MAX_STR_LENGTH){
+    int32_t max_str_length = (long_reads_ ? MAX_LONG_READ_STR_LENGTH : MAX_STR_LENGTH);
+    if (region_iter->stop() - region_iter->start() > max_str_length){
       num_too_long_++;
-      full_logger() << "Skipping region as the reference allele length exceeds the threshold (" << region_iter->stop()-region_iter->start() << " vs " << MAX_STR_LENGTH << ")" << "\n"
-		    << "You can increase this threshold using the --max-str-len option" << std::endl;
+      full_logger() << "Skipping region as the reference allele length exceeds the threshold (" << region_iter->stop()-region_iter->start() << " vs " << max_str_length << ")" << "\n"
+		    << "You can increase this threshold using the " << (long_reads_ ? "--max-long-str-len" : "--max-str-len") << " option" << std::endl;
       continue;
     }
     
     // Read FASTA sequence for chromosome 
     if (region_iter->chrom().compare(cur_chrom) != 0){
+      if (!cur_chrom.empty())
+	finish_chromosome(chrom_seq);
       cur_chrom = region_iter->chrom();
       fasta_reader.get_sequence(cur_chrom, chrom_seq);
       assert(chrom_seq.size() != 0);
     }
 
-    if (region_iter->start() < 50 || region_iter->stop()+50 >= chrom_seq.size()){
-      full_logger() << "Skipping region within 50bp of the end of the contig" << std::endl;
+    if (region_iter->start() < CONTIG_END_DIST || region_iter->stop()+CONTIG_END_DIST >= chrom_seq.size()){
+      full_logger() << "Skipping region within " << CONTIG_END_DIST << "bp of the end of the contig" << std::endl;
       continue;
     }
 
+    int region_index = region_iter - regions.begin();
+    if (!planned_loci.empty() && !planned_loci[region_index].matches_reference(chrom_seq))
+      printErrorAndDie("The reference sequence for region " + region_iter->str() + " doesn't match the locus plan. Please ensure that the plan was prepared using the same FASTA file");
+
+    // Reject loci that are guaranteed to fail before seeking the BAMs, using the locus plan if one was provided.
+    // Loci must be processed if their reads are being written to a BAM
+    if (pass_writer == NULL && filt_writer == NULL){
+      PlannedLocus computed_locus(*region_iter);
+      if (planned_loci.empty() && can_reject_flanks_before_io())
+	LocusPlan::plan_locus(chrom_seq, computed_locus);
+      if (reject_locus_before_io(planned_loci.empty() ? computed_locus : planned_loci[region_index]))
+	continue;
+    }
+
+    RegionGroup region_group(*region_iter); // TO DO: Extend region groups to have multiple regions
+    if (load_locus_results(region_group, chrom_seq))
+      continue;
+
     locus_bam_seek_time_ = clock();
     if (!reader.SetRegion(cur_chrom, (region_iter->start() < MAX_MATE_DIST ? 0: region_iter->start()-MAX_MATE_DIST),
 			  region_iter->stop() + MAX_MATE_DIST))
@@ -589,7 +635,6 @@ void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string
 
     std::vector<std::string> rg_names;
     std::vector<BamAlnList> paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg;
-    RegionGroup region_group(*region_iter); // TO DO: Extend region groups to have multiple regions
     read_and_filter_reads(reader, chrom_seq, region_group, rg_to_sample, rg_names,
 			  paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, pass_writer, filt_writer);
 
@@ -620,6 +665,57 @@ void BamProcessor::process_regions(BamCramMultiReader& reader, const std::string
     if (REMOVE_PCR_DUPS == 1)
       remove_pcr_duplicates(base_quality_, use_bam_rgs_, rg_to_library, paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, selective_logger());
 
+    for (unsigned int i = 0; i < rg_names.size(); i++)
+      num_reads_processed_ += paired_strs_by_rg[i].size() + unpaired_strs_by_rg[i].size();
+
     process_reads(paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, rg_names, region_group, chrom_seq);
+    store_locus_results(region_group);
+  }
+  if (!cur_chrom.empty())
+    finish_chromosome(chrom_seq);
+  update_status(regions.size(), NULL, true);
+}
+
+void BamProcessor::update_status(int64_t loci_processed, const Region* current_region, bool finished){
+  if (status_reporter_ == NULL || (!finished && !status_reporter_->due()))
+    return;
+
+  StatusReport report;
+  report.loci_processed  = loci_processed;
+  report.reads_processed = num_reads_processed_;
+  if (current_region != NULL){
+    report.current_chrom = current_region->chrom();
+    report.current_start = current_region->start();
   }
+  describe_status(report);
+  status_reporter_->write(report, finished);
+}
+
+void BamProcessor::describe_status(StatusReport& report) const {
+  report.add_outcome("too_long", num_too_long_);
+  report.add_stage_time("bam_seek",       total_bam_seek_time_);
+  report.add_stage_time("read_filtering", total_read_filter_time_);
+}
+
+void BamProcessor::describe_parameters(std::ostream& out) const {
+  out << "use_bam_rgs="              << use_bam_rgs_              << "\n"
+      << "use_hap_tags="             << use_hap_tags_             << "\n"
+      << "long_reads="               << long_reads_               << "\n"
+      << "LONG_READ_FLANK="          << LONG_READ_FLANK           << "\n"
+      << "MAX_LONG_READ_STR_LENGTH=" << MAX_LONG_READ_STR_LENGTH  << "\n"
+      << "MAX_MATE_DIST="            << MAX_MATE_DIST             << "\n"
+      << "MIN_BP_BEFORE_INDEL="      << MIN_BP_BEFORE_INDEL       << "\n"
+      << "MIN_FLANK="                << MIN_FLANK                 << "\n"
+      << "MIN_READ_END_MATCH="       << MIN_READ_END_MATCH        << "\n"
+      << "MAXIMAL_END_MATCH_WINDOW=" << MAXIMAL_END_MATCH_WINDOW  << "\n"
+      << "REMOVE_PCR_DUPS="          << REMOVE_PCR_DUPS           << "\n"
+      << "REQUIRE_SPANNING="         << REQUIRE_SPANNING          << "\n"
+      << "REQUIRE_PAIRED_READS="     << REQUIRE_PAIRED_READS      << "\n"
+      << "MIN_SUM_QUAL_LOG_PROB="    << MIN_SUM_QUAL_LOG_PROB     << "\n"
+      << "MAX_TOTAL_READS="          << MAX_TOTAL_READS           << "\n"
+      << "BASE_QUAL_TRIM="           << BASE_QUAL_TRIM            << "\n";
+  out << "sample_set=";
+  for (auto sample_iter = sample_set_.begin(); sample_iter != sample_set_.end(); sample_iter++)
+    out << *sample_iter << ",";
+  out << "\n";
 }
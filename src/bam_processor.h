@@ -12,8 +12,10 @@
 #include "base_quality.h"
 #include "error.h"
 #include "fasta_reader.h"
+#include "locus_plan.h"
 #include "null_ostream.h"
 #include "region.h"
+#include "status_reporter.h"
 #include "stringops.h"
 
 class BamProcessor {
@@ -29,6 +31,15 @@ class BamProcessor {
   double total_read_filter_time_;
   double locus_read_filter_time_;
 
+  // Optional periodically rewritten file describing the run's progress
+  StatusReporter* status_reporter_;
+  int64_t num_reads_processed_;
+
+  // Optional precomputed plan that replaces the region file
+  LocusPlanReader* locus_plan_;
+
+  void update_status(int64_t loci_processed, const Region* current_region, bool finished);
+
 
   void  write_passing_alignment(BamAlignment& aln, BamWriter* writer);
   void write_filtered_alignment(BamAlignment& aln, std::string filter, BamWriter* writer);
@@ -56,14 +67,34 @@ class BamProcessor {
 
  virtual void init_output_vcf(const std::string& fasta_path, const std::vector<std::string>& chroms, const std::string& full_command) = 0;
 
+ // Allows subclasses to emit previously computed results for a locus instead of reading and processing its alignments
+ // If this function returns true, the locus is skipped. Otherwise, store_locus_results() is invoked once the locus has been processed,
+ // regardless of whether it was successfully genotyped
+ virtual bool load_locus_results(const RegionGroup& region_group, const std::string& chrom_seq){ return false; }
+ virtual void store_locus_results(const RegionGroup& region_group){}
+
+ // Allows subclasses to skip loci that are guaranteed to fail based on their reference-only information, before any BAM I/O
+ // If this function returns true, the locus is skipped. It's responsible for logging and counting the failure
+ virtual bool reject_locus_before_io(const PlannedLocus& locus){ return false; }
+
+ // Returns true iff reject_locus_before_io() can use the flank analyses of a PlannedLocus. If there's no locus plan,
+ // these analyses are only performed when this function returns true
+ virtual bool can_reject_flanks_before_io() const { return false; }
+
+ // Allows subclasses to defer the analysis of loci until the current chromosome's sequence is about to be discarded.
+ // Invoked before the next chromosome's sequence is loaded and once all regions have been processed
+ virtual void finish_chromosome(const std::string& chrom_seq){}
+
  protected:
  BaseQuality base_quality_;
 
- bool bams_from_10x_; // True iff BAMs were generated from 10X GEMCODE platform
+ bool use_hap_tags_; // True iff reads should be phased using their HP and PS tags (e.g. 10X or haplotagged long-read BAMs)
+ bool long_reads_;   // True iff reads should be clipped to LONG_READ_FLANK bp around each region before any other processing
  bool quiet_, silent_;
  bool log_to_file_;
  NullOstream null_log_;
  std::ofstream log_;
+ std::ostream* log_buffer_; // If non-NULL, unsuppressed log messages are written to this stream instead of the log
 
  std::set<std::string> sample_set_;
 
@@ -76,6 +107,9 @@ class BamProcessor {
  int num_too_long_;
 
   public:
+ // Loci within this many bp of either end of their contig are skipped
+ static const int32_t CONTIG_END_DIST = 50;
+
  BamProcessor(bool use_bam_rgs, bool remove_pcr_dups){
    num_too_long_            = 0;
    use_bam_rgs_             = use_bam_rgs;
@@ -92,6 +126,7 @@ class BamProcessor {
    total_read_filter_time_  = 0;
    locus_read_filter_time_  = -1;
    MAX_STR_LENGTH           = 100;
+   MAX_LONG_READ_STR_LENGTH = 1000;
    MIN_SUM_QUAL_LOG_PROB    = -10;
    quiet_                   = false;
    silent_                  = false;
@@ -99,12 +134,22 @@ class BamProcessor {
    MAX_TOTAL_READS          = 1000000;
    BASE_QUAL_TRIM           = '5';
    TOO_MANY_READS           = false;
-   bams_from_10x_           = false;
+   use_hap_tags_            = false;
+   long_reads_              = false;
+   LONG_READ_FLANK          = 100;
+   status_reporter_         = NULL;
+   num_reads_processed_     = 0;
+   locus_plan_              = NULL;
+   log_buffer_              = NULL;
  }
 
- ~BamProcessor(){
+ virtual ~BamProcessor(){
    if (log_to_file_)
      log_.close();
+   if (status_reporter_ != NULL)
+     delete status_reporter_;
+   if (locus_plan_ != NULL)
+     delete locus_plan_;
  }
 
  double total_bam_seek_time()    { return total_bam_seek_time_;    }
@@ -114,7 +159,16 @@ class BamProcessor {
  void use_custom_read_groups()   { use_bam_rgs_ = false;           }
  void suppress_most_logging()    { quiet_ = true; silent_ = false; }
  void suppress_all_logging()     { silent_ = true; quiet_ = false; }
- void use_10x_bam_tags()         { bams_from_10x_ = true;          }
+ void use_haplotype_tags()       { use_hap_tags_ = true;           }
+
+ // Long reads are clipped to a fixed window around each region, aren't required to have mate pairs
+ // and are subject to the larger MAX_LONG_READ_STR_LENGTH threshold instead of MAX_STR_LENGTH. As clipping discards
+ // the original start coordinates and long-read libraries are typically PCR-free, PCR duplicates aren't removed
+ void use_long_read_mode(){
+   long_reads_          = true;
+   REQUIRE_PAIRED_READS = 0;
+   REMOVE_PCR_DUPS      = 0;
+ }
 
  void process_regions(BamCramMultiReader& reader,
 		      const std::string& region_file, const std::string& fasta_file,
@@ -136,11 +190,11 @@ class BamProcessor {
  }
 
  inline std::ostream& full_logger(){
-   return (silent_ ? null_log_ : (log_to_file_ ? log_ : std::cerr));
+   return (silent_ ? null_log_ : (log_buffer_ != NULL ? *log_buffer_ : (log_to_file_ ? log_ : std::cerr)));
  }
 
  inline std::ostream& selective_logger(){
-   return ((silent_ || quiet_) ? null_log_ : (log_to_file_ ? log_ : std::cerr));
+   return ((silent_ || quiet_) ? null_log_ : (log_buffer_ != NULL ? *log_buffer_ : (log_to_file_ ? log_ : std::cerr)));
  }
 
  void set_sample_set(const std::string& sample_names){
@@ -149,6 +203,26 @@ class BamProcessor {
    sample_set_ = std::set<std::string>(sample_list.begin(), sample_list.end());
  }
 
+ // Write the parameters that influence the per-locus results to the provided stream
+ virtual void describe_parameters(std::ostream& out) const;
+
+ // Add the number of loci with each outcome and the time spent in each stage to the report
+ virtual void describe_status(StatusReport& report) const;
+
+ // Periodically rewrite the provided file with the run's progress, at most once every INTERVAL seconds
+ void set_status_file(const std::string& path, double interval){
+   if (status_reporter_ != NULL)
+     delete status_reporter_;
+   status_reporter_ = new StatusReporter(path, interval);
+ }
+
+ // Read the loci from a plan generated by HipSTR prepare instead of the region file
+ void set_locus_plan(const std::string& plan_file){
+   if (locus_plan_ != NULL)
+     delete locus_plan_;
+   locus_plan_ = new LocusPlanReader(plan_file);
+ }
+
  static void add_passes_filters_tag(BamAlignment& aln, const std::string& passes);
 
  static void passes_filters(BamAlignment& aln, std::vector<bool>& region_passes);
@@ -159,6 +233,9 @@ class BamProcessor {
  int32_t MIN_READ_END_MATCH;
  int32_t MAXIMAL_END_MATCH_WINDOW;
  int32_t MAX_STR_LENGTH;
+ int32_t MAX_LONG_READ_STR_LENGTH;  // In long-read mode, skip regions longer than this many bps. Together with LONG_READ_FLANK,
+                                    // this bounds the length of the clipped reads and therefore the size of each alignment matrix
+ int32_t LONG_READ_FLANK;       // In long-read mode, clip reads to this many bps upstream and downstream of each region
 
  int     REMOVE_PCR_DUPS;
  int     REQUIRE_SPANNING;
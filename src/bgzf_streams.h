@@ -26,21 +26,50 @@ TODO:
 ************************************************************************/
 
 #include <err.h>
+#include <string.h>
 #include <iostream>
 #include <ostream>
 #include <stdexcept>
+#include <vector>
 
 #include "htslib/htslib/bgzf.h"
 
+/*
+ * Buffers reads and writes in a large get/put area so that BGZF is only invoked once per BUFFER_SIZE bytes,
+ * rather than once per character or per << fragment. Flushing the stream passes the buffered data to BGZF
+ * but doesn't force the end of the current BGZF block, so the compressed output doesn't depend on how
+ * often the stream is flushed
+ */
 class bgzf_streambuf : public std::streambuf {
  private:
   BGZF* _fp;
   std::string filename;
-  int cur_val;
+  bool writing;
+  std::vector<char> buffer;
+
+  void write_bytes(const char* s, size_t n){
+    ssize_t i = bgzf_write(_fp, s, n);
+    if (i < 0)
+      err(1,"bgzf_write(%s) failed", filename.c_str());
+    if ((size_t)i != n)
+      err(1,"bgzf_write(%s) wrote only %zd, asked for %zu bytes",
+	  filename.c_str(), i, n);
+  }
+
+  // Pass the contents of the put area to BGZF
+  void flush_buffer(){
+    int n = pptr() - pbase();
+    if (n > 0){
+      write_bytes(pbase(), n);
+      pbump(-n);
+    }
+  }
 
  public:
- bgzf_streambuf(): _fp(NULL){ 
-    cur_val = -999;
+  static const int BUFFER_SIZE = 4*BGZF_BLOCK_SIZE;
+
+ bgzf_streambuf(): _fp(NULL){
+    writing = false;
   }
   
   virtual ~bgzf_streambuf(){
@@ -55,11 +84,27 @@ class bgzf_streambuf : public std::streambuf {
     if (_fp == NULL)
       err(1,"bgzf_open(%s,%s) failed", _filename, mode);
     filename = _filename;
+    writing  = (strchr(mode, 'r') == NULL);
+    buffer.resize(BUFFER_SIZE);
+    if (writing)
+      setp(&buffer[0], &buffer[0] + buffer.size());
+    else
+      setg(&buffer[0], &buffer[0], &buffer[0]);
+  }
+
+  // Compress (or decompress) the BGZF blocks using a pool of NUM_THREADS threads
+  void set_threads(int num_threads){
+    if (_fp == NULL)
+      throw std::invalid_argument("bgzf_streambuf: set_threads: called on non-open stream");
+    if (num_threads > 1 && bgzf_mt(_fp, num_threads, 256) != 0)
+      err(1,"bgzf_mt(%s) failed", filename.c_str());
   }
   
   void close(){
     if (_fp == NULL)
       return;
+    if (writing)
+      flush_buffer();
     
     int i = bgzf_close(_fp);
     if (i != 0)
@@ -67,56 +112,57 @@ class bgzf_streambuf : public std::streambuf {
     
     _fp = NULL;
     filename = "";
-  }
-  
-  virtual int uflow(){
-    if (cur_val != -999){
-      int res = cur_val;
-      cur_val = -999;
-      return res;
-    }
-    int res = bgzf_getc(_fp);
-    if (res == -2) err(1, "bgzf_getc() failed");
-    if (res == -1) return EOF;
-    return res;
+    setp(NULL, NULL);
+    setg(NULL, NULL, NULL);
+    std::vector<char>().swap(buffer);
   }
   
   virtual int underflow(){
     if ( _fp == NULL)
       throw std::invalid_argument("bgzf_streambuf: underflow: called on non-open stream");
-    if (cur_val != -999)
-      return cur_val;
-    cur_val = bgzf_getc(_fp);
-    if (cur_val == -2) err(1, "bgzf_getc() failed");
-    if (cur_val == -1) cur_val = EOF;
-    return cur_val;
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+
+    ssize_t n = bgzf_read(_fp, &buffer[0], buffer.size());
+    if (n < 0) err(1, "bgzf_read() failed");
+    if (n == 0) return EOF;
+    setg(&buffer[0], &buffer[0], &buffer[0] + n);
+    return traits_type::to_int_type(*gptr());
   }
 
   virtual int overflow(int c = EOF){
-    char z = (char) c;
-    ssize_t i = bgzf_write(_fp, &z, 1);
-    if (i < 0) {
-      err(1,"bgzf_write(%s) failed", filename.c_str());
-      return EOF;
+    if ( _fp == NULL)
+      throw std::invalid_argument("bgzf_streambuf: overflow: called on non-open stream");
+    flush_buffer();
+    if (c != EOF){
+      *pptr() = (char) c;
+      pbump(1);
     }
-    return c;
+    return traits_type::not_eof(c);
+  }
+
+  virtual int sync(){
+    if (_fp != NULL && writing)
+      flush_buffer();
+    return 0;
   }
 
   virtual std::streamsize xsputn (const char* s, std::streamsize n){
     if ( _fp == NULL)
       throw std::invalid_argument("bgzf_streambuf: overflow: called on non-open stream");
-    
-    ssize_t i = bgzf_write(_fp, s, n);
-    if (i < 0) {
-      err(1,"bgzf_write(%s) failed", filename.c_str());
-      return EOF;
-    }
-    if ((std::streamsize)i != n) {
-      err(1,"bgzf_write(%s) wrote only %zd, asked for %zu bytes",
-	  filename.c_str(), i, n);
-      return EOF;
+
+    if (n > epptr() - pptr()){
+      flush_buffer();
+
+      // Large writes bypass the put area entirely
+      if (n >= epptr() - pptr()){
+	write_bytes(s, n);
+	return n;
+      }
     }
-    return (std::streamsize)n;
+    memcpy(pptr(), s, n);
+    pbump(n);
+    return n;
   }
 };
 
@@ -137,6 +183,10 @@ class bgzfistream : public std::istream {
     rdbuf(&buf);
   }
 
+  void set_threads(int num_threads){
+    buf.set_threads(num_threads);
+  }
+
   void close(){
     buf.close();
   }
@@ -159,6 +209,10 @@ class bgzfostream : public std::ostream {
     rdbuf(&buf);
   }
 
+  void set_threads(int num_threads){
+    buf.set_threads(num_threads);
+  }
+
   void close(){
     buf.close();
   }
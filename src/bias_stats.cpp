@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <mutex>
+
+#include "bias_stats.h"
+#include "cephes/cephes.h"
+#include "htslib/htslib/kfunc.h"
+
+const int MAX_TABULATED_DEPTH = 256;
+static std::vector<double> allele_bias_table; // Entry for counts (a, b) is at index (a+b)*(a+b+1)/2 + a
+static std::once_flag allele_bias_flag;
+
+static double calc_allele_bias(int hap_a_read_count, int hap_b_read_count){
+  // We use the bdtr(k, N, p) function from the cephes directory, which computes the CDF for a binomial distribution
+  // e.g.: double val = bdtr (24, 50, 0.5);
+  int total = hap_a_read_count + hap_b_read_count;
+
+  // Not applicable
+  if (total == 0)
+    return 1;
+
+  // p-value is 1
+  if (hap_a_read_count == hap_b_read_count)
+    return 0.0;
+
+  int min_count = std::min(hap_a_read_count, hap_b_read_count);
+  double pvalue = 2*bdtr(min_count, total, 0.5); // Two-sided pvalue
+  return log10(std::min(1.0, pvalue));
+}
+
+static void fill_allele_bias_table(){
+  allele_bias_table.reserve((MAX_TABULATED_DEPTH+1)*(MAX_TABULATED_DEPTH+2)/2);
+  for (int total = 0; total <= MAX_TABULATED_DEPTH; total++)
+    for (int hap_a_read_count = 0; hap_a_read_count <= total; hap_a_read_count++)
+      allele_bias_table.push_back(calc_allele_bias(hap_a_read_count, total-hap_a_read_count));
+}
+
+double log10_allele_bias_pvalue(int hap_a_read_count, int hap_b_read_count){
+  int total = hap_a_read_count + hap_b_read_count;
+  if (total > MAX_TABULATED_DEPTH)
+    return calc_allele_bias(hap_a_read_count, hap_b_read_count);
+  std::call_once(allele_bias_flag, fill_allele_bias_table);
+  return allele_bias_table[total*(total+1)/2 + hap_a_read_count];
+}
+
+double StrandBiasCache::log10_pvalue(int fw_hap_a, int rv_hap_a, int fw_hap_b, int rv_hap_b){
+  // Counts that fit in 16 bits are packed into a single key
+  bool cacheable = (std::max(std::max(fw_hap_a, rv_hap_a), std::max(fw_hap_b, rv_hap_b)) < 65536);
+  uint64_t key   = (((uint64_t)fw_hap_a) << 48) | (((uint64_t)rv_hap_a) << 32) | (((uint64_t)fw_hap_b) << 16) | ((uint64_t)rv_hap_b);
+  if (cacheable){
+    auto pvalue_iter = log_pvalues_.find(key);
+    if (pvalue_iter != log_pvalues_.end())
+      return pvalue_iter->second;
+  }
+
+  // Compute the strand bias p-value using the kt_fisher_exact function from htslib
+  // For the bias, we use the two-sided p-value
+  double left, right, two;
+  kt_fisher_exact(fw_hap_a, rv_hap_a, fw_hap_b, rv_hap_b, &left, &right, &two);
+  double log_pvalue = log10(std::min(1.0, two));
+  if (cacheable)
+    log_pvalues_[key] = log_pvalue;
+  return log_pvalue;
+}
+
+void compute_bias_statistics(const std::vector<bool>& compute,
+			     const std::vector<int>& reads_hap_a,    const std::vector<int>& reads_hap_b,
+			     const std::vector<int>& rv_reads_hap_a, const std::vector<int>& rv_reads_hap_b,
+			     std::vector<double>& allele_biases, std::vector<double>& strand_biases){
+  assert(compute.size() == reads_hap_a.size() && compute.size() == reads_hap_b.size());
+  assert(compute.size() == allele_biases.size() && compute.size() == strand_biases.size());
+  StrandBiasCache strand_bias_cache;
+  for (unsigned int i = 0; i < compute.size(); i++){
+    if (!compute[i])
+      continue;
+    allele_biases[i] = log10_allele_bias_pvalue(reads_hap_a[i], reads_hap_b[i]);
+    strand_biases[i] = strand_bias_cache.log10_pvalue(reads_hap_a[i] - rv_reads_hap_a[i], rv_reads_hap_a[i],
+						      reads_hap_b[i] - rv_reads_hap_b[i], rv_reads_hap_b[i]);
+  }
+}
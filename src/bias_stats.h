@@ -0,0 +1,36 @@
+#ifndef BIAS_STATS_H_
+#define BIAS_STATS_H_
+
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+/*
+ * Returns the log10 of the two-sided binomial p-value for the imbalance between the number of reads uniquely assigned to
+ * each haplotype, or 1 if no reads were assigned. Depths are small integers, so the values for depths of at most
+ * MAX_TABULATED_DEPTH are computed once and shared by all threads
+ */
+double log10_allele_bias_pvalue(int hap_a_read_count, int hap_b_read_count);
+
+/*
+ * Memoizes the log10 of the two-sided Fisher's exact test p-value for strand bias, as samples frequently share the same
+ * forward and reverse read counts. An instance must not be shared across threads
+ */
+class StrandBiasCache {
+ private:
+  std::unordered_map<uint64_t, double> log_pvalues_;
+
+ public:
+  double log10_pvalue(int fw_hap_a, int rv_hap_a, int fw_hap_b, int rv_hap_b);
+};
+
+/*
+ * Computes the allele and strand bias statistics for each sample whose COMPUTE flag is set, using the number of reads uniquely
+ * assigned to each haplotype and how many of them are from the reverse strand. Entries for the remaining samples are left unchanged
+ */
+void compute_bias_statistics(const std::vector<bool>& compute,
+			     const std::vector<int>& reads_hap_a,    const std::vector<int>& reads_hap_b,
+			     const std::vector<int>& rv_reads_hap_a, const std::vector<int>& rv_reads_hap_b,
+			     std::vector<double>& allele_biases, std::vector<double>& strand_biases);
+
+#endif
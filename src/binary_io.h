@@ -0,0 +1,151 @@
+#ifndef BINARY_IO_H_
+#define BINARY_IO_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "error.h"
+
+/*
+ * Helpers for (de)serializing fixed-width values, strings and vectors using the host's byte order.
+ * They're only intended for files that are written and read by the same build (e.g. locus captures).
+ * Each read function returns false if the stream is exhausted or truncated
+ */
+template<typename T> void write_binary(std::ostream& out, const T& val){
+  out.write((const char*)&val, sizeof(T));
+}
+
+template<typename T> bool read_binary(std::istream& in, T& val){
+  return (bool)in.read((char*)&val, sizeof(T));
+}
+
+inline void write_binary_string(std::ostream& out, const std::string& val){
+  write_binary<uint64_t>(out, val.size());
+  out.write(val.data(), val.size());
+}
+
+inline bool read_binary_string(std::istream& in, std::string& val){
+  uint64_t length;
+  if (!read_binary(in, length))
+    return false;
+  val.resize(length);
+  return (length == 0 || (bool)in.read(&val[0], length));
+}
+
+template<typename T> void write_binary_vector(std::ostream& out, const std::vector<T>& vals){
+  write_binary<uint64_t>(out, vals.size());
+  if (!vals.empty())
+    out.write((const char*)&vals[0], vals.size()*sizeof(T));
+}
+
+template<typename T> bool read_binary_vector(std::istream& in, std::vector<T>& vals){
+  uint64_t length;
+  if (!read_binary(in, length))
+    return false;
+  vals.resize(length);
+  return (length == 0 || (bool)in.read((char*)&vals[0], length*sizeof(T)));
+}
+
+inline void write_binary_strings(std::ostream& out, const std::vector<std::string>& vals){
+  write_binary<uint64_t>(out, vals.size());
+  for (auto val_iter = vals.begin(); val_iter != vals.end(); val_iter++)
+    write_binary_string(out, *val_iter);
+}
+
+inline bool read_binary_strings(std::istream& in, std::vector<std::string>& vals){
+  uint64_t length;
+  if (!read_binary(in, length))
+    return false;
+  vals.resize(length);
+  for (uint64_t i = 0; i < length; i++)
+    if (!read_binary_string(in, vals[i]))
+      return false;
+  return true;
+}
+
+
+/*
+ * Helpers for (de)serializing fixed-width values and strings using little-endian byte buffers, for
+ * portable file formats (e.g. genotype matrices)
+ */
+
+// Decodes the NUM_BYTES little-endian unsigned integer stored at DATA
+inline uint64_t decode_le(const char* data, int num_bytes){
+  uint64_t val = 0;
+  for (int i = 0; i < num_bytes; i++)
+    val |= ((uint64_t)((unsigned char)data[i])) << (8*i);
+  return val;
+}
+
+inline float decode_le_float(const char* data){
+  uint32_t bits = decode_le(data, 4);
+  float val;
+  memcpy(&val, &bits, sizeof(float));
+  return val;
+}
+
+class ByteWriter {
+ public:
+  std::string data;
+
+  void put_u16(uint16_t val){ for (int i = 0; i < 2; i++) data.push_back((char)((val >> (8*i)) & 0xFF)); }
+  void put_u32(uint32_t val){ for (int i = 0; i < 4; i++) data.push_back((char)((val >> (8*i)) & 0xFF)); }
+  void put_u64(uint64_t val){ for (int i = 0; i < 8; i++) data.push_back((char)((val >> (8*i)) & 0xFF)); }
+  void put_i16(int16_t val) { put_u16((uint16_t)val); }
+  void put_i32(int32_t val) { put_u32((uint32_t)val); }
+  void put_float(float val){
+    uint32_t bits;
+    memcpy(&bits, &val, sizeof(float));
+    put_u32(bits);
+  }
+  void put_string(const std::string& val){
+    put_u32(val.size());
+    data.append(val);
+  }
+};
+
+// Reads values from a buffer, which must outlive the reader. Reading past the end of the buffer
+// is fatal, and the error message names the buffer's SOURCE (e.g. "Genotype matrix file")
+class ByteReader {
+ private:
+  const std::string& data_;
+  std::string source_;
+  size_t offset_;
+
+  void require(size_t num_bytes){
+    if (offset_ + num_bytes > data_.size())
+      printErrorAndDie(source_ + " is truncated or corrupted");
+  }
+
+ public:
+  ByteReader(const std::string& data, const std::string& source) : data_(data), source_(source), offset_(0){}
+
+  uint32_t get_u32(){
+    require(4);
+    uint32_t val = decode_le(data_.data()+offset_, 4);
+    offset_ += 4;
+    return val;
+  }
+
+  uint64_t get_u64(){
+    require(8);
+    uint64_t val = decode_le(data_.data()+offset_, 8);
+    offset_ += 8;
+    return val;
+  }
+
+  int32_t get_i32(){ return (int32_t)get_u32(); }
+
+  std::string get_string(){
+    uint32_t len = get_u32();
+    require(len);
+    std::string val = data_.substr(offset_, len);
+    offset_ += len;
+    return val;
+  }
+};
+
+#endif
@@ -1,11 +1,13 @@
 #include <algorithm>
 #include <cfloat>
+#include <cmath>
 #include <cstring>
 #include <sstream>
 
 #include "em_stutter_genotyper.h"
 #include "error.h"
 #include "mathops.h"
+#include "stringops.h"
 
 void EMStutterGenotyper::init_log_gt_priors(){
   std::fill(log_gt_priors_, log_gt_priors_+num_alleles_, 1); // Use 1 sample pseudocount                                                                                  
@@ -55,9 +57,12 @@ void EMStutterGenotyper::recalc_log_gt_priors(){
   }
 }
 
-void EMStutterGenotyper::init_stutter_model(){
+void EMStutterGenotyper::init_stutter_model(const StutterModel* init_model){
   delete stutter_model_;
-  stutter_model_ = new StutterModel(0.9, 0.1, 0.1, 0.8, 0.01, 0.01, motif_len_);
+  if (init_model != NULL && init_model->period() == motif_len_)
+    stutter_model_ = init_model->copy();
+  else
+    stutter_model_ = new StutterModel(0.9, 0.1, 0.1, 0.8, 0.01, 0.01, motif_len_);
 }
   
 void EMStutterGenotyper::recalc_stutter_model(){
@@ -167,12 +172,13 @@ void EMStutterGenotyper::recalc_log_read_phase_posteriors(){
   }
 }
 
-bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger){
+bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger,
+			       const StutterModel* init_model){
   double max_param_diff = 0.0001;
 
   // Initialization
   init_log_gt_priors();
-  init_stutter_model();
+  init_stutter_model(init_model);
 
   int num_iter   = 1;
   double LL      = -DBL_MAX;
@@ -224,3 +230,194 @@ bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double mi
   }
   return false;
 }
+
+void EMStutterGenotyper::genotype(const StutterModel* stutter_model){
+  if (stutter_model != NULL){
+    delete stutter_model_;
+    stutter_model_ = stutter_model->copy();
+  }
+  else if (stutter_model_ == NULL)
+    printErrorAndDie("No stutter model has been specified or learned");
+
+  // Use the same genotype priors as the sequence-based genotyper so that the GLs are computed consistently
+  use_pop_freqs_ = false;
+  calc_hap_aln_probs(log_aln_probs_);
+  calc_log_sample_posteriors();
+}
+
+void EMStutterGenotyper::get_alleles(const Region& region, const std::string& chrom_seq, int32_t& pos, std::vector<std::string>& alleles) const {
+  assert(alleles.empty());
+  std::string ref_seq = uppercase(chrom_seq.substr(region.start(), region.stop()-region.start()));
+  pos = region.start();
+
+  bool pad_left = false;
+  for (unsigned int i = 0; i < bps_per_allele_.size(); i++){
+    int32_t allele_len = (int32_t)ref_seq.size() + bps_per_allele_[i];
+    assert(allele_len >= 0); // Reads with larger deletions must be discarded before genotyping
+    std::string allele = ref_seq.substr(0, std::min(allele_len, (int32_t)ref_seq.size()));
+    for (int32_t j = allele.size(); j < allele_len; j++)
+      allele.push_back(j >= motif_len_ ? allele[j-motif_len_] : ref_seq[j % ref_seq.size()]);
+    pad_left |= allele.empty();
+    alleles.push_back(allele);
+  }
+
+  // If necessary, add 1bp on the left so that none of the alleles are empty
+  if (pad_left){
+    pos -= 1;
+    std::string left_flank = uppercase(chrom_seq.substr(pos, 1));
+    for (unsigned int i = 0; i < alleles.size(); i++)
+      alleles[i] = left_flank + alleles[i];
+  }
+  pos += 1; // Fix off-by-1 VCF error
+}
+
+void EMStutterGenotyper::write_vcf_record(const std::vector<std::string>& sample_names, const Region& region, const std::string& chrom_seq,
+					  VCFWriter* vcf_writer, GenotypeMatrixWriter* gt_matrix_writer, std::ostream& logger){
+  std::stringstream out;
+  out.precision(2);
+  out.setf(std::ios::fixed, std::ios::floatfield);
+
+  // Alleles are already sorted by length, with the reference allele first
+  int32_t pos;
+  std::vector<std::string> alleles;
+  get_alleles(region, chrom_seq, pos, alleles);
+
+  // Extract the optimal genotypes and their associated likelihoods
+  std::vector< std::pair<int,int> > haplotypes, gts;
+  std::vector<double> log_phased_posteriors, log_unphased_posteriors, gl_diffs;
+  std::vector<double> hap_log_phased_posteriors, hap_log_unphased_posteriors;
+  FlatMatrix<double> gls, phased_gls;
+  FlatMatrix<int> pls;
+  std::vector<int> hap_to_allele;
+  for (int i = 0; i < num_alleles_; i++)
+    hap_to_allele.push_back(i);
+  extract_genotypes_and_likelihoods(num_alleles_, hap_to_allele, haplotypes, gts, log_phased_posteriors, log_unphased_posteriors,
+				    hap_log_phased_posteriors, hap_log_unphased_posteriors,
+				    true, gls, gl_diffs, (options_.OUTPUT_PLS == 1), pls, (options_.OUTPUT_PHASED_GLS == 1), phased_gls);
+
+  // Extract information about each read and group by sample
+  std::vector<int> num_reads_with_snps(num_samples_, 0), num_reads_strand_one(num_samples_, 0), num_reads_strand_two(num_samples_, 0);
+  std::vector< std::vector<int> > bps_per_sample(num_samples_);
+  std::vector< std::vector<double> > log_read_phases(num_samples_);
+  double* read_LL_ptr = log_aln_probs_;
+  for (unsigned int read_index = 0; read_index < num_reads_; read_index++, read_LL_ptr += num_alleles_){
+    int sample_index     = sample_label_[read_index];
+    int hap_a            = gts[sample_index].first;
+    int hap_b            = gts[sample_index].second;
+    double total_read_LL = log_sum_exp(LOG_ONE_HALF+log_p1_[read_index]+read_LL_ptr[hap_a], LOG_ONE_HALF+log_p2_[read_index]+read_LL_ptr[hap_b]);
+    log_read_phases[sample_index].push_back(LOG_ONE_HALF + log_p1_[read_index] + read_LL_ptr[hap_a] - total_read_LL);
+    bps_per_sample[sample_index].push_back(bps_per_allele_[allele_index_[read_index]]);
+
+    if (std::fabs(log_p1_[read_index] - log_p2_[read_index]) > TOLERANCE){
+      num_reads_with_snps[sample_index]++;
+      if (log_p1_[read_index] > log_p2_[read_index])
+	num_reads_strand_one[sample_index]++;
+      else
+	num_reads_strand_two[sample_index]++;
+    }
+  }
+
+  // Compute allele counts and depths for the samples of interest
+  std::vector<int> allele_counts(num_alleles_, 0);
+  int32_t allele_number = 0, tot_dp = 0, tot_dsnp = 0;
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    auto sample_iter = sample_indices_.find(sample_names[i]);
+    if (sample_iter == sample_indices_.end() || reads_per_sample_[sample_iter->second] == 0)
+      continue;
+    int sample_index = sample_iter->second;
+    allele_counts[gts[sample_index].first]++;
+    allele_number++;
+    if (!haploid_){
+      allele_counts[gts[sample_index].second]++;
+      allele_number++;
+    }
+    tot_dp   += reads_per_sample_[sample_index];
+    tot_dsnp += num_reads_with_snps[sample_index];
+  }
+
+  logger << "Allele counts" << std::endl;
+  for (unsigned int i = 0; i < alleles.size(); i++)
+    logger << "\t" << alleles[i] << " " << allele_counts[i] << std::endl;
+
+  write_vcf_site_info(region, pos, alleles, bps_per_allele_, stutter_model_, 0, 0, out);
+  out << "DP="   << tot_dp   << ";"
+      << "DSNP=" << tot_dsnp << ";";
+  write_vcf_allele_counts(allele_number, allele_counts, out);
+
+  // The length-based genotyper doesn't trace alignments or assemble haplotypes, so the stutter, bias and haplotype fields aren't available
+  std::string empty_str = write_vcf_format(false, false, false, out);
+
+  GenotypeMatrixLocus gt_matrix_locus;
+  if (gt_matrix_writer != NULL){
+    gt_matrix_locus.chrom    = region.chrom();
+    gt_matrix_locus.pos      = pos;
+    gt_matrix_locus.start    = region.start()+1;
+    gt_matrix_locus.stop     = region.stop();
+    gt_matrix_locus.period   = region.period();
+    gt_matrix_locus.alleles  = alleles;
+    gt_matrix_locus.bp_diffs = bps_per_allele_;
+    for (unsigned int i = 0; i < sample_names.size(); i++)
+      gt_matrix_locus.add_missing_sample();
+  }
+
+  std::map<std::string, int> filter_reasons;
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    out << "\t";
+    auto sample_iter = sample_indices_.find(sample_names[i]);
+    if (sample_iter == sample_indices_.end() || reads_per_sample_[sample_iter->second] == 0){
+      if (sample_iter != sample_indices_.end())
+	filter_reasons["NO_READS"]++;
+      out << (options_.OUTPUT_FILTERS == 0 ? "." : empty_str + "NO_READS");
+      continue;
+    }
+
+    int sample_index    = sample_iter->second;
+    double phase1_reads = exp(log_sum_exp(log_read_phases[sample_index]));
+    double phase2_reads = reads_per_sample_[sample_index] - phase1_reads;
+    int gt_a = gts[sample_index].first, gt_b = gts[sample_index].second;
+
+    if (gt_matrix_writer != NULL){
+      gt_matrix_locus.gt_a[i]   = gt_a;
+      gt_matrix_locus.gt_b[i]   = gt_b;
+      gt_matrix_locus.quals[i]  = exp(log_unphased_posteriors[sample_index]);
+      gt_matrix_locus.depths[i] = reads_per_sample_[sample_index];
+    }
+
+    if (!haploid_){
+      out << gt_a << "|" << gt_b                                                                   // Genotype
+	  << ":" << bps_per_allele_[gt_a] << "|" << bps_per_allele_[gt_b]                           // Base pair differences from reference
+	  << ":" << exp(log_unphased_posteriors[sample_index])                                      // Unphased posterior
+	  << ":" << exp(log_phased_posteriors[sample_index])                                        // Phased posterior
+	  << ":" << reads_per_sample_[sample_index]                                                 // Total reads used to genotype
+	  << ":" << num_reads_with_snps[sample_index]                                               // Total reads with SNP information
+	  << ":" << phase1_reads << "|" << phase2_reads                                             // Reads per allele
+	  << ":" << num_reads_strand_one[sample_index] << "|" << num_reads_strand_two[sample_index]; // Reads with SNPs supporting each haploid genotype
+    }
+    else {
+      out << gt_a                                                                                  // Genotype
+	  << ":" << bps_per_allele_[gt_a]                                                           // Base pair differences from reference
+	  << ":" << exp(log_unphased_posteriors[sample_index])                                      // Unphased posterior
+	  << ":" << reads_per_sample_[sample_index];                                                // Total reads used to genotype
+    }
+
+    // Difference in GL between the current and next best genotype
+    if (alleles.size() == 1)
+      out << ":" << ".";
+    else
+      out << ":" << gl_diffs[sample_index];
+
+    if (options_.OUTPUT_ALLREADS == 1)
+      out << ":" << condense_read_counts(bps_per_sample[sample_index]);
+
+    // Alleles are already in VCF order, so the GLs and PLs can be output directly
+    write_vcf_likelihoods(sample_index, hap_to_allele, gls, pls, phased_gls, out);
+
+    if (options_.OUTPUT_FILTERS == 1)
+      out << ":PASS";
+  }
+
+  vcf_writer->add_vcf_record(region.chrom(), pos, out.str());
+  if (gt_matrix_writer != NULL)
+    gt_matrix_writer->add_locus(gt_matrix_locus);
+  log_filter_reasons(filter_reasons, logger);
+}
@@ -10,8 +10,11 @@
 #include <vector>
 
 #include "error.h"
+#include "genotype_matrix.h"
 #include "genotyper.h"
+#include "region.h"
 #include "stutter_model.h"
+#include "vcf_writer.h"
 
 class EMStutterGenotyper: public Genotyper {
  private:
@@ -33,7 +36,7 @@ class EMStutterGenotyper: public Genotyper {
   
   // Initialization functions for the EM algorithm
   void init_log_gt_priors();
-  void init_stutter_model();
+  void init_stutter_model(const StutterModel* init_model);
   
   // Functions for the M step of the EM algorithm
   void recalc_log_gt_priors();
@@ -42,16 +45,19 @@ class EMStutterGenotyper: public Genotyper {
   // Functions for the E step of the EM algorithm
   void recalc_log_read_phase_posteriors();
 
+  // Construct the sequence of each allele by truncating or periodically extending the reference sequence
+  void get_alleles(const Region& region, const std::string& chrom_seq, int32_t& pos, std::vector<std::string>& alleles) const;
+
   // Private unimplemented copy constructor and assignment operator to prevent operations
   EMStutterGenotyper(const EMStutterGenotyper& other);
   EMStutterGenotyper& operator=(const EMStutterGenotyper& other);
 
  public:
- EMStutterGenotyper(bool haploid, int motif_length,
+ EMStutterGenotyper(const GenotyperOptions& options, bool haploid, int motif_length,
 		    const std::vector< std::vector<int> >& num_bps,
 		    const std::vector< std::vector<double> >& log_p1,
 		    const std::vector< std::vector<double> >& log_p2,
-		    const std::vector<std::string>& sample_names, int ref_allele): Genotyper(haploid, sample_names, log_p1, log_p2){
+		    const std::vector<std::string>& sample_names, int ref_allele): Genotyper(options, haploid, sample_names, log_p1, log_p2){
     assert(num_bps.size() == log_p1.size() && num_bps.size() == log_p2.size() && num_bps.size() == sample_names.size());
     motif_len_     = motif_length;
     use_pop_freqs_ = false;
@@ -107,7 +113,20 @@ class EMStutterGenotyper: public Genotyper {
     delete stutter_model_;
   }  
   
-  bool train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger);
+  // If an initial stutter model is provided, the EM algorithm is warm-started from its parameters.
+  // Otherwise, the default initial parameters are used
+  bool train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger,
+	     const StutterModel* init_model = NULL);
+
+  // Compute the genotype posteriors using uniform genotype priors and the provided stutter model,
+  // or the trained stutter model if none is provided
+  void genotype(const StutterModel* stutter_model = NULL);
+
+  // Write a VCF record for the region using the bp length genotypes. Fields that require
+  // haplotype alignments (e.g. DSTUTTER, DFLANKINDEL and MALLREADS) are omitted. No read's bp difference
+  // may be a deletion larger than the region's reference allele
+  void write_vcf_record(const std::vector<std::string>& sample_names, const Region& region, const std::string& chrom_seq,
+			VCFWriter* vcf_writer, GenotypeMatrixWriter* gt_matrix_writer, std::ostream& logger);
 
   StutterModel* get_stutter_model() const {
     if (stutter_model_ == NULL)
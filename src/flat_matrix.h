@@ -0,0 +1,42 @@
+#ifndef FLAT_MATRIX_H_
+#define FLAT_MATRIX_H_
+
+#include <assert.h>
+#include <vector>
+
+/*
+ * Row-major matrix backed by a single contiguous allocation. Indexing a row returns a pointer to its first element,
+ * so entries are accessed as matrix[row][col]. Used for per-sample outputs whose rows all have the same length
+ */
+template<typename T> class FlatMatrix {
+ private:
+  std::vector<T> values_;
+  int num_rows_, num_cols_;
+
+ public:
+  FlatMatrix(){
+    num_rows_ = 0;
+    num_cols_ = 0;
+  }
+
+  void resize(int num_rows, int num_cols, const T& init = T()){
+    assert(num_rows >= 0 && num_cols >= 0);
+    num_rows_ = num_rows;
+    num_cols_ = num_cols;
+    values_.assign((size_t)num_rows*num_cols, init);
+  }
+
+  void clear(){
+    values_.clear();
+    num_rows_ = num_cols_ = 0;
+  }
+
+  int num_rows() const { return num_rows_;       }
+  int num_cols() const { return num_cols_;       }
+  bool empty()   const { return num_rows_ == 0;  }
+
+  T*       operator[](int row)       { return values_.data() + (size_t)row*num_cols_; }
+  const T* operator[](int row) const { return values_.data() + (size_t)row*num_cols_; }
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+
+#include "binary_io.h"
+#include "genotype_matrix.h"
+
+static const char     GT_MATRIX_MAGIC[8] = {'H', 'I', 'P', 'S', 'T', 'R', 'G', 'M'};
+static const uint32_t GT_MATRIX_VERSION  = 1;
+static const char*    GT_MATRIX_SOURCE   = "Genotype matrix file";
+
+static void write_compressed_block(std::ofstream& out, const char* data, uint64_t raw_size){
+  uLongf comp_size = compressBound(raw_size);
+  std::string buffer(comp_size, '\0');
+  if (compress2((Bytef*)&buffer[0], &comp_size, (const Bytef*)data, raw_size, Z_DEFAULT_COMPRESSION) != Z_OK)
+    printErrorAndDie("Failed to compress genotype matrix block");
+
+  ByteWriter sizes;
+  sizes.put_u64(raw_size);
+  sizes.put_u64(comp_size);
+  out.write(sizes.data.c_str(), sizes.data.size());
+  out.write(buffer.c_str(), comp_size);
+}
+
+static void read_compressed_block(std::ifstream& in, std::string& data){
+  std::string size_bytes(16, '\0');
+  if (!in.read(&size_bytes[0], 16))
+    printErrorAndDie("Genotype matrix file is truncated or corrupted");
+  ByteReader sizes(size_bytes, GT_MATRIX_SOURCE);
+  uint64_t raw_size  = sizes.get_u64();
+  uint64_t comp_size = sizes.get_u64();
+
+  std::string buffer(comp_size, '\0');
+  if (comp_size != 0 && !in.read(&buffer[0], comp_size))
+    printErrorAndDie("Genotype matrix file is truncated or corrupted");
+
+  data.assign(raw_size, '\0');
+  uLongf dest_size = raw_size;
+  if (raw_size != 0 && (uncompress((Bytef*)&data[0], &dest_size, (const Bytef*)buffer.c_str(), comp_size) != Z_OK || dest_size != raw_size))
+    printErrorAndDie("Failed to decompress genotype matrix block");
+}
+
+bool locus_position_comparator(const GenotypeMatrixLocus& l1, const GenotypeMatrixLocus& l2){
+  return l1.pos < l2.pos;
+}
+
+void GenotypeMatrixWriter::open(const std::string& filename, const std::vector<std::string>& sample_names){
+  if (open_)
+    printErrorAndDie("Cannot reopen a GenotypeMatrixWriter that is already open");
+  out_.open(filename.c_str(), std::ios_base::out | std::ios_base::binary);
+  if (!out_.is_open())
+    printErrorAndDie("Failed to open the genotype matrix file: " + filename);
+  open_        = true;
+  filename_    = filename;
+  num_samples_ = sample_names.size();
+
+  ByteWriter header;
+  header.data.append(GT_MATRIX_MAGIC, sizeof(GT_MATRIX_MAGIC));
+  header.put_u32(GT_MATRIX_VERSION);
+  header.put_u32(num_samples_);
+  for (auto sample_iter = sample_names.begin(); sample_iter != sample_names.end(); sample_iter++)
+    header.put_string(*sample_iter);
+  out_.write(header.data.c_str(), header.data.size());
+}
+
+void GenotypeMatrixWriter::add_locus(const GenotypeMatrixLocus& locus){
+  if (!open_)
+    printErrorAndDie("Cannot invoke add_locus() on a non-open GenotypeMatrixWriter");
+  if (locus.gt_a.size() != num_samples_ || locus.gt_b.size() != num_samples_ || locus.quals.size() != num_samples_ || locus.depths.size() != num_samples_)
+    printErrorAndDie("Genotype matrix locus must contain an entry for each sample");
+  if (locus.alleles.size() != locus.bp_diffs.size())
+    printErrorAndDie("Genotype matrix locus must contain a base pair difference for each allele");
+
+  // Chunks only contain loci from a single chromosome
+  if (!chunk_loci_.empty() && chunk_loci_.back().chrom.compare(locus.chrom) != 0)
+    write_chunk();
+  chunk_loci_.push_back(locus);
+  if (chunk_loci_.size() >= LOCI_PER_CHUNK)
+    write_chunk();
+}
+
+void GenotypeMatrixWriter::write_chunk(){
+  if (chunk_loci_.empty())
+    return;
+  std::stable_sort(chunk_loci_.begin(), chunk_loci_.end(), locus_position_comparator);
+
+  const std::string& chrom = chunk_loci_.front().chrom;
+  auto chrom_iter = chrom_indices_.find(chrom);
+  if (chrom_iter == chrom_indices_.end()){
+    chrom_iter = chrom_indices_.insert(std::pair<std::string, int32_t>(chrom, chroms_.size())).first;
+    chroms_.push_back(chrom);
+  }
+
+  GenotypeMatrixChunkInfo chunk;
+  chunk.offset      = out_.tellp();
+  chunk.num_loci    = chunk_loci_.size();
+  chunk.chrom_index = chrom_iter->second;
+  chunk.min_start   = chunk_loci_.front().start;
+  chunk.max_stop    = chunk_loci_.front().stop;
+
+  // Per-locus metadata block
+  ByteWriter metadata;
+  for (auto locus_iter = chunk_loci_.begin(); locus_iter != chunk_loci_.end(); locus_iter++){
+    chunk.min_start = std::min(chunk.min_start, locus_iter->start);
+    chunk.max_stop  = std::max(chunk.max_stop,  locus_iter->stop);
+    metadata.put_i32(locus_iter->pos);
+    metadata.put_i32(locus_iter->start);
+    metadata.put_i32(locus_iter->stop);
+    metadata.put_i32(locus_iter->period);
+    metadata.put_u32(locus_iter->alleles.size());
+    for (unsigned int i = 0; i < locus_iter->alleles.size(); i++){
+      metadata.put_string(locus_iter->alleles[i]);
+      metadata.put_i32(locus_iter->bp_diffs[i]);
+    }
+  }
+  write_compressed_block(out_, metadata.data.c_str(), metadata.data.size());
+
+  // Dense loci x samples column for each field, stored little-endian like the metadata
+  ByteWriter gt_a, gt_b, quals, depths;
+  for (auto locus_iter = chunk_loci_.begin(); locus_iter != chunk_loci_.end(); locus_iter++){
+    for (uint32_t i = 0; i < num_samples_; i++){
+      gt_a.put_i16(locus_iter->gt_a[i]);
+      gt_b.put_i16(locus_iter->gt_b[i]);
+      quals.put_float(locus_iter->quals[i]);
+      depths.put_i32(locus_iter->depths[i]);
+    }
+  }
+  write_compressed_block(out_, gt_a.data.c_str(),   gt_a.data.size());
+  write_compressed_block(out_, gt_b.data.c_str(),   gt_b.data.size());
+  write_compressed_block(out_, quals.data.c_str(),  quals.data.size());
+  write_compressed_block(out_, depths.data.c_str(), depths.data.size());
+
+  chunks_.push_back(chunk);
+  chunk_loci_.clear();
+}
+
+void GenotypeMatrixWriter::close(){
+  if (!open_)
+    printErrorAndDie("Cannot invoke close() on a non-open GenotypeMatrixWriter");
+  write_chunk();
+
+  uint64_t index_offset = out_.tellp();
+  ByteWriter index;
+  index.put_u32(chroms_.size());
+  for (auto chrom_iter = chroms_.begin(); chrom_iter != chroms_.end(); chrom_iter++)
+    index.put_string(*chrom_iter);
+  index.put_u32(chunks_.size());
+  for (auto chunk_iter = chunks_.begin(); chunk_iter != chunks_.end(); chunk_iter++){
+    index.put_u64(chunk_iter->offset);
+    index.put_u32(chunk_iter->num_loci);
+    index.put_i32(chunk_iter->chrom_index);
+    index.put_i32(chunk_iter->min_start);
+    index.put_i32(chunk_iter->max_stop);
+  }
+  index.put_u64(index_offset);
+  index.data.append(GT_MATRIX_MAGIC, sizeof(GT_MATRIX_MAGIC));
+  out_.write(index.data.c_str(), index.data.size());
+  out_.close();
+
+  if (out_.fail())
+    printErrorAndDie("Failed to write the genotype matrix file: " + filename_);
+  open_ = false;
+  chroms_.clear();
+  chrom_indices_.clear();
+  chunks_.clear();
+}
+
+GenotypeMatrixReader::GenotypeMatrixReader(const std::string& filename){
+  filename_ = filename;
+  in_.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!in_.is_open())
+    printErrorAndDie("Failed to open the genotype matrix file: " + filename);
+
+  // Read the header and sample names
+  std::string header(sizeof(GT_MATRIX_MAGIC) + 8, '\0');
+  if (!in_.read(&header[0], header.size()) || memcmp(header.c_str(), GT_MATRIX_MAGIC, sizeof(GT_MATRIX_MAGIC)) != 0)
+    printErrorAndDie("File is not a valid genotype matrix: " + filename);
+  std::string header_fields = header.substr(sizeof(GT_MATRIX_MAGIC));
+  ByteReader header_reader(header_fields, GT_MATRIX_SOURCE);
+  if (header_reader.get_u32() != GT_MATRIX_VERSION)
+    printErrorAndDie("Unsupported genotype matrix version in file: " + filename);
+  uint32_t num_samples = header_reader.get_u32();
+  for (uint32_t i = 0; i < num_samples; i++){
+    std::string len_bytes(4, '\0');
+    if (!in_.read(&len_bytes[0], 4))
+      printErrorAndDie("Genotype matrix file is truncated or corrupted");
+    uint32_t len = ByteReader(len_bytes, GT_MATRIX_SOURCE).get_u32();
+    std::string sample(len, '\0');
+    if (len != 0 && !in_.read(&sample[0], len))
+      printErrorAndDie("Genotype matrix file is truncated or corrupted");
+    samples_.push_back(sample);
+  }
+
+  // Use the footer to locate and read the index
+  int footer_size = 8 + sizeof(GT_MATRIX_MAGIC);
+  in_.seekg(0, std::ios_base::end);
+  std::streamoff file_size = in_.tellg();
+  if (file_size < footer_size)
+    printErrorAndDie("Genotype matrix file is truncated or corrupted");
+  std::string footer(footer_size, '\0');
+  in_.seekg(file_size - footer_size);
+  in_.read(&footer[0], footer_size);
+  if (memcmp(footer.c_str()+8, GT_MATRIX_MAGIC, sizeof(GT_MATRIX_MAGIC)) != 0)
+    printErrorAndDie("Genotype matrix file is truncated or was not properly closed: " + filename);
+  uint64_t index_offset = ByteReader(footer, GT_MATRIX_SOURCE).get_u64();
+  if (index_offset > (uint64_t)(file_size - footer_size))
+    printErrorAndDie("Genotype matrix file is truncated or corrupted");
+
+  std::string index(file_size - footer_size - index_offset, '\0');
+  in_.seekg(index_offset);
+  in_.read(&index[0], index.size());
+  ByteReader index_reader(index, GT_MATRIX_SOURCE);
+  uint32_t num_chroms = index_reader.get_u32();
+  for (uint32_t i = 0; i < num_chroms; i++)
+    chroms_.push_back(index_reader.get_string());
+  uint32_t num_chunks = index_reader.get_u32();
+  for (uint32_t i = 0; i < num_chunks; i++){
+    GenotypeMatrixChunkInfo chunk;
+    chunk.offset      = index_reader.get_u64();
+    chunk.num_loci    = index_reader.get_u32();
+    chunk.chrom_index = index_reader.get_i32();
+    chunk.min_start   = index_reader.get_i32();
+    chunk.max_stop    = index_reader.get_i32();
+    chunks_.push_back(chunk);
+  }
+}
+
+int GenotypeMatrixReader::get_sample_index(const std::string& sample) const {
+  for (unsigned int i = 0; i < samples_.size(); i++)
+    if (samples_[i].compare(sample) == 0)
+      return i;
+  return -1;
+}
+
+void GenotypeMatrixReader::get_loci(const std::string& chrom, int32_t start, int32_t stop,
+				    const std::vector<int>& sample_indices, std::vector<GenotypeMatrixLocus>& loci){
+  std::vector<int> samples(sample_indices);
+  if (samples.empty())
+    for (unsigned int i = 0; i < samples_.size(); i++)
+      samples.push_back(i);
+  for (auto sample_iter = samples.begin(); sample_iter != samples.end(); sample_iter++)
+    if (*sample_iter < 0 || *sample_iter >= (int)samples_.size())
+      printErrorAndDie("Invalid sample index provided to GenotypeMatrixReader::get_loci()");
+
+  auto chrom_iter = std::find(chroms_.begin(), chroms_.end(), chrom);
+  if (chrom_iter == chroms_.end())
+    return;
+  int32_t chrom_index = chrom_iter - chroms_.begin();
+
+  for (auto chunk_iter = chunks_.begin(); chunk_iter != chunks_.end(); chunk_iter++)
+    if (chunk_iter->chrom_index == chrom_index && chunk_iter->min_start <= stop && chunk_iter->max_stop >= start)
+      read_chunk(*chunk_iter, start, stop, samples, loci);
+}
+
+void GenotypeMatrixReader::read_chunk(const GenotypeMatrixChunkInfo& chunk, int32_t start, int32_t stop,
+				      const std::vector<int>& sample_indices, std::vector<GenotypeMatrixLocus>& loci){
+  in_.clear();
+  in_.seekg(chunk.offset);
+
+  // Determine which loci in the chunk overlap the region
+  std::string metadata;
+  read_compressed_block(in_, metadata);
+  ByteReader metadata_reader(metadata, GT_MATRIX_SOURCE);
+  std::vector<GenotypeMatrixLocus> chunk_loci(chunk.num_loci);
+  std::vector<int> overlapping;
+  for (uint32_t i = 0; i < chunk.num_loci; i++){
+    GenotypeMatrixLocus& locus = chunk_loci[i];
+    locus.chrom  = chroms_[chunk.chrom_index];
+    locus.pos    = metadata_reader.get_i32();
+    locus.start  = metadata_reader.get_i32();
+    locus.stop   = metadata_reader.get_i32();
+    locus.period = metadata_reader.get_i32();
+    uint32_t num_alleles = metadata_reader.get_u32();
+    for (uint32_t j = 0; j < num_alleles; j++){
+      locus.alleles.push_back(metadata_reader.get_string());
+      locus.bp_diffs.push_back(metadata_reader.get_i32());
+    }
+    if (locus.start <= stop && locus.stop >= start)
+      overlapping.push_back(i);
+  }
+  if (overlapping.empty())
+    return;
+
+  // Only decompress the per-sample columns if at least one locus overlaps the region
+  uint32_t num_samples = samples_.size();
+  std::string gt_a, gt_b, quals, depths;
+  read_compressed_block(in_, gt_a);
+  read_compressed_block(in_, gt_b);
+  read_compressed_block(in_, quals);
+  read_compressed_block(in_, depths);
+  size_t num_entries = (size_t)chunk.num_loci*num_samples;
+  if (gt_a.size() != 2*num_entries || gt_b.size() != 2*num_entries || quals.size() != 4*num_entries || depths.size() != 4*num_entries)
+    printErrorAndDie("Genotype matrix file is truncated or corrupted");
+
+  for (auto locus_iter = overlapping.begin(); locus_iter != overlapping.end(); locus_iter++){
+    GenotypeMatrixLocus& locus = chunk_loci[*locus_iter];
+    size_t row_offset = (size_t)(*locus_iter)*num_samples;
+    for (auto sample_iter = sample_indices.begin(); sample_iter != sample_indices.end(); sample_iter++){
+      size_t index = row_offset + *sample_iter;
+      locus.add_sample((int16_t)decode_le(gt_a.data()+2*index, 2), (int16_t)decode_le(gt_b.data()+2*index, 2),
+		       decode_le_float(quals.data()+4*index), (int32_t)decode_le(depths.data()+4*index, 4));
+    }
+    loci.push_back(locus);
+  }
+}
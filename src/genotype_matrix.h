@@ -0,0 +1,157 @@
+#ifndef GENOTYPE_MATRIX_H_
+#define GENOTYPE_MATRIX_H_
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "error.h"
+
+/*
+ * Columnar binary store of the per-sample STR genotypes that can be written alongside the VCF
+ *
+ * File layout:
+ *  HEADER : Magic string, format version and the list of sample names
+ *  CHUNKS : Up to LOCI_PER_CHUNK loci from a single chromosome. Each chunk consists of a zlib-compressed block of
+ *           per-locus allele metadata, followed by one zlib-compressed dense loci x samples array for each of the
+ *           GT_A, GT_B, Q and DP fields
+ *  INDEX  : Chromosome names and the file offset, chromosome and coordinate range of each chunk
+ *  FOOTER : File offset of the index followed by the magic string
+ *
+ * All integers and floats are stored in little-endian byte order, regardless of the host's byte order.
+ * Loci can therefore be retrieved by coordinate range without decompressing unrelated chunks, and genotypes
+ * can be extracted for an arbitrary subset of the samples
+ */
+
+const int16_t GT_MATRIX_MISSING = -1;
+
+class GenotypeMatrixLocus {
+ public:
+  std::string chrom;
+  int32_t pos;                       // 1-based VCF position of the record
+  int32_t start;                     // 1-based inclusive start coordinate of the repeat
+  int32_t stop;                      // Inclusive end coordinate of the repeat
+  int32_t period;
+  std::vector<std::string> alleles;  // Alleles in VCF order, with the reference allele first
+  std::vector<int32_t> bp_diffs;     // Base pair difference of each allele from the reference allele
+
+  // Per-sample fields, in the order of the requested samples
+  std::vector<int16_t> gt_a, gt_b;   // Allele indices of each sample's genotype or GT_MATRIX_MISSING
+  std::vector<float> quals;          // Posterior probability of each sample's unphased genotype (Q)
+  std::vector<int32_t> depths;       // Number of reads used to genotype each sample (DP)
+
+  GenotypeMatrixLocus(){
+    pos = start = stop = period = -1;
+  }
+
+  int num_samples()                     const { return gt_a.size();                          }
+  bool is_missing(int sample_index)     const { return gt_a[sample_index] == GT_MATRIX_MISSING; }
+  int32_t gb_a(int sample_index)        const { return bp_diffs[gt_a[sample_index]];         }
+  int32_t gb_b(int sample_index)        const { return bp_diffs[gt_b[sample_index]];         }
+
+  void add_missing_sample(){
+    gt_a.push_back(GT_MATRIX_MISSING);
+    gt_b.push_back(GT_MATRIX_MISSING);
+    quals.push_back(0);
+    depths.push_back(0);
+  }
+
+  void add_sample(int allele_a, int allele_b, float qual, int32_t depth){
+    gt_a.push_back(allele_a);
+    gt_b.push_back(allele_b);
+    quals.push_back(qual);
+    depths.push_back(depth);
+  }
+};
+
+class GenotypeMatrixChunkInfo {
+ public:
+  uint64_t offset;
+  uint32_t num_loci;
+  int32_t chrom_index;
+  int32_t min_start, max_stop;
+
+  GenotypeMatrixChunkInfo(){
+    offset      = 0;
+    num_loci    = 0;
+    chrom_index = -1;
+    min_start   = max_stop = -1;
+  }
+};
+
+class GenotypeMatrixWriter {
+ private:
+  std::ofstream out_;
+  bool open_;
+  std::string filename_;
+  uint32_t num_samples_;
+
+  std::vector<std::string> chroms_;
+  std::map<std::string, int32_t> chrom_indices_;
+  std::vector<GenotypeMatrixLocus> chunk_loci_;
+  std::vector<GenotypeMatrixChunkInfo> chunks_;
+
+  void write_chunk();
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  GenotypeMatrixWriter(const GenotypeMatrixWriter& other);
+  GenotypeMatrixWriter& operator=(const GenotypeMatrixWriter& other);
+
+ public:
+  static const uint32_t LOCI_PER_CHUNK = 1024;
+
+  GenotypeMatrixWriter(){
+    open_        = false;
+    num_samples_ = 0;
+  }
+
+  ~GenotypeMatrixWriter(){
+    if (open_)
+      close();
+  }
+
+  bool is_open() const { return open_; }
+
+  void open(const std::string& filename, const std::vector<std::string>& sample_names);
+
+  // Loci must contain an entry for each sample provided to open(). Loci are expected in roughly sorted order,
+  // but the coordinate range stored for each chunk ensures that slightly out-of-order loci are still retrieved
+  void add_locus(const GenotypeMatrixLocus& locus);
+
+  void close();
+};
+
+class GenotypeMatrixReader {
+ private:
+  std::ifstream in_;
+  std::string filename_;
+  std::vector<std::string> samples_;
+  std::vector<std::string> chroms_;
+  std::vector<GenotypeMatrixChunkInfo> chunks_;
+
+  void read_chunk(const GenotypeMatrixChunkInfo& chunk, int32_t start, int32_t stop,
+		  const std::vector<int>& sample_indices, std::vector<GenotypeMatrixLocus>& loci);
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  GenotypeMatrixReader(const GenotypeMatrixReader& other);
+  GenotypeMatrixReader& operator=(const GenotypeMatrixReader& other);
+
+ public:
+  explicit GenotypeMatrixReader(const std::string& filename);
+
+  const std::vector<std::string>& get_samples() const { return samples_; }
+  const std::vector<std::string>& get_chroms()  const { return chroms_;  }
+  int num_chunks()                              const { return chunks_.size(); }
+
+  // Returns the index of the sample or -1 if it isn't present in the matrix
+  int get_sample_index(const std::string& sample) const;
+
+  // Appends all loci on the chromosome whose repeats overlap [start, stop] to the provided vector.
+  // Per-sample fields are only extracted for the provided sample indices, or for all samples if the vector is empty
+  void get_loci(const std::string& chrom, int32_t start, int32_t stop,
+		const std::vector<int>& sample_indices, std::vector<GenotypeMatrixLocus>& loci);
+};
+
+#endif
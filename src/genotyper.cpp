@@ -6,11 +6,13 @@
 #include <algorithm>
 #include <cfloat>
 #include <cmath>
+#include <mutex>
 #include <sstream>
 
 #include "genotyper.h"
 #include "fasta_reader.h"
 #include "mathops.h"
+#include "parallel_for.h"
 
 // Each genotype has an equal total prior, but heterozygotes have two possible phasings. Therefore,
 // i)   Phased heterozygotes have a prior of 1/(n(n+1))
@@ -43,6 +45,8 @@ void Genotyper::init_log_sample_priors(double* log_sample_ptr){
 
 double Genotyper::calc_log_sample_posteriors(std::vector<int>& read_weights){
   double posterior_time = clock();
+  PerfCounts posterior_start;
+  PerfCounters::snapshot(posterior_start);
   assert(read_weights.size() == num_reads_);
   init_log_sample_priors(log_sample_posteriors_);
 
@@ -76,40 +80,23 @@ double Genotyper::calc_log_sample_posteriors(std::vector<int>& read_weights){
 
   posterior_time         = (clock() - posterior_time)/CLOCKS_PER_SEC;
   total_posterior_time_ += posterior_time;
+  posterior_counts_.add_since(posterior_start);
   return total_LL;
 }
 
-void Genotyper::get_optimal_haplotypes(std::vector< std::pair<int, int> >& gts) const {
-  assert(gts.size() == 0);
-  gts = std::vector< std::pair<int,int> > (num_samples_, std::pair<int,int>(-1,-1));
-  double* log_posterior_ptr = log_sample_posteriors_;
-  std::vector<double> log_phased_posteriors(num_samples_, -DBL_MAX);
-  for (unsigned int sample_index = 0; sample_index < num_samples_; ++sample_index){
-    for (int index_1 = 0; index_1 < num_alleles_; ++index_1){
-      for (int index_2 = 0; index_2 < num_alleles_; ++index_2, ++log_posterior_ptr){
-        if (*log_posterior_ptr > log_phased_posteriors[sample_index]){
-          log_phased_posteriors[sample_index] = *log_posterior_ptr;
-          gts[sample_index] = std::pair<int,int>(index_1, index_2);
-        }
-      }
-    }
-  }
-}
-
-void Genotyper::calc_PLs(const std::vector<double>& gls, std::vector<int>& pls) const {
-  assert(pls.empty());
-  double max_gl = *(std::max_element(gls.begin(), gls.end()));
-  for (unsigned int i = 0; i < gls.size(); i++)
-    pls.push_back(std::min(999, (int)(-10*(gls[i]-max_gl))));
+void Genotyper::calc_PLs(const double* gls, int num_gls, int* pls) const {
+  double max_gl = *(std::max_element(gls, gls+num_gls));
+  for (int i = 0; i < num_gls; i++)
+    pls[i] = std::min(999, (int)(-10*(gls[i]-max_gl)));
 }
 
-double Genotyper::calc_gl_diff(const std::vector<double>& gls, int gt_a, int gt_b) const {
+double Genotyper::calc_gl_diff(const double* gls, int num_gls, int gt_a, int gt_b) const {
   if (num_alleles_ == 1)
     return -1000;
 
-  double max_gl    = *(std::max_element(gls.begin(), gls.end()));
+  double max_gl    = *(std::max_element(gls, gls+num_gls));
   double second_gl = -DBL_MAX;
-  for (unsigned int i = 0; i < gls.size(); i++)
+  for (int i = 0; i < num_gls; i++)
     if (gls[i] < max_gl)
       second_gl = std::max(second_gl, gls[i]);
   if (second_gl == -DBL_MAX)
@@ -126,131 +113,361 @@ double Genotyper::calc_gl_diff(const std::vector<double>& gls, int gt_a, int gt_
   return ((std::fabs(max_gl-gls[gl_index]) < TOLERANCE) ? (max_gl-second_gl) : gls[gl_index]-max_gl);
 }
 
+void Genotyper::calc_sample_gls(int sample_index, int num_variants, const double* log_phased_posteriors,
+				double* gls, double* phased_gls) const {
+  // The genotype likelihoods should not contain the priors we used during the posterior calculation
+  // To obtain the true likelihoods, we subtract out the priors from the posteriors using these values
+  double hom_ll_correction  = log_homozygous_prior();
+  double het_ll_correction  = (haploid_ ? 0 : log_heterozygous_prior()); // If haploid, don't correct hetz genotypes as they're impossible
+
+  // Precompute corrections for the number of haplotypes we will average for the GLs or PHASEDGLs
+  double gl_nconfig_corr, pgl_nconfig_corr;
+  if (haploid_){
+    gl_nconfig_corr  = int_log(2) + int_log(num_alleles_) - int_log(num_variants);
+    pgl_nconfig_corr = int_log(num_alleles_) - int_log(num_variants);
+  }
+  else {
+    gl_nconfig_corr  = int_log(2) + 2*(int_log(num_alleles_) - int_log(num_variants));
+    pgl_nconfig_corr = 2*(int_log(num_alleles_) - int_log(num_variants));
+  }
+
+  // Average the GLs and PHASEDGLs across all haplotype configurations
+  int gt_index = 0;
+  for (int index_1 = 0; index_1 < num_variants; ++index_1){
+    for (int index_2 = 0; index_2 < num_variants; ++index_2, ++gt_index){
+      int alt_gt_index   = index_2*num_variants + index_1;
+      double gl_ll_corr  = (index_1 == index_2 ? hom_ll_correction : het_ll_correction) + gl_nconfig_corr;
+      double pgl_ll_corr = (index_1 == index_2 ? hom_ll_correction : het_ll_correction) + pgl_nconfig_corr;
+      if ((index_2 <= index_1) && (!haploid_ || (index_1 == index_2))){
+	double gl_base_e = sample_total_LLs_[sample_index] - gl_ll_corr + fast_log_sum_exp(log_phased_posteriors[gt_index],
+											   log_phased_posteriors[alt_gt_index]);
+	*gls++ = gl_base_e*LOG_E_BASE_10; // Convert from ln to log10
+      }
+      if (phased_gls != NULL && (!haploid_ || (index_1 == index_2)))
+	*phased_gls++ = (sample_total_LLs_[sample_index] - pgl_ll_corr + log_phased_posteriors[gt_index])*LOG_E_BASE_10;
+    }
+  }
+}
+
+template<bool CALC_PLS, bool CALC_PHASED_GLS>
+void Genotyper::calc_sample_likelihoods(int sample_index, int num_variants, const double* log_phased_posteriors, int gt_a, int gt_b,
+					FlatMatrix<double>& gls, std::vector<double>& gl_diffs, FlatMatrix<int>& pls, FlatMatrix<double>& phased_gls) const {
+  calc_sample_gls(sample_index, num_variants, log_phased_posteriors, gls[sample_index], (CALC_PHASED_GLS ? phased_gls[sample_index] : NULL));
+  gl_diffs[sample_index] = calc_gl_diff(gls[sample_index], gls.num_cols(), gt_a, gt_b);
+  if (CALC_PLS)
+    calc_PLs(gls[sample_index], gls.num_cols(), pls[sample_index]);
+}
+
 void Genotyper::extract_genotypes_and_likelihoods(int num_variants, std::vector<int>& hap_to_allele,
 						  std::vector< std::pair<int,int>  >& best_haplotypes,
 						  std::vector< std::pair<int,int>  >& best_gts,
 						  std::vector<double>& log_phased_posteriors,     std::vector<double>& log_unphased_posteriors,
 						  std::vector<double>& hap_log_phased_posteriors, std::vector<double>& hap_log_unphased_posteriors,
-						  bool calc_gls,        std::vector< std::vector<double> >& gls, std::vector<double>& gl_diffs,
-						  bool calc_pls,        std::vector< std::vector<int> >& pls,
-						  bool calc_phased_gls, std::vector< std::vector<double> >& phased_gls){
+						  bool calc_gls,        FlatMatrix<double>& gls, std::vector<double>& gl_diffs,
+						  bool calc_pls,        FlatMatrix<int>& pls,
+						  bool calc_phased_gls, FlatMatrix<double>& phased_gls){
   assert(log_phased_posteriors.empty() && log_unphased_posteriors.empty() && gl_diffs.empty());
   assert(hap_log_phased_posteriors.empty() && hap_log_unphased_posteriors.empty());
   assert(best_haplotypes.empty() && best_gts.empty() && gls.empty() && pls.empty() && phased_gls.empty());
 
-  // Use the standard genotyper approach to find the ML combination of haplotypes
-  get_optimal_haplotypes(best_haplotypes);
-
-  // Extract the ML alleles for the variant
-  for (int sample_index = 0; sample_index < num_samples_; sample_index++)
-    best_gts.push_back(std::pair<int,int>(hap_to_allele[best_haplotypes[sample_index].first], hap_to_allele[best_haplotypes[sample_index].second]));
+  // Size each output for all samples up front, so that ranges of samples can be processed concurrently
+  bool need_gls = (calc_gls || calc_phased_gls || calc_pls);
+  best_haplotypes.resize(num_samples_);
+  best_gts.resize(num_samples_);
+  log_phased_posteriors.resize(num_samples_);
+  log_unphased_posteriors.resize(num_samples_);
+  hap_log_phased_posteriors.resize(num_samples_);
+  hap_log_unphased_posteriors.resize(num_samples_);
+  if (need_gls){
+    gls.resize(num_samples_, haploid_ ? num_variants : num_variants*(num_variants+1)/2);
+    gl_diffs.resize(num_samples_);
+    if (calc_pls)
+      pls.resize(num_samples_, gls.num_cols());
+    if (calc_phased_gls)
+      phased_gls.resize(num_samples_, haploid_ ? num_variants : num_variants*num_variants);
+  }
 
-  // Marginalize over all haplotypes to compute the genotype posteriors and use streaming log-sum-exp to aggregate values
-  std::vector< std::vector<double>  > max_log_phased_posteriors   (num_samples_, std::vector<double>(num_variants*num_variants, -DBL_MAX/2));
-  std::vector< std::vector<double>  > total_log_phased_posteriors (num_samples_, std::vector<double>(num_variants*num_variants, 0.0));
-  double* log_posterior_ptr = log_sample_posteriors_;
-  for (unsigned int sample_index = 0; sample_index < num_samples_; ++sample_index)
-    for (int index_1 = 0; index_1 < num_alleles_; ++index_1){
-      for (int index_2 = 0; index_2 < num_alleles_; ++index_2, ++log_posterior_ptr){
-	int gt_index = num_variants*hap_to_allele[index_1] + hap_to_allele[index_2];
-	update_streaming_log_sum_exp(*log_posterior_ptr, max_log_phased_posteriors[sample_index][gt_index], total_log_phased_posteriors[sample_index][gt_index]);
-    }
+  // Precompute the phased genotype associated with each diplotype
+  std::vector<int> diplotype_to_gt(num_alleles_*num_alleles_);
+  bool identity_map = (num_variants == num_alleles_);
+  for (int index_1 = 0, diplotype = 0; index_1 < num_alleles_; ++index_1){
+    identity_map &= (hap_to_allele[index_1] == index_1);
+    for (int index_2 = 0; index_2 < num_alleles_; ++index_2, ++diplotype)
+      diplotype_to_gt[diplotype] = num_variants*hap_to_allele[index_1] + hap_to_allele[index_2];
   }
-  int gt_index = 0;
-  for (int index_1 = 0; index_1 < num_variants; ++index_1){
-    for (int index_2 = 0; index_2 < num_variants; ++index_2, ++gt_index){
-      for (unsigned int sample_index = 0; sample_index < num_samples_; ++sample_index){
-	double total = finish_streaming_log_sum_exp(max_log_phased_posteriors[sample_index][gt_index], total_log_phased_posteriors[sample_index][gt_index]);
-	total_log_phased_posteriors[sample_index][gt_index] = total;
-      }
+
+  // Select the kernels specialized for the requested optional outputs. As clock() measures the CPU time of the entire process,
+  // the elapsed time already includes all threads, while the performance counters are summed over the threads
+  double extract_time = clock();
+  PerfCounts thread_counts;
+  if (calc_pls && calc_phased_gls)
+    extract_sample_ranges<true, true>(num_variants, hap_to_allele, diplotype_to_gt, identity_map, best_haplotypes, best_gts,
+				      log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors,
+				      need_gls, gls, gl_diffs, pls, phased_gls, thread_counts);
+  else if (calc_pls)
+    extract_sample_ranges<true, false>(num_variants, hap_to_allele, diplotype_to_gt, identity_map, best_haplotypes, best_gts,
+				       log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors,
+				       need_gls, gls, gl_diffs, pls, phased_gls, thread_counts);
+  else if (calc_phased_gls)
+    extract_sample_ranges<false, true>(num_variants, hap_to_allele, diplotype_to_gt, identity_map, best_haplotypes, best_gts,
+				       log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors,
+				       need_gls, gls, gl_diffs, pls, phased_gls, thread_counts);
+  else
+    extract_sample_ranges<false, false>(num_variants, hap_to_allele, diplotype_to_gt, identity_map, best_haplotypes, best_gts,
+					log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors,
+					need_gls, gls, gl_diffs, pls, phased_gls, thread_counts);
+  total_posterior_time_ += (clock() - extract_time)/CLOCKS_PER_SEC;
+  posterior_counts_.add(thread_counts);
+
+  if (need_gls && !calc_gls)
+    gls.clear();
+}
+
+void Genotyper::extract_best_haplotypes(std::vector< std::pair<int, int> >& best_haplotypes){
+  std::vector<int> hap_to_allele(num_alleles_);
+  for (int i = 0; i < num_alleles_; i++)
+    hap_to_allele[i] = i;
+  std::vector< std::pair<int,int> > best_gts;
+  std::vector<double> log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors, gl_diffs;
+  FlatMatrix<double> gls, phased_gls;
+  FlatMatrix<int> pls;
+  extract_genotypes_and_likelihoods(num_alleles_, hap_to_allele, best_haplotypes, best_gts, log_phased_posteriors, log_unphased_posteriors,
+				    hap_log_phased_posteriors, hap_log_unphased_posteriors, false, gls, gl_diffs, false, pls, false, phased_gls);
+}
+
+template<bool CALC_PLS, bool CALC_PHASED_GLS>
+void Genotyper::extract_sample_ranges(int num_variants, const std::vector<int>& hap_to_allele,
+				      const std::vector<int>& diplotype_to_gt, bool identity_map,
+				      std::vector< std::pair<int,int>  >& best_haplotypes,
+				      std::vector< std::pair<int,int>  >& best_gts,
+				      std::vector<double>& log_phased_posteriors,     std::vector<double>& log_unphased_posteriors,
+				      std::vector<double>& hap_log_phased_posteriors, std::vector<double>& hap_log_unphased_posteriors,
+				      bool need_gls, FlatMatrix<double>& gls, std::vector<double>& gl_diffs,
+				      FlatMatrix<int>& pls, FlatMatrix<double>& phased_gls, PerfCounts& thread_counts) const {
+  std::mutex counts_lock;
+  parallel_for(num_samples_, options_.NUM_THREADS, options_.MIN_SAMPLES_PER_THREAD, [&](int start, int end){
+      // Each thread's counters only reflect its own work, so snapshot within the thread and sum the counts
+      PerfCounts range_start, range_counts;
+      PerfCounters::snapshot(range_start);
+      extract_dense_sample_range<CALC_PLS, CALC_PHASED_GLS>(start, end, num_variants, hap_to_allele, diplotype_to_gt, identity_map, best_haplotypes, best_gts,
+							    log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors,
+							    need_gls, gls, gl_diffs, pls, phased_gls);
+      range_counts.add_since(range_start);
+      std::lock_guard<std::mutex> guard(counts_lock);
+      thread_counts.add(range_counts);
+    });
+}
+
+template<bool CALC_PLS, bool CALC_PHASED_GLS>
+void Genotyper::extract_dense_sample_range(int start, int end, int num_variants, const std::vector<int>& hap_to_allele,
+					   const std::vector<int>& diplotype_to_gt, bool identity_map,
+					   std::vector< std::pair<int,int>  >& best_haplotypes,
+					   std::vector< std::pair<int,int>  >& best_gts,
+					   std::vector<double>& log_phased_posteriors,     std::vector<double>& log_unphased_posteriors,
+					   std::vector<double>& hap_log_phased_posteriors, std::vector<double>& hap_log_unphased_posteriors,
+					   bool need_gls, FlatMatrix<double>& gls, std::vector<double>& gl_diffs,
+					   FlatMatrix<int>& pls, FlatMatrix<double>& phased_gls) const {
+  const int num_diplotypes = num_alleles_*num_alleles_;
+  const int num_genotypes  = num_variants*num_variants;
+  std::vector<double> max_log_phased_posteriors(num_genotypes), sample_log_phased_posteriors(num_genotypes);
+
+  for (int sample_index = start; sample_index < end; sample_index++){
+    const double* log_posterior_ptr = log_sample_posteriors_ + (size_t)sample_index*num_diplotypes;
+
+    // Find the ML combination of haplotypes and extract its alleles
+    int best_diplotype = 0;
+    for (int diplotype = 1; diplotype < num_diplotypes; diplotype++)
+      if (log_posterior_ptr[diplotype] > log_posterior_ptr[best_diplotype])
+	best_diplotype = diplotype;
+    std::pair<int,int> best_haps(best_diplotype/num_alleles_, best_diplotype%num_alleles_);
+    int gt_a = hap_to_allele[best_haps.first], gt_b = hap_to_allele[best_haps.second];
+    best_haplotypes[sample_index] = best_haps;
+    best_gts[sample_index]        = std::pair<int,int>(gt_a, gt_b);
+
+    // Marginalize over all haplotypes to compute the genotype posteriors. When each haplotype is a distinct allele, the
+    // posteriors are unchanged. Otherwise, we find each genotype's maximum and then sum the scaled values in a second pass
+    if (identity_map)
+      std::copy(log_posterior_ptr, log_posterior_ptr+num_diplotypes, sample_log_phased_posteriors.begin());
+    else {
+      std::fill(max_log_phased_posteriors.begin(), max_log_phased_posteriors.end(), -DBL_MAX/2);
+      std::fill(sample_log_phased_posteriors.begin(), sample_log_phased_posteriors.end(), 0.0);
+      for (int diplotype = 0; diplotype < num_diplotypes; diplotype++)
+	max_log_phased_posteriors[diplotype_to_gt[diplotype]] = std::max(max_log_phased_posteriors[diplotype_to_gt[diplotype]], log_posterior_ptr[diplotype]);
+      for (int diplotype = 0; diplotype < num_diplotypes; diplotype++)
+	sample_log_phased_posteriors[diplotype_to_gt[diplotype]] += exp(log_posterior_ptr[diplotype] - max_log_phased_posteriors[diplotype_to_gt[diplotype]]);
+      for (int gt_index = 0; gt_index < num_genotypes; gt_index++)
+	sample_log_phased_posteriors[gt_index] = finish_streaming_log_sum_exp(max_log_phased_posteriors[gt_index], sample_log_phased_posteriors[gt_index]);
     }
-  }
 
-  // Extract the posteriors for the optimal phased and unphased haplotypes
-  log_posterior_ptr = log_sample_posteriors_;
-  for (int sample_index = 0; sample_index < num_samples_; sample_index++){
-    int hap_index_a = best_haplotypes[sample_index].first*num_alleles_  + best_haplotypes[sample_index].second;
-    int hap_index_b = best_haplotypes[sample_index].second*num_alleles_ + best_haplotypes[sample_index].first;
-    hap_log_phased_posteriors.push_back(log_posterior_ptr[hap_index_a]);
+    // Extract the posteriors for the optimal phased and unphased haplotypes
+    int hap_index_a = best_haps.first*num_alleles_  + best_haps.second;
+    int hap_index_b = best_haps.second*num_alleles_ + best_haps.first;
+    hap_log_phased_posteriors[sample_index] = log_posterior_ptr[hap_index_a];
     if (hap_index_a != hap_index_b)
-      hap_log_unphased_posteriors.push_back(fast_log_sum_exp(log_posterior_ptr[hap_index_a], log_posterior_ptr[hap_index_b]));
+      hap_log_unphased_posteriors[sample_index] = fast_log_sum_exp(log_posterior_ptr[hap_index_a], log_posterior_ptr[hap_index_b]);
     else
-      hap_log_unphased_posteriors.push_back(log_posterior_ptr[hap_index_a]);
-    log_posterior_ptr += num_alleles_*num_alleles_;
-  }
+      hap_log_unphased_posteriors[sample_index] = log_posterior_ptr[hap_index_a];
 
-  // Store the aggregated posterior values in the provided vectors
-  for (int sample_index = 0; sample_index < num_samples_; sample_index++){
-    int gt_a = best_gts[sample_index].first, gt_b = best_gts[sample_index].second;
-    double log_phased_prob = total_log_phased_posteriors[sample_index][num_variants*gt_a + gt_b];
-    log_phased_posteriors.push_back(log_phased_prob);
+    // Extract the posteriors for the optimal phased and unphased genotypes
+    double log_phased_prob = sample_log_phased_posteriors[num_variants*gt_a + gt_b];
+    log_phased_posteriors[sample_index] = log_phased_prob;
     if (gt_a == gt_b)
-      log_unphased_posteriors.push_back(log_phased_prob);
-    else {
-      double alt_log_phased_prob = total_log_phased_posteriors[sample_index][num_variants*gt_b + gt_a];
-      log_unphased_posteriors.push_back(log_sum_exp(log_phased_prob, alt_log_phased_prob));
-    }
+      log_unphased_posteriors[sample_index] = log_phased_prob;
+    else
+      log_unphased_posteriors[sample_index] = log_sum_exp(log_phased_prob, sample_log_phased_posteriors[num_variants*gt_b + gt_a]);
+
+    if (need_gls)
+      calc_sample_likelihoods<CALC_PLS, CALC_PHASED_GLS>(sample_index, num_variants, sample_log_phased_posteriors.data(), gt_a, gt_b,
+							 gls, gl_diffs, pls, phased_gls);
   }
-  assert(best_haplotypes.size() == num_samples_ && best_gts.size() == num_samples_);
-  assert(log_phased_posteriors.size() == num_samples_ && log_unphased_posteriors.size() == num_samples_);
-
-  // Compute GLs and phased GLs if necessary
-  if (calc_gls || calc_phased_gls || calc_pls){
-    // The genotype likelihoods should not contain the priors we used during the posterior calculation
-    // To obtain the true likelihoods, we subtract out the priors from the posteriors using these values
-    gls = std::vector< std::vector<double> >(num_samples_);
-    if (calc_phased_gls)
-      phased_gls = std::vector< std::vector<double> >(num_samples_);
-    double hom_ll_correction  = log_homozygous_prior();
-    double het_ll_correction  = (haploid_ ? 0 : log_heterozygous_prior()); // If haploid, don't correct hetz genotypes as they're impossible
-
-    // Precompute corrections for the number of haplotypes we will average for the GLs or PHASEDGLs
-    double gl_nconfig_corr, pgl_nconfig_corr;
-    if (haploid_){
-      gl_nconfig_corr  = int_log(2) + int_log(num_alleles_) - int_log(num_variants);
-      pgl_nconfig_corr = int_log(num_alleles_) - int_log(num_variants);
+}
+
+void Genotyper::write_vcf_site_info(const Region& region, int32_t pos, const std::vector<std::string>& alleles, const std::vector<int>& allele_bp_diffs,
+				    const StutterModel* stutter_model, int skip_count, int filt_count, std::ostream& out) const {
+  //VCF line format = CHROM POS ID REF ALT QUAL FILTER INFO FORMAT SAMPLE_1 SAMPLE_2 ... SAMPLE_N
+  out << region.chrom() << "\t" << pos << "\t" << (region.name().empty() ? "." : region.name());
+
+  // Add reference allele and alternate alleles
+  out << "\t" << alleles[0] << "\t";
+  if (alleles.size() == 1)
+    out << ".";
+  else {
+    for (unsigned int i = 1; i < alleles.size()-1; i++)
+      out << alleles[i] << ",";
+    out << alleles.back();
+  }
+
+  // Add QUAL and FILTER fields
+  out << "\t" << "." << "\t" << ".";
+
+  // Add INFO field items
+  out << "\tINFRAME_PGEOM=" << stutter_model->get_parameter(true,  'P') << ";"
+      << "INFRAME_UP="      << stutter_model->get_parameter(true,  'U') << ";"
+      << "INFRAME_DOWN="    << stutter_model->get_parameter(true,  'D') << ";"
+      << "OUTFRAME_PGEOM="  << stutter_model->get_parameter(false, 'P') << ";"
+      << "OUTFRAME_UP="     << stutter_model->get_parameter(false, 'U') << ";"
+      << "OUTFRAME_DOWN="   << stutter_model->get_parameter(false, 'D') << ";"
+      << "START="           << region.start()+1 << ";"
+      << "END="             << region.stop()    << ";"
+      << "PERIOD="          << region.period()  << ";"
+      << "NSKIP="           << skip_count       << ";"
+      << "NFILT="           << filt_count       << ";";
+  if (alleles.size() > 1){
+    out << "BPDIFFS=" << allele_bp_diffs[1];
+    for (unsigned int i = 2; i < alleles.size(); i++)
+      out << "," << allele_bp_diffs[i];
+    out << ";";
+  }
+}
+
+void Genotyper::write_vcf_allele_counts(int allele_number, const std::vector<int>& allele_counts, std::ostream& out) const {
+  out << "AN=" << allele_number << ";" << "REFAC=" << allele_counts[0];
+  if (allele_counts.size() > 1){
+    out << ";AC=";
+    for (unsigned int i = 1; i < allele_counts.size()-1; i++)
+      out << allele_counts[i] << ",";
+    out << allele_counts.back();
+  }
+}
+
+std::string Genotyper::write_vcf_format(bool stutter_depths, bool bias_stats, bool haplotype_fields, std::ostream& out) const {
+  bool output_mallreads = (haplotype_fields && options_.OUTPUT_MALLREADS == 1);
+  bool output_hap_data  = (haplotype_fields && options_.OUTPUT_HAPLOTYPE_DATA == 1);
+  bool output_phased_gl = (!haploid_ && options_.OUTPUT_PHASED_GLS == 1);
+
+  int num_fields;
+  if (!haploid_){
+    out << (stutter_depths ? "\tGT:GB:Q:PQ:DP:DSNP:DSTUTTER:DFLANKINDEL:PDP:PSNP:GLDIFF" : "\tGT:GB:Q:PQ:DP:DSNP:PDP:PSNP:GLDIFF");
+    num_fields = (stutter_depths ? 11 : 9);
+  }
+  else {
+    out << (stutter_depths ? "\tGT:GB:Q:DP:DSTUTTER:DFLANKINDEL:GLDIFF" : "\tGT:GB:Q:DP:GLDIFF");
+    num_fields = (stutter_depths ? 7 : 5);
+  }
+  if (bias_stats)                    out << ":AB:DAB:FS";
+  if (options_.OUTPUT_ALLREADS == 1) out << ":ALLREADS";
+  if (output_mallreads)              out << ":MALLREADS";
+  if (options_.OUTPUT_GLS == 1)      out << ":GL";
+  if (options_.OUTPUT_PLS == 1)      out << ":PL";
+  if (output_phased_gl)              out << ":PHASEDGL";
+  if (output_hap_data)               out << ":HQ:PHQ";
+  if (options_.OUTPUT_FILTERS == 1)  out << ":FILTER";
+
+  // Build the missing genotype string
+  // Exclude OUTPUT_FILTERS, as we won't use that to build the missing genotype string
+  num_fields += (bias_stats ? 3 : 0) + (output_mallreads ? 1 : 0) + (output_phased_gl ? 1 : 0) + (output_hap_data ? 2 : 0);
+  num_fields += options_.OUTPUT_ALLREADS + options_.OUTPUT_GLS + options_.OUTPUT_PLS;
+  std::stringstream empty_gt;
+  for (int n = 0; n < num_fields; n++)
+    empty_gt << ".:";
+  return empty_gt.str();
+}
+
+void Genotyper::write_vcf_likelihoods(int sample_index, const std::vector<int>& new_to_old, const FlatMatrix<double>& gls,
+				      const FlatMatrix<int>& pls, const FlatMatrix<double>& phased_gls, std::ostream& out) const {
+  int num_variants = new_to_old.size();
+  if (haploid_){
+    if (options_.OUTPUT_GLS == 1){
+      out << ":" << gls[sample_index][0];
+      for (int i = 1; i < num_variants; i++)
+	out << "," << gls[sample_index][new_to_old[i]];
     }
-    else {
-      gl_nconfig_corr  = int_log(2) + 2*(int_log(num_alleles_) - int_log(num_variants));
-      pgl_nconfig_corr = 2*(int_log(num_alleles_) - int_log(num_variants));
+
+    if (options_.OUTPUT_PLS == 1){
+      out << ":" << pls[sample_index][0];
+      for (int i = 1; i < num_variants; i++)
+	out << "," << pls[sample_index][new_to_old[i]];
     }
+    return;
+  }
 
-    // Average the GLs and PHASEDGLs across all haplotype configurations
-    int gt_index = 0;
-    for (int index_1 = 0; index_1 < num_variants; ++index_1){
-      for (int index_2 = 0; index_2 < num_variants; ++index_2, ++gt_index){
-	int alt_gt_index   = index_2*num_variants + index_1;
-	double gl_ll_corr  = (index_1 == index_2 ? hom_ll_correction : het_ll_correction) + gl_nconfig_corr;
-	double pgl_ll_corr = (index_1 == index_2 ? hom_ll_correction : het_ll_correction) + pgl_nconfig_corr;
-	for (int sample_index = 0; sample_index < num_samples_; sample_index++){
-	  if ((index_2 <= index_1) && (!haploid_ || (index_1 == index_2))){
-	    double gl_base_e = sample_total_LLs_[sample_index] - gl_ll_corr + fast_log_sum_exp(total_log_phased_posteriors[sample_index][gt_index],
-											       total_log_phased_posteriors[sample_index][alt_gt_index]);
-	    gls[sample_index].push_back(gl_base_e*LOG_E_BASE_10); // Convert from ln to log10
-	  }
-	  if (calc_phased_gls && (!haploid_ || (index_1 == index_2)))
-	    phased_gls[sample_index].push_back((sample_total_LLs_[sample_index] - pgl_ll_corr + total_log_phased_posteriors[sample_index][gt_index])*LOG_E_BASE_10);
-	}
+  if (options_.OUTPUT_GLS == 1){
+    out << ":" << gls[sample_index][0];
+    for (int i = 1; i < num_variants; i++){
+      for (int j = 0; j <= i; j++){
+	int index_a = std::min(new_to_old[i], new_to_old[j]);
+	int index_b = std::max(new_to_old[i], new_to_old[j]);
+	out << "," << gls[sample_index][index_b*(index_b+1)/2 + index_a];
       }
     }
+  }
 
-    // GLDIFFs
-    for (int sample_index = 0; sample_index < num_samples_; sample_index++)
-      gl_diffs.push_back(calc_gl_diff(gls[sample_index], best_gts[sample_index].first, best_gts[sample_index].second));
-
-    // PLs
-    if (calc_pls){
-      pls = std::vector< std::vector<int> >(num_samples_);
-      for (int sample_index = 0; sample_index < num_samples_; sample_index++)
-	calc_PLs(gls[sample_index], pls[sample_index]);
+  if (options_.OUTPUT_PLS == 1){
+    out << ":" << pls[sample_index][0];
+    for (int i = 1; i < num_variants; i++){
+      for (int j = 0; j <= i; j++){
+	int index_a = std::min(new_to_old[i], new_to_old[j]);
+	int index_b = std::max(new_to_old[i], new_to_old[j]);
+	out << "," << pls[sample_index][index_b*(index_b+1)/2 + index_a];
+      }
     }
+  }
 
-    if (!calc_gls)
-      gls.clear();
+  if (options_.OUTPUT_PHASED_GLS == 1){
+    out << ":" << phased_gls[sample_index][0];
+    for (int i = 0; i < num_variants; i++){
+      for (int j = 0; j < num_variants; j++){
+	if (i == 0 && j == 0)
+	  continue;
+	out << "," << phased_gls[sample_index][new_to_old[i]*num_variants + new_to_old[j]];
+      }
+    }
   }
 }
 
-std::string Genotyper::get_vcf_header(const std::string& fasta_path, const std::string& full_command, const std::vector<std::string>& chroms, const std::vector<std::string>& sample_names){
+void Genotyper::log_filter_reasons(const std::map<std::string, int>& filter_reasons, std::ostream& logger) const {
+  if (filter_reasons.empty())
+    return;
+  int32_t filt_count = 0;
+  for (auto filter_iter = filter_reasons.begin(); filter_iter != filter_reasons.end(); filter_iter++)
+    filt_count += filter_iter->second;
+  logger << "Filtered " << filt_count << " sample genotypes for the following reasons:\t";
+  for (auto filter_iter = filter_reasons.begin(); filter_iter != filter_reasons.end(); filter_iter++)
+    logger << filter_iter->second << "=" << filter_iter->first << "\t";
+  logger << std::endl;
+}
+
+std::string Genotyper::get_vcf_header(const GenotyperOptions& options, const std::string& fasta_path, const std::string& full_command, const std::vector<std::string>& chroms, const std::vector<std::string>& sample_names){
   std::stringstream out;
   out << "##fileformat=VCFv4.1" << "\n"
       << "##command="   << full_command << "\n"
@@ -298,23 +515,23 @@ std::string Genotyper::get_vcf_header(const std::string& fasta_path, const std::
       << "where 0 is no bias and more negative values are increasingly biased. 0 for all homozygous genotypes" << "\">" << "\n"
       << "##FORMAT=<ID=" << "DAB"         << ",Number=1,Type=Integer,Description=\"" << "Number of reads used in the AB and FS calculations" << "\">" << "\n";
 
-  if (OUTPUT_HAPLOTYPE_DATA == 1)
+  if (options.OUTPUT_HAPLOTYPE_DATA == 1)
     out << "##FORMAT=<ID=" << "HQ"  << ",Number=1,Type=Float,Description=\"" << "Posterior probability of unphased haplotypes" << "\">" << "\n"
 	<< "##FORMAT=<ID=" << "PHQ" << ",Number=1,Type=Float,Description=\"" << "Posterior probability of phased haplotypes"   << "\">" << "\n";
-  if (OUTPUT_ALLREADS == 1)
+  if (options.OUTPUT_ALLREADS == 1)
     out << "##FORMAT=<ID=" << "ALLREADS" << ",Number=1,Type=String,Description=\"" << "Base pair difference observed in each read's Needleman-Wunsch alignment" << "\">" << "\n";
-  if (OUTPUT_MALLREADS == 1)
+  if (options.OUTPUT_MALLREADS == 1)
     out << "##FORMAT=<ID=" << "MALLREADS" << ",Number=1,Type=String,Description=\""
 	<< "Maximum likelihood bp diff in each read based on haplotype alignments for reads that span the repeat region by at least 5 base pairs" << "\">" << "\n";
-  if (OUTPUT_GLS == 1)
+  if (options.OUTPUT_GLS == 1)
     out << "##FORMAT=<ID=" << "GL" << ",Number=G,Type=Float,Description=\"" << "log10 genotype likelihoods" << "\">" << "\n";
-  if (OUTPUT_PLS == 1)
+  if (options.OUTPUT_PLS == 1)
     out << "##FORMAT=<ID=" << "PL" << ",Number=G,Type=Integer,Description=\"" << "Phred-scaled genotype likelihoods" << "\">" << "\n";
-  if (OUTPUT_PHASED_GLS == 1)
+  if (options.OUTPUT_PHASED_GLS == 1)
     out << "##FORMAT=<ID=" << "PHASEDGL" << ",Number=.,Type=Float,Description=\""
 	<< "log10 genotype likelihood for each phased genotype. Value for phased genotype X|Y is stored at a 0-based index of X*A + Y, where A is the number of alleles. Not applicable to haploid genotypes"
 	<< "\">" << "\n";
-  if (OUTPUT_FILTERS == 1)
+  if (options.OUTPUT_FILTERS == 1)
     out << "##FORMAT=<ID=" << "FILTER" << ",Number=1,Type=String,Description=\"" << "Reason for filtering the current call, or PASS if the call was not filtered" << "\">" << "\n";
 
   // Sample names
@@ -325,13 +542,3 @@ std::string Genotyper::get_vcf_header(const std::string& fasta_path, const std::
   return out.str();
 
 }
-
-// Default settings for VCF output
-int Genotyper::OUTPUT_GLS             = 0;
-int Genotyper::OUTPUT_PLS             = 0;
-int Genotyper::OUTPUT_PHASED_GLS      = 0;
-int Genotyper::OUTPUT_ALLREADS        = 1;
-int Genotyper::OUTPUT_MALLREADS       = 1;
-int Genotyper::OUTPUT_FILTERS         = 0;
-int Genotyper::OUTPUT_HAPLOTYPE_DATA  = 0;
-float Genotyper::MAX_FLANK_INDEL_FRAC = 0.15;
@@ -9,7 +9,12 @@
 #include <string>
 #include <vector>
 
+#include "flat_matrix.h"
+#include "genotyper_options.h"
 #include "mathops.h"
+#include "perf_counters.h"
+#include "region.h"
+#include "stutter_model.h"
 
 class Genotyper {
  private:
@@ -24,6 +29,7 @@ class Genotyper {
   double* log_p1_, *log_p2_;  // Log of SNP phasing likelihoods for each read
   int* sample_label_;         // Sample index for each read
   bool haploid_;              // True iff the underlying marker is haploid
+  const GenotyperOptions options_;  // Per-run output and extraction settings
 
   std::vector<std::string> sample_names_;      // List of sample names
   std::map<std::string, int> sample_indices_;  // Mapping from sample name to index
@@ -37,8 +43,9 @@ class Genotyper {
   // Total log-likelihoods for each sample
   double* sample_total_LLs_;
 
-  // Total time spent computing posteriors (seconds)
+  // Total time spent computing posteriors and extracting genotypes from them (seconds)
   double total_posterior_time_;
+  PerfCounts posterior_counts_;
 
   // Read weights used to calculate posteriors (See calc_log_sample_posteriors function)
   // Used to account for special cases in which both reads in a pair overlap the STR by setting
@@ -75,14 +82,71 @@ class Genotyper {
     return calc_log_sample_posteriors(read_weights_);
   }
 
-  // Determine the genotype associated with each sample based on the current genotype posteriors
-  void get_optimal_haplotypes(std::vector< std::pair<int, int> >& gts) const;
+  // Determine the most probable pair of haplotypes for each sample based on the current posteriors.
+  // Uses the same kernels as extract_genotypes_and_likelihoods, but discards the posteriors and likelihoods
+  void extract_best_haplotypes(std::vector< std::pair<int, int> >& best_haplotypes);
+
+  // Helpers that write the portions of a VCF record shared by all genotypers. Alleles, their bp differences
+  // and their counts must already be in VCF order, in which the reference allele is first
+
+  // Write the CHROM through FILTER columns, followed by the INFO items for the stutter model and the locus (up to and including BPDIFFS)
+  void write_vcf_site_info(const Region& region, int32_t pos, const std::vector<std::string>& alleles, const std::vector<int>& allele_bp_diffs,
+			   const StutterModel* stutter_model, int skip_count, int filt_count, std::ostream& out) const;
+
+  // Write the AN, REFAC and AC INFO items
+  void write_vcf_allele_counts(int allele_number, const std::vector<int>& allele_counts, std::ostream& out) const;
+
+  // Write the FORMAT column and return the string of empty values that precedes a filtered sample's FILTER value.
+  // STUTTER_DEPTHS adds DSTUTTER and DFLANKINDEL, BIAS_STATS adds AB, DAB and FS, and HAPLOTYPE_FIELDS permits the
+  // MALLREADS, HQ and PHQ fields if they were requested
+  std::string write_vcf_format(bool stutter_depths, bool bias_stats, bool haplotype_fields, std::ostream& out) const;
+
+  // Write a sample's requested GL, PL and PHASEDGL fields. NEW_TO_OLD contains the index of each allele in VCF order
+  // within the genotyper's alleles, which the likelihoods are indexed by
+  void write_vcf_likelihoods(int sample_index, const std::vector<int>& new_to_old, const FlatMatrix<double>& gls,
+			     const FlatMatrix<int>& pls, const FlatMatrix<double>& phased_gls, std::ostream& out) const;
+
+  // Log the number of sample genotypes removed by each filter
+  void log_filter_reasons(const std::map<std::string, int>& filter_reasons, std::ostream& logger) const;
+
+  // Compute a sample's GLs and, if PHASED_GLS is not NULL, its PHASEDGLs using its log-posteriors for each phased genotype
+  void calc_sample_gls(int sample_index, int num_variants, const double* log_phased_posteriors, double* gls, double* phased_gls) const;
+
+  // Compute a sample's GLs, GLDIFF and optionally its PLs and PHASEDGLs, storing them in the sample's rows of the preallocated outputs.
+  // The optional fields are template parameters so that the per-sample loops don't test the output settings for every sample
+  template<bool CALC_PLS, bool CALC_PHASED_GLS>
+  void calc_sample_likelihoods(int sample_index, int num_variants, const double* log_phased_posteriors, int gt_a, int gt_b,
+			       FlatMatrix<double>& gls, std::vector<double>& gl_diffs, FlatMatrix<int>& pls, FlatMatrix<double>& phased_gls) const;
+
+  // Kernels for extract_genotypes_and_likelihoods that process the samples in [START, END). Each output must already be sized
+  // for all samples, and a kernel only writes the entries for its samples, so disjoint ranges can be processed concurrently
+  template<bool CALC_PLS, bool CALC_PHASED_GLS>
+  void extract_dense_sample_range(int start, int end, int num_variants, const std::vector<int>& hap_to_allele,
+				  const std::vector<int>& diplotype_to_gt, bool identity_map,
+				  std::vector< std::pair<int,int>  >& best_haplotypes,
+				  std::vector< std::pair<int,int>  >& best_gts,
+				  std::vector<double>& log_phased_posteriors,     std::vector<double>& log_unphased_posteriors,
+				  std::vector<double>& hap_log_phased_posteriors, std::vector<double>& hap_log_unphased_posteriors,
+				  bool need_gls, FlatMatrix<double>& gls, std::vector<double>& gl_diffs,
+				  FlatMatrix<int>& pls, FlatMatrix<double>& phased_gls) const;
+
+  // Process all samples using extract_dense_sample_range, dividing them among the available threads.
+  // Adds the performance counts of all the threads to THREAD_COUNTS
+  template<bool CALC_PLS, bool CALC_PHASED_GLS>
+  void extract_sample_ranges(int num_variants, const std::vector<int>& hap_to_allele,
+			     const std::vector<int>& diplotype_to_gt, bool identity_map,
+			     std::vector< std::pair<int,int>  >& best_haplotypes,
+			     std::vector< std::pair<int,int>  >& best_gts,
+			     std::vector<double>& log_phased_posteriors,     std::vector<double>& log_unphased_posteriors,
+			     std::vector<double>& hap_log_phased_posteriors, std::vector<double>& hap_log_unphased_posteriors,
+			     bool need_gls, FlatMatrix<double>& gls, std::vector<double>& gl_diffs,
+			     FlatMatrix<int>& pls, FlatMatrix<double>& phased_gls, PerfCounts& thread_counts) const;
 
  public:
-  Genotyper(bool haploid,
+  Genotyper(const GenotyperOptions& options, bool haploid,
 	    const std::vector<std::string>& sample_names,
 	    const std::vector< std::vector<double> >& log_p1,
-	    const std::vector< std::vector<double> >& log_p2){
+	    const std::vector< std::vector<double> >& log_p2) : options_(options){
     assert(log_p1.size() == log_p2.size() && log_p1.size() == sample_names.size());
     num_reads_ = 0;
     for (unsigned int i = 0; i < log_p1.size(); i++)
@@ -130,32 +194,25 @@ class Genotyper {
   }
 
   double posterior_time() const { return total_posterior_time_;  }
+  const PerfCounts& posterior_counts() const { return posterior_counts_; }
 
-  static std::string get_vcf_header(const std::string& fasta_path, const std::string& full_command, const std::vector<std::string>& chroms, const std::vector<std::string>& sample_names);
+  static std::string get_vcf_header(const GenotyperOptions& options, const std::string& fasta_path, const std::string& full_command, const std::vector<std::string>& chroms, const std::vector<std::string>& sample_names);
 
-  void calc_PLs(const std::vector<double>& gls, std::vector<int>& pls) const;
+  void calc_PLs(const double* gls, int num_gls, int* pls) const;
 
-  double calc_gl_diff(const std::vector<double>& gls, int gt_a, int gt_b) const;
+  double calc_gl_diff(const double* gls, int num_gls, int gt_a, int gt_b) const;
+
+  // Each sample's GLs, PLs and PHASEDGLs are stored in the corresponding row of the matrices.
+  // Samples are processed in parallel using up to the options' NUM_THREADS threads
 
   void extract_genotypes_and_likelihoods(int num_variants, std::vector<int>& hap_to_allele,
 					 std::vector< std::pair<int,int>  >& best_haplotypes,
 					 std::vector< std::pair<int,int>  >& best_gts,
 					 std::vector<double>& log_phased_posteriors,     std::vector<double>& log_unphased_posteriors,
 					 std::vector<double>& hap_log_phased_posteriors, std::vector<double>& hap_log_unphased_posteriors,
-					 bool calc_gls,        std::vector< std::vector<double> >& gls, std::vector<double>& gl_diffs,
-					 bool calc_pls,        std::vector< std::vector<int> >& pls,
-					 bool calc_phased_gls, std::vector< std::vector<double> >& phased_gls);
-
-  // Parameters that control what is output to the VCF
-  static int OUTPUT_GLS;              // Output the GL FORMAT field
-  static int OUTPUT_PLS;              // Output the PL FORMAT field
-  static int OUTPUT_PHASED_GLS;       // Output the PHASEDGL FORMAT field
-  static int OUTPUT_ALLREADS;         // Output the ALLREADS  FORMAT field
-  static int OUTPUT_MALLREADS;        // Output the MALLREADS FORMAT field
-  static int OUTPUT_FILTERS;          // Output the FILTERS FORMAT field
-  static float MAX_FLANK_INDEL_FRAC;  // Only output genotypes if the fraction of a sample's reads with
-                                      // indels in the flank is less than this threshold
-  static int OUTPUT_HAPLOTYPE_DATA;   // Output information about the haplotypes (in addition to the genotypes)
+					 bool calc_gls,        FlatMatrix<double>& gls, std::vector<double>& gl_diffs,
+					 bool calc_pls,        FlatMatrix<int>& pls,
+					 bool calc_phased_gls, FlatMatrix<double>& phased_gls);
 };
 
 #endif
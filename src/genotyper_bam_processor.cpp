@@ -1,35 +1,17 @@
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <time.h>
 
 //#include "sys/sysinfo.h"
 //#include "sys/types.h"
 
-#include "extract_indels.h"
 #include "genotyper_bam_processor.h"
+#include "locus_genotyper.h"
+#include "status_reporter.h"
+#include "version.h"
+#include "SeqAlignment/HaplotypeGenerator.h"
 
-int parseLine(char* line){
-  int i = strlen(line);
-  while (*line < '0' || *line > '9') line++;
-  line[i-3] = '\0';
-  i = atoi(line);
-  return i;
-}
-
-int getUsedPhysicalMemoryKB(){
-  FILE* file = fopen("/proc/self/status", "r");
-  int result = -1;
-  char line[128];
-
-  while (fgets(line, 128, file) != NULL){
-    if (strncmp(line, "VmRSS:", 6) == 0){
-      result = parseLine(line);
-      break;
-    }
-  }
-  fclose(file);
-  return result;
-}
 
 /*
   Left align BamAlignments in the provided vector and store those that successfully realign in the provided vector.
@@ -38,64 +20,19 @@ int getUsedPhysicalMemoryKB(){
 void GenotyperBamProcessor::left_align_reads(const RegionGroup& region_group, const std::string& chrom_seq, std::vector<BamAlnList>& alignments,
 					     const std::vector< std::vector<double> >& log_p1, const std::vector< std::vector<double> >& log_p2,
 					     std::vector< std::vector<double> >& filt_log_p1,  std::vector< std::vector<double> >& filt_log_p2,
-					     std::vector<Alignment>& left_alns){
+					     AlignmentArena& left_alns){
   locus_left_aln_time_ = clock();
+  PerfCounts left_aln_start;
+  PerfCounters::snapshot(left_aln_start);
   selective_logger() << "Left aligning reads" << std::endl;
-  std::map<std::string, int> seq_to_alns;
-  int32_t align_fail_count = 0, total_reads = 0;
-  left_alns.clear(); filt_log_p1.clear(); filt_log_p2.clear();
-
-  std::vector<bool> passes_region_filters; passes_region_filters.reserve(region_group.num_regions());
-  for (unsigned int i = 0; i < alignments.size(); ++i){
-    filt_log_p1.push_back(std::vector<double>());
-    filt_log_p2.push_back(std::vector<double>());
-
-    for (unsigned int j = 0; j < alignments[i].size(); ++j, ++total_reads){
-      // Trim alignment if it extends very far upstream or downstream of the STR. For tractability, we limit it to 40bp
-      alignments[i][j].TrimAlignment((region_group.start() > 40 ? region_group.start()-40 : 1), region_group.stop()+40);
-      if (alignments[i][j].Length() == 0)
-        continue;
-
-      auto iter      = seq_to_alns.find(alignments[i][j].QueryBases());
-      bool have_prev = (iter != seq_to_alns.end());
-      if (have_prev)
-        have_prev &= left_alns[iter->second].get_sequence().size() == alignments[i][j].QueryBases().size();
-
-      if (!have_prev){
-        left_alns.push_back(Alignment(alignments[i][j].Name()));
-        if (alignments[i][j].MatchesReference())
-          convertAlignment(alignments[i][j], chrom_seq, left_alns.back());
-        else if (!realign(alignments[i][j], chrom_seq, left_alns.back())){
-	  // Failed to realign read
-          align_fail_count++;
-          left_alns.pop_back();
-          continue;
-	}
-	seq_to_alns[alignments[i][j].QueryBases()] = left_alns.size()-1;
-      }
-      else {
-        // Reuse alignments if the sequence has already been observed and didn't lead to a soft-clipped alignment
-        // Soft-clipping is problematic because it complicates base quality extration (but not really that much)
-        Alignment& prev_aln = left_alns[iter->second];
-        assert(prev_aln.get_sequence().size() == alignments[i][j].QueryBases().size());
-	std::string bases = uppercase(alignments[i][j].QueryBases());
-        Alignment new_aln(prev_aln.get_start(), prev_aln.get_stop(), alignments[i][j].IsReverseStrand(), alignments[i][j].Name(), alignments[i][j].Qualities(), bases, prev_aln.get_alignment());
-        new_aln.set_cigar_list(prev_aln.get_cigar_list());
-        left_alns.push_back(new_aln);
-      }
-
-      left_alns.back().check_CIGAR_string(); // Ensure alignment is properly formatted
-      filt_log_p1[i].push_back(log_p1[i][j]);
-      filt_log_p2[i].push_back(log_p2[i][j]);
-
-      passes_region_filters.clear();
-      BamProcessor::passes_filters(alignments[i][j], passes_region_filters);
-      left_alns.back().set_hap_gen_info(passes_region_filters);
-    }
-  }
+  int32_t flank = (long_reads_ ? LONG_READ_FLANK : 40), total_reads;
+  int32_t align_fail_count = left_align_sample_reads(region_group, chrom_seq, flank, alignments, log_p1, log_p2,
+						     filt_log_p1, filt_log_p2, left_alns, total_reads);
 
   locus_left_aln_time_  = (clock() - locus_left_aln_time_)/CLOCKS_PER_SEC;
   total_left_aln_time_ += locus_left_aln_time_;
+  locus_left_aln_counts_.clear();
+  locus_left_aln_counts_.add_since(left_aln_start);
   if (align_fail_count != 0)
     selective_logger() << "Failed to left align " << align_fail_count << " out of " << total_reads << " reads" << std::endl;
 }
@@ -104,32 +41,10 @@ StutterModel* GenotyperBamProcessor::learn_stutter_model(std::vector<BamAlnList>
 							 const std::vector< std::vector<double> >& log_p1s,
 							 const std::vector< std::vector<double> >& log_p2s,
 							 bool haploid, const std::vector<std::string>& rg_names, const Region& region){
-  std::vector< std::vector<int> > str_bp_lengths(alignments.size());
-  std::vector< std::vector<double> > str_log_p1s(alignments.size()), str_log_p2s(alignments.size());
-  int inf_reads = 0;
+  std::vector< std::vector<int> > str_bp_lengths;
+  std::vector< std::vector<double> > str_log_p1s, str_log_p2s;
   const int MAX_INF_READS = 10000;
-
-  // Extract bp differences and phasing probabilities for each read if we need to train a stutter model
-  for (unsigned int i = 0; i < alignments.size(); ++i){
-    for (unsigned int j = 0; j < alignments[i].size(); ++j){
-      int bp_diff;
-      bool got_size = ExtractCigar(alignments[i][j].CigarData(), alignments[i][j].Position(), region.start()-region.period(), region.stop()+region.period(), bp_diff);
-      if (got_size){
-	if (bp_diff < -(int)(region.stop()-region.start()+1))
-	  continue;
-	inf_reads++;
-	str_bp_lengths[i].push_back(bp_diff);
-	if (log_p1s.size() == 0){
-	  str_log_p1s[i].push_back(0); str_log_p2s[i].push_back(0); // Assign equal phasing LLs as no SNP info is available
-	}
-	else {
-	  str_log_p1s[i].push_back(log_p1s[i][j]); str_log_p2s[i].push_back(log_p2s[i][j]);
-	}
-      }
-    }
-    if (inf_reads > MAX_INF_READS)
-      break;
-  }
+  int inf_reads = extract_str_lengths(alignments, log_p1s, log_p2s, region, MAX_INF_READS, str_bp_lengths, str_log_p1s, str_log_p2s);
 
   if (inf_reads < MIN_TOTAL_READS){
     full_logger() << "Skipping locus with too few informative reads for stutter training: TOTAL=" << inf_reads << ", MIN=" << MIN_TOTAL_READS << std::endl;
@@ -138,12 +53,17 @@ StutterModel* GenotyperBamProcessor::learn_stutter_model(std::vector<BamAlnList>
   }
 
   selective_logger() << "Building EM stutter model" << std::endl;
-  EMStutterGenotyper length_genotyper(haploid, region.period(), str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, 0);
+  EMStutterGenotyper length_genotyper(genotyper_options_, haploid, region.period(), str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, 0);
   selective_logger() << "Training EM stutter model" << std::endl;
   bool trained = length_genotyper.train(MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE, false, selective_logger());
   if (trained){
-    if (output_stutter_models_)
-      length_genotyper.get_stutter_model()->write_model(region.chrom(), region.start(), region.stop(), stutter_model_out_);
+    if (output_stutter_models_){
+      std::stringstream model_text;
+      length_genotyper.get_stutter_model()->write_model(region.chrom(), region.start(), region.stop(), model_text);
+      stutter_model_out_ << model_text.str();
+      if (locus_cache_ != NULL)
+	locus_cache_entry_.stutter_text += model_text.str();
+    }
     num_em_converge_++;
     StutterModel* stutter_model = length_genotyper.get_stutter_model()->copy();
     selective_logger() << "Learned stutter model " << *stutter_model;
@@ -157,10 +77,61 @@ StutterModel* GenotyperBamProcessor::learn_stutter_model(std::vector<BamAlnList>
   }
 }
 
+bool GenotyperBamProcessor::genotype_str_lengths(std::vector<BamAlnList>& alignments,
+						 const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+						 bool haploid, const std::vector<std::string>& rg_names, const RegionGroup& region_group,
+						 const std::string& chrom_seq, const std::vector<StutterModel*>& stutter_models){
+  const std::vector<Region>& regions = region_group.regions();
+  assert(stutter_models.size() == regions.size());
+
+  // Ensure that every region has informative reads before writing any records
+  std::vector< std::vector< std::vector<int> > > str_bp_lengths(regions.size());
+  std::vector< std::vector< std::vector<double> > > str_log_p1s(regions.size()), str_log_p2s(regions.size());
+  for (unsigned int i = 0; i < regions.size(); i++){
+    extract_str_lengths(alignments, log_p1s, log_p2s, regions[i], -1, str_bp_lengths[i], str_log_p1s[i], str_log_p2s[i]);
+
+    // Discard reads whose deletions exceed the reference allele's length, as they would imply an allele of negative length
+    int32_t ref_len = regions[i].stop() - regions[i].start();
+    int inf_reads   = 0;
+    for (unsigned int j = 0; j < str_bp_lengths[i].size(); j++){
+      unsigned int num_kept = 0;
+      for (unsigned int k = 0; k < str_bp_lengths[i][j].size(); k++){
+	if (str_bp_lengths[i][j][k] < -ref_len)
+	  continue;
+	str_bp_lengths[i][j][num_kept] = str_bp_lengths[i][j][k];
+	str_log_p1s[i][j][num_kept]    = str_log_p1s[i][j][k];
+	str_log_p2s[i][j][num_kept]    = str_log_p2s[i][j][k];
+	num_kept++;
+      }
+      str_bp_lengths[i][j].resize(num_kept);
+      str_log_p1s[i][j].resize(num_kept);
+      str_log_p2s[i][j].resize(num_kept);
+      inf_reads += num_kept;
+    }
+
+    if (inf_reads == 0){
+      selective_logger() << "No reads span the STR at " << regions[i].chrom() << ":" << regions[i].start() << "-" << regions[i].stop() << std::endl;
+      return false;
+    }
+  }
+
+  selective_logger() << "Genotyping STR lengths using the EM genotyper" << std::endl;
+  for (unsigned int i = 0; i < regions.size(); i++){
+    EMStutterGenotyper length_genotyper(genotyper_options_, haploid, regions[i].period(), str_bp_lengths[i], str_log_p1s[i], str_log_p2s[i], rg_names, 0);
+    length_genotyper.genotype(stutter_models[i]);
+    length_genotyper.write_vcf_record(samples_to_genotype_, regions[i], chrom_seq, &vcf_writer_,
+				      (gt_matrix_writer_.is_open() ? &gt_matrix_writer_ : NULL), selective_logger());
+  }
+  return true;
+}
+
 void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& alignments,
 						      std::vector< std::vector<double> >& log_p1s,
 						      std::vector< std::vector<double> >& log_p2s,
 						      const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq){
+  if (capture_writer_ != NULL)
+    capture_locus(alignments, log_p1s, log_p2s, rg_names, region_group, chrom_seq);
+
   int32_t total_reads = 0;
   for (unsigned int i = 0; i < alignments.size(); i++)
     total_reads += alignments[i].size();
@@ -177,6 +148,67 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
     return;
   }
 
+  if (!batching_loci()){
+    genotype_locus(alignments, log_p1s, log_p2s, rg_names, region_group, chrom_seq,
+		   locus_bam_seek_time(), locus_read_filter_time(), locus_snp_phase_info_time());
+    return;
+  }
+  if (!locus_batch_.empty() && locus_batch_.back()->region_group.chrom().compare(region_group.chrom()) != 0)
+    printErrorAndDie("Batched loci must be located on the same chromosome");
+
+  // Take ownership of the locus' reads, as the caller discards them once this function returns
+  BatchedLocus* locus = new BatchedLocus(region_group);
+  locus->rg_names = rg_names;
+  locus->alignments.swap(alignments);
+  locus->log_p1s.swap(log_p1s);
+  locus->log_p2s.swap(log_p2s);
+  locus->bam_seek_time       = locus_bam_seek_time();
+  locus->read_filter_time    = locus_read_filter_time();
+  locus->snp_phase_info_time = locus_snp_phase_info_time();
+
+  // Buffer all subsequent log messages until the batch has been genotyped, so that they can be placed after the locus' messages
+  if (locus_batch_.empty())
+    log_buffer_ = &batch_log_;
+  locus->log_offset = batch_log_.tellp();
+  locus_batch_.push_back(locus);
+
+  if ((int)locus_batch_.size() >= LOCUS_BATCH_SIZE || total_reads > MAX_BATCH_LOCUS_READS)
+    process_locus_batch(chrom_seq);
+}
+
+void GenotyperBamProcessor::process_locus_batch(const std::string& chrom_seq){
+  if (locus_batch_.empty())
+    return;
+
+  num_batches_++;
+  std::string pending_log = batch_log_.str(), batch_log;
+  size_t log_start = 0;
+  std::ostringstream locus_log;
+  for (unsigned int i = 0; i < locus_batch_.size(); i++){
+    BatchedLocus* locus = locus_batch_[i];
+    batch_log.append(pending_log, log_start, locus->log_offset-log_start);
+    log_start = locus->log_offset;
+
+    locus_log.str("");
+    log_buffer_ = &locus_log;
+    genotype_locus(locus->alignments, locus->log_p1s, locus->log_p2s, locus->rg_names, locus->region_group, chrom_seq,
+		   locus->bam_seek_time, locus->read_filter_time, locus->snp_phase_info_time);
+    batch_log += locus_log.str();
+    delete locus;
+  }
+  batch_log.append(pending_log, log_start, std::string::npos);
+  locus_batch_.clear();
+  batch_log_.str("");
+  log_buffer_ = NULL;
+
+  // Write the log messages for the entire batch at once
+  full_logger() << batch_log << std::flush;
+}
+
+void GenotyperBamProcessor::genotype_locus(std::vector<BamAlnList>& alignments,
+					   std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+					   const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq,
+					   double bam_seek_time, double read_filter_time, double snp_phase_info_time){
   assert(alignments.size() == log_p1s.size() && alignments.size() == log_p2s.size() && alignments.size() == rg_names.size());
   bool haploid = (haploid_chroms_.find(region_group.chrom()) != haploid_chroms_.end());
   const std::vector<Region>& regions = region_group.regions();
@@ -218,15 +250,23 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
   // Genotype the regions, if requested
   locus_genotype_time_ = clock();
   SeqStutterGenotyper* seq_genotyper = NULL;
-  if (vcf_writer_.is_open() && stutter_success) {
-    std::vector<Alignment> left_alignments;
+  if (length_only_ && vcf_writer_.is_open() && stutter_success){
+    if (genotype_str_lengths(alignments, log_p1s, log_p2s, haploid, rg_names, region_group, chrom_seq, stutter_models))
+      num_genotype_success_++;
+    else
+      num_genotype_fail_++;
+  }
+  else if (vcf_writer_.is_open() && stutter_success) {
+    AlignmentArena left_alignments;
     std::vector< std::vector<double> > filt_log_p1s, filt_log_p2s;
     left_align_reads(region_group, chrom_seq, alignments, log_p1s, log_p2s, filt_log_p1s,
 		     filt_log_p2s, left_alignments);
 
+    // The genotyper takes ownership of the arena's contents
     bool run_assembly = (REQUIRE_SPANNING == 0);
-    seq_genotyper = new SeqStutterGenotyper(region_group, haploid, run_assembly, left_alignments, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq,
+    seq_genotyper = new SeqStutterGenotyper(genotyper_options_, region_group, haploid, run_assembly, left_alignments, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq,
 					    stutter_models, ref_vcf_, selective_logger(),skip_assembly_);
+    seq_genotyper->set_aligner_workspace(&aligner_workspace_);
 
     if (seq_genotyper->genotype(MAX_TOTAL_HAPLOTYPES, MAX_FLANK_HAPLOTYPES, MIN_FLANK_FREQ, selective_logger())) {
       bool pass = true;
@@ -238,7 +278,17 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
 
       if (pass){
 	num_genotype_success_++;
-	seq_genotyper->write_vcf_record(samples_to_genotype_, chrom_seq, output_viz_, (VIZ_LEFT_ALNS == 1), viz_out_, &vcf_writer_, selective_logger());
+	if (locus_cache_ != NULL && output_viz_){
+	  // Buffer the visualization output so that it can also be cached
+	  std::stringstream viz_text;
+	  seq_genotyper->write_vcf_record(samples_to_genotype_, chrom_seq, output_viz_, (VIZ_LEFT_ALNS == 1), viz_text, &vcf_writer_,
+					  (gt_matrix_writer_.is_open() ? &gt_matrix_writer_ : NULL), selective_logger());
+	  viz_out_ << viz_text.str();
+	  locus_cache_entry_.viz_text += viz_text.str();
+	}
+	else
+	  seq_genotyper->write_vcf_record(samples_to_genotype_, chrom_seq, output_viz_, (VIZ_LEFT_ALNS == 1), viz_out_, &vcf_writer_,
+					  (gt_matrix_writer_.is_open() ? &gt_matrix_writer_ : NULL), selective_logger());
       }
       else
 	num_genotype_fail_++;
@@ -250,13 +300,13 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
   total_genotype_time_ += locus_genotype_time_;
 
   selective_logger() << "Locus timing:"                                          << "\n"
-		     << " BAM seek time       = " << locus_bam_seek_time()       << " seconds\n"
-		     << " Read filtering      = " << locus_read_filter_time()    << " seconds\n"
-		     << " SNP info extraction = " << locus_snp_phase_info_time() << " seconds\n"
+		     << " BAM seek time       = " << bam_seek_time               << " seconds\n"
+		     << " Read filtering      = " << read_filter_time            << " seconds\n"
+		     << " SNP info extraction = " << snp_phase_info_time         << " seconds\n"
 		     << " Stutter estimation  = " << locus_stutter_time()        << " seconds\n";
   if (stutter_success && vcf_writer_.is_open()){
     selective_logger() << " Genotyping          = " << locus_genotype_time()       << " seconds\n";
-    if (vcf_writer_.is_open()){
+    if (!length_only_){
       assert(seq_genotyper != NULL);
       selective_logger() << "\t" << " Left alignment        = "  << locus_left_aln_time_             << " seconds\n"
 			 << "\t" << " Haplotype generation  = "  << seq_genotyper->hap_build_time()  << " seconds\n"
@@ -271,6 +321,18 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
       process_timer_.add_time("Flank assembly",        seq_genotyper->assembly_time());
       process_timer_.add_time("Posterior computation", seq_genotyper->posterior_time());
       process_timer_.add_time("Alignment traceback",   seq_genotyper->aln_trace_time());
+
+      if (PerfCounters::enabled()){
+	log_stage_counts(selective_logger(), "Locus hardware performance counters", locus_left_aln_counts_,
+			 seq_genotyper->hap_build_counts(), seq_genotyper->hap_aln_counts(), seq_genotyper->assembly_counts(),
+			 seq_genotyper->posterior_counts(), seq_genotyper->aln_trace_counts());
+	process_timer_.add_counts("Left alignment",        locus_left_aln_counts_);
+	process_timer_.add_counts("Haplotype generation",  seq_genotyper->hap_build_counts());
+	process_timer_.add_counts("Haplotype alignment",   seq_genotyper->hap_aln_counts());
+	process_timer_.add_counts("Flank assembly",        seq_genotyper->assembly_counts());
+	process_timer_.add_counts("Posterior computation", seq_genotyper->posterior_counts());
+	process_timer_.add_counts("Alignment traceback",   seq_genotyper->aln_trace_counts());
+      }
     }
   }
 
@@ -285,3 +347,263 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector<BamAlnList>& a
   for (int i = 0; i < stutter_models.size(); i++)
     delete stutter_models[i];
 }
+
+void GenotyperBamProcessor::log_stage_counts(std::ostream& out, const std::string& title, const PerfCounts& left_aln, const PerfCounts& hap_build,
+					     const PerfCounts& hap_aln, const PerfCounts& assembly, const PerfCounts& posterior, const PerfCounts& aln_trace) const {
+  out << title << ":" << "\n";
+  out << "\t" << " Left alignment        : "; left_aln.write(out);  out << "\n";
+  out << "\t" << " Haplotype generation  : "; hap_build.write(out); out << "\n";
+  out << "\t" << " Haplotype alignment   : "; hap_aln.write(out);   out << "\n";
+  out << "\t" << " Flank assembly        : "; assembly.write(out);  out << "\n";
+  out << "\t" << " Posterior computation : "; posterior.write(out); out << "\n";
+  out << "\t" << " Alignment traceback   : "; aln_trace.write(out); out << "\n";
+}
+
+void GenotyperBamProcessor::describe_parameters(std::ostream& out) const {
+  SNPBamProcessor::describe_parameters(out);
+  out << "MAX_EM_ITER="           << MAX_EM_ITER                     << "\n"
+      << "ABS_LL_CONVERGE="       << ABS_LL_CONVERGE                 << "\n"
+      << "FRAC_LL_CONVERGE="      << FRAC_LL_CONVERGE                << "\n"
+      << "MIN_TOTAL_READS="       << MIN_TOTAL_READS                 << "\n"
+      << "MAX_TOTAL_HAPLOTYPES="  << MAX_TOTAL_HAPLOTYPES            << "\n"
+      << "MAX_FLANK_HAPLOTYPES="  << MAX_FLANK_HAPLOTYPES            << "\n"
+      << "MIN_FLANK_FREQ="        << MIN_FLANK_FREQ                  << "\n"
+      << "VIZ_LEFT_ALNS="         << VIZ_LEFT_ALNS                   << "\n"
+      << "recalc_stutter_model="  << recalc_stutter_model_           << "\n"
+      << "skip_assembly="         << skip_assembly_                  << "\n"
+      << "length_only="           << length_only_                    << "\n"
+      << "output_viz="            << output_viz_                     << "\n"
+      << "output_stutter_models=" << output_stutter_models_          << "\n"
+      << "OUTPUT_GLS="            << genotyper_options_.OUTPUT_GLS           << "\n"
+      << "OUTPUT_PLS="            << genotyper_options_.OUTPUT_PLS           << "\n"
+      << "OUTPUT_PHASED_GLS="     << genotyper_options_.OUTPUT_PHASED_GLS    << "\n"
+      << "OUTPUT_ALLREADS="       << genotyper_options_.OUTPUT_ALLREADS      << "\n"
+      << "OUTPUT_MALLREADS="      << genotyper_options_.OUTPUT_MALLREADS     << "\n"
+      << "OUTPUT_FILTERS="        << genotyper_options_.OUTPUT_FILTERS       << "\n"
+      << "OUTPUT_HAPLOTYPE_DATA=" << genotyper_options_.OUTPUT_HAPLOTYPE_DATA << "\n"
+      << "MAX_FLANK_INDEL_FRAC="  << genotyper_options_.MAX_FLANK_INDEL_FRAC  << "\n"
+      << "MAX_POOL_CORRECTION_ERROR="     << genotyper_options_.MAX_POOL_CORRECTION_ERROR     << "\n"
+      << "MAX_STUTTER_REFIT_ROUNDS="      << genotyper_options_.MAX_STUTTER_REFIT_ROUNDS      << "\n"
+      << "MIN_KMER="                      << genotyper_options_.MIN_KMER                      << "\n"
+      << "MAX_KMER="                      << genotyper_options_.MAX_KMER                      << "\n"
+      << "STRAND_TOLERANCE="              << genotyper_options_.STRAND_TOLERANCE              << "\n";
+  out << "haploid_chroms=";
+  for (auto chrom_iter = haploid_chroms_.begin(); chrom_iter != haploid_chroms_.end(); chrom_iter++)
+    out << *chrom_iter << ",";
+  out << "\n" << "samples=";
+  for (auto sample_iter = samples_to_genotype_.begin(); sample_iter != samples_to_genotype_.end(); sample_iter++)
+    out << *sample_iter << ",";
+  out << "\n";
+}
+
+void GenotyperBamProcessor::describe_status(StatusReport& report) const {
+  SNPBamProcessor::describe_status(report);
+  report.add_outcome("genotyped",             num_genotype_success_);
+  report.add_outcome("genotype_failed",       num_genotype_fail_);
+  report.add_outcome("cached",                num_cached_loci_);
+  report.add_outcome("too_many_reads",        too_many_reads_);
+  report.add_outcome("too_few_reads",         too_few_reads_);
+  report.add_outcome("missing_stutter_model", num_missing_models_);
+  report.add_outcome("stutter_em_failed",     num_em_fail_);
+  report.add_outcome("rejected_missing_stutter_model", num_rejected_models_);
+  report.add_outcome("rejected_repetitive_flanks",     num_rejected_flanks_);
+
+  report.add_stage_time("stutter_estimation",    total_stutter_time_);
+  report.add_stage_time("genotyping",            total_genotype_time_);
+  report.add_stage_time("left_alignment",        process_timer_.get_total_time("Left alignment"));
+  report.add_stage_time("haplotype_generation",  process_timer_.get_total_time("Haplotype generation"));
+  report.add_stage_time("haplotype_alignment",   process_timer_.get_total_time("Haplotype alignment"));
+  report.add_stage_time("flank_assembly",        process_timer_.get_total_time("Flank assembly"));
+  report.add_stage_time("posterior_computation", process_timer_.get_total_time("Posterior computation"));
+  report.add_stage_time("alignment_traceback",   process_timer_.get_total_time("Alignment traceback"));
+}
+
+void GenotyperBamProcessor::set_locus_cache(const std::string& cache_dir, const std::vector<std::string>& input_files,
+					    const std::map<std::string, std::string>& rg_to_sample, const std::map<std::string, std::string>& rg_to_library){
+  if (!gt_matrix_file_.empty())
+    printErrorAndDie("The locus cache cannot be used in conjunction with the genotype matrix output");
+  if (capture_writer_ != NULL)
+    printErrorAndDie("The locus cache cannot be used in conjunction with the locus capture output");
+  if (locus_cache_ != NULL)
+    delete locus_cache_;
+  locus_cache_ = new LocusCache(cache_dir);
+
+  std::stringstream parameters;
+  describe_parameters(parameters);
+  locus_cache_->add_to_fingerprint("version", VERSION);
+  locus_cache_->add_to_fingerprint("parameters", parameters.str());
+  for (auto file_iter = input_files.begin(); file_iter != input_files.end(); file_iter++)
+    locus_cache_->add_input_file(*file_iter);
+  for (auto rg_iter = rg_to_sample.begin(); rg_iter != rg_to_sample.end(); rg_iter++)
+    locus_cache_->add_to_fingerprint("rg_sample", rg_iter->first + "\t" + rg_iter->second);
+  for (auto rg_iter = rg_to_library.begin(); rg_iter != rg_to_library.end(); rg_iter++)
+    locus_cache_->add_to_fingerprint("rg_library", rg_iter->first + "\t" + rg_iter->second);
+}
+
+void GenotyperBamProcessor::get_outcome_counters(std::vector< std::pair<std::string, int*> >& counters){
+  counters.clear();
+  counters.push_back(std::pair<std::string, int*>("too_few_reads",    &too_few_reads_));
+  counters.push_back(std::pair<std::string, int*>("too_many_reads",   &too_many_reads_));
+  counters.push_back(std::pair<std::string, int*>("missing_models",   &num_missing_models_));
+  counters.push_back(std::pair<std::string, int*>("em_converge",      &num_em_converge_));
+  counters.push_back(std::pair<std::string, int*>("em_fail",          &num_em_fail_));
+  counters.push_back(std::pair<std::string, int*>("genotype_success", &num_genotype_success_));
+  counters.push_back(std::pair<std::string, int*>("genotype_fail",    &num_genotype_fail_));
+}
+
+bool GenotyperBamProcessor::load_locus_results(const RegionGroup& region_group, const std::string& chrom_seq){
+  if (locus_cache_ == NULL)
+    return false;
+
+  // Never let a capture armed for a previous locus record this locus' output
+  vcf_writer_.capture_records(NULL);
+  locus_cache_entry_.clear();
+
+  // User-provided stutter models aren't captured by the run's input files, so we include them in each locus' key
+  std::stringstream locus_description;
+  const std::vector<Region>& regions = region_group.regions();
+  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+    if (def_stutter_model_ != NULL)
+      def_stutter_model_->write(locus_description);
+    else if (read_stutter_models_){
+      auto model_iter = stutter_models_.find(*region_iter);
+      if (model_iter != stutter_models_.end())
+	model_iter->second->write(locus_description);
+      else
+	locus_description << "NO_MODEL\n";
+    }
+  }
+  locus_cache_->get_key(region_group, chrom_seq, MAX_MATE_DIST, locus_description.str(), locus_cache_key_);
+
+  if (locus_cache_->load(locus_cache_key_, locus_cache_entry_)){
+    full_logger() << "Reusing cached results for locus" << "\n" << std::endl;
+    num_cached_loci_++;
+    if (vcf_writer_.is_open())
+      for (auto record_iter = locus_cache_entry_.vcf_records.begin(); record_iter != locus_cache_entry_.vcf_records.end(); record_iter++)
+	vcf_writer_.add_vcf_record(region_group.chrom(), record_iter->first, record_iter->second);
+    if (output_stutter_models_)
+      stutter_model_out_ << locus_cache_entry_.stutter_text;
+    if (output_viz_)
+      viz_out_ << locus_cache_entry_.viz_text;
+
+    // Replay the locus' outcome so that the run's summary matches that of the run which cached it
+    std::vector< std::pair<std::string, int*> > counters;
+    get_outcome_counters(counters);
+    for (auto counter_iter = counters.begin(); counter_iter != counters.end(); counter_iter++){
+      auto count_iter = locus_cache_entry_.outcome_counts.find(counter_iter->first);
+      if (count_iter != locus_cache_entry_.outcome_counts.end())
+	*(counter_iter->second) += count_iter->second;
+    }
+    return true;
+  }
+
+  // Capture the locus' results as they're generated
+  locus_cache_entry_.clear();
+  vcf_writer_.capture_records(&(locus_cache_entry_.vcf_records));
+  std::vector< std::pair<std::string, int*> > counters;
+  get_outcome_counters(counters);
+  locus_start_counts_.clear();
+  for (auto counter_iter = counters.begin(); counter_iter != counters.end(); counter_iter++)
+    locus_start_counts_[counter_iter->first] = *(counter_iter->second);
+  return false;
+}
+
+bool GenotyperBamProcessor::reject_locus_before_io(const PlannedLocus& locus){
+  // The capture output requires every locus' reads, and loci are only genotyped if there's a VCF to write them to
+  if (!vcf_writer_.is_open() || capture_writer_ != NULL)
+    return false;
+
+  // Loci without a stutter model in the file provided to --stutter-in are never genotyped
+  const Region& region = locus.region;
+  if (def_stutter_model_ == NULL && read_stutter_models_ && stutter_models_.find(region) == stutter_models_.end()){
+    full_logger() << "WARNING: No stutter model found for " << region.chrom() << ":" << region.start() << "-" << region.stop() << std::endl;
+    num_rejected_models_++;
+    return true;
+  }
+
+  // The sequence-based genotyper aborts loci whose reference flanks are too repetitive to assemble. A flank is only flagged if it
+  // fails the check for every boundary and length the reads could produce (see LocusPlan), so only guaranteed failures are rejected
+  if ((!locus.left_flank_repetitive && !locus.right_flank_repetitive) || !can_reject_flanks_before_io())
+    return false;
+
+  bool upstream       = locus.left_flank_repetitive;
+  int32_t flank_start = (upstream ? region.start() - HaplotypeGenerator::LEFT_PAD - HaplotypeGenerator::REF_FLANK_LEN : region.stop() + HaplotypeGenerator::RIGHT_PAD);
+  selective_logger() << "Aborting genotyping of the locus as the sequence " << (upstream ? "upstream" : "downstream")
+		     << " of the repeat is too repetitive for accurate genotyping" << "\n";
+  selective_logger() << "\tFlanking sequence = " << uppercase(locus.ref_seq.substr(flank_start - locus.ref_start, HaplotypeGenerator::REF_FLANK_LEN)) << std::endl;
+  num_rejected_flanks_++;
+  return true;
+}
+
+bool GenotyperBamProcessor::can_reject_flanks_before_io() const {
+  // The flank check only applies if the flanks are built from the reference, the stutter models needn't be learned,
+  // every locus' reads needn't be captured and the flanks were analyzed using the genotyper's k-mer sizes
+  if (!vcf_writer_.is_open() || capture_writer_ != NULL)
+    return false;
+  if (length_only_ || skip_assembly_ || ref_vcf_ != NULL || output_stutter_models_)
+    return false;
+  return LocusPlan::flank_analysis_valid(genotyper_options_);
+}
+
+void GenotyperBamProcessor::store_locus_results(const RegionGroup& region_group){
+  if (locus_cache_ == NULL)
+    return;
+  vcf_writer_.capture_records(NULL);
+  std::vector< std::pair<std::string, int*> > counters;
+  get_outcome_counters(counters);
+  for (auto counter_iter = counters.begin(); counter_iter != counters.end(); counter_iter++){
+    int32_t delta = *(counter_iter->second) - locus_start_counts_[counter_iter->first];
+    if (delta != 0)
+      locus_cache_entry_.outcome_counts[counter_iter->first] = delta;
+  }
+  locus_cache_->store(locus_cache_key_, locus_cache_entry_);
+  locus_cache_entry_.clear();
+  locus_cache_key_.clear();
+}
+
+void GenotyperBamProcessor::capture_locus(const std::vector<BamAlnList>& alignments,
+					  const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+					  const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq){
+  // Stutter models from --stutter-in are captured at full precision so that the replay is identical
+  std::stringstream stutter_text;
+  stutter_text << std::setprecision(17);
+  if (read_stutter_models_){
+    const std::vector<Region>& regions = region_group.regions();
+    for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+      auto model_iter = stutter_models_.find(*region_iter);
+      if (model_iter != stutter_models_.end())
+	model_iter->second->write_model(region_iter->chrom(), region_iter->start(), region_iter->stop(), stutter_text);
+    }
+  }
+
+  bool haploid = (haploid_chroms_.find(region_group.chrom()) != haploid_chroms_.end());
+  // As with the locus cache keys, the reference within MAX_MATE_DIST of the reads covers everything the genotyper accesses
+  capture_writer_->write_locus(region_group, chrom_seq, MAX_MATE_DIST, haploid, TOO_MANY_READS, stutter_text.str(),
+			       rg_names, alignments, log_p1s, log_p2s);
+  selective_logger() << "Captured the genotyping input for the locus" << std::endl;
+}
+
+void GenotyperBamProcessor::replay_loci(LocusCaptureReader& capture_reader){
+  if (vcf_writer_.is_open())
+    write_vcf_header(capture_reader.vcf_header());
+
+  LocusCapture locus;
+  std::string chrom_seq;
+  while (capture_reader.next_locus(locus)){
+    RegionGroup region_group = locus.region_group();
+    full_logger() << "" << "Replaying region " << region_group.chrom() << " " << region_group.start() << " " << region_group.stop() << std::endl;
+
+    locus.fill_chrom_seq(chrom_seq);
+    if (locus.haploid)
+      add_haploid_chrom(region_group.chrom());
+    if (capture_reader.read_stutter_models()){
+      std::istringstream stutter_input(locus.stutter_text);
+      add_input_stutter(stutter_input);
+    }
+    TOO_MANY_READS = locus.too_many_reads;
+    analyze_reads_and_phasing(locus.alignments, locus.log_p1s, locus.log_p2s, locus.rg_names, region_group, chrom_seq);
+
+    // Each captured locus only contains the reference sequence surrounding it, so batched loci can't outlive it
+    finish_chromosome(chrom_seq);
+  }
+}
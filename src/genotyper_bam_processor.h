@@ -5,23 +5,50 @@
 #include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "bam_io.h"
 #include "bgzf_streams.h"
 #include "em_stutter_genotyper.h"
+#include "genotype_matrix.h"
+#include "genotyper_options.h"
+#include "locus_cache.h"
+#include "locus_capture.h"
 #include "process_timer.h"
 #include "region.h"
 #include "seq_stutter_genotyper.h"
 #include "snp_bam_processor.h"
 #include "stutter_model.h"
+#include "vcf_input.h"
 #include "vcf_reader.h"
 #include "vcf_writer.h"
+#include "SeqAlignment/AlignmentArena.h"
 #include "SeqAlignment/AlignmentData.h"
 #include "SeqAlignment/AlignmentOps.h"
+#include "SeqAlignment/HapAligner.h"
 #include "SeqAlignment/HTMLCreator.h"
 
+/*
+ * Genotyping input for a locus whose analysis has been deferred until its batch is processed.
+ * The timing fields record the locus' BAM seek, read filtering and SNP info extraction times, as they're overwritten by subsequent loci.
+ * LOG_OFFSET is the length of the batch's buffered log messages when the locus was deferred
+ */
+class BatchedLocus {
+ public:
+  RegionGroup region_group;
+  std::vector<std::string> rg_names;
+  std::vector< std::vector<BamAlignment> > alignments;
+  std::vector< std::vector<double> > log_p1s, log_p2s;
+  double bam_seek_time, read_filter_time, snp_phase_info_time;
+  size_t log_offset;
+
+  explicit BatchedLocus(const RegionGroup& group) : region_group(group){
+    bam_seek_time = read_filter_time = snp_phase_info_time = 0;
+    log_offset    = 0;
+  }
+};
 
 class GenotyperBamProcessor : public SNPBamProcessor {
 private:
@@ -44,11 +71,33 @@ private:
   VCFWriter vcf_writer_;
   std::vector<std::string> samples_to_genotype_;
 
+  // Optional columnar binary file to which the GT, GB, Q and DP fields are also written
+  std::string gt_matrix_file_;
+  GenotypeMatrixWriter gt_matrix_writer_;
+
   // Counters for genotyping success;
   int num_genotype_success_, num_genotype_fail_;
 
+  // Counter for loci whose results were reused from the locus cache
+  int num_cached_loci_;
+
+  // Counters for loci whose predictable failures were detected before any BAM I/O. As their reads are never examined, these loci
+  // aren't included in the failure counters above, which only count loci that reached the corresponding step
+  int num_rejected_models_, num_rejected_flanks_;
+
   // VCF containing STR genotypes for a reference panel
-  VCF::VCFReader* ref_vcf_;
+  RefVCFCursor* ref_vcf_;
+
+  // Output and extraction settings provided to each genotyper
+  GenotyperOptions genotyper_options_;
+
+  // Loci whose genotyping has been deferred, in the order they were read. All of them are located on the current chromosome
+  std::vector<BatchedLocus*> locus_batch_;
+  std::ostringstream batch_log_; // Log messages emitted since the batch's first locus was deferred
+  int num_batches_;
+
+  // Alignment buffers shared by the genotypers for every locus
+  HapAlignerWorkspace aligner_workspace_;
 
   bool output_viz_;
   bgzfostream viz_out_;
@@ -58,12 +107,52 @@ private:
   double total_stutter_time_,  locus_stutter_time_;
   double total_left_aln_time_, locus_left_aln_time_;
   double total_genotype_time_, locus_genotype_time_;
+  PerfCounts locus_left_aln_counts_;
 
   // True iff we should recalculate the stutter model after performing haplotype alignments
   // The idea is that the haplotype-based alignments should be far more accurate, and reperforming
   // the stutter analysis will result in a better stutter model
   bool recalc_stutter_model_;
 
+  // Optional on-disk cache used to reuse the results for loci whose inputs haven't changed
+  LocusCache* locus_cache_;
+  LocusCacheEntry locus_cache_entry_;
+  LocusCacheKey locus_cache_key_;
+  std::map<std::string, int32_t> locus_start_counts_;  // Outcome counter values before the locus being cached was processed
+
+  // Names and addresses of the counters summarizing each locus' outcome, which are replayed for cached loci
+  void get_outcome_counters(std::vector< std::pair<std::string, int*> >& counters);
+
+  bool load_locus_results(const RegionGroup& region_group, const std::string& chrom_seq);
+  void store_locus_results(const RegionGroup& region_group);
+
+  bool reject_locus_before_io(const PlannedLocus& locus);
+  bool can_reject_flanks_before_io() const;
+
+  // Genotype any deferred loci before the chromosome's sequence is discarded
+  void finish_chromosome(const std::string& chrom_seq){ process_locus_batch(chrom_seq); }
+
+  // Returns true iff loci are genotyped in batches. Loci are cached as soon as they're processed, so batching is disabled if there's a locus cache
+  bool batching_loci() const { return (LOCUS_BATCH_SIZE > 1 && locus_cache_ == NULL); }
+
+  // Genotype each deferred locus in order and write their results. The log messages buffered for the batch are
+  // interleaved with those of each locus as they would've been without batching and written in a single flush
+  void process_locus_batch(const std::string& chrom_seq);
+
+  // Learn or look up the stutter model for each region, followed by genotyping the regions if a VCF is being generated.
+  // The provided times are logged as the locus' BAM seek, read filtering and SNP info extraction times
+  void genotype_locus(std::vector<BamAlnList>& alignments,
+		      std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+		      const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq,
+		      double bam_seek_time, double read_filter_time, double snp_phase_info_time);
+
+  // Optional file to which the input of the genotyping stage is written for each locus
+  LocusCaptureWriter* capture_writer_;
+
+  void capture_locus(const std::vector<BamAlnList>& alignments,
+		     const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+		     const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq);
+
   // Simple object to track total times consumed by various processes
   ProcessTimer process_timer_;
 
@@ -73,7 +162,17 @@ private:
   void left_align_reads(const RegionGroup& region_group, const std::string& chrom_seq, std::vector<BamAlnList>& alignments,
 			const std::vector< std::vector<double> >& log_p1, const std::vector< std::vector<double> >& log_p2,
 			std::vector< std::vector<double> >& filt_log_p1,  std::vector< std::vector<double> >& filt_log_p2,
-			std::vector< Alignment>& left_alns);
+			AlignmentArena& left_alns);
+
+  // Genotype each region using only the bp differences in the reads' CIGAR strings
+  bool genotype_str_lengths(std::vector<BamAlnList>& alignments,
+			    const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+			    bool haploid, const std::vector<std::string>& rg_names, const RegionGroup& region_group,
+			    const std::string& chrom_seq, const std::vector<StutterModel*>& stutter_models);
+
+  // Log the hardware performance counters for each stage of the sequence-based genotyper
+  void log_stage_counts(std::ostream& out, const std::string& title, const PerfCounts& left_aln, const PerfCounts& hap_build,
+			const PerfCounts& hap_aln, const PerfCounts& assembly, const PerfCounts& posterior, const PerfCounts& aln_trace) const;
 
   StutterModel* learn_stutter_model(std::vector<BamAlnList>& alignments,
 				    const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
@@ -87,11 +186,24 @@ private:
     assert(vcf_writer_.is_open());
 
     // Write VCF header
-    std::string header = Genotyper::get_vcf_header(fasta_path, full_command, chroms, samples_to_genotype_);
+    std::string header = Genotyper::get_vcf_header(genotyper_options_, fasta_path, full_command, chroms, samples_to_genotype_);
+    write_vcf_header(header);
+  }
+
+  void write_vcf_header(const std::string& header){
+    assert(vcf_writer_.is_open());
     vcf_writer_.write_header(header);
+
+    if (!gt_matrix_file_.empty())
+      gt_matrix_writer_.open(gt_matrix_file_, samples_to_genotype_);
+    if (capture_writer_ != NULL)
+      capture_writer_->write_header(read_stutter_models_, header, samples_to_genotype_);
   }
   bool skip_assembly_;
 
+  // True iff genotypes should be computed using the length-based EM genotyper instead of the sequence-based genotyper
+  bool length_only_;
+
 public:
  GenotyperBamProcessor(bool use_bam_rgs, bool remove_pcr_dups) : SNPBamProcessor(use_bam_rgs, remove_pcr_dups){
     output_stutter_models_ = false;
@@ -104,6 +216,9 @@ public:
     num_missing_models_    = 0;
     num_genotype_success_  = 0;
     num_genotype_fail_     = 0;
+    num_cached_loci_       = 0;
+    num_rejected_models_   = 0;
+    num_rejected_flanks_   = 0;
     MAX_EM_ITER            = 100;
     ABS_LL_CONVERGE        = 0.01;
     FRAC_LL_CONVERGE       = 0.001;
@@ -122,6 +237,12 @@ public:
     def_stutter_model_     = NULL;
     ref_vcf_               = NULL;
     skip_assembly_         = false;
+    length_only_           = false;
+    locus_cache_           = NULL;
+    capture_writer_        = NULL;
+    num_batches_           = 0;
+    LOCUS_BATCH_SIZE       = 1;
+    MAX_BATCH_LOCUS_READS  = 250;
   }
 
   ~GenotyperBamProcessor(){
@@ -132,6 +253,12 @@ public:
       delete ref_vcf_;
     if (def_stutter_model_ != NULL)
       delete def_stutter_model_;
+    if (locus_cache_ != NULL)
+      delete locus_cache_;
+    if (capture_writer_ != NULL)
+      delete capture_writer_;
+    for (unsigned int i = 0; i < locus_batch_.size(); i++)
+      delete locus_batch_[i];
   }
 
   double total_stutter_time()  const { return total_stutter_time_;  }
@@ -140,6 +267,7 @@ public:
   double locus_left_aln_time() const { return locus_left_aln_time_; }
   double total_genotype_time() const { return total_genotype_time_; }
   double locus_genotype_time() const { return locus_genotype_time_; }
+  const PerfCounts& locus_left_aln_counts() const { return locus_left_aln_counts_; }
 
   void add_haploid_chrom(std::string chrom){ haploid_chroms_.insert(chrom); }
   bool has_default_stutter_model() const   { return def_stutter_model_ != NULL; }
@@ -155,15 +283,54 @@ public:
 	skip_assembly_ = true;
 }
 
+  // Skip left alignment, haplotype alignment and assembly and instead genotype each STR using the bp differences in the reads' CIGAR strings
+  void use_length_only_genotyping(){ length_only_ = true; }
+
   void set_output_viz(const std::string& viz_file){
     output_viz_ = true;
     viz_out_.open(viz_file.c_str());
   }
 
+  // Must be called before the output VCF is initialized, as its header depends on the requested FORMAT fields
+  void set_genotyper_options(const GenotyperOptions& options){ genotyper_options_ = options; }
+
+  const GenotyperOptions& genotyper_options() const { return genotyper_options_; }
+
+  // Compress the STR VCF and visualization outputs using a pool of NUM_THREADS threads
+  void set_compression_threads(int num_threads){
+    if (vcf_writer_.is_open())
+      vcf_writer_.set_compression_threads(num_threads);
+    if (output_viz_)
+      viz_out_.set_threads(num_threads);
+  }
+
+  void set_output_gt_matrix(const std::string& gt_matrix_file){
+    gt_matrix_file_ = gt_matrix_file;
+  }
+
+  // Should only be invoked once all other parameters and input files have been configured, as they're used to construct each locus' cache key
+  void set_locus_cache(const std::string& cache_dir, const std::vector<std::string>& input_files,
+		       const std::map<std::string, std::string>& rg_to_sample, const std::map<std::string, std::string>& rg_to_library);
+
+  void describe_parameters(std::ostream& out) const;
+
+  void describe_status(StatusReport& report) const;
+
+  // Write the input of the genotyping stage for each locus to the provided file. PARAM_ARGS should contain
+  // the command line options that configure the run's parameters, as these are used to replay the loci
+  void set_capture_file(const std::string& capture_file, const std::vector<std::string>& param_args){
+    if (capture_writer_ != NULL)
+      delete capture_writer_;
+    capture_writer_ = new LocusCaptureWriter(capture_file, param_args);
+  }
+
+  // Rerun the genotyping stage for each locus in the capture file
+  void replay_loci(LocusCaptureReader& capture_reader);
+
   void set_ref_vcf(const std::string& ref_vcf_file){
     if (ref_vcf_ != NULL)
       delete ref_vcf_;
-    ref_vcf_ = new VCF::VCFReader(ref_vcf_file);
+    ref_vcf_ = new RefVCFCursor(ref_vcf_file);
   }
 
   void set_input_stutter(const std::string& model_file){
@@ -175,6 +342,16 @@ public:
     read_stutter_models_ = true;
     input.close();
   }
+
+  // Add the stutter models in the stream to those provided by the user. Existing models for the same regions are retained
+  void add_input_stutter(std::istream& input){
+    std::map<Region, StutterModel*> models;
+    StutterModel::read_models(input, models);
+    for (auto model_iter = models.begin(); model_iter != models.end(); model_iter++)
+      if (!stutter_models_.insert(*model_iter).second)
+	delete model_iter->second;
+    read_stutter_models_ = true;
+  }
   
   void set_output_stutter(const std::string& model_file){
     output_stutter_models_ = true;
@@ -202,12 +379,20 @@ public:
     SNPBamProcessor::finish();
     if (vcf_writer_.is_open())
       vcf_writer_.close();
+    if (gt_matrix_writer_.is_open())
+      gt_matrix_writer_.close();
     if (output_stutter_models_)
       stutter_model_out_.close();
     if (output_viz_)
       viz_out_.close();
 
     full_logger() << "\n\n\n------HipSTR Execution Summary------\n";
+    if (locus_cache_ != NULL)
+      full_logger() << "Reused cached results for " << locus_cache_->num_hits() << " loci and cached the results for " << locus_cache_->num_stores() << " loci\n";
+    if (capture_writer_ != NULL){
+      capture_writer_->close();
+      full_logger() << "Captured the genotyping input for " << capture_writer_->num_loci() << " loci\n";
+    }
     if (num_too_long_ != 0)
       full_logger() << "Skipped " << num_too_long_   << " loci whose lengths were above the maximum threshold.\n"
 		    << "\t If this is a sizeable portion of your loci, see the --max-str-len command line option\n";
@@ -221,6 +406,12 @@ public:
     if (num_em_converge_+num_em_fail_ != 0)
       full_logger() << "Stutter model training succeeded for " << num_em_converge_ << "/" << num_em_converge_+num_em_fail_ << " loci\n";
     full_logger() << "Genotyping succeeded for " << num_genotype_success_ << "/" << num_genotype_success_+num_genotype_fail_ << " loci\n";
+    if (num_rejected_models_ != 0)
+      full_logger() << "Skipped the BAM I/O for " << num_rejected_models_ << " loci that did not have a stutter model in the file provided to --stutter-in\n";
+    if (num_rejected_flanks_ != 0)
+      full_logger() << "Skipped the BAM I/O for " << num_rejected_flanks_ << " loci whose reference flanks were too repetitive for accurate genotyping\n";
+    if (num_batches_ != 0)
+      full_logger() << "Genotyped loci in " << num_batches_ << " batches of at most " << LOCUS_BATCH_SIZE << " loci\n";
 
     full_logger() << "\nApproximate timing breakdown" << "\n"
 		  << " BAM seek time       = " << total_bam_seek_time()       << " seconds\n"
@@ -235,6 +426,11 @@ public:
 		  << "\t" << " Flank assembly        = "  << process_timer_.get_total_time("Flank assembly")        << " seconds\n"
 		  << "\t" << " Posterior computation = "  << process_timer_.get_total_time("Posterior computation") << " seconds\n"
 		  << "\t" << " Alignment traceback   = "  << process_timer_.get_total_time("Alignment traceback")   << " seconds\n";
+    if (PerfCounters::enabled())
+      log_stage_counts(full_logger(), "Hardware performance counters",
+		       process_timer_.get_total_counts("Left alignment"),        process_timer_.get_total_counts("Haplotype generation"),
+		       process_timer_.get_total_counts("Haplotype alignment"),   process_timer_.get_total_counts("Flank assembly"),
+		       process_timer_.get_total_counts("Posterior computation"), process_timer_.get_total_counts("Alignment traceback"));
   }
 
   // EM parameters for length-based stutter learning
@@ -250,6 +446,11 @@ public:
 
   // If this flag is set, HTML alignments are written for both the haplotype alignments and Needleman-Wunsch left alignments
   int VIZ_LEFT_ALNS;
+
+  // Loci with at most MAX_BATCH_LOCUS_READS reads are deferred and genotyped in batches of up to LOCUS_BATCH_SIZE loci,
+  // so that each batch's log messages are written in bulk. A locus with more reads ends its batch. Batching is disabled if LOCUS_BATCH_SIZE is 1
+  int LOCUS_BATCH_SIZE;
+  int32_t MAX_BATCH_LOCUS_READS;
 };
 
 #endif
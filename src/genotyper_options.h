@@ -0,0 +1,64 @@
+#ifndef GENOTYPER_OPTIONS_H_
+#define GENOTYPER_OPTIONS_H_
+
+/*
+ * Parameters shared by all of the genotypers during a run. They're populated once (e.g. from the command line) before
+ * any loci are processed, and each genotyper stores its own immutable copy, so concurrent genotypers never read shared mutable state
+ */
+class GenotyperOptions {
+ public:
+  // Parameters that control what is output to the VCF
+  int OUTPUT_GLS;              // Output the GL FORMAT field
+  int OUTPUT_PLS;              // Output the PL FORMAT field
+  int OUTPUT_PHASED_GLS;       // Output the PHASEDGL FORMAT field
+  int OUTPUT_ALLREADS;         // Output the ALLREADS  FORMAT field
+  int OUTPUT_MALLREADS;        // Output the MALLREADS FORMAT field
+  int OUTPUT_FILTERS;          // Output the FILTERS FORMAT field
+  float MAX_FLANK_INDEL_FRAC;  // Only output genotypes if the fraction of a sample's reads with
+                               // indels in the flank is less than this threshold
+  int OUTPUT_HAPLOTYPE_DATA;   // Output information about the haplotypes (in addition to the genotypes)
+
+  // Parameters that control the parallel extraction of genotypes and likelihoods
+  int NUM_THREADS;             // Maximum number of threads used to process samples
+  int MIN_SAMPLES_PER_THREAD;  // Only use additional threads if each thread would process at least this many samples
+
+  // If > 0, reads that differ from a more common read only at low-quality bases outside of the repeat reuse its alignment
+  // probabilities, provided the error of their corrected log-likelihoods is at most this value (0 = only pool identical reads)
+  double MAX_POOL_CORRECTION_ERROR;
+
+  // Maximum number of rounds of stutter model retraining and realignment when the stutter models are recomputed.
+  // Each round realigns every read, so additional rounds are only worthwhile if a single warm-started refit is insufficient
+  int MAX_STUTTER_REFIT_ROUNDS;
+
+  // Range of k-mer sizes used to assemble the flanks. Loci are aborted if a reference flank's de Bruijn graph has cycles for every size
+  int MIN_KMER;
+  int MAX_KMER;
+
+  // Reads are only assigned to one of a sample's haplotypes when reporting allele counts and strand biases
+  // if their log-likelihoods for the two haplotypes differ by more than this value
+  double STRAND_TOLERANCE;
+
+  GenotyperOptions(){
+    OUTPUT_GLS             = 0;
+    OUTPUT_PLS             = 0;
+    OUTPUT_PHASED_GLS      = 0;
+    OUTPUT_ALLREADS        = 1;
+    OUTPUT_MALLREADS       = 1;
+    OUTPUT_FILTERS         = 0;
+    OUTPUT_HAPLOTYPE_DATA  = 0;
+    MAX_FLANK_INDEL_FRAC   = 0.15;
+
+    // By default, genotypes and likelihoods are extracted on the calling thread
+    NUM_THREADS            = 1;
+    MIN_SAMPLES_PER_THREAD = 32;
+
+    MAX_POOL_CORRECTION_ERROR = 0;
+    MAX_STUTTER_REFIT_ROUNDS  = 1;
+
+    MIN_KMER         = 10;
+    MAX_KMER         = 15;
+    STRAND_TOLERANCE = 0.1;
+  }
+};
+
+#endif
@@ -58,7 +58,11 @@ void DiploidHaplotype::remove_next_snp(){
 void HaplotypeTracker::add_snp(const VCF::Variant& variant){
   num_snps_++;
   positions_.push_back(variant.get_position());
-  
+  inconsistent_families_.push_back(std::vector<int>());
+  bool biallelic_snp = variant.is_biallelic_snp();
+
+  // Alleles added to each sample's haplotypes, where only the first alternate allele is tracked
+  std::vector<uint8_t> hap_one_alleles(samples_.size(), 0), hap_two_alleles(samples_.size(), 0);
   int sample_index = 0;
   for (unsigned int i = 0; i < families_.size(); i++){
     NuclearFamily& family = families_[i];
@@ -68,18 +72,36 @@ void HaplotypeTracker::add_snp(const VCF::Variant& variant){
       use_gts = false; // Ignore a SNP if any samples in the family are missing a genotype
     else if (!family.is_mendelian(variant))
       use_gts = false; // Ignore a SNP if any samples in the family have a Mendelian inconsistency
+    if (!use_gts && biallelic_snp)
+      inconsistent_families_.back().push_back(i);
 
     int gt_a, gt_b;
     for (int j = 0; j < family.size(); j++){
       if (use_gts){
 	variant.get_genotype(vcf_indices_[sample_index], gt_a, gt_b);
 	snp_haplotypes_[sample_index].add_snp(gt_a, gt_b);
+	hap_one_alleles[sample_index] = (gt_a == 1 ? 1 : 0);
+	hap_two_alleles[sample_index] = (gt_b == 1 ? 1 : 0);
       }
       else
 	snp_haplotypes_[sample_index].add_snp(0, 0);
       sample_index++;
     }      
   }
+
+  // Update the edit distances between each child and its parents
+  pair_mismatches_.push_back(std::vector<uint8_t>(pairs_.size(), 0));
+  std::vector<uint8_t>& mismatches = pair_mismatches_.back();
+  for (unsigned int i = 0; i < pairs_.size(); i++){
+    int child = pairs_[i].first, parent = pairs_[i].second;
+    uint8_t mask = ((hap_one_alleles[child] != hap_one_alleles[parent]) ? 1 : 0)
+      | ((hap_one_alleles[child] != hap_two_alleles[parent]) ? 2 : 0)
+      | ((hap_two_alleles[child] != hap_one_alleles[parent]) ? 4 : 0)
+      | ((hap_two_alleles[child] != hap_two_alleles[parent]) ? 8 : 0);
+    mismatches[i] = mask;
+    for (int j = 0; j < 4; j++)
+      pair_distances_[4*i + j] += ((mask >> j) & 1);
+  }
 }
 
 void HaplotypeTracker::advance(const std::string& chrom, int32_t position, const std::set<std::string>& sites_to_skip){
@@ -109,8 +131,10 @@ void HaplotypeTracker::advance(const std::string& chrom, int32_t position, const
     std::stringstream ss;
     ss << snp_variant.get_chromosome() << ":" << snp_variant.get_position();
     std::string key = ss.str();
-    if (sites_to_skip.find(key) != sites_to_skip.end())
+    if (sites_to_skip.find(key) != sites_to_skip.end()){
+      skipped_sites_ = true;
       continue;
+    }
     add_snp(snp_variant);
   }
 
@@ -120,6 +144,21 @@ void HaplotypeTracker::advance(const std::string& chrom, int32_t position, const
   //logger << " done" << std::endl;
 }
 
+bool HaplotypeTracker::add_inconsistent_site(const std::string& chrom, int32_t position, std::vector< std::set<int32_t> >& bad_sites_by_family) const {
+  // Every SNP strictly inside the window has been loaded and none have been removed
+  if (chrom.compare(chrom_) != 0 || skipped_sites_ || position <= prev_window_start_ || position >= prev_window_end_)
+    return false;
+  assert(bad_sites_by_family.size() == families_.size());
+
+  auto pos_iter = std::lower_bound(positions_.begin(), positions_.end(), position);
+  for (int snp_index = pos_iter - positions_.begin(); snp_index < num_snps_ && positions_[snp_index] == position; snp_index++){
+    const std::vector<int>& families = inconsistent_families_[snp_index];
+    for (auto family_iter = families.begin(); family_iter != families.end(); family_iter++)
+      bad_sites_by_family[*family_iter].insert(position);
+  }
+  return true;
+}
+
 /* Analyze edit distances between the phased SNP haplotypes of each child and its parents. Returns true iff all the children in the family
  * have a valid match, which is controlled by the parameters MAX_BEST_SCORE and MIN_SECOND_BEST_SCORE.
  * For a given child, a valid match occurs if a child's haplotype matches a parental haplotype with distance <= MAX_BEST_SCORE, no other child-parent haplotype
@@ -138,14 +177,14 @@ bool HaplotypeTracker::infer_haplotype_inheritance(const NuclearFamily& family,
   std::set<int> mismatch_indices;
 
   for (auto child_iter = family.get_children().begin(); child_iter != family.get_children().end(); child_iter++){
-    DiploidEditDistance maternal_distance = edit_distances(*child_iter, family.get_mother());
+    DiploidEditDistance maternal_distance = pair_edit_distances(*child_iter, family.get_mother());
     int min_mat_dist, min_mat_index, second_mat_dist, second_mat_index;
     maternal_distance.min_distance(min_mat_dist, min_mat_index);
     maternal_distance.second_min_distance(second_mat_dist, second_mat_index);
     if (min_mat_dist > max_best_score || second_mat_dist < min_second_best_score)
       return false;
 
-    DiploidEditDistance paternal_distance = edit_distances(*child_iter, family.get_father());
+    DiploidEditDistance paternal_distance = pair_edit_distances(*child_iter, family.get_father());
     int min_pat_dist, min_pat_index, second_pat_dist, second_pat_index;
     paternal_distance.min_distance(min_pat_dist, min_pat_index);
     paternal_distance.second_min_distance(second_pat_dist, second_pat_index);
@@ -1,12 +1,15 @@
 #ifndef HAPLOTYPE_TRACKER_H_
 #define HAPLOTYPE_TRACKER_H_
 
+#include <algorithm>
 #include <climits>
 #include <deque>
 #include <iostream>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 #include "vcf_reader.h"
 #include "pedigree.h"
@@ -132,6 +135,18 @@ class HaplotypeTracker {
   int32_t num_snps_;
   std::deque<int32_t> positions_;
   int32_t prev_window_start_, prev_window_end_;
+  bool skipped_sites_;  // True iff any sites in the current window were omitted via advance()'s SITES_TO_SKIP
+
+  // Families with a missing genotype or a Mendelian inconsistency at each SNP in the window, computed once as the SNP enters
+  // the window. Only populated for biallelic SNPs, as only these sites are used to phase reads
+  std::deque< std::vector<int> > inconsistent_families_;
+
+  // Edit distances between each child's haplotypes and those of its mother and father, maintained as SNPs enter and leave the
+  // window. Each child-parent pair stores the 4 distances in DiploidEditDistance order, and each SNP stores a 4-bit mismatch mask per pair
+  std::map<std::pair<int,int>, int> pair_indices_;  // (child, parent) sample indices -> pair index
+  std::vector< std::pair<int,int> > pairs_;
+  std::vector<int> pair_distances_;
+  std::deque< std::vector<uint8_t> > pair_mismatches_;
 
   // Private unimplemented copy constructor and assignment operator to prevent operations
   HaplotypeTracker(const HaplotypeTracker& other);
@@ -156,6 +171,13 @@ class HaplotypeTracker {
     for (unsigned int i = 0; i < snp_haplotypes_.size(); i++)
       snp_haplotypes_[i].remove_next_snp();
     positions_.pop_front();
+    inconsistent_families_.pop_front();
+
+    const std::vector<uint8_t>& mismatches = pair_mismatches_.front();
+    for (unsigned int i = 0; i < mismatches.size(); i++)
+      for (int j = 0; j < 4; j++)
+	pair_distances_[4*i + j] -= ((mismatches[i] >> j) & 1);
+    pair_mismatches_.pop_front();
   }
 
   void reset(){
@@ -163,8 +185,12 @@ class HaplotypeTracker {
     positions_ =  std::deque<int32_t>();
     prev_window_start_ = -1;
     prev_window_end_   = -1;
+    skipped_sites_     = false;
     for (unsigned int i = 0; i < snp_haplotypes_.size(); i++)
       snp_haplotypes_[i].reset();
+    inconsistent_families_.clear();
+    pair_mismatches_.clear();
+    std::fill(pair_distances_.begin(), pair_distances_.end(), 0);
   }
 
   void add_snp(const VCF::Variant& variant);
@@ -188,6 +214,22 @@ class HaplotypeTracker {
     num_snps_          = 0;
     prev_window_start_ = -1;
     prev_window_end_   = -1;
+    skipped_sites_     = false;
+
+    // Track the distances between each child and its parents. A sample in several families uses its last entry, as in edit_distances()
+    for (auto family_iter = families_.begin(); family_iter != families_.end(); family_iter++){
+      for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); child_iter++){
+	int child_index = sample_indices_[*child_iter];
+	for (int parent = 0; parent < 2; parent++){
+	  std::pair<int,int> key(child_index, sample_indices_[parent == 0 ? family_iter->get_mother() : family_iter->get_father()]);
+	  if (pair_indices_.find(key) == pair_indices_.end()){
+	    pair_indices_[key] = pairs_.size();
+	    pairs_.push_back(key);
+	  }
+	}
+      }
+    }
+    pair_distances_ = std::vector<int>(4*pairs_.size(), 0);
   }
 
   const std::vector<NuclearFamily>& families() const {
@@ -202,8 +244,24 @@ class HaplotypeTracker {
     return snp_haplotypes_[index_1].edit_distances(snp_haplotypes_[index_2]);
   }
 
+  // Returns the distances between the child's and parent's haplotypes, using the maintained distances if the pair is tracked
+  DiploidEditDistance pair_edit_distances(const std::string& child, const std::string& parent) const {
+    auto pair_iter = pair_indices_.find(std::pair<int,int>(sample_indices_.find(child)->second, sample_indices_.find(parent)->second));
+    if (pair_iter == pair_indices_.end())
+      return edit_distances(child, parent);
+    const int* distances = pair_distances_.data() + 4*pair_iter->second;
+    return DiploidEditDistance(distances[0], distances[1], distances[2], distances[3]);
+  }
+
   void advance(const std::string& chrom, int32_t pos, const std::set<std::string>& sites_to_skip);
 
+  /*
+   * Adds the position to the bad sites of each family with a missing genotype or a Mendelian inconsistency at a biallelic SNP
+   * at the position, using the values computed when the SNP entered the window. Returns false if the window doesn't include
+   * every SNP on the chromosome at the position, in which case the caller must check the families itself
+   */
+  bool add_inconsistent_site(const std::string& chrom, int32_t position, std::vector< std::set<int32_t> >& bad_sites_by_family) const;
+
   bool infer_haplotype_inheritance(const NuclearFamily& family, int max_best_score, int min_second_best_score,
 				   std::vector<int>& maternal_indices, std::vector<int>& paternal_indices, std::set<int32_t>& bad_sites);
 };
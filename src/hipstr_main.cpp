@@ -13,8 +13,12 @@
 
 #include "bam_io.h"
 #include "error.h"
+#include "fasta_reader.h"
 #include "genotyper_bam_processor.h"
+#include "locus_plan.h"
 #include "pedigree.h"
+#include "perf_counters.h"
+#include "read_pooler.h"
 #include "stringops.h"
 #include "vcf_reader.h"
 #include "version.h"
@@ -29,7 +33,8 @@ bool is_file(const std::string& name){
   return (S_ISREG (st_buf.st_mode));
 }
 
-void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_max_str_len, int def_max_haplotypes, int def_max_flanks, double def_min_flank_freq){
+void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_max_str_len, int def_max_haplotypes, int def_max_flanks, double def_min_flank_freq,
+		 int def_long_read_flank, int def_max_long_str_len){
   std::cerr << "Usage: HipSTR --bams <list_of_bams> --fasta <genome.fa> --regions <region_file.bed> --str-vcf <str_gts.vcf.gz> [OPTIONS]" << "\n" << "\n"
     
 	    << "Required parameters:" << "\n"
@@ -45,12 +50,28 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "                                      "  << "\t" << " used as candidate variants instead of finding candidates in the BAMs/CRAMs (Default)" << "\n"
 	    << "\t" << "--snp-vcf    <phased_snps.vcf.gz>     "  << "\t" << "Bgzipped input VCF file containing phased SNP genotypes for the samples"               << "\n"
 	    << "\t" << "                                      "  << "\t" << " to be genotyped. These SNPs will be used to physically phase STRs "                   << "\n"
-	    << "\t" << "--stutter-in <stutter_models.txt>     "  << "\t" << "Use stutter models in the file to genotype STRs (Default = Learn via EM algorithm)"    << "\n" << "\n"
+	    << "\t" << "--hap-tags                            "  << "\t" << "Phase STRs using the HP and PS tags in the BAMs/CRAMs (e.g. 10X Genomics BAMs or"      << "\n"
+	    << "\t" << "                                      "  << "\t" << " haplotagged PacBio/ONT BAMs) instead of the SNPs in --snp-vcf"                       << "\n"
+	    << "\t" << "--stutter-in <stutter_models.txt>     "  << "\t" << "Use stutter models in the file to genotype STRs (Default = Learn via EM algorithm)"    << "\n"
+	    << "\t" << "--locus-plan <loci.plan>              "  << "\t" << "Read the loci from a plan generated using HipSTR prepare instead of --regions,"       << "\n"
+	    << "\t" << "                                      "  << "\t" << " so that each locus' reference flanks needn't be analyzed in every run:"            << "\n"
+	    << "\t" << "                                      "  << "\t" << " HipSTR prepare --fasta <genome.fa> --regions <region_file.bed> --plan <loci.plan>"   << "\n" << "\n"
     
 	    << "Optional output parameters:" << "\n"
 	    << "\t" << "--log           <log.txt>             "  << "\t" << "Output the log information to the provided file (Default = Standard error)"         << "\n"
 	    << "\t" << "--viz-out       <aln_viz.gz>          "  << "\t" << "Output a file of each locus' alignments for visualization with VizAln or VizAlnPdf" << "\n"
-	    << "\t" << "--stutter-out   <stutter_models.txt>  "  << "\t" << "Output stutter models learned by the EM algorithm to the provided file"             << "\n" << "\n"
+	    << "\t" << "--gt-matrix     <str_gts.gtm>         "  << "\t" << "Also write the GT, GB, Q and DP fields to a compressed columnar binary file that"     << "\n"
+	    << "\t" << "                                      "  << "\t" << " supports fast retrieval of genotypes by region and sample"                          << "\n"
+	    << "\t" << "--stutter-out   <stutter_models.txt>  "  << "\t" << "Output stutter models learned by the EM algorithm to the provided file"             << "\n"
+	    << "\t" << "--status-file   <status.prom>         "  << "\t" << "Periodically rewrite the provided file with the run's progress (loci processed,"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " outcomes, throughput, memory usage and ETA) in the Prometheus text format"          << "\n"
+	    << "\t" << "--status-interval <secs>              "  << "\t" << "Minimum number of seconds between updates to the --status-file (Default = 60)"     << "\n"
+	    << "\t" << "--locus-cache   <cache_dir>           "  << "\t" << "Store each locus' results in the provided directory and reuse them in later runs"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " if the locus, its reference sequence, the input files and parameters are unchanged" << "\n"
+	    << "\t" << "--capture-locus <loci.capture>        "  << "\t" << "Write the reads, phasing likelihoods, reference sequence and parameters provided"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " to the genotyper for each locus to the file. The genotyping of the captured loci"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " can then be rerun without any BAMs/CRAMs using"                                   << "\n"
+	    << "\t" << "                                      "  << "\t" << " HipSTR replay <loci.capture> --str-vcf <str_gts.vcf.gz> [OPTIONS]"                << "\n" << "\n"
     //    << "\t" << "--viz-left-alns                       "  << "\t" << "Output the original left aligned reads to the HTML output in addition to the "       << "\n"
     //    << "\t" << "                                      "  << "\t" << " haplotype alignments. By default, only the latter is output"                        << "\n"
     //    << "\t" << "--pass-bam      <used_reads.bam>      "  << "\t" << "Output a BAM file containing the reads used to genotype each region"                 << "\n"
@@ -70,7 +91,10 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "--output-gls                          "  << "\t" << "Write genotype likelihoods to the VCF (Default = False)"                             << "\n"
 	    << "\t" << "--output-pls                          "  << "\t" << "Write phred-scaled genotype likelihoods to the VCF (Default = False)"                << "\n"
 	    << "\t" << "--output-phased-gls                   "  << "\t" << "Write phased genotype likelihoods to the VCF (Default = False)"                      << "\n"
-	    << "\t" << "--output-filters                      "  << "\t" << "Write why individual calls were filtered to the VCF (Default = False)"               << "\n" << "\n"
+	    << "\t" << "--output-filters                      "  << "\t" << "Write why individual calls were filtered to the VCF (Default = False)"               << "\n"
+	    << "\t" << "--threads       <num_threads>         "  << "\t" << "Number of threads used to extract each sample's genotype posteriors and likelihoods" << "\n"
+	    << "\t" << "                                      "  << "\t" << " at loci with many samples and to compress the VCF and --viz-out outputs"         << "\n"
+	    << "\t" << "                                      "  << "\t" << " (Default = 1)"                                                                    << "\n" << "\n"
 
 	    << "Optional BAM/CRAM tweaking parameters:" << "\n"
 	    << "\t" << "--bam-samps     <list_of_samples>     "  << "\t" << "Comma separated list of read groups in same order as BAM/CRAM files. "               << "\n"
@@ -110,6 +134,24 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
             << "\t" << "                                      "  << "\t" << "  information to filter SNPs prior to phasing STRs (Default = use all SNPs)"         << "\n"
 	    << "\t" << "--skip-assembly                       "  << "\t" << "Skip assembly for genotyping with long reads" << "\n"
 	    << "\t" << "--min-sum-qual	      <threshold>     "  << "\t" << "Allow for lower quality threshold for long read data" << "\n"
+	    << "\t" << "--long-reads                          "  << "\t" << "Clip long reads (e.g. PacBio HiFi) to a window around each STR before any other processing" << "\n"
+	    << "\t" << "                                      "  << "\t" << " and genotype STRs up to --max-long-str-len bp instead of --max-str-len bp. This option"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " also uses unpaired reads and disables PCR duplicate removal (as with --use-unpaired"      << "\n"
+	    << "\t" << "                                      "  << "\t" << " and --no-rmdup), as clipping discards the reads' original start coordinates"            << "\n"
+	    << "\t" << "--long-read-flank    <max_bp>         "  << "\t" << "Size of the window on each side of an STR to which long reads are clipped (Default = " << def_long_read_flank << ")" << "\n"
+	    << "\t" << "--max-long-str-len   <max_bp>         "  << "\t" << "With --long-reads, only genotype STRs with length < MAX_BP (Default = " << def_max_long_str_len << ")" << "\n"
+	    << "\t" << "--length-only                         "  << "\t" << "Genotype each STR using only the bp differences in the reads' CIGAR strings. Skips"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " left alignment, haplotype alignment and assembly, making it much faster but less"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " accurate. Intended for quick QC passes (Default = False)"                          << "\n"
+	    << "\t" << "--batch-loci         <num_loci>       "  << "\t" << "Genotype consecutive loci with few reads in batches of up to NUM_LOCI loci that"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " share their alignment buffers and write their log messages in a single flush."    << "\n"
+	    << "\t" << "                                      "  << "\t" << " Loci are still genotyped and output in order (Default = 1, no batching)"          << "\n"
+	    << "\t" << "--pool-near-reads    <max_ll_error>   "  << "\t" << "Also pool reads that only differ from a more common read at up to " << ReadPooler::MAX_NEAR_MISMATCHES << " low-quality" << "\n"
+	    << "\t" << "                                      "  << "\t" << " bases outside of the STR, aligning them once and correcting their log-likelihoods"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " for the mismatched bases. Reads are only pooled if the error of the corrected"      << "\n"
+	    << "\t" << "                                      "  << "\t" << " log-likelihoods is at most MAX_LL_ERROR (Default = 0, only pool identical reads)"   << "\n"
+	    << "\t" << "--perf-counters                       "  << "\t" << "Log hardware performance counters (cycles, instructions, cache and branch misses)" << "\n"
+	    << "\t" << "                                      "  << "\t" << " for each genotyping stage, per locus and in aggregate. Requires Linux (Default = False)" << "\n"
 	    << "\n" << "\n"
 	    << "*** Looking for answers to commonly asked questions or usage examples? ***"                     << "\n"
 	    << "\t i.  An in-depth description of HipSTR is available at https://hipstr-tool.github.io/HipSTR"  << "\n"
@@ -123,22 +165,29 @@ void parse_command_line_args(int argc, char** argv,
 			     std::string& bamfile_string,     std::string& bamlist_string,    std::string& rg_sample_string,  std::string& rg_lib_string,
 			     std::string& haploid_chr_string, std::string& hap_chr_file,      std::string& fasta_file,        std::string& region_file,   std::string& snp_vcf_file,
 			     std::string& chrom,              std::string& bam_pass_out_file, std::string& bam_filt_out_file, std::string& ref_vcf_file,
-			     std::string& str_vcf_out_file,   std::string& fam_file,          std::string& log_file,
+			     std::string& str_vcf_out_file,   std::string& fam_file,          std::string& log_file,          std::string& locus_cache_dir,
+			     std::string& capture_file,       std::string& locus_plan_file,   std::vector<std::string>& param_args,
 			     int& bam_lib_from_samp, int& skip_genotyping, GenotyperBamProcessor& bam_processor){
   int def_mdist             = bam_processor.MAX_MATE_DIST;
   int def_min_reads         = bam_processor.MIN_TOTAL_READS;
   int def_max_reads         = bam_processor.MAX_TOTAL_READS;
   int def_max_str_len       = bam_processor.MAX_STR_LENGTH;
+  int def_long_read_flank   = bam_processor.LONG_READ_FLANK;
+  int def_max_long_str_len  = bam_processor.MAX_LONG_READ_STR_LENGTH;
   int def_max_flanks        = bam_processor.MAX_FLANK_HAPLOTYPES;
   int def_max_haplotypes    = bam_processor.MAX_TOTAL_HAPLOTYPES;
   double def_min_flank_freq = bam_processor.MIN_FLANK_FREQ;
 
   if (argc == 1 || (argc == 2 && std::string("-h").compare(std::string(argv[1])) == 0)){
-    print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len, def_max_haplotypes, def_max_flanks, def_min_flank_freq);
+    print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len, def_max_haplotypes, def_max_flanks, def_min_flank_freq, def_long_read_flank, def_max_long_str_len);
     exit(0);
   }
 
-  int print_help = 0, print_version = 0, quiet_log = 0, silent_log = 0, def_stutter_model = 0, bams_from_10x = 0, skip_assembly = 0;
+  int print_help = 0, print_version = 0, quiet_log = 0, silent_log = 0, def_stutter_model = 0, use_hap_tags = 0, skip_assembly = 0, long_reads = 0, length_only = 0;
+  int perf_counters = 0;
+  GenotyperOptions genotyper_options;
+  std::string status_file = "";
+  double status_interval  = 60;
 
   static struct option long_options[] = {
     {"bams",            required_argument, 0, 'b'},
@@ -155,6 +204,8 @@ void parse_command_line_args(int argc, char** argv,
     {"min-flank-freq",  required_argument, 0, 'I'},
     {"read-qual-trim",  required_argument, 0, 'j'},
     {"log",             required_argument, 0, 'l'},
+    {"status-file",     required_argument, 0, 'U'},
+    {"status-interval", required_argument, 0, 'V'},
     {"max-reads",       required_argument, 0, 'n'},
     {"max-flank-indel", required_argument, 0, 'F'},
     {"str-vcf",         required_argument, 0, 'o'},
@@ -170,17 +221,27 @@ void parse_command_line_args(int argc, char** argv,
     {"max-str-len",     required_argument, 0, 'x'},
     {"filt-bam",        required_argument, 0, 'y'},
     {"viz-out",         required_argument, 0, 'z'},
+    {"gt-matrix",       required_argument, 0, 'M'},
+    {"locus-cache",     required_argument, 0, 'K'},
+    {"capture-locus",   required_argument, 0, 'C'},
+    {"locus-plan",      required_argument, 0, 'P'},
     {"min-sum-qual",	required_argument, 0, 'W'},
-    {"10x-bams",           no_argument, &bams_from_10x, 1},
+    {"long-read-flank", required_argument, 0, 'L'},
+    {"max-long-str-len", required_argument, 0, 'X'},
+    {"threads",         required_argument, 0, 'N'},
+    {"batch-loci",      required_argument, 0, 'A'},
+    {"pool-near-reads", required_argument, 0, 'R'},
+    {"10x-bams",           no_argument, &use_hap_tags, 1},
+    {"hap-tags",           no_argument, &use_hap_tags, 1},
     {"h",                  no_argument, &print_help, 1},
     {"help",               no_argument, &print_help, 1},
     {"lib-from-samp",      no_argument, &bam_lib_from_samp, 1},
-    {"hide-allreads",      no_argument, &(Genotyper::OUTPUT_ALLREADS),      0},
-    {"hide-mallreads",     no_argument, &(Genotyper::OUTPUT_MALLREADS),     0},
-    {"output-gls",         no_argument, &(Genotyper::OUTPUT_GLS),           1},
-    {"output-pls",         no_argument, &(Genotyper::OUTPUT_PLS),           1},
-    {"output-phased-gls",  no_argument, &(Genotyper::OUTPUT_PHASED_GLS),    1},
-    {"output-filters",     no_argument, &(Genotyper::OUTPUT_FILTERS),       1},
+    {"hide-allreads",      no_argument, &(genotyper_options.OUTPUT_ALLREADS),   0},
+    {"hide-mallreads",     no_argument, &(genotyper_options.OUTPUT_MALLREADS),  0},
+    {"output-gls",         no_argument, &(genotyper_options.OUTPUT_GLS),        1},
+    {"output-pls",         no_argument, &(genotyper_options.OUTPUT_PLS),        1},
+    {"output-phased-gls",  no_argument, &(genotyper_options.OUTPUT_PHASED_GLS), 1},
+    {"output-filters",     no_argument, &(genotyper_options.OUTPUT_FILTERS),    1},
     {"no-rmdup",           no_argument, &(bam_processor.REMOVE_PCR_DUPS),      0},
     {"use-unpaired",       no_argument, &(bam_processor.REQUIRE_PAIRED_READS), 0},
     {"dont-use-all-reads", no_argument, &(bam_processor.REQUIRE_SPANNING),     1},
@@ -191,16 +252,45 @@ void parse_command_line_args(int argc, char** argv,
     {"silent",             no_argument, &silent_log, 1},
     {"skip-genotyping",    no_argument, &skip_genotyping, 1},
     {"skip-assembly",	   no_argument, &skip_assembly, 1},
+    {"long-reads",         no_argument, &long_reads, 1},
+    {"length-only",        no_argument, &length_only, 1},
+    {"perf-counters",      no_argument, &perf_counters, 1},
     {0, 0, 0, 0}
   };
 
+  // Options that specify input/output files or how reads are extracted. All other options only configure the parameters
+  // of the genotyping stage and are recorded in PARAM_ARGS so that they can be reapplied when replaying captured loci
+  const char* non_param_option_names[] = {"bams", "bam-files", "chrom", "fam", "fasta", "bam-samps", "bam-libs", "lib-from-samp", "log", "str-vcf",
+					  "regions", "snp-vcf", "stutter-in", "stutter-out", "sample-list", "haploid-chrs", "hap-chr-file", "pass-bam",
+					  "filt-bam", "viz-out", "gt-matrix", "locus-cache", "capture-locus", "locus-plan", "h", "help", "version", "quiet", "silent",
+					  "skip-genotyping", "perf-counters", "status-file", "status-interval", "threads", "batch-loci"};
+  std::set<std::string> non_param_options(non_param_option_names, non_param_option_names + sizeof(non_param_option_names)/sizeof(non_param_option_names[0]));
+  param_args.clear();
+
   std::string filename;
   while (true){
     int option_index = 0;
-    int c = getopt_long(argc, argv, "b:B:c:d:D:e:f:F:g:G:i:I:j:k:l:m:n:o:p:q:r:s:S:t:u:v:w:x:y:z:W:", long_options, &option_index);
+    int c = getopt_long(argc, argv, "A:b:B:c:C:d:D:e:f:F:g:G:i:I:j:k:K:l:L:m:M:n:N:o:p:P:q:r:R:s:S:t:u:U:v:V:w:x:y:z:W:X:", long_options, &option_index);
     if (c == -1)
       break;
 
+    const char* option_name = NULL;
+    if (c == 0)
+      option_name = long_options[option_index].name;
+    else {
+      for (int i = 0; long_options[i].name != 0; i++){
+	if (long_options[i].flag == NULL && long_options[i].val == c){
+	  option_name = long_options[i].name;
+	  break;
+	}
+      }
+    }
+    if (option_name != NULL && non_param_options.find(option_name) == non_param_options.end()){
+      param_args.push_back("--" + std::string(option_name));
+      if (optarg != NULL)
+	param_args.push_back(std::string(optarg));
+    }
+
     if (optarg != NULL){
       std::string val(optarg);
       if (string_starts_with(val, "--"))
@@ -219,6 +309,12 @@ void parse_command_line_args(int argc, char** argv,
     case 'c':
       chrom = std::string(optarg);
       break;
+    case 'C':
+      capture_file = std::string(optarg);
+      break;
+    case 'P':
+      locus_plan_file = std::string(optarg);
+      break;
     case 'd':
       bam_processor.MAX_MATE_DIST = atoi(optarg);
       break;
@@ -256,6 +352,9 @@ void parse_command_line_args(int argc, char** argv,
       if (bam_processor.MAX_TOTAL_HAPLOTYPES <= 1)
 	printErrorAndDie("--max-haps must be greater than 1");
       break;
+    case 'K':
+      locus_cache_dir = std::string(optarg);
+      break;
     case 'l':
       log_file = std::string(optarg);
       break;
@@ -263,6 +362,9 @@ void parse_command_line_args(int argc, char** argv,
       filename = std::string(optarg);
       bam_processor.set_input_stutter(filename);
       break;
+    case 'M':
+      bam_processor.set_output_gt_matrix(std::string(optarg));
+      break;
     case 'n':
       bam_processor.MAX_TOTAL_READS = atoi(optarg);
       break;
@@ -291,9 +393,15 @@ void parse_command_line_args(int argc, char** argv,
     case 'u':
       hap_chr_file = std::string(optarg);
       break;
+    case 'U':
+      status_file = std::string(optarg);
+      break;
     case 'v':
       snp_vcf_file = std::string(optarg);
       break;
+    case 'V':
+      status_interval = atof(optarg);
+      break;
     case 'w':
       bam_pass_out_file = std::string(optarg);
       break;
@@ -310,11 +418,36 @@ void parse_command_line_args(int argc, char** argv,
       bam_processor.set_output_viz(filename);
       break;
     case 'F':
-      Genotyper::MAX_FLANK_INDEL_FRAC = atof(optarg);
+      genotyper_options.MAX_FLANK_INDEL_FRAC = atof(optarg);
       break;
     case 'W':
 	bam_processor.MIN_SUM_QUAL_LOG_PROB = atof(optarg);
 	break;
+    case 'L':
+      bam_processor.LONG_READ_FLANK = atoi(optarg);
+      if (bam_processor.LONG_READ_FLANK <= 0)
+	printErrorAndDie("--long-read-flank must be > 0");
+      break;
+    case 'X':
+      bam_processor.MAX_LONG_READ_STR_LENGTH = atoi(optarg);
+      if (bam_processor.MAX_LONG_READ_STR_LENGTH <= 0)
+	printErrorAndDie("--max-long-str-len must be > 0");
+      break;
+    case 'N':
+      genotyper_options.NUM_THREADS = atoi(optarg);
+      if (genotyper_options.NUM_THREADS <= 0)
+	printErrorAndDie("--threads must be > 0");
+      break;
+    case 'A':
+      bam_processor.LOCUS_BATCH_SIZE = atoi(optarg);
+      if (bam_processor.LOCUS_BATCH_SIZE <= 0)
+	printErrorAndDie("--batch-loci must be > 0");
+      break;
+    case 'R':
+      genotyper_options.MAX_POOL_CORRECTION_ERROR = atof(optarg);
+      if (genotyper_options.MAX_POOL_CORRECTION_ERROR < 0)
+	printErrorAndDie("--pool-near-reads must be >= 0");
+      break;
     case '?':
       printErrorAndDie("Unrecognized command line option");
       break;
@@ -338,7 +471,7 @@ void parse_command_line_args(int argc, char** argv,
     exit(0);
   }
   if (print_help){
-    print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len, def_max_haplotypes, def_max_flanks, def_min_flank_freq);
+    print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len, def_max_haplotypes, def_max_flanks, def_min_flank_freq, def_long_read_flank, def_max_long_str_len);
     exit(0);
   }
   if (quiet_log)
@@ -347,16 +480,208 @@ void parse_command_line_args(int argc, char** argv,
     bam_processor.suppress_all_logging();
   if (def_stutter_model == 1)
     bam_processor.set_default_stutter_model(0.95, 0.05, 0.05, 0.95, 0.01, 0.01);
-  if (bams_from_10x){
-    bam_processor.use_10x_bam_tags();
-    bam_processor.full_logger() << "Using 10X BAM tags to genotype and phase STRs (WARNING: Any arguments provided to --snp-vcf will be ignored)" << std::endl;
+  if (use_hap_tags){
+    bam_processor.use_haplotype_tags();
+    bam_processor.full_logger() << "Using BAM haplotype tags to genotype and phase STRs (WARNING: Any arguments provided to --snp-vcf will be ignored)" << std::endl;
   }
   if (skip_assembly == 1){
     bam_processor.skip_assembly();
   }
+  if (long_reads == 1){
+    bam_processor.use_long_read_mode();
+    bam_processor.full_logger() << "Clipping long reads to " << bam_processor.LONG_READ_FLANK << "bp on each side of the STRs and genotyping STRs shorter than "
+				<< bam_processor.MAX_LONG_READ_STR_LENGTH << "bp" << "\n"
+				<< "Long-read mode uses unpaired reads and doesn't remove PCR duplicates (equivalent to --use-unpaired and --no-rmdup)" << std::endl;
+  }
+  if (length_only == 1){
+    bam_processor.use_length_only_genotyping();
+    bam_processor.full_logger() << "Genotyping STRs using only the bp differences in each read's CIGAR string (WARNING: Sequence-based genotypes and --viz-out output will not be generated)" << std::endl;
+  }
+  if (perf_counters == 1){
+    std::string error;
+    if (PerfCounters::enable(error))
+      bam_processor.full_logger() << "Collecting hardware performance counters for each genotyping stage" << std::endl;
+    else
+      bam_processor.full_logger() << "WARNING: Hardware performance counters are unavailable and won't be reported (" << error << ")" << std::endl;
+  }
+  if (!status_file.empty())
+    bam_processor.set_status_file(status_file, status_interval);
+  bam_processor.set_genotyper_options(genotyper_options);
 }	
 
+/*
+ * Precompute the reference-only information for each locus in a region file and store it in a locus plan,
+ * which can be provided to later runs using --locus-plan instead of the region file
+ */
+int prepare_main(int argc, char** argv){
+  double total_time = clock();
+  std::string fasta_file = "", region_file = "", plan_file = "", chrom = "";
+  int print_help = 0;
+  static struct option long_options[] = {
+    {"chrom",   required_argument, 0, 'c'},
+    {"fasta",   required_argument, 0, 'f'},
+    {"plan",    required_argument, 0, 'P'},
+    {"regions", required_argument, 0, 'r'},
+    {"h",       no_argument, &print_help, 1},
+    {"help",    no_argument, &print_help, 1},
+    {0, 0, 0, 0}
+  };
+
+  while (true){
+    int option_index = 0;
+    int c = getopt_long(argc, argv, "c:f:P:r:", long_options, &option_index);
+    if (c == -1)
+      break;
+    switch(c){
+    case 0:
+      break;
+    case 'c':
+      chrom = std::string(optarg);
+      break;
+    case 'f':
+      fasta_file = std::string(optarg);
+      break;
+    case 'P':
+      plan_file = std::string(optarg);
+      break;
+    case 'r':
+      region_file = std::string(optarg);
+      break;
+    case '?':
+      printErrorAndDie("Unrecognized command line option");
+      break;
+    default:
+      abort();
+      break;
+    }
+  }
+
+  if (argc == 1 || print_help){
+    std::cerr << "Usage: HipSTR prepare --fasta <genome.fa> --regions <region_file.bed> --plan <loci.plan> [--chrom <chrom>]" << "\n"
+	      << "\t" << "Precomputes the reference windows, motifs and flank assembly feasibility of each region and stores" << "\n"
+	      << "\t" << "them in a binary locus plan, which can be provided to HipSTR using the --locus-plan option" << std::endl;
+    exit(0);
+  }
+  if (optind < argc)
+    printErrorAndDie("Did not recognize command line argument: " + std::string(argv[optind]));
+  if (fasta_file.empty())
+    printErrorAndDie("--fasta option required");
+  if (region_file.empty())
+    printErrorAndDie("--regions option required");
+  if (plan_file.empty())
+    printErrorAndDie("--plan option required");
+  if (!file_exists(fasta_file) || !is_file(fasta_file))
+    printErrorAndDie("FASTA file " + fasta_file + " does not exist. Please ensure that the path provided to --fasta is a valid FASTA file");
+
+  std::vector<Region> regions;
+  readRegions(region_file, 1000000000, chrom, regions, std::cerr);
+  orderRegions(regions);
+
+  FastaReader fasta_reader(fasta_file);
+  LocusPlanWriter plan_writer(plan_file, fasta_file);
+  std::string cur_chrom = "", chrom_seq = "";
+  int32_t num_near_end = 0, num_repetitive = 0;
+  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+    if (region_iter->chrom().compare(cur_chrom) != 0){
+      cur_chrom = region_iter->chrom();
+      fasta_reader.get_sequence(cur_chrom, chrom_seq);
+      if (chrom_seq.empty())
+	printErrorAndDie("No sequence for chromosome " + cur_chrom + " is present in the FASTA file " + fasta_file);
+    }
+    if (region_iter->stop() > (int32_t)chrom_seq.size())
+      printErrorAndDie("Region " + region_iter->str() + " extends beyond the end of its chromosome in the FASTA file");
+
+    PlannedLocus locus(*region_iter);
+    LocusPlan::plan_locus(chrom_seq, locus);
+    plan_writer.write_locus(locus);
+    num_near_end   += (locus.near_contig_end ? 1 : 0);
+    num_repetitive += (locus.left_flank_repetitive || locus.right_flank_repetitive ? 1 : 0);
+  }
+  plan_writer.close();
+
+  total_time = (clock() - total_time)/CLOCKS_PER_SEC;
+  std::cerr << "Wrote " << plan_writer.num_loci() << " loci to the locus plan " << plan_file << "\n"
+	    << "\t" << num_near_end   << " loci are within " << BamProcessor::CONTIG_END_DIST << "bp of a contig end" << "\n"
+	    << "\t" << num_repetitive << " loci have flanks that are too repetitive to assemble" << "\n"
+	    << "Total runtime = " << total_time << " sec" << std::endl;
+  return 0;
+}
+
+/*
+ * Rerun the genotyping stage for the loci in a file generated using --capture-locus. The captured parameters are applied first,
+ * followed by the provided options, which specify the output files and can override any of the captured parameters
+ */
+int replay_main(int argc, char** argv){
+  double total_time = clock();
+  precompute_integer_logs();
+
+  if (argc < 2 || string_starts_with(argv[1], "-")){
+    std::cerr << "Usage: HipSTR replay <loci.capture> --str-vcf <str_gts.vcf.gz> [OPTIONS]" << "\n"
+	      << "\t" << "Reruns the genotyping of the loci captured using --capture-locus. Accepts the same optional output" << "\n"
+	      << "\t" << "and genotyping parameters as HipSTR, which override those used when the loci were captured" << std::endl;
+    exit(argc < 2 ? 0 : 1);
+  }
+
+  std::string capture_path(argv[1]);
+  LocusCaptureReader capture_reader(capture_path);
+  std::stringstream full_command_ss;
+  full_command_ss << "HipSTR-" << VERSION << " replay";
+  std::vector<std::string> args(1, "HipSTR");
+  args.insert(args.end(), capture_reader.param_args().begin(), capture_reader.param_args().end());
+  for (int i = 1; i < argc; i++){
+    full_command_ss << " " << argv[i];
+    if (i > 1)
+      args.push_back(argv[i]);
+  }
+  std::string full_command = full_command_ss.str();
+  std::vector<char*> arg_ptrs;
+  for (unsigned int i = 0; i < args.size(); i++)
+    arg_ptrs.push_back(&args[i][0]);
+
+  GenotyperBamProcessor bam_processor(true, true);
+  int bam_lib_from_samp = 0, skip_genotyping = 0;
+  std::string bamfile_string="", bamlist_string="", rg_sample_string="", rg_lib_string="", hap_chr_string="", hap_chr_file="";
+  std::string region_file="", fasta_file="", chrom="", snp_vcf_file="";
+  std::string bam_pass_out_file="", bam_filt_out_file="", str_vcf_out_file="", fam_file = "", log_file = "", ref_vcf_file="";
+  std::string locus_cache_dir="", capture_file="", locus_plan_file="";
+  std::vector<std::string> param_args;
+  parse_command_line_args(arg_ptrs.size(), &arg_ptrs[0],
+			  bamfile_string, bamlist_string, rg_sample_string, rg_lib_string, hap_chr_string, hap_chr_file, fasta_file, region_file, snp_vcf_file,
+			  chrom, bam_pass_out_file, bam_filt_out_file, ref_vcf_file, str_vcf_out_file, fam_file, log_file, locus_cache_dir, capture_file,
+			  locus_plan_file, param_args, bam_lib_from_samp, skip_genotyping, bam_processor);
+
+  if (!log_file.empty())
+    bam_processor.set_log(log_file);
+  if (!bamfile_string.empty() || !bamlist_string.empty() || !region_file.empty() || !fasta_file.empty() || !snp_vcf_file.empty() || !fam_file.empty()
+      || !chrom.empty() || !bam_pass_out_file.empty() || !bam_filt_out_file.empty() || !locus_cache_dir.empty() || !capture_file.empty()
+      || !locus_plan_file.empty())
+    printErrorAndDie("Options that specify the BAMs/CRAMs, regions, FASTA, SNP VCF or locus caching can't be used when replaying captured loci");
+  if (str_vcf_out_file.empty())
+    printErrorAndDie("--str-vcf option required");
+  if (!string_ends_with(str_vcf_out_file, ".gz"))
+    printErrorAndDie("Path for STR VCF output file must end in .gz as it will be bgzipped");
+  if (!ref_vcf_file.empty())
+    bam_processor.set_ref_vcf(ref_vcf_file);
+
+  std::set<std::string> samples(capture_reader.samples().begin(), capture_reader.samples().end());
+  bam_processor.set_output_str_vcf(str_vcf_out_file, fasta_file, full_command, samples);
+  bam_processor.set_compression_threads(bam_processor.genotyper_options().NUM_THREADS);
+  bam_processor.full_logger() << "Replaying the loci captured in " << capture_path << std::endl;
+  bam_processor.replay_loci(capture_reader);
+  bam_processor.finish();
+
+  total_time = (clock() - total_time)/CLOCKS_PER_SEC;
+  bam_processor.full_logger() << "HipSTR execution finished: Total runtime = " << total_time << " sec" << "\n"
+			      << "-----------------\n\n" << std::endl;
+  return 0;
+}
+
 int main(int argc, char** argv){
+  if (argc > 1 && std::string(argv[1]).compare("replay") == 0)
+    return replay_main(argc-1, argv+1);
+  if (argc > 1 && std::string(argv[1]).compare("prepare") == 0)
+    return prepare_main(argc-1, argv+1);
+
   double total_time = clock();
   precompute_integer_logs(); // Calculate and cache log of integers from 1 -> 999
 
@@ -372,10 +697,13 @@ int main(int argc, char** argv){
   std::string bamfile_string="", bamlist_string="", rg_sample_string="", rg_lib_string="", hap_chr_string="", hap_chr_file="";
   std::string region_file="", fasta_file="", chrom="", snp_vcf_file="";
   std::string bam_pass_out_file="", bam_filt_out_file="", str_vcf_out_file="", fam_file = "", log_file = "", ref_vcf_file="";
+  std::string locus_cache_dir="", capture_file="", locus_plan_file="";
+  std::vector<std::string> param_args;
 
   parse_command_line_args(argc, argv,
 			  bamfile_string, bamlist_string, rg_sample_string, rg_lib_string, hap_chr_string, hap_chr_file, fasta_file, region_file, snp_vcf_file,
-			  chrom, bam_pass_out_file, bam_filt_out_file, ref_vcf_file, str_vcf_out_file, fam_file, log_file, bam_lib_from_samp, skip_genotyping, bam_processor);
+			  chrom, bam_pass_out_file, bam_filt_out_file, ref_vcf_file, str_vcf_out_file, fam_file, log_file, locus_cache_dir, capture_file,
+			  locus_plan_file, param_args, bam_lib_from_samp, skip_genotyping, bam_processor);
 
   if (!log_file.empty())
     bam_processor.set_log(log_file);
@@ -384,9 +712,11 @@ int main(int argc, char** argv){
     printErrorAndDie("You must specify either the --bams or --bam-files option");
   else if ((!bamfile_string.empty()) && (!bamlist_string.empty()))
     printErrorAndDie("You can only specify one of the --bams or --bam-files options");
-  else if (region_file.empty()){
+  else if (!region_file.empty() && !locus_plan_file.empty())
+    printErrorAndDie("You can only specify one of the --regions or --locus-plan options");
+  else if (region_file.empty() && locus_plan_file.empty()){
     std::stringstream err;
-    err << "--regions option required" << "\n"
+    err << "--regions or --locus-plan option required" << "\n"
 	<< "\tVisit https://github.com/HipSTR-Tool/HipSTR-references to view premade region files available for various model organisms";
     printErrorAndDie(err.str());
   }
@@ -399,6 +729,9 @@ int main(int argc, char** argv){
   if (!file_exists(fasta_file) || !is_file(fasta_file))
     printErrorAndDie("FASTA file " + fasta_file + " does not exist. Please ensure that the path provided to --fasta is a valid FASTA file");
 
+  if (!locus_plan_file.empty())
+    bam_processor.set_locus_plan(locus_plan_file);
+
   std::vector<std::string> bam_files;
   if (!bamlist_string.empty())
     split_by_delim(bamlist_string, ',', bam_files);
@@ -523,6 +856,7 @@ int main(int argc, char** argv){
       printErrorAndDie("Path for STR VCF output file must end in .gz as it will be bgzipped");
     bam_processor.set_output_str_vcf(str_vcf_out_file, fasta_file, full_command, rg_samples);
   }
+  bam_processor.set_compression_threads(bam_processor.genotyper_options().NUM_THREADS);
 
   if (!hap_chr_string.empty()){
     std::vector<std::string> haploid_chroms;
@@ -558,6 +892,27 @@ int main(int argc, char** argv){
       bam_processor.use_pedigree_to_filter_snps(families, snp_vcf_file);
   }
 
+  if (!capture_file.empty()){
+    if (skip_genotyping)
+      printErrorAndDie("--capture-locus option cannot be used in conjunction with the --skip-genotyping option");
+    bam_processor.set_capture_file(capture_file, param_args);
+  }
+
+  // Configure the locus cache last, as its keys depend on all of the other options
+  if (!locus_cache_dir.empty()){
+    if (skip_genotyping)
+      printErrorAndDie("--locus-cache option cannot be used in conjunction with the --skip-genotyping option");
+    if (!bam_pass_out_file.empty() || !bam_filt_out_file.empty())
+      printErrorAndDie("--locus-cache option cannot be used in conjunction with the --pass-bam or --filt-bam options");
+
+    std::vector<std::string> input_files(bam_files);
+    input_files.push_back(fasta_file);
+    if (!snp_vcf_file.empty()) input_files.push_back(snp_vcf_file);
+    if (!ref_vcf_file.empty()) input_files.push_back(ref_vcf_file);
+    if (!fam_file.empty())     input_files.push_back(fam_file);
+    bam_processor.set_locus_cache(locus_cache_dir, input_files, rg_ids_to_sample, rg_ids_to_library);
+  }
+
   // Run analysis
   bam_processor.process_regions(reader, region_file, fasta_file, rg_ids_to_sample, rg_ids_to_library, full_command, bam_pass_writer, bam_filt_writer, 10000000, chrom);
   bam_processor.finish();
@@ -0,0 +1,160 @@
+#include <fstream>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "locus_cache.h"
+#include "htslib/htslib/hts.h"
+
+const std::string LOCUS_CACHE_MAGIC = "HIPSTR_LOCUS_CACHE";
+const int LOCUS_CACHE_VERSION       = 3;
+
+static std::string md5_digest(const std::string& data){
+  hts_md5_context* context = hts_md5_init();
+  if (context == NULL)
+    printErrorAndDie("Failed to initialize the MD5 context for the locus cache");
+  unsigned char digest[16];
+  char hex[33];
+  hts_md5_update(context, data.data(), data.size());
+  hts_md5_final(digest, context);
+  hts_md5_hex(hex, digest);
+  hts_md5_destroy(context);
+  return std::string(hex);
+}
+
+LocusCache::LocusCache(const std::string& directory){
+  directory_  = directory;
+  num_hits_   = 0;
+  num_stores_ = 0;
+  while (directory_.size() > 1 && directory_[directory_.size()-1] == '/')
+    directory_.resize(directory_.size()-1);
+
+  struct stat st_buf;
+  if (stat(directory_.c_str(), &st_buf) != 0){
+    if (mkdir(directory_.c_str(), 0755) != 0)
+      printErrorAndDie("Failed to create the locus cache directory: " + directory_);
+  }
+  else if (!S_ISDIR(st_buf.st_mode))
+    printErrorAndDie("Path provided for the locus cache is not a directory: " + directory_);
+}
+
+void LocusCache::add_input_file(const std::string& path){
+  struct stat st_buf;
+  if (stat(path.c_str(), &st_buf) != 0)
+    printErrorAndDie("Failed to obtain the file information required by the locus cache for file: " + path);
+  run_fingerprint_ << "file=" << path << "\t" << st_buf.st_size << "\t" << st_buf.st_mtime << "\n";
+}
+
+void LocusCache::get_key(const RegionGroup& region_group, const std::string& chrom_seq,
+			 int32_t ref_padding, const std::string& locus_description, LocusCacheKey& key) const {
+  std::stringstream ss;
+  ss << run_fingerprint_.str();
+  for (auto region_iter = region_group.regions().begin(); region_iter != region_group.regions().end(); region_iter++)
+    ss << "region=" << region_iter->chrom() << "\t" << region_iter->start() << "\t" << region_iter->stop()
+       << "\t" << region_iter->period() << "\t" << region_iter->name() << "\n";
+
+  // Include the reference sequence from which the locus' reads are extracted
+  int32_t ref_start = std::max(0, region_group.start()-ref_padding);
+  int32_t ref_stop  = std::min((int32_t)chrom_seq.size(), region_group.stop()+ref_padding);
+  ss << "ref=" << chrom_seq.substr(ref_start, ref_stop-ref_start) << "\n";
+  ss << "locus=" << locus_description << "\n";
+
+  key.data   = ss.str();
+  key.digest = md5_digest(key.data);
+}
+
+bool LocusCache::load(const LocusCacheKey& key, LocusCacheEntry& entry){
+  entry.clear();
+  std::ifstream input(entry_path(key.digest).c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!input.is_open())
+    return false;
+
+  std::string line;
+  std::stringstream header;
+  header << LOCUS_CACHE_MAGIC << "\t" << LOCUS_CACHE_VERSION;
+  if (!std::getline(input, line) || line.compare(header.str()) != 0)
+    return false;
+
+  // Only reuse the entry if it was generated from exactly the same key data
+  std::stringstream key_header;
+  key_header << "KEY\t" << key.data.size();
+  if (!std::getline(input, line) || line.compare(key_header.str()) != 0)
+    return false;
+  std::string key_data(key.data.size(), '\0');
+  if (!key_data.empty() && !input.read(&key_data[0], key_data.size()))
+    return false;
+  if (key_data.compare(key.data) != 0)
+    return false;
+
+  // Each section consists of a tagged line specifying the number of bytes in the section followed by its text
+  while (std::getline(input, line)){
+    if (line.compare("END") == 0){
+      num_hits_++;
+      return true;
+    }
+
+    std::istringstream ss(line);
+    std::string tag;
+    int32_t pos = -1;
+    size_t num_bytes;
+    if (!(ss >> tag))
+      break;
+    if (tag.compare("OUTCOME") == 0){
+      // Outcome counts are stored on a single line rather than as a section of text
+      std::string name;
+      int32_t count;
+      if (!(ss >> name >> count))
+	break;
+      entry.outcome_counts[name] = count;
+      continue;
+    }
+    if (tag.compare("VCF") == 0 && !(ss >> pos))
+      break;
+    if (!(ss >> num_bytes))
+      break;
+    std::string text(num_bytes, '\0');
+    if (num_bytes != 0 && !input.read(&text[0], num_bytes))
+      break;
+
+    if (tag.compare("VCF") == 0)
+      entry.vcf_records.push_back(std::pair<int32_t, std::string>(pos, text));
+    else if (tag.compare("STUTTER") == 0)
+      entry.stutter_text = text;
+    else if (tag.compare("VIZ") == 0)
+      entry.viz_text = text;
+    else
+      break;
+  }
+
+  // Treat truncated or malformed entries as cache misses
+  entry.clear();
+  return false;
+}
+
+void LocusCache::store(const LocusCacheKey& key, const LocusCacheEntry& entry){
+  // Write to a temporary file and then rename it so that concurrent runs never observe a partial entry
+  std::stringstream tmp_path;
+  tmp_path << entry_path(key.digest) << ".tmp." << getpid();
+  std::ofstream output(tmp_path.str().c_str(), std::ios_base::out | std::ios_base::binary);
+  if (!output.is_open())
+    printErrorAndDie("Failed to write the locus cache file: " + tmp_path.str());
+
+  output << LOCUS_CACHE_MAGIC << "\t" << LOCUS_CACHE_VERSION << "\n";
+  output << "KEY\t" << key.data.size() << "\n" << key.data;
+  for (auto record_iter = entry.vcf_records.begin(); record_iter != entry.vcf_records.end(); record_iter++)
+    output << "VCF\t" << record_iter->first << "\t" << record_iter->second.size() << "\n" << record_iter->second;
+  if (!entry.stutter_text.empty())
+    output << "STUTTER\t" << entry.stutter_text.size() << "\n" << entry.stutter_text;
+  if (!entry.viz_text.empty())
+    output << "VIZ\t" << entry.viz_text.size() << "\n" << entry.viz_text;
+  for (auto count_iter = entry.outcome_counts.begin(); count_iter != entry.outcome_counts.end(); count_iter++)
+    output << "OUTCOME\t" << count_iter->first << "\t" << count_iter->second << "\n";
+  output << "END\n";
+  output.close();
+
+  if (output.fail() || rename(tmp_path.str().c_str(), entry_path(key.digest).c_str()) != 0){
+    remove(tmp_path.str().c_str());
+    printErrorAndDie("Failed to write the locus cache file: " + entry_path(key.digest));
+  }
+  num_stores_++;
+}
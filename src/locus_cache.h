@@ -0,0 +1,91 @@
+#ifndef LOCUS_CACHE_H_
+#define LOCUS_CACHE_H_
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "error.h"
+#include "region.h"
+
+/*
+ * Results emitted while processing a single locus. Replaying an entry reproduces the VCF, stutter model and
+ * visualization output of the locus, along with its contributions to the run's outcome counters (e.g. genotyping failures)
+ */
+class LocusCacheEntry {
+ public:
+  std::vector< std::pair<int32_t, std::string> > vcf_records;
+  std::string stutter_text;
+  std::string viz_text;
+  std::map<std::string, int32_t> outcome_counts;
+
+  void clear(){
+    vcf_records.clear();
+    stutter_text.clear();
+    viz_text.clear();
+    outcome_counts.clear();
+  }
+};
+
+/*
+ * Identifies a locus' cache entry. The entry's file is named using the 128-bit MD5 digest of the key's data,
+ * and the data itself is stored in the entry so that a digest collision can never return another locus' results
+ */
+class LocusCacheKey {
+ public:
+  std::string digest;
+  std::string data;
+
+  void clear(){
+    digest.clear();
+    data.clear();
+  }
+};
+
+/*
+ * On-disk cache of per-locus results stored in a directory with one file per locus.
+ * Each file is named using a digest of the locus' region, the surrounding reference sequence,
+ * the run's parameters and the identities of its input files (path, size and modification time).
+ * As a result, only loci whose inputs have changed are recomputed when a run is repeated or its region file is edited
+ */
+class LocusCache {
+ private:
+  std::string directory_;
+  std::stringstream run_fingerprint_;
+  int32_t num_hits_, num_stores_;
+
+  std::string entry_path(const std::string& key) const { return directory_ + "/" + key + ".locus"; }
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusCache(const LocusCache& other);
+  LocusCache& operator=(const LocusCache& other);
+
+ public:
+  explicit LocusCache(const std::string& directory);
+
+  int32_t num_hits()   const { return num_hits_;   }
+  int32_t num_stores() const { return num_stores_; }
+
+  // Add a named value that affects every locus' results to the run's fingerprint
+  void add_to_fingerprint(const std::string& name, const std::string& value){
+    run_fingerprint_ << name << "=" << value << "\n";
+  }
+
+  // Add an input file's identity (path, size and modification time) to the run's fingerprint
+  void add_input_file(const std::string& path);
+
+  // Construct the cache key for a locus. The locus-specific description should contain any
+  // information that isn't captured by the regions and the reference sequence (e.g. per-locus stutter models)
+  void get_key(const RegionGroup& region_group, const std::string& chrom_seq,
+	       int32_t ref_padding, const std::string& locus_description, LocusCacheKey& key) const;
+
+  // Returns true iff an entry whose key data matches the key was found, in which case it's loaded into the provided entry
+  bool load(const LocusCacheKey& key, LocusCacheEntry& entry);
+
+  void store(const LocusCacheKey& key, const LocusCacheEntry& entry);
+};
+
+#endif
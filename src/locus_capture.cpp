@@ -0,0 +1,146 @@
+#include <algorithm>
+
+#include "binary_io.h"
+#include "error.h"
+#include "locus_capture.h"
+
+const std::string LOCUS_CAPTURE_MAGIC = "HIPSTR_LOCUS_CAPTURE";
+const int32_t LOCUS_CAPTURE_VERSION   = 1;
+
+// Tags preceding each section of the file
+const char CAPTURE_HEADER_TAG = 'H';
+const char CAPTURE_LOCUS_TAG  = 'L';
+
+LocusCaptureWriter::LocusCaptureWriter(const std::string& path, const std::vector<std::string>& param_args)
+  : param_args_(param_args){
+  wrote_header_ = false;
+  num_loci_     = 0;
+  output_.open(path.c_str(), std::ios_base::out | std::ios_base::binary);
+  if (!output_.is_open())
+    printErrorAndDie("Failed to open the locus capture file: " + path);
+  write_binary_string(output_, LOCUS_CAPTURE_MAGIC);
+  write_binary(output_, LOCUS_CAPTURE_VERSION);
+}
+
+void LocusCaptureWriter::write_header(bool read_stutter_models, const std::string& vcf_header, const std::vector<std::string>& samples){
+  assert(!wrote_header_);
+  write_binary(output_, CAPTURE_HEADER_TAG);
+  write_binary_strings(output_, param_args_);
+  write_binary(output_, read_stutter_models);
+  write_binary_string(output_, vcf_header);
+  write_binary_strings(output_, samples);
+  wrote_header_ = true;
+}
+
+void LocusCaptureWriter::write_locus(const RegionGroup& region_group, const std::string& chrom_seq, int32_t ref_padding, bool haploid, bool too_many_reads,
+				     const std::string& stutter_text, const std::vector<std::string>& rg_names,
+				     const std::vector< std::vector<BamAlignment> >& alignments,
+				     const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s){
+  assert(wrote_header_);
+  assert(alignments.size() == rg_names.size() && alignments.size() == log_p1s.size() && alignments.size() == log_p2s.size());
+  write_binary(output_, CAPTURE_LOCUS_TAG);
+
+  const std::vector<Region>& regions = region_group.regions();
+  write_binary<uint32_t>(output_, regions.size());
+  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+    write_binary_string(output_, region_iter->chrom());
+    write_binary(output_, region_iter->start());
+    write_binary(output_, region_iter->stop());
+    write_binary(output_, region_iter->period());
+    write_binary_string(output_, region_iter->name());
+  }
+  write_binary(output_, haploid);
+  write_binary(output_, too_many_reads);
+
+  // Only the portion of the chromosome that the genotyper can access is required
+  int32_t ref_start = region_group.start(), ref_stop = region_group.stop();
+  for (auto sample_iter = alignments.begin(); sample_iter != alignments.end(); sample_iter++){
+    for (auto aln_iter = sample_iter->begin(); aln_iter != sample_iter->end(); aln_iter++){
+      ref_start = std::min(ref_start, aln_iter->Position());
+      ref_stop  = std::max(ref_stop,  aln_iter->GetEndPosition());
+    }
+  }
+  ref_start = std::max(0, ref_start-ref_padding);
+  ref_stop  = std::min((int32_t)chrom_seq.size(), ref_stop+ref_padding);
+  write_binary<int32_t>(output_, chrom_seq.size());
+  write_binary(output_, ref_start);
+  write_binary_string(output_, chrom_seq.substr(ref_start, ref_stop-ref_start));
+  write_binary_string(output_, stutter_text);
+
+  write_binary<uint32_t>(output_, alignments.size());
+  for (unsigned int i = 0; i < alignments.size(); i++){
+    write_binary_string(output_, rg_names[i]);
+    write_binary<uint32_t>(output_, alignments[i].size());
+    for (auto aln_iter = alignments[i].begin(); aln_iter != alignments[i].end(); aln_iter++)
+      aln_iter->Serialize(output_);
+    write_binary_vector(output_, log_p1s[i]);
+    write_binary_vector(output_, log_p2s[i]);
+  }
+  output_.flush();
+  if (output_.fail())
+    printErrorAndDie("Failed to write to the locus capture file");
+  num_loci_++;
+}
+
+LocusCaptureReader::LocusCaptureReader(const std::string& path) : path_(path){
+  input_.open(path.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!input_.is_open())
+    printErrorAndDie("Failed to open the locus capture file: " + path);
+
+  std::string magic;
+  int32_t version;
+  if (!read_binary_string(input_, magic) || magic.compare(LOCUS_CAPTURE_MAGIC) != 0)
+    printErrorAndDie("File is not a HipSTR locus capture file: " + path);
+  if (!read_binary(input_, version) || version != LOCUS_CAPTURE_VERSION)
+    printErrorAndDie("Locus capture file was generated by an incompatible version of HipSTR: " + path);
+
+  char tag;
+  if (!read_binary(input_, tag) || tag != CAPTURE_HEADER_TAG || !read_binary_strings(input_, param_args_) || !read_binary(input_, read_stutter_models_)
+      || !read_binary_string(input_, vcf_header_) || !read_binary_strings(input_, samples_))
+    printErrorAndDie("Locus capture file is truncated or corrupted: " + path);
+}
+
+bool LocusCaptureReader::next_locus(LocusCapture& locus){
+  char tag;
+  if (!read_binary(input_, tag))
+    return false;
+
+  bool valid = (tag == CAPTURE_LOCUS_TAG);
+  uint32_t num_regions = 0, num_samples = 0;
+  valid = valid && read_binary(input_, num_regions) && num_regions > 0;
+  locus.regions.clear();
+  for (uint32_t i = 0; valid && i < num_regions; i++){
+    std::string chrom, name;
+    int32_t start, stop;
+    int period;
+    valid = read_binary_string(input_, chrom) && read_binary(input_, start) && read_binary(input_, stop)
+      && read_binary(input_, period) && read_binary_string(input_, name);
+    if (valid)
+      locus.regions.push_back(Region(chrom, start, stop, period, name));
+  }
+  valid = valid && read_binary(input_, locus.haploid) && read_binary(input_, locus.too_many_reads);
+  valid = valid && read_binary(input_, locus.chrom_length) && read_binary(input_, locus.ref_start) && read_binary_string(input_, locus.ref_seq);
+  valid = valid && locus.ref_start >= 0 && locus.ref_start + (int64_t)locus.ref_seq.size() <= locus.chrom_length;
+  valid = valid && read_binary_string(input_, locus.stutter_text);
+  valid = valid && read_binary(input_, num_samples);
+  if (valid){
+    locus.rg_names     = std::vector<std::string>(num_samples);
+    locus.alignments   = std::vector< std::vector<BamAlignment> >(num_samples);
+    locus.log_p1s      = std::vector< std::vector<double> >(num_samples);
+    locus.log_p2s      = std::vector< std::vector<double> >(num_samples);
+  }
+  for (uint32_t i = 0; valid && i < num_samples; i++){
+    uint32_t num_alns;
+    valid = read_binary_string(input_, locus.rg_names[i]) && read_binary(input_, num_alns);
+    if (valid)
+      locus.alignments[i].resize(num_alns);
+    for (uint32_t j = 0; valid && j < num_alns; j++)
+      valid = locus.alignments[i][j].Deserialize(input_);
+    valid = valid && read_binary_vector(input_, locus.log_p1s[i]) && read_binary_vector(input_, locus.log_p2s[i]);
+    valid = valid && locus.log_p1s[i].size() == num_alns && locus.log_p2s[i].size() == num_alns;
+  }
+
+  if (!valid)
+    printErrorAndDie("Locus capture file is truncated or corrupted: " + path_);
+  return true;
+}
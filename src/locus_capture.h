@@ -0,0 +1,105 @@
+#ifndef LOCUS_CAPTURE_H_
+#define LOCUS_CAPTURE_H_
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "bam_io.h"
+#include "region.h"
+
+/*
+ * Everything provided to the genotyping stage for a single locus: the filtered reads and SNP phasing
+ * log-likelihoods for each sample, the reference sequence surrounding the locus and any stutter models
+ * supplied using --stutter-in. Replaying a capture reruns only the genotyping stage, without any BAM, FASTA or VCF access
+ */
+class LocusCapture {
+ public:
+  std::vector<Region> regions;
+  bool haploid, too_many_reads;
+  int32_t chrom_length, ref_start;
+  std::string ref_seq;                          // Reference sequence starting at REF_START
+  std::string stutter_text;                     // User-provided stutter models for the regions, in --stutter-in format
+  std::vector<std::string> rg_names;
+  std::vector< std::vector<BamAlignment> > alignments;
+  std::vector< std::vector<double> > log_p1s, log_p2s;
+
+  LocusCapture(){
+    haploid        = false;
+    too_many_reads = false;
+    chrom_length   = 0;
+    ref_start      = 0;
+  }
+
+  RegionGroup region_group() const {
+    RegionGroup region_group(regions[0]);
+    for (unsigned int i = 1; i < regions.size(); i++)
+      region_group.add_region(regions[i]);
+    return region_group;
+  }
+
+  // Overwrite the window of the chromosome's sequence that was captured with this locus
+  void fill_chrom_seq(std::string& chrom_seq) const {
+    if ((int32_t)chrom_seq.size() != chrom_length)
+      chrom_seq.assign(chrom_length, 'N');
+    chrom_seq.replace(ref_start, ref_seq.size(), ref_seq);
+  }
+};
+
+/*
+ * Binary file containing the loci provided to the genotyping stage of a run. The file's header contains
+ * the command line options that configure the run's parameters and the run's VCF header
+ */
+class LocusCaptureWriter {
+ private:
+  std::ofstream output_;
+  std::vector<std::string> param_args_;
+  bool wrote_header_;
+  int32_t num_loci_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusCaptureWriter(const LocusCaptureWriter& other);
+  LocusCaptureWriter& operator=(const LocusCaptureWriter& other);
+
+ public:
+  LocusCaptureWriter(const std::string& path, const std::vector<std::string>& param_args);
+
+  int32_t num_loci() const { return num_loci_; }
+
+  void write_header(bool read_stutter_models, const std::string& vcf_header, const std::vector<std::string>& samples);
+
+  // The captured reference sequence spans the reads and extends REF_PADDING bp beyond the region group and the reads
+  void write_locus(const RegionGroup& region_group, const std::string& chrom_seq, int32_t ref_padding, bool haploid, bool too_many_reads,
+		   const std::string& stutter_text, const std::vector<std::string>& rg_names,
+		   const std::vector< std::vector<BamAlignment> >& alignments,
+		   const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s);
+
+  void close(){ output_.close(); }
+};
+
+class LocusCaptureReader {
+ private:
+  std::ifstream input_;
+  std::string path_;
+  std::vector<std::string> param_args_, samples_;
+  std::string vcf_header_;
+  bool read_stutter_models_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusCaptureReader(const LocusCaptureReader& other);
+  LocusCaptureReader& operator=(const LocusCaptureReader& other);
+
+ public:
+  explicit LocusCaptureReader(const std::string& path);
+
+  const std::vector<std::string>& param_args() const { return param_args_;          }
+  const std::vector<std::string>& samples()    const { return samples_;             }
+  const std::string& vcf_header()              const { return vcf_header_;          }
+  bool read_stutter_models()                   const { return read_stutter_models_; }
+
+  // Returns false once all of the captured loci have been read
+  bool next_locus(LocusCapture& locus);
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include <assert.h>
+#include <map>
+#include <mutex>
+
+#include "bam_processor.h"
+#include "em_stutter_genotyper.h"
+#include "extract_indels.h"
+#include "locus_genotyper.h"
+#include "mathops.h"
+#include "seq_stutter_genotyper.h"
+#include "stringops.h"
+#include "SeqAlignment/AlignmentOps.h"
+
+int left_align_sample_reads(const RegionGroup& region_group, const std::string& chrom_seq, int32_t flank,
+			    std::vector< std::vector<BamAlignment> >& alignments,
+			    const std::vector< std::vector<double> >& log_p1, const std::vector< std::vector<double> >& log_p2,
+			    std::vector< std::vector<double> >& filt_log_p1,  std::vector< std::vector<double> >& filt_log_p2,
+			    AlignmentArena& left_alns, int32_t& total_reads){
+  std::map<std::string, int> seq_to_alns;
+  int32_t align_fail_count = 0;
+  total_reads = 0;
+  left_alns.clear(); filt_log_p1.clear(); filt_log_p2.clear();
+
+  std::vector<bool> passes_region_filters; passes_region_filters.reserve(region_group.num_regions());
+  for (unsigned int i = 0; i < alignments.size(); ++i){
+    filt_log_p1.push_back(std::vector<double>());
+    filt_log_p2.push_back(std::vector<double>());
+
+    for (unsigned int j = 0; j < alignments[i].size(); ++j, ++total_reads){
+      // Trim alignment if it extends very far upstream or downstream of the STR. For tractability, we limit it to 40bp
+      // (or to the long-read window, in which case reads have already been clipped to this window)
+      alignments[i][j].TrimAlignment((region_group.start() > flank ? region_group.start()-flank : 1), region_group.stop()+flank);
+      if (alignments[i][j].Length() == 0)
+        continue;
+
+      auto iter      = seq_to_alns.find(alignments[i][j].QueryBases());
+      bool have_prev = (iter != seq_to_alns.end());
+      if (have_prev)
+        have_prev &= left_alns.get_sequence_length(iter->second) == alignments[i][j].QueryBases().size();
+
+      passes_region_filters.clear();
+      BamProcessor::passes_filters(alignments[i][j], passes_region_filters);
+
+      if (!have_prev){
+        // Only the read being realigned is materialized. It's discarded once it's been copied into the arena
+        Alignment left_aln(alignments[i][j].Name());
+        if (alignments[i][j].MatchesReference())
+          convertAlignment(alignments[i][j], chrom_seq, left_aln);
+        else if (!realign(alignments[i][j], chrom_seq, left_aln)){
+	  // Failed to realign read
+          align_fail_count++;
+          continue;
+	}
+        left_aln.check_CIGAR_string(); // Ensure alignment is properly formatted
+        left_aln.set_hap_gen_info(passes_region_filters);
+	seq_to_alns[alignments[i][j].QueryBases()] = left_alns.add(left_aln);
+      }
+      else {
+        // Reuse alignments if the sequence has already been observed and didn't lead to a soft-clipped alignment
+        // Soft-clipping is problematic because it complicates base quality extration (but not really that much)
+        // As the sequences have the same length, the reused CIGAR string is also properly formatted
+	std::string bases = uppercase(alignments[i][j].QueryBases());
+        left_alns.add_with_alignment_of(iter->second, alignments[i][j].Name(), alignments[i][j].IsReverseStrand(),
+					alignments[i][j].Qualities(), bases, passes_region_filters);
+      }
+
+      filt_log_p1[i].push_back(log_p1[i][j]);
+      filt_log_p2[i].push_back(log_p2[i][j]);
+    }
+  }
+  return align_fail_count;
+}
+
+int extract_str_lengths(std::vector< std::vector<BamAlignment> >& alignments,
+			const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+			const Region& region, int max_reads, std::vector< std::vector<int> >& str_bp_lengths,
+			std::vector< std::vector<double> >& str_log_p1s, std::vector< std::vector<double> >& str_log_p2s){
+  str_bp_lengths = std::vector< std::vector<int> >(alignments.size());
+  str_log_p1s    = std::vector< std::vector<double> >(alignments.size());
+  str_log_p2s    = std::vector< std::vector<double> >(alignments.size());
+  int inf_reads  = 0;
+
+  // Extract bp differences and phasing probabilities for each read
+  for (unsigned int i = 0; i < alignments.size(); ++i){
+    for (unsigned int j = 0; j < alignments[i].size(); ++j){
+      int bp_diff;
+      bool got_size = ExtractCigar(alignments[i][j].CigarData(), alignments[i][j].Position(), region.start()-region.period(), region.stop()+region.period(), bp_diff);
+      if (got_size){
+	if (bp_diff < -(int)(region.stop()-region.start()+1))
+	  continue;
+	inf_reads++;
+	str_bp_lengths[i].push_back(bp_diff);
+	if (log_p1s.size() == 0){
+	  str_log_p1s[i].push_back(0); str_log_p2s[i].push_back(0); // Assign equal phasing LLs as no SNP info is available
+	}
+	else {
+	  str_log_p1s[i].push_back(log_p1s[i][j]); str_log_p2s[i].push_back(log_p2s[i][j]);
+	}
+      }
+    }
+    if (max_reads >= 0 && inf_reads > max_reads)
+      break;
+  }
+
+  return inf_reads;
+}
+
+// The table of integer logarithms used throughout the genotyper is shared by all instances and only filled once
+static std::once_flag integer_logs_flag;
+
+LocusGenotyper::LocusGenotyper(const LocusGenotyperOptions& options) : options_(options){
+  def_stutter_model_ = NULL;
+  logger_            = &null_log_;
+  std::call_once(integer_logs_flag, precompute_integer_logs);
+}
+
+StutterModel* LocusGenotyper::learn_stutter_model(LocusReads& reads, const Region& region, std::string& failure_reason){
+  std::vector< std::vector<int> > str_bp_lengths;
+  std::vector< std::vector<double> > str_log_p1s, str_log_p2s;
+  const int MAX_INF_READS = 10000;
+  int inf_reads = extract_str_lengths(reads.alignments, reads.log_p1s, reads.log_p2s, region, MAX_INF_READS, str_bp_lengths, str_log_p1s, str_log_p2s);
+  if (inf_reads < options_.min_total_reads){
+    failure_reason = "Too few informative reads for stutter training";
+    return NULL;
+  }
+
+  EMStutterGenotyper length_genotyper(options_.genotyper, options_.haploid, region.period(), str_bp_lengths, str_log_p1s, str_log_p2s, reads.sample_names, 0);
+  if (!length_genotyper.train(options_.max_em_iter, options_.abs_ll_converge, options_.frac_ll_converge, false, *logger_)){
+    failure_reason = "Stutter model training failed";
+    return NULL;
+  }
+  return length_genotyper.get_stutter_model()->copy();
+}
+
+bool LocusGenotyper::genotype(const RegionGroup& region_group, const std::string& chrom_seq, LocusReads& reads, LocusGenotypes& results){
+  results.success = false;
+  results.failure_reason.clear();
+  results.loci.clear();
+  if (reads.alignments.size() != reads.sample_names.size())
+    printErrorAndDie("LocusGenotyper requires one list of reads for each sample");
+
+  // Assign equal phasing LLs if no SNP info was provided
+  if (reads.log_p1s.empty() && reads.log_p2s.empty()){
+    for (unsigned int i = 0; i < reads.alignments.size(); i++){
+      reads.log_p1s.push_back(std::vector<double>(reads.alignments[i].size(), 0.0));
+      reads.log_p2s.push_back(std::vector<double>(reads.alignments[i].size(), 0.0));
+    }
+  }
+  if (reads.log_p1s.size() != reads.alignments.size() || reads.log_p2s.size() != reads.alignments.size())
+    printErrorAndDie("LocusGenotyper requires phasing log-likelihoods for each sample's reads");
+
+  // Reads that weren't filtered by a BamProcessor are used to generate haplotypes for every region
+  int32_t total_reads = 0;
+  std::string all_pass(region_group.num_regions(), '1');
+  for (unsigned int i = 0; i < reads.alignments.size(); i++){
+    if (reads.log_p1s[i].size() != reads.alignments[i].size() || reads.log_p2s[i].size() != reads.alignments[i].size())
+      printErrorAndDie("LocusGenotyper requires phasing log-likelihoods for each sample's reads");
+    for (unsigned int j = 0; j < reads.alignments[i].size(); j++)
+      if (!reads.alignments[i][j].HasTag("PF"))
+	BamProcessor::add_passes_filters_tag(reads.alignments[i][j], all_pass);
+    total_reads += reads.alignments[i].size();
+  }
+  if (total_reads < options_.min_total_reads){
+    results.failure_reason = "Too few reads";
+    return false;
+  }
+
+  // Use the default stutter model or learn one for each region
+  const std::vector<Region>& regions = region_group.regions();
+  std::vector<StutterModel*> stutter_models;
+  bool stutter_success = true;
+  for (auto region_iter = regions.begin(); region_iter != regions.end() && stutter_success; region_iter++){
+    StutterModel* stutter_model = NULL;
+    if (def_stutter_model_ != NULL){
+      stutter_model = def_stutter_model_->copy();
+      stutter_model->set_period(region_iter->period());
+    }
+    else
+      stutter_model = learn_stutter_model(reads, *region_iter, results.failure_reason);
+    stutter_success = (stutter_model != NULL);
+    if (stutter_success)
+      stutter_models.push_back(stutter_model);
+  }
+
+  if (stutter_success){
+    AlignmentArena left_alignments;
+    std::vector< std::vector<double> > filt_log_p1s, filt_log_p2s;
+    left_align_sample_reads(region_group, chrom_seq, options_.read_flank, reads.alignments, reads.log_p1s, reads.log_p2s,
+			    filt_log_p1s, filt_log_p2s, left_alignments, total_reads);
+
+    // The genotyper takes ownership of the arena's contents
+    SeqStutterGenotyper seq_genotyper(options_.genotyper, region_group, options_.haploid, options_.reassemble_flanks, left_alignments, filt_log_p1s, filt_log_p2s,
+				      reads.sample_names, chrom_seq, stutter_models, NULL, *logger_, options_.skip_assembly);
+    if (!seq_genotyper.genotype(options_.max_total_haplotypes, options_.max_flank_haplotypes, options_.min_flank_freq, *logger_))
+      results.failure_reason = "Genotyping failed";
+    else if (options_.recalc_stutter_model && !seq_genotyper.recompute_stutter_models(*logger_, options_.max_total_haplotypes, options_.max_flank_haplotypes,
+											   options_.min_flank_freq, options_.max_em_iter,
+											   options_.abs_ll_converge, options_.frac_ll_converge))
+      results.failure_reason = "Stutter model recalculation failed";
+    else {
+      seq_genotyper.write_vcf_record(reads.sample_names, chrom_seq, false, false, null_log_, NULL, NULL, *logger_, &results.loci);
+      results.success = true;
+    }
+  }
+
+  for (unsigned int i = 0; i < stutter_models.size(); i++)
+    delete stutter_models[i];
+  return results.success;
+}
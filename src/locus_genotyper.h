@@ -0,0 +1,140 @@
+#ifndef LOCUS_GENOTYPER_H_
+#define LOCUS_GENOTYPER_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "bam_io.h"
+#include "genotype_matrix.h"
+#include "genotyper_options.h"
+#include "null_ostream.h"
+#include "region.h"
+#include "stutter_model.h"
+#include "SeqAlignment/AlignmentArena.h"
+#include "SeqAlignment/AlignmentData.h"
+
+/*
+ * Left align each sample's reads relative to the reference, reusing the alignment of previously observed sequences. Reads
+ * are first trimmed to FLANK bp around the region group. Reads that fail to realign are discarded. Returns the number of discarded reads
+ */
+int left_align_sample_reads(const RegionGroup& region_group, const std::string& chrom_seq, int32_t flank,
+			    std::vector< std::vector<BamAlignment> >& alignments,
+			    const std::vector< std::vector<double> >& log_p1, const std::vector< std::vector<double> >& log_p2,
+			    std::vector< std::vector<double> >& filt_log_p1,  std::vector< std::vector<double> >& filt_log_p2,
+			    AlignmentArena& left_alns, int32_t& total_reads);
+
+// Extract the bp difference of each read that spans the region, using at most MAX_READS reads (or all reads if negative).
+// Returns the number of informative reads
+int extract_str_lengths(std::vector< std::vector<BamAlignment> >& alignments,
+			const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+			const Region& region, int max_reads, std::vector< std::vector<int> >& str_bp_lengths,
+			std::vector< std::vector<double> >& str_log_p1s, std::vector< std::vector<double> >& str_log_p2s);
+
+/*
+ * Parameters for a LocusGenotyper. The defaults match those of the HipSTR command line
+ */
+class LocusGenotyperOptions {
+ public:
+  bool haploid;                // Genotype the samples as haploid
+  bool reassemble_flanks;      // Use local assembly to identify variants in the flanks of the STR
+  bool skip_assembly;          // Skip assembly of the STR itself and only use stutter-derived candidate alleles
+  bool recalc_stutter_model;   // Retrain the stutter model using the haplotype alignments and regenotype
+  int min_total_reads;
+  int max_total_haplotypes;
+  int max_flank_haplotypes;
+  double min_flank_freq;
+  int max_em_iter;
+  double abs_ll_converge;
+  double frac_ll_converge;
+  int32_t read_flank;          // Reads are trimmed to this many bp around the region group before left alignment
+  GenotyperOptions genotyper;  // Output and extraction settings for the underlying genotypers
+
+  LocusGenotyperOptions(){
+    haploid              = false;
+    reassemble_flanks    = true;
+    skip_assembly        = false;
+    recalc_stutter_model = false;
+    min_total_reads      = 100;
+    max_total_haplotypes = 1000;
+    max_flank_haplotypes = 4;
+    min_flank_freq       = 0.01;
+    max_em_iter          = 100;
+    abs_ll_converge      = 0.01;
+    frac_ll_converge     = 0.001;
+    read_flank           = 40;
+  }
+};
+
+/*
+ * Reads provided for a single region group, grouped by sample. The phasing log-likelihoods are optional. If they're
+ * empty, every read is assumed to be equally likely to originate from either haplotype
+ */
+class LocusReads {
+ public:
+  std::vector<std::string> sample_names;
+  std::vector< std::vector<BamAlignment> > alignments;
+  std::vector< std::vector<double> > log_p1s, log_p2s;
+};
+
+/*
+ * Genotyping results for a region group. LOCI contains one entry per region, with one genotype per input sample in
+ * the order the samples were provided. Samples whose calls were filtered or that had no usable reads are marked as missing
+ */
+class LocusGenotypes {
+ public:
+  bool success;
+  std::string failure_reason;
+  std::vector<GenotypeMatrixLocus> loci;
+
+  LocusGenotypes(){
+    success = false;
+  }
+};
+
+/*
+ * Reentrant entry point to HipSTR's sequence-based genotyper that genotypes one region group at a time from reads supplied
+ * by the caller. Each instance only reads its immutable options, so separate instances can genotype loci concurrently
+ * on different threads. A single instance must not be shared across threads
+ */
+class LocusGenotyper {
+ private:
+  const LocusGenotyperOptions options_;
+  StutterModel* def_stutter_model_;
+  NullOstream null_log_;
+  std::ostream* logger_;
+
+  StutterModel* learn_stutter_model(LocusReads& reads, const Region& region, std::string& failure_reason);
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusGenotyper(const LocusGenotyper& other);
+  LocusGenotyper& operator=(const LocusGenotyper& other);
+
+ public:
+  explicit LocusGenotyper(const LocusGenotyperOptions& options);
+
+  ~LocusGenotyper(){
+    delete def_stutter_model_;
+  }
+
+  const LocusGenotyperOptions& options() const { return options_; }
+
+  // Use a copy of the provided stutter model for every region instead of learning one from each locus' reads
+  void set_default_stutter_model(const StutterModel& stutter_model){
+    delete def_stutter_model_;
+    def_stutter_model_ = stutter_model.copy();
+  }
+
+  // Write the genotyper's progress messages to the provided stream, which must outlive the genotyper (or be used by one thread)
+  void set_log(std::ostream& logger){ logger_ = &logger; }
+
+  /*
+   * Genotype each region in the group using the provided reads and the sequence of the region group's chromosome.
+   * Reads lacking the PF tag that BamProcessor adds during filtering are used to generate candidate haplotypes for every region.
+   * Returns false and sets the results' failure reason if the locus couldn't be genotyped
+   */
+  bool genotype(const RegionGroup& region_group, const std::string& chrom_seq, LocusReads& reads, LocusGenotypes& results);
+};
+
+#endif
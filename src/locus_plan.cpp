@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <map>
+
+#include "bam_processor.h"
+#include "binary_io.h"
+#include "debruijn_graph.h"
+#include "error.h"
+#include "locus_plan.h"
+#include "stringops.h"
+#include "SeqAlignment/HaplotypeGenerator.h"
+
+const std::string LOCUS_PLAN_MAGIC = "HIPSTR_LOCUS_PLAN";
+const int32_t LOCUS_PLAN_VERSION   = 2;
+
+// Bits used to store the locus flags
+const uint8_t PLAN_NEAR_CONTIG_END  = 1;
+const uint8_t PLAN_LEFT_REPETITIVE  = 2;
+const uint8_t PLAN_RIGHT_REPETITIVE = 4;
+
+const GenotyperOptions LocusPlan::DEFAULT_OPTIONS;
+
+std::string LocusPlan::most_frequent_motif(const std::string& seq, int period){
+  if (period <= 0 || (int)seq.size() < period)
+    return "";
+  std::map<std::string, int> counts;
+  std::string best_motif = seq.substr(0, period);
+  int best_count = 0;
+  for (unsigned int i = 0; i+period <= seq.size(); i++){
+    std::string motif = seq.substr(i, period);
+    int count = ++counts[motif];
+    if (count > best_count){
+      best_count = count;
+      best_motif = motif;
+    }
+  }
+  return best_motif;
+}
+
+// Returns true iff every flank ending/starting at the boundaries in [MIN_POS, MAX_POS] is too repetitive to assemble,
+// regardless of its length. Longer flanks are tested first, as they're the most likely to be assembled
+static bool all_flanks_repetitive(const std::string& chrom_seq, int32_t min_pos, int32_t max_pos, bool upstream, int min_kmer, int max_kmer){
+  for (int32_t pos = min_pos; pos <= max_pos; pos++){
+    for (int32_t flank_len = HaplotypeGenerator::REF_FLANK_LEN; flank_len >= HaplotypeGenerator::MIN_REF_FLANK_LEN; flank_len--){
+      int32_t flank_start = (upstream ? pos - flank_len : pos);
+      std::string flank   = uppercase(chrom_seq.substr(flank_start, flank_len));
+      int max_k           = std::min(max_kmer, (int)flank.size()-1);
+      int kmer_length;
+      if (DebruijnGraph::calc_kmer_length(flank, min_kmer, max_k, kmer_length))
+	return false;
+    }
+  }
+  return true;
+}
+
+void LocusPlan::plan_locus(const std::string& chrom_seq, PlannedLocus& locus){
+  const Region& region   = locus.region;
+  int32_t chrom_length   = chrom_seq.size();
+  locus.near_contig_end  = (region.start() < BamProcessor::CONTIG_END_DIST || region.stop() + BamProcessor::CONTIG_END_DIST >= chrom_length);
+  locus.left_flank_repetitive = locus.right_flank_repetitive = false;
+  if (region.stop() <= chrom_length)
+    locus.motif = most_frequent_motif(uppercase(chrom_seq.substr(region.start(), region.stop()-region.start())), region.period());
+  else
+    locus.motif.clear();
+
+  // Loci near the contig ends are skipped, so there's no need to analyze their flanks
+  if (locus.near_contig_end){
+    locus.ref_start = 0;
+    locus.ref_seq.clear();
+    return;
+  }
+
+  const int32_t left_pad = HaplotypeGenerator::LEFT_PAD, right_pad = HaplotypeGenerator::RIGHT_PAD;
+  int32_t window_start = std::max(0, region.start() - left_pad - HaplotypeGenerator::REF_FLANK_LEN);
+  int32_t window_stop  = std::min(chrom_length, region.stop() + right_pad + HaplotypeGenerator::REF_FLANK_LEN);
+  locus.ref_start      = window_start;
+  locus.ref_seq        = chrom_seq.substr(window_start, window_stop-window_start);
+
+  // CONTIG_END_DIST exceeds the padding and flank lengths, so every possible flank lies within the chromosome
+  int min_kmer = DEFAULT_OPTIONS.MIN_KMER, max_kmer = DEFAULT_OPTIONS.MAX_KMER;
+  locus.left_flank_repetitive  = all_flanks_repetitive(chrom_seq, region.start()-left_pad, region.start(), true,  min_kmer, max_kmer);
+  locus.right_flank_repetitive = all_flanks_repetitive(chrom_seq, region.stop(), region.stop()+right_pad, false, min_kmer, max_kmer);
+}
+
+LocusPlanWriter::LocusPlanWriter(const std::string& path, const std::string& fasta_path){
+  num_loci_ = 0;
+  output_.open(path.c_str(), std::ios_base::out | std::ios_base::binary);
+  if (!output_.is_open())
+    printErrorAndDie("Failed to open the locus plan file: " + path);
+  write_binary_string(output_, LOCUS_PLAN_MAGIC);
+  write_binary(output_, LOCUS_PLAN_VERSION);
+  write_binary(output_, BamProcessor::CONTIG_END_DIST);
+  write_binary(output_, HaplotypeGenerator::MIN_REF_FLANK_LEN);
+  write_binary(output_, HaplotypeGenerator::REF_FLANK_LEN);
+  write_binary(output_, HaplotypeGenerator::LEFT_PAD);
+  write_binary(output_, HaplotypeGenerator::RIGHT_PAD);
+  write_binary<int32_t>(output_, GenotyperOptions().MIN_KMER);
+  write_binary<int32_t>(output_, GenotyperOptions().MAX_KMER);
+  write_binary_string(output_, fasta_path);
+}
+
+void LocusPlanWriter::write_locus(const PlannedLocus& locus){
+  const Region& region = locus.region;
+  if (chroms_.empty() || chroms_.back().compare(region.chrom()) != 0){
+    if (std::find(chroms_.begin(), chroms_.end(), region.chrom()) != chroms_.end())
+      printErrorAndDie("Loci must be grouped by chromosome when writing a locus plan");
+    chroms_.push_back(region.chrom());
+    chrom_offsets_.push_back(output_.tellp());
+    chrom_counts_.push_back(0);
+  }
+
+  uint8_t flags = ((locus.near_contig_end        ? PLAN_NEAR_CONTIG_END  : 0) |
+		   (locus.left_flank_repetitive  ? PLAN_LEFT_REPETITIVE  : 0) |
+		   (locus.right_flank_repetitive ? PLAN_RIGHT_REPETITIVE : 0));
+  write_binary(output_, region.start());
+  write_binary(output_, region.stop());
+  write_binary<int32_t>(output_, region.period());
+  write_binary_string(output_, region.name());
+  write_binary_string(output_, locus.motif);
+  write_binary(output_, locus.ref_start);
+  write_binary_string(output_, locus.ref_seq);
+  write_binary(output_, flags);
+  chrom_counts_.back()++;
+  num_loci_++;
+}
+
+void LocusPlanWriter::close(){
+  // Append the chromosome index, followed by its offset
+  int64_t index_offset = output_.tellp();
+  write_binary_strings(output_, chroms_);
+  write_binary_vector(output_, chrom_offsets_);
+  write_binary_vector(output_, chrom_counts_);
+  write_binary(output_, index_offset);
+  output_.close();
+  if (output_.fail())
+    printErrorAndDie("Failed to write to the locus plan file");
+}
+
+LocusPlanReader::LocusPlanReader(const std::string& path) : path_(path){
+  input_.open(path.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!input_.is_open())
+    printErrorAndDie("Failed to open the locus plan file: " + path);
+
+  std::string magic;
+  int32_t version;
+  if (!read_binary_string(input_, magic) || magic.compare(LOCUS_PLAN_MAGIC) != 0)
+    printErrorAndDie("File is not a HipSTR locus plan file: " + path);
+  if (!read_binary(input_, version) || version != LOCUS_PLAN_VERSION)
+    printErrorAndDie("Locus plan file was generated by an incompatible version of HipSTR: " + path);
+
+  // The flank analyses are only valid if they used the same parameters as this build
+  int32_t contig_end_dist, min_ref_flank_len, ref_flank_len, left_pad, right_pad, min_kmer, max_kmer;
+  if (!read_binary(input_, contig_end_dist) || !read_binary(input_, min_ref_flank_len) || !read_binary(input_, ref_flank_len)
+      || !read_binary(input_, left_pad) || !read_binary(input_, right_pad) || !read_binary(input_, min_kmer) || !read_binary(input_, max_kmer)
+      || !read_binary_string(input_, fasta_path_))
+    printErrorAndDie("Locus plan file is truncated or corrupted: " + path);
+  GenotyperOptions kmer_options;
+  kmer_options.MIN_KMER = min_kmer;
+  kmer_options.MAX_KMER = max_kmer;
+  if (contig_end_dist != BamProcessor::CONTIG_END_DIST || min_ref_flank_len != HaplotypeGenerator::MIN_REF_FLANK_LEN
+      || ref_flank_len != HaplotypeGenerator::REF_FLANK_LEN || left_pad != HaplotypeGenerator::LEFT_PAD || right_pad != HaplotypeGenerator::RIGHT_PAD
+      || !LocusPlan::flank_analysis_valid(kmer_options))
+    printErrorAndDie("Locus plan file was generated by an incompatible version of HipSTR: " + path);
+
+  int64_t index_offset;
+  input_.seekg(-(int64_t)sizeof(index_offset), std::ios_base::end);
+  if (!read_binary(input_, index_offset) || !input_.seekg(index_offset)
+      || !read_binary_strings(input_, chroms_) || !read_binary_vector(input_, chrom_offsets_) || !read_binary_vector(input_, chrom_counts_)
+      || chroms_.size() != chrom_offsets_.size() || chroms_.size() != chrom_counts_.size())
+    printErrorAndDie("Locus plan file is truncated or corrupted: " + path);
+}
+
+void LocusPlanReader::read_loci(uint32_t max_loci, const std::string& chrom_limit, std::vector<PlannedLocus>& loci, std::ostream& logger){
+  logger << "Reading locus plan " << path_ << std::endl;
+  loci.clear();
+  int64_t num_loci = 0;
+  for (unsigned int i = 0; i < chroms_.size(); i++)
+    num_loci += chrom_counts_[i];
+
+  for (unsigned int i = 0; i < chroms_.size() && loci.size() < max_loci; i++){
+    if (!chrom_limit.empty() && chroms_[i].compare(chrom_limit) != 0)
+      continue;
+
+    input_.clear();
+    input_.seekg(chrom_offsets_[i]);
+    for (int32_t j = 0; j < chrom_counts_[i] && loci.size() < max_loci; j++){
+      int32_t start, stop, period;
+      std::string name;
+      bool valid = read_binary(input_, start) && read_binary(input_, stop) && read_binary(input_, period) && read_binary_string(input_, name);
+      valid      = valid && start >= 0 && stop > start && period >= 1;
+      if (!valid)
+	printErrorAndDie("Locus plan file is truncated or corrupted: " + path_);
+
+      loci.push_back(PlannedLocus(Region(chroms_[i], start, stop, period, name)));
+      PlannedLocus& locus = loci.back();
+      uint8_t flags;
+      if (!read_binary_string(input_, locus.motif) || !read_binary(input_, locus.ref_start) || !read_binary_string(input_, locus.ref_seq)
+	  || !read_binary(input_, flags))
+	printErrorAndDie("Locus plan file is truncated or corrupted: " + path_);
+      locus.near_contig_end        = ((flags & PLAN_NEAR_CONTIG_END)  != 0);
+      locus.left_flank_repetitive  = ((flags & PLAN_LEFT_REPETITIVE)  != 0);
+      locus.right_flank_repetitive = ((flags & PLAN_RIGHT_REPETITIVE) != 0);
+    }
+  }
+
+  logger << "Locus plan contains " << num_loci << " loci";
+  if (!chrom_limit.empty())
+    logger << ", of which " << loci.size() << " were located on the requested chromosome";
+  logger << "\n" << std::endl;
+
+  if (!chrom_limit.empty() && loci.empty())
+    printErrorAndDie("Locus plan " + path_ + " did not contain any loci on the requested chromosome: " + chrom_limit);
+}
@@ -0,0 +1,110 @@
+#ifndef LOCUS_PLAN_H_
+#define LOCUS_PLAN_H_
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "genotyper_options.h"
+#include "region.h"
+
+/*
+ * Reference-only information for a single STR locus, computed once by HipSTR prepare so that genotyping
+ * runs needn't parse the region file and can skip loci whose flanks can't be assembled before any BAM I/O
+ */
+class PlannedLocus {
+ public:
+  Region region;
+  std::string motif;           // Most frequent PERIOD-mer in the reference allele
+  int32_t ref_start;
+  std::string ref_seq;         // Reference window spanning the locus and the longest possible haplotype flanks, starting at REF_START
+  bool near_contig_end;        // True iff the locus lies within BamProcessor::CONTIG_END_DIST bp of the end of its contig
+  bool left_flank_repetitive;  // True iff none of the possible upstream flanks have a cycle-free de Bruijn graph
+  bool right_flank_repetitive; // True iff none of the possible downstream flanks have a cycle-free de Bruijn graph
+
+  explicit PlannedLocus(const Region& locus_region) : region(locus_region){
+    ref_start              = 0;
+    near_contig_end        = false;
+    left_flank_repetitive  = false;
+    right_flank_repetitive = false;
+  }
+
+  // Returns true iff the reference window matches the corresponding portion of the chromosome's sequence
+  bool matches_reference(const std::string& chrom_seq) const {
+    return (ref_start + ref_seq.size() <= chrom_seq.size() && chrom_seq.compare(ref_start, ref_seq.size(), ref_seq) == 0);
+  }
+};
+
+/*
+ * The flank analyses use the parameters of the HaplotypeGenerator class and the default k-mer sizes in GenotyperOptions. Trimming the candidate
+ * alleles moves each STR block's boundary by at most LEFT_PAD/RIGHT_PAD bp, while the reference flanks extend between MIN_REF_FLANK_LEN and
+ * REF_FLANK_LEN bp beyond the block depending on the extent of the reads. A flank is therefore only flagged as repetitive if its de Bruijn graph
+ * has cycles for every possible boundary and every possible flank length, in which case the genotyper is guaranteed to abort the locus
+ */
+class LocusPlan {
+ private:
+  static const GenotyperOptions DEFAULT_OPTIONS;
+
+ public:
+  static void plan_locus(const std::string& chrom_seq, PlannedLocus& locus);
+
+  // Returns true iff the flank analyses apply to genotypers using the provided options
+  static bool flank_analysis_valid(const GenotyperOptions& options){
+    return (options.MIN_KMER == DEFAULT_OPTIONS.MIN_KMER && options.MAX_KMER == DEFAULT_OPTIONS.MAX_KMER);
+  }
+
+  static std::string most_frequent_motif(const std::string& seq, int period);
+};
+
+/*
+ * Binary file containing the planned loci for each chromosome, in sorted order. An index at the end of the file
+ * records the offset of each chromosome's loci so that runs restricted to a single chromosome only read its loci
+ */
+class LocusPlanWriter {
+ private:
+  std::ofstream output_;
+  std::vector<std::string> chroms_;
+  std::vector<int64_t> chrom_offsets_;
+  std::vector<int32_t> chrom_counts_;
+  int32_t num_loci_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusPlanWriter(const LocusPlanWriter& other);
+  LocusPlanWriter& operator=(const LocusPlanWriter& other);
+
+ public:
+  LocusPlanWriter(const std::string& path, const std::string& fasta_path);
+
+  int32_t num_loci() const { return num_loci_; }
+
+  // Loci must be written in sorted order
+  void write_locus(const PlannedLocus& locus);
+
+  void close();
+};
+
+class LocusPlanReader {
+ private:
+  std::ifstream input_;
+  std::string path_, fasta_path_;
+  std::vector<std::string> chroms_;
+  std::vector<int64_t> chrom_offsets_;
+  std::vector<int32_t> chrom_counts_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  LocusPlanReader(const LocusPlanReader& other);
+  LocusPlanReader& operator=(const LocusPlanReader& other);
+
+ public:
+  explicit LocusPlanReader(const std::string& path);
+
+  const std::string& path()       const { return path_;       }
+  const std::string& fasta_path() const { return fasta_path_; }
+
+  // Read at most MAX_LOCI loci, restricted to CHROM_LIMIT if it's non-empty
+  void read_loci(uint32_t max_loci, const std::string& chrom_limit, std::vector<PlannedLocus>& loci, std::ostream& logger);
+};
+
+#endif
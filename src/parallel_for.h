@@ -0,0 +1,39 @@
+#ifndef PARALLEL_FOR_H_
+#define PARALLEL_FOR_H_
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+/*
+ * Split the items [0, NUM_ITEMS) into contiguous chunks and invoke FUNC(start, end) on each chunk using up to NUM_THREADS threads.
+ * Each thread processes at least MIN_ITEMS_PER_THREAD items, so small workloads run entirely on the calling thread.
+ * FUNC must only write to state owned by its chunk
+ */
+template<typename Function> void parallel_for(int num_items, int num_threads, int min_items_per_thread, Function func){
+  int num_chunks = std::min(num_threads, num_items/std::max(1, min_items_per_thread));
+  if (num_chunks <= 1){
+    if (num_items > 0)
+      func(0, num_items);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks-1);
+  int chunk_size = num_items/num_chunks, remainder = num_items%num_chunks, start = 0;
+  std::vector< std::pair<int,int> > chunks;
+  for (int i = 0; i < num_chunks; i++){
+    int end = start + chunk_size + (i < remainder ? 1 : 0);
+    chunks.push_back(std::pair<int,int>(start, end));
+    start = end;
+  }
+
+  // The calling thread processes the first chunk
+  for (int i = 1; i < num_chunks; i++)
+    threads.push_back(std::thread(func, chunks[i].first, chunks[i].second));
+  func(chunks[0].first, chunks[0].second);
+  for (unsigned int i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+#endif
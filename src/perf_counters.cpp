@@ -0,0 +1,173 @@
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <iomanip>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include "perf_counters.h"
+
+bool PerfCounters::enabled_ = false;
+bool PerfCounters::available_[PerfCounts::NUM_EVENTS] = {false, false, false, false, false};
+
+PerfCounters::ThreadGroup& PerfCounters::thread_group(){
+  static thread_local ThreadGroup group;
+  return group;
+}
+
+PerfCounters::ThreadGroup::ThreadGroup() : attempted(false), group_fd(-1), num_open(0){
+  for (int i = 0; i < PerfCounts::NUM_EVENTS; i++){
+    fds[i]   = -1;
+    slots[i] = -1;
+  }
+}
+
+PerfCounters::ThreadGroup::~ThreadGroup(){
+  for (int i = 0; i < PerfCounts::NUM_EVENTS; i++)
+    if (fds[i] != -1)
+      close(fds[i]);
+}
+
+const char* PerfCounters::event_name(int event){
+  switch (event){
+  case PerfCounts::CYCLES:        return "cycles";
+  case PerfCounts::INSTRUCTIONS:  return "instructions";
+  case PerfCounts::L1D_MISSES:    return "L1d-misses";
+  case PerfCounts::LLC_MISSES:    return "LLC-misses";
+  case PerfCounts::BRANCH_MISSES: return "branch-misses";
+  default:                        return "unknown";
+  }
+}
+
+#ifdef __linux__
+
+static int open_event(uint32_t type, uint64_t config, int group_fd){
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.disabled       = (group_fd == -1 ? 1 : 0);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+  attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+bool PerfCounters::ThreadGroup::open(int& error_code){
+  attempted = true;
+  const uint32_t types[PerfCounts::NUM_EVENTS]   = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+						    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+  const uint64_t configs[PerfCounts::NUM_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+						    PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+						    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+  // The first event that opens successfully leads the group, so that all of the events are scheduled together
+  error_code = 0;
+  for (int i = 0; i < PerfCounts::NUM_EVENTS; i++){
+    int fd = open_event(types[i], configs[i], group_fd);
+    if (fd == -1){
+      if (group_fd == -1)
+	error_code = errno;
+      continue;
+    }
+    if (group_fd == -1)
+      group_fd = fd;
+    fds[i]   = fd;
+    slots[i] = num_open++;
+  }
+
+  if (group_fd == -1)
+    return false;
+  ioctl(group_fd, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+  ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+bool PerfCounters::enable(std::string& error){
+  if (enabled_)
+    return true;
+
+  // Determine which events are available by opening them on the calling thread. Other threads open their own counters on demand
+  ThreadGroup& group = thread_group();
+  int error_code;
+  if (!group.open(error_code)){
+    error = std::string("perf_event_open failed: ") + strerror(error_code);
+    return false;
+  }
+  for (int i = 0; i < PerfCounts::NUM_EVENTS; i++)
+    available_[i] = (group.slots[i] != -1);
+  enabled_ = true;
+  return true;
+}
+
+void PerfCounters::read_counts(PerfCounts& counts){
+  // Layout for PERF_FORMAT_GROUP: nr, time_enabled, time_running, followed by one value per open event
+  uint64_t buffer[3 + PerfCounts::NUM_EVENTS];
+  counts.clear();
+  ThreadGroup& group = thread_group();
+  if (!group.attempted){
+    int error_code;
+    group.open(error_code);
+  }
+  if (group.group_fd == -1 || read(group.group_fd, buffer, sizeof(buffer)) < (ssize_t)(3*sizeof(uint64_t)))
+    return;
+
+  // Extrapolate the counts if the kernel had to multiplex the events
+  double scale = (buffer[2] > 0 && buffer[2] < buffer[1]) ? (1.0*buffer[1]/buffer[2]) : 1.0;
+  for (int i = 0; i < PerfCounts::NUM_EVENTS; i++)
+    if (group.slots[i] != -1 && group.slots[i] < (int)buffer[0])
+      counts.values[i] = (uint64_t)(scale*buffer[3+group.slots[i]]);
+}
+
+#else
+
+bool PerfCounters::ThreadGroup::open(int& error_code){
+  attempted  = true;
+  error_code = ENOSYS;
+  return false;
+}
+
+bool PerfCounters::enable(std::string& error){
+  error = "Hardware performance counters are only supported on Linux";
+  return false;
+}
+
+void PerfCounters::read_counts(PerfCounts& counts){
+  counts.clear();
+}
+
+#endif
+
+void PerfCounts::add_since(const PerfCounts& start){
+  if (!PerfCounters::enabled())
+    return;
+  PerfCounts now;
+  PerfCounters::snapshot(now);
+  for (int i = 0; i < NUM_EVENTS; i++)
+    if (now.values[i] > start.values[i])
+      values[i] += now.values[i] - start.values[i];
+}
+
+void PerfCounts::write(std::ostream& out) const {
+  std::stringstream ss;
+  for (int i = 0; i < NUM_EVENTS; i++){
+    ss << (i == 0 ? "" : ", ") << PerfCounters::event_name(i) << "=";
+    if (PerfCounters::event_available(i))
+      ss << values[i];
+    else
+      ss << "NA";
+  }
+  ss << ", IPC=";
+  if (PerfCounters::event_available(CYCLES) && PerfCounters::event_available(INSTRUCTIONS) && values[CYCLES] > 0)
+    ss << std::fixed << std::setprecision(2) << (1.0*values[INSTRUCTIONS]/values[CYCLES]);
+  else
+    ss << "NA";
+  out << ss.str();
+}
@@ -0,0 +1,86 @@
+#ifndef PERF_COUNTERS_H_
+#define PERF_COUNTERS_H_
+
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+/*
+ * Snapshot or accumulated totals of the hardware events monitored by PerfCounters
+ */
+class PerfCounts {
+ public:
+  static const int NUM_EVENTS = 5;
+  enum Event { CYCLES = 0, INSTRUCTIONS = 1, L1D_MISSES = 2, LLC_MISSES = 3, BRANCH_MISSES = 4 };
+
+  uint64_t values[NUM_EVENTS];
+
+  PerfCounts(){ clear(); }
+
+  void clear(){
+    for (int i = 0; i < NUM_EVENTS; i++)
+      values[i] = 0;
+  }
+
+  void add(const PerfCounts& other){
+    for (int i = 0; i < NUM_EVENTS; i++)
+      values[i] += other.values[i];
+  }
+
+  // Add the events that have occurred since the START snapshot was taken. Does nothing if the counters aren't enabled
+  void add_since(const PerfCounts& start);
+
+  // Write the counts, along with the instructions per cycle, as a single line of text
+  void write(std::ostream& out) const;
+};
+
+/*
+ * Optional hardware performance counters, collected using the Linux perf_event_open system call.
+ * Each thread lazily opens its own group of counters on its first snapshot, so a snapshot only reflects the work of the calling thread.
+ * Work divided among several threads must therefore snapshot within each thread and sum the resulting counts.
+ * The counters are disabled by default, in which case snapshots are all zero and cost a single branch.
+ * Events that the kernel or CPU doesn't support (e.g. in many virtual machines) are reported as unavailable
+ */
+class PerfCounters {
+ private:
+  // Counters opened by a single thread, which are closed when the thread exits
+  class ThreadGroup {
+  public:
+    bool attempted;  // Whether the thread has already tried to open the events
+    int group_fd;
+    int num_open;
+    int fds[PerfCounts::NUM_EVENTS];
+    int slots[PerfCounts::NUM_EVENTS];  // Position of each event in the group's read buffer, or -1 if unavailable
+
+    ThreadGroup();
+    ~ThreadGroup();
+
+    // Open the events on the calling thread. Returns false if none of them are available
+    bool open(int& error_code);
+  };
+
+  static bool enabled_;
+  static bool available_[PerfCounts::NUM_EVENTS];  // Whether each event could be opened when the counters were enabled
+
+  static ThreadGroup& thread_group();
+
+  static void read_counts(PerfCounts& counts);
+
+ public:
+  // Attempt to open the counters. Returns false and sets the error message if none of the events are available
+  static bool enable(std::string& error);
+
+  static bool enabled(){ return enabled_; }
+
+  static bool event_available(int event){ return available_[event]; }
+
+  static const char* event_name(int event);
+
+  // Take a snapshot of the calling thread's counters
+  static void snapshot(PerfCounts& counts){
+    if (enabled_)
+      read_counts(counts);
+  }
+};
+
+#endif
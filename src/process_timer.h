@@ -4,9 +4,12 @@
 #include <map>
 #include <string>
 
+#include "perf_counters.h"
+
 class ProcessTimer {
  private:
   std::map<std::string, double> total_times_;
+  std::map<std::string, PerfCounts> total_counts_;
 
  public:
   ProcessTimer(){}
@@ -23,6 +26,17 @@ class ProcessTimer {
       return 0.0;
     return iter->second;
   }
+
+  void add_counts(std::string key, const PerfCounts& counts){
+    total_counts_[key].add(counts);
+  }
+
+  PerfCounts get_total_counts(std::string key) const {
+    auto iter = total_counts_.find(key);
+    if (iter == total_counts_.end())
+      return PerfCounts();
+    return iter->second;
+  }
 };
 
 #endif
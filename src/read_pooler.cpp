@@ -1,9 +1,12 @@
+#include <algorithm>
+#include <sstream>
+
 #include "read_pooler.h"
 
 int32_t ReadPooler::add_alignment(Alignment& aln){
   if (pooled_)
     printErrorAndDie("Cannot call add_alignment function once pool() function has been invoked");
-  
+
   auto pool_iter = seq_to_pool_.find(aln.get_sequence());
   if (pool_iter == seq_to_pool_.end()){
     seq_to_pool_[aln.get_sequence()] = pool_index_;
@@ -16,5 +19,137 @@ int32_t ReadPooler::add_alignment(Alignment& aln){
   else{
     qualities_by_pool_[pool_iter->second].push_back(new std::string(aln.get_base_qualities()));
     return pool_iter->second;
-  }  
+  }
+}
+
+int32_t ReadPooler::add_alignment(const AlignmentArena& alns, int32_t index){
+  if (pooled_)
+    printErrorAndDie("Cannot call add_alignment function once pool() function has been invoked");
+
+  auto pool_iter = seq_to_pool_.find(std::string(alns.get_sequence(index), alns.get_sequence_length(index)));
+  if (pool_iter == seq_to_pool_.end()){
+    Alignment aln = alns.get_alignment(index);
+    return add_alignment(aln);
+  }
+  else{
+    qualities_by_pool_[pool_iter->second].push_back(new std::string(alns.get_base_qualities(index), alns.get_base_qualities_length(index)));
+    return pool_iter->second;
+  }
+}
+
+void ReadPooler::pool(const BaseQuality& base_quality){
+  // For each pooled set of reads, set the base quality at each position to be the median across the set
+  assert(pooled_alns_.size() == qualities_by_pool_.size());
+  for (unsigned int i = 0; i < pooled_alns_.size(); i++)
+    pooled_alns_[i].set_base_qualities(base_quality.median_base_qualities(qualities_by_pool_[i]));
+
+  rep_pools_.clear();
+  for (int32_t i = 0; i < pool_index_; i++)
+    rep_pools_.push_back(i);
+  log_corrections_ = std::vector<double>(pool_index_, 0.0);
+  max_errors_      = std::vector<double>(pool_index_, 0.0);
+  if (max_correction_error_ > 0)
+    merge_near_identical_pools(base_quality);
+  pooled_ = true;
+}
+
+void ReadPooler::mismatch_ll_range(char quality, char rep_quality, const BaseQuality& base_quality, double& min_diff, double& max_diff){
+  double log_correct = base_quality.log_prob_correct(quality),     log_wrong = base_quality.log_prob_error(quality);
+  double rep_correct = base_quality.log_prob_correct(rep_quality), rep_wrong = base_quality.log_prob_error(rep_quality);
+  double diffs[4]    = {log_wrong   - rep_correct,  // Haplotype base matches the representative's base
+			log_correct - rep_wrong,    // Haplotype base matches the read's base
+			log_wrong   - rep_wrong,    // Haplotype base matches neither base
+			log_correct - rep_correct}; // Base is emitted as an insertion or outside of the haplotype
+  min_diff = *std::min_element(diffs, diffs+4);
+  max_diff = *std::max_element(diffs, diffs+4);
+}
+
+std::string ReadPooler::alignment_structure(const Alignment& aln) const {
+  std::stringstream ss;
+  ss << aln.get_start() << ":";
+  char prev_type = '\0';
+  int prev_num   = 0;
+  for (auto cigar_iter = aln.get_cigar_list().begin(); cigar_iter != aln.get_cigar_list().end(); cigar_iter++){
+    char type = ((cigar_iter->get_type() == '=' || cigar_iter->get_type() == 'X') ? 'M' : cigar_iter->get_type());
+    if (type == prev_type)
+      prev_num += cigar_iter->get_num();
+    else {
+      if (prev_num > 0)
+	ss << prev_num << prev_type;
+      prev_type = type;
+      prev_num  = cigar_iter->get_num();
+    }
+  }
+  if (prev_num > 0)
+    ss << prev_num << prev_type;
+  return ss.str();
+}
+
+bool ReadPooler::calc_near_correction(const Alignment& aln, const Alignment& rep_aln, const BaseQuality& base_quality,
+				      double& log_correction, double& max_error) const {
+  const std::string& seq       = aln.get_sequence();
+  const std::string& rep_seq   = rep_aln.get_sequence();
+  const std::string& quals     = aln.get_base_qualities();
+  const std::string& rep_quals = rep_aln.get_base_qualities();
+  assert(seq.size() == rep_seq.size());
+
+  // The correction is the midpoint of the range of possible changes summed across mismatches,
+  // so its error for any haplotype is at most half of the summed range's width
+  log_correction = max_error = 0;
+  int num_mismatches = 0;
+  int32_t pos = rep_aln.get_start(), seq_index = 0;
+  for (auto cigar_iter = rep_aln.get_cigar_list().begin(); cigar_iter != rep_aln.get_cigar_list().end(); cigar_iter++){
+    char type = cigar_iter->get_type();
+    if (type == 'D'){
+      pos += cigar_iter->get_num();
+      continue;
+    }
+    for (int i = 0; i < cigar_iter->get_num(); ++i, ++seq_index){
+      bool aligned = (type == '=' || type == 'X');
+      if (seq[seq_index] != rep_seq[seq_index]){
+	if (!aligned || ++num_mismatches > MAX_NEAR_MISMATCHES)
+	  return false;
+	if (pos >= repeat_start_ && pos < repeat_stop_)
+	  return false;
+
+	double min_diff, max_diff;
+	mismatch_ll_range(quals[seq_index], rep_quals[seq_index], base_quality, min_diff, max_diff);
+	log_correction += 0.5*(min_diff + max_diff);
+	max_error      += 0.5*(max_diff - min_diff);
+      }
+      if (aligned)
+	pos++;
+    }
+  }
+  assert(seq_index == (int)seq.size());
+  return num_mismatches > 0;
+}
+
+void ReadPooler::merge_near_identical_pools(const BaseQuality& base_quality){
+  // Consider pools from largest to smallest, so that each pool is represented by the most common compatible sequence.
+  // Only pools with identical alignment structures are compared, as their alignments then share the same seed base
+  std::vector< std::pair<int, int32_t> > pool_order;
+  for (int32_t i = 0; i < pool_index_; i++)
+    pool_order.push_back(std::pair<int, int32_t>(-(int)qualities_by_pool_[i].size(), i));
+  std::sort(pool_order.begin(), pool_order.end());
+
+  std::map<std::string, std::vector<int32_t> > reps_by_structure;
+  for (auto order_iter = pool_order.begin(); order_iter != pool_order.end(); order_iter++){
+    int32_t pool = order_iter->second;
+    std::vector<int32_t>& reps = reps_by_structure[alignment_structure(pooled_alns_[pool])];
+    bool merged = false;
+    for (auto rep_iter = reps.begin(); rep_iter != reps.end(); rep_iter++){
+      double log_correction, max_error;
+      if (calc_near_correction(pooled_alns_[pool], pooled_alns_[*rep_iter], base_quality, log_correction, max_error)
+	  && max_error <= max_correction_error_){
+	rep_pools_[pool]       = *rep_iter;
+	log_corrections_[pool] = log_correction;
+	max_errors_[pool]      = max_error;
+	merged = true;
+	break;
+      }
+    }
+    if (!merged)
+      reps.push_back(pool);
+  }
 }
@@ -8,8 +8,15 @@
 
 #include "base_quality.h"
 #include "error.h"
+#include "SeqAlignment/AlignmentArena.h"
 #include "SeqAlignment/AlignmentData.h"
 
+/*
+ * Groups reads with identical sequences so that each distinct sequence only needs to be aligned to the haplotypes once.
+ * Optionally, a pool whose sequence differs from that of a larger pool only at a few low-quality bases outside of the repeat
+ * can also reuse the larger pool's alignment probabilities. Each of these pools is assigned a log-likelihood correction
+ * computed from the mismatched bases alone, along with a bound on the correction's error that holds for any haplotype
+ */
 class ReadPooler {
  private:
   std::vector<Alignment> pooled_alns_;
@@ -18,14 +25,36 @@ class ReadPooler {
   bool pooled_;         // True iff pool() function has been invoked
   int32_t pool_index_;
 
+  // Near-identical pooling is disabled unless the maximum correction error is > 0
+  double max_correction_error_;
+  int32_t repeat_start_, repeat_stop_;  // Mismatches whose reference coordinates lie within [start, stop) are never corrected
+  std::vector<int32_t> rep_pools_;      // Pool whose alignment probabilities are reused by each pool (itself if it's aligned)
+  std::vector<double> log_corrections_; // LL correction added to the representative pool's alignment probabilities
+  std::vector<double> max_errors_;      // Maximum absolute error of each pool's corrected alignment probabilities
+
+  // Returns the pool's reference coordinates and CIGAR operations, with matches and mismatches merged into M operations
+  std::string alignment_structure(const Alignment& aln) const;
+
+  // Computes the correction for reusing REP_ALN's alignment probabilities for ALN. Returns false if the sequences
+  // differ at more than MAX_NEAR_MISMATCHES bases or at bases that are inserted or lie within the repeat
+  bool calc_near_correction(const Alignment& aln, const Alignment& rep_aln, const BaseQuality& base_quality,
+			    double& log_correction, double& max_error) const;
+
+  void merge_near_identical_pools(const BaseQuality& base_quality);
+
   // Private unimplemented copy constructor and assignment operator to prevent operations
   ReadPooler(const ReadPooler& other);
   ReadPooler& operator=(const ReadPooler& other);
-  
+
  public:
+  const static int MAX_NEAR_MISMATCHES = 2;
+
   ReadPooler(){
-    pool_index_ = 0;
-    pooled_     = false;
+    pool_index_           = 0;
+    pooled_               = false;
+    max_correction_error_ = 0;
+    repeat_start_         = 0;
+    repeat_stop_          = 0;
   }
 
   ~ReadPooler(){
@@ -39,17 +68,48 @@ class ReadPooler {
 
   int32_t add_alignment(Alignment& aln);
 
-  void pool(const BaseQuality& base_quality){
-    // For each pooled set of reads, set the base quality at each position to be the median across the set
-    assert(pooled_alns_.size() == qualities_by_pool_.size());
-    for (unsigned int i = 0; i < pooled_alns_.size(); i++)
-      pooled_alns_[i].set_base_qualities(base_quality.median_base_qualities(qualities_by_pool_[i]));
-    pooled_ = true;
+  // Pools the read at the provided index in the arena, only materializing its alignment if it starts a new pool
+  int32_t add_alignment(const AlignmentArena& alns, int32_t index);
+
+  /*
+   * Also pool reads whose sequences only differ from those of a larger pool at low-quality bases outside of the repeat
+   * spanning [REPEAT_START, REPEAT_STOP), provided the error of their corrected log-likelihoods is at most MAX_CORRECTION_ERROR.
+   * Must be invoked before pool()
+   */
+  void enable_near_identical_pooling(double max_correction_error, int32_t repeat_start, int32_t repeat_stop){
+    if (pooled_)
+      printErrorAndDie("Cannot enable near-identical pooling once pool() function has been invoked");
+    max_correction_error_ = max_correction_error;
+    repeat_start_         = repeat_start;
+    repeat_stop_          = repeat_stop;
   }
 
+  void pool(const BaseQuality& base_quality);
+
   std::vector<Alignment>& get_alignments(){
     return pooled_alns_;
   }
+
+  // Index of the pool whose alignment probabilities should be used for the provided pool
+  int32_t representative(int32_t pool) const { return rep_pools_[pool]; }
+
+  // Log-likelihood correction to add to the representative pool's alignment probabilities and the bound on its error
+  double log_correction(int32_t pool) const { return log_corrections_[pool]; }
+  double max_error(int32_t pool)      const { return max_errors_[pool];      }
+
+  int32_t num_aligned_pools() const {
+    int32_t count = 0;
+    for (unsigned int i = 0; i < rep_pools_.size(); i++)
+      count += (rep_pools_[i] == (int32_t)i ? 1 : 0);
+    return count;
+  }
+
+  /*
+   * Bounds the change in an alignment's log-likelihood when the read base with quality QUALITY is replaced by a different base
+   * with quality REP_QUALITY. Every alignment emits the base exactly once, either as a match to the representative's base, a match
+   * to the read's base, a match to another base or an insertion, so the change always lies within [MIN_DIFF, MAX_DIFF]
+   */
+  static void mismatch_ll_range(char quality, char rep_quality, const BaseQuality& base_quality, double& min_diff, double& max_diff);
 };
 
 #endif
@@ -9,6 +9,7 @@
 
 #include "seq_stutter_genotyper.h"
 #include "bam_processor.h"
+#include "bias_stats.h"
 #include "debruijn_graph.h"
 #include "em_stutter_genotyper.h"
 #include "error.h"
@@ -26,9 +27,6 @@
 #include "SeqAlignment/RepeatStutterInfo.h"
 #include "SeqAlignment/RepeatBlock.h"
 
-#include "cephes/cephes.h"
-#include "htslib/htslib/kfunc.h"
-
 int max_index(double* vals, unsigned int num_vals){
 	int best_index = 0;
 	for (unsigned int i = 1; i < num_vals; i++)
@@ -42,6 +40,8 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 	retrace_alignments(traced_alns);
 
 	double locus_assembly_time = clock();
+	PerfCounts assembly_start;
+	PerfCounters::snapshot(assembly_start);
 	logger << "Reassembling flanking sequences" << std::endl;
 	std::vector< std::vector<std::string> > alleles_to_add (haplotype_->num_blocks());
 	std::vector<bool> realign_sample(num_samples_, false);
@@ -51,16 +51,19 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 		std::string flank_dir = (flank == 0 ? "left" : "right");
 		int block_index       = (flank == 0 ? 0 : haplotype_->num_blocks()-1);
 		std::string ref_seq   = hap_blocks_[block_index]->get_seq(0);
-		int max_k             = std::min(MAX_KMER, ref_seq.size() == 0 ? -1 : (int)ref_seq.size()-1);
+		int max_k             = std::min(options_.MAX_KMER, ref_seq.size() == 0 ? -1 : (int)ref_seq.size()-1);
 		new_total_haps       /= haplotype_->num_options(block_index);
 
-		int kmer_length;
-		if (!skip_assembly && !DebruijnGraph::calc_kmer_length(ref_seq, MIN_KMER, max_k, kmer_length))
+		// The reference flank's k-mer size was determined when the locus was first checked for repetitive flanks.
+		// The reference path is cycle-free for every larger k-mer size, so any cycles found below are induced by the sample's reads
+		int kmer_length = flank_kmer_lengths_[flank];
+		if (!skip_assembly && kmer_length == -1)
 			return false;
 
 		std::map<std::string, int> haplotype_indexes;        // Index associated with each alterate flank
 		std::vector< std::vector<int> > haplotype_to_sample; // List of samples supporting each alternate flank
 		std::vector< std::pair<std::string,int> > assembly_data;
+		std::vector<const std::string*> sample_flanks;
 		int min_read_index = 0, read_index = -1;
 		for (int sample_index = 0; sample_index < num_samples_; sample_index++){
 			if (!call_sample_[sample_index].empty()){
@@ -72,17 +75,24 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 				continue;
 			}
 
+			// Extract the sample's flank sequences once, as they're reused for each k-mer size
+			sample_flanks.clear();
+			for (read_index = min_read_index; read_index < num_reads_; read_index++){
+				if (sample_label_[read_index] != sample_index)
+					break;
+				if (traced_alns[read_index] == NULL)
+					continue;
+				const std::string& seq = traced_alns[read_index]->flank_seq(block_index);
+				if (!seq.empty())
+					sample_flanks.push_back(&seq);
+			}
+			min_read_index = read_index;
+
 			assembly_data.clear();
 			bool acyclic;
 			if (skip_assembly){
-				for(read_index = min_read_index; read_index < num_reads_; read_index++){
-					if (sample_label_[read_index] != sample_index)
-						break;
-					if (traced_alns[read_index] == NULL)
-						continue;
-					std::string seq = traced_alns[read_index]->flank_seq(block_index);
-					if(seq.empty()) continue;
-
+				for (auto seq_iter = sample_flanks.begin(); seq_iter != sample_flanks.end(); seq_iter++){
+					const std::string& seq = **seq_iter;
 					bool find_seq = false;
 					for(int i = 0; i < assembly_data.size(); i++){
 						if(assembly_data[i].first == seq){
@@ -94,22 +104,18 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 					if(!find_seq)
 						assembly_data.push_back(make_pair(seq, 1));
 				}
-				acyclic = true;				
+				acyclic = true;
+			}
+			else if (sample_flanks.empty()){
+				// Without any reads, the graph only contains the acyclic reference path, which can't yield an alternate flank
+				acyclic = true;
 			}
-			else{ 
+			else {
 				acyclic = false;
 				for (int k = kmer_length; k <= max_k; k++){
 					DebruijnGraph assembler(k, ref_seq);
-					for (read_index = min_read_index; read_index < num_reads_; read_index++){
-						if (sample_label_[read_index] != sample_index)
-							break;
-						if (traced_alns[read_index] == NULL)
-							continue;
-
-						std::string seq = traced_alns[read_index]->flank_seq(block_index);
-						if (!seq.empty())
-							assembler.add_string(seq);
-					}
+					for (auto seq_iter = sample_flanks.begin(); seq_iter != sample_flanks.end(); seq_iter++)
+						assembler.add_string(**seq_iter);
 
 					assembler.prune_edges(0.02, 2);
 					if (!assembler.has_cycles() && assembler.is_source_ok() && assembler.is_sink_ok()){
@@ -119,7 +125,6 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 					}
 				}
 			}
-			min_read_index = read_index;
 
 			if (acyclic){
 				if (call_sample_[sample_index].empty() && assembly_data.size() > 1){
@@ -195,6 +200,7 @@ bool SeqStutterGenotyper::assemble_flanks(int max_total_haplotypes, int max_flan
 	}
 	locus_assembly_time   = (clock() - locus_assembly_time)/CLOCKS_PER_SEC;
 	total_assembly_time_ += locus_assembly_time;
+	assembly_counts_.add_since(assembly_start);
 
 	// Verify that the new flanks won't result in too many candidate haplotypes
 	if (new_total_haps > max_total_haplotypes){
@@ -258,7 +264,7 @@ void SeqStutterGenotyper::get_unused_alleles(bool check_spanned, bool check_call
 
 	// Extract each sample's optimal haplotypes
 	std::vector< std::pair<int,int> > haps;
-	get_optimal_haplotypes(haps);
+	extract_best_haplotypes(haps);
 
 	// Retrace the alignments
 	std::vector<AlignmentTrace*> traced_alns;
@@ -445,14 +451,16 @@ void SeqStutterGenotyper::remove_alleles(std::vector< std::vector<int> >& allele
 
 bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vector<StutterModel*>& stutter_models, std::ostream& logger){
 	double locus_hap_build_time = clock();
+	PerfCounts hap_build_start;
+	PerfCounters::snapshot(hap_build_start);
 	assert(hap_blocks_.empty() && haplotype_ == NULL);
 	logger << "Generating candidate haplotypes" << std::endl;
 
 	// Determine the minimum and maximum alignment boundaries
 	int32_t min_aln_start = INT_MAX, max_aln_stop = INT_MIN;
 	for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
-		min_aln_start = std::min(min_aln_start, alns_[read_index].get_start());
-		max_aln_stop  = std::max(max_aln_stop,  alns_[read_index].get_stop());
+		min_aln_start = std::min(min_aln_start, alns_.get_start(read_index));
+		max_aln_stop  = std::max(max_aln_stop,  alns_.get_stop(read_index));
 	}
 
 	HaplotypeGenerator hap_generator(min_aln_start, max_aln_stop);
@@ -462,13 +470,13 @@ bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vec
 		// Select only those alignments marked as good for haplotype generation
 		std::vector<AlnList> gen_hap_alns(num_samples_);
 		for (unsigned int read_index = 0; read_index < num_reads_; read_index++)
-			if (alns_[read_index].use_for_hap_generation(region_index))
-				gen_hap_alns[sample_label_[read_index]].push_back(alns_[read_index]);
+			if (alns_.use_for_hap_generation(read_index, region_index))
+				gen_hap_alns[sample_label_[read_index]].push_back(alns_.get_alignment(read_index));
 
 		std::vector<std::string> vcf_alleles;
 		if (ref_vcf_ != NULL){
 			int32_t pos;
-			if (!read_vcf_alleles(ref_vcf_, regions[region_index], vcf_alleles, pos)){
+			if (!ref_vcf_->read_alleles(regions[region_index], vcf_alleles, pos)){
 				logger << "Haplotype construction failed: The alleles could not be extracted from the reference VCF" << std::endl;
 				success = false;
 				break;
@@ -508,6 +516,7 @@ bool SeqStutterGenotyper::build_haplotype(const std::string& chrom_seq, std::vec
 
 	locus_hap_build_time   = (clock() - locus_hap_build_time)/CLOCKS_PER_SEC;
 	total_hap_build_time_ += locus_hap_build_time;
+	hap_build_counts_.add_since(hap_build_start);
 	return success;
 }
 
@@ -519,10 +528,10 @@ void SeqStutterGenotyper::init(std::vector<StutterModel*>& stutter_models, const
 	std::string prev_aln_name = "";
 
 	for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
-		pool_index_[read_index]   = pooler_.add_alignment(alns_[read_index]);
-		second_mate_[read_index]  = (alns_[read_index].get_name().compare(prev_aln_name) == 0);
+		pool_index_[read_index]   = pooler_.add_alignment(alns_, read_index);
+		second_mate_[read_index]  = (alns_.get_name(read_index).compare(prev_aln_name) == 0);
 		read_weights_.push_back(second_mate_[read_index] ? 0 : 1);
-		prev_aln_name = alns_[read_index].get_name();
+		prev_aln_name = alns_.get_name(read_index);
 	}
 
 	initialized_ = build_haplotype(chrom_seq, stutter_models, logger);
@@ -542,15 +551,23 @@ void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplo
 
 void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplotype, std::vector<bool>& realign_pool, std::vector<bool>& copy_read){
 	double locus_hap_aln_time = clock();
+	PerfCounts hap_aln_start;
+	PerfCounters::snapshot(hap_aln_start);
 	assert(haplotype_->num_combs() == realign_to_haplotype.size() && haplotype_->num_combs() == num_alleles_);
-	HapAligner hap_aligner(haplotype_, realign_to_haplotype);
+	HapAligner hap_aligner(haplotype_, realign_to_haplotype, aligner_workspace_);
 
 
-	// Align each pooled read to each haplotype
+	// Align each pooled read to each haplotype. Pools that reuse the alignment probabilities
+	// of a near-identical pool are only realigned via their representative
 	AlnList& pooled_alns       = pooler_.get_alignments();
-	double* log_pool_aln_probs = new double[pooled_alns.size()*num_alleles_];
-	int* pool_seed_positions   = new int[pooled_alns.size()];
-	hap_aligner.process_reads(pooled_alns, 0, &base_quality_, realign_pool, log_pool_aln_probs, pool_seed_positions);
+	std::vector<bool> align_pool(pooled_alns.size(), false);
+	for (unsigned int i = 0; i < pooled_alns.size(); i++)
+		if (realign_pool[i])
+			align_pool[pooler_.representative(i)] = true;
+	HapAlignerWorkspace* workspace = hap_aligner.workspace();
+	double* log_pool_aln_probs     = workspace->get_buffer(HapAlignerWorkspace::POOL_ALN_PROBS,      pooled_alns.size()*num_alleles_);
+	int* pool_seed_positions       = workspace->get_buffer(HapAlignerWorkspace::POOL_SEED_POSITIONS, pooled_alns.size());
+	hap_aligner.process_reads(pooled_alns, 0, &base_quality_, align_pool, log_pool_aln_probs, pool_seed_positions);
 
 	// Copy each pool's alignment probabilities to the entries for its constituent reads, but only for realigned haplotypes
 	double* log_aln_ptr = log_aln_probs_;
@@ -560,14 +577,14 @@ void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplo
 			continue;
 		}
 
-		seed_positions_[i] = pool_seed_positions[pool_index_[i]];
-		double* src_ptr = log_pool_aln_probs + num_alleles_*pool_index_[i];
+		int32_t rep_pool   = pooler_.representative(pool_index_[i]);
+		double correction  = pooler_.log_correction(pool_index_[i]);
+		seed_positions_[i] = pool_seed_positions[rep_pool];
+		double* src_ptr = log_pool_aln_probs + num_alleles_*rep_pool;
 		for (unsigned int j = 0; j < num_alleles_; ++j, ++log_aln_ptr, ++src_ptr)
 			if (realign_to_haplotype[j])
-				*log_aln_ptr = *src_ptr;
+				*log_aln_ptr = *src_ptr + correction;
 	}
-	delete [] log_pool_aln_probs;
-	delete [] pool_seed_positions;
 
 	// If both mate pairs overlap the STR region, they share the same phasing probabilities and we need to avoid treating them as independent
 	// To do so, we combine the alignment probabilities here and set the read weight for the second in the pair to zero during the posterior calculation
@@ -590,6 +607,7 @@ void SeqStutterGenotyper::calc_hap_aln_probs(std::vector<bool>& realign_to_haplo
 
 	locus_hap_aln_time   = (clock() - locus_hap_aln_time)/CLOCKS_PER_SEC;
 	total_hap_aln_time_ += locus_hap_aln_time;
+	hap_aln_counts_.add_since(hap_aln_start);
 }
 
 bool SeqStutterGenotyper::id_and_align_to_stutter_alleles(int max_total_haplotypes, std::ostream& logger){
@@ -643,18 +661,36 @@ bool SeqStutterGenotyper::genotype(int max_total_haplotypes, int max_flank_haplo
 	for (int flank = 0; flank < 2; flank++){
 		int block_index     = (flank == 0 ? 0 : haplotype_->num_blocks()-1);
 		std::string ref_seq = hap_blocks_[block_index]->get_seq(0);
-		int max_k           = std::min(MAX_KMER, ref_seq.size() == 0 ? -1 : (int)ref_seq.size()-1);
+		int max_k           = std::min(options_.MAX_KMER, ref_seq.size() == 0 ? -1 : (int)ref_seq.size()-1);
 		int kmer_length;
-		if (!skip_assembly  && !DebruijnGraph::calc_kmer_length(ref_seq, MIN_KMER, max_k, kmer_length)){
+		if (skip_assembly)
+			continue;
+		if (!DebruijnGraph::calc_kmer_length(ref_seq, options_.MIN_KMER, max_k, kmer_length)){
 			logger << "Aborting genotyping of the locus as the sequence " << (flank == 0 ? "upstream" : "downstream")
 				<< " of the repeat is too repetitive for accurate genotyping" << "\n";
 			logger << "\tFlanking sequence = " << ref_seq << std::endl;
 			return false;
 		}
+		flank_kmer_lengths_[flank] = kmer_length;
 	}
 
 	init_alignment_model();
+	if (options_.MAX_POOL_CORRECTION_ERROR > 0){
+		// Near-identical reads may only differ outside of the span of the repeat blocks
+		int32_t repeat_start = -1, repeat_stop = -1;
+		for (int i = 0; i < haplotype_->num_blocks(); i++){
+			HapBlock* block = haplotype_->get_block(i);
+			if (block->get_repeat_info() != NULL){
+				repeat_start = (repeat_start == -1 ? block->start() : std::min(repeat_start, block->start()));
+				repeat_stop  = std::max(repeat_stop, block->end());
+			}
+		}
+		pooler_.enable_near_identical_pooling(options_.MAX_POOL_CORRECTION_ERROR, repeat_start, repeat_stop);
+	}
 	pooler_.pool(base_quality_);
+	if (options_.MAX_POOL_CORRECTION_ERROR > 0)
+		logger << "Pooled " << num_reads_ << " reads into " << pooler_.num_pools() << " unique sequences, of which "
+		       << pooler_.num_aligned_pools() << " require alignment" << std::endl;
 
 	// Align each read to each candidate haplotype and store them in the provided arrays
 	logger << "Aligning reads to each candidate haplotype" << std::endl;
@@ -664,7 +700,10 @@ bool SeqStutterGenotyper::genotype(int max_total_haplotypes, int max_flank_haplo
 	
 	calc_log_sample_posteriors();
 
+	return refine_candidate_alleles(max_total_haplotypes, max_flank_haplotypes, min_flank_freq, logger);
+}
 
+bool SeqStutterGenotyper::refine_candidate_alleles(int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq, std::ostream& logger){
 	if (ref_vcf_ == NULL){
 		// Look for additional alleles in stutter artifacts and align to them (if necessary)
 		if (!id_and_align_to_stutter_alleles(max_total_haplotypes, logger))
@@ -799,11 +838,11 @@ void SeqStutterGenotyper::debug_sample(int sample_index, std::ostream& logger){
 	for (unsigned int i = 0; i < num_reads_; ++i){
 		if(sample_label_[i] == sample_index && seed_positions_[i] >= 0){
 			std::cerr << "\t" << "READ #" << i << ", SEED BASE=" << seed_positions_[i] << ", POOL INDEX=" << pool_index_[i] << ", IS_SECOND_MATE=" << second_mate_[i]
-				<< ", TOTAL QUAL CORRECT= " << base_quality_.sum_log_prob_correct(alns_[i].get_base_qualities())
+				<< ", TOTAL QUAL CORRECT= " << base_quality_.sum_log_prob_correct(std::string(alns_.get_base_qualities(i), alns_.get_base_qualities_length(i)))
 				<< max_index(read_LL_ptr, num_alleles_) << ", "
 				<< log_p1_[i] << " " << log_p2_[i] <<  ", "
-				<< alns_[i].get_sequence().substr(0, seed_positions_[i])
-				<< " " << alns_[i].get_sequence().substr(seed_positions_[i]+1) << std::endl
+				<< std::string(alns_.get_sequence(i), seed_positions_[i])
+				<< " " << std::string(alns_.get_sequence(i)+seed_positions_[i]+1, alns_.get_sequence_length(i)-seed_positions_[i]-1) << std::endl
 				<< traced_alns[i]->hap_aln() << std::endl
 				<< traced_alns[i]->traced_aln().get_alignment()  << std::endl
 				<< traced_alns[i]->traced_aln().getCigarString() << std::endl;
@@ -825,14 +864,17 @@ void SeqStutterGenotyper::debug_sample(int sample_index, std::ostream& logger){
 
 void SeqStutterGenotyper::retrace_alignments(std::vector<AlignmentTrace*>& traced_alns){
 	assert(traced_alns.size() == 0);
+	std::vector< std::pair<int, int> > haps;
+	extract_best_haplotypes(haps);
+
 	double trace_start = clock();
+	PerfCounts trace_counts_start;
+	PerfCounters::snapshot(trace_counts_start);
 	traced_alns.reserve(num_reads_);
-	std::vector< std::pair<int, int> > haps;
-	get_optimal_haplotypes(haps);
 
 	AlnList& pooled_alns = pooler_.get_alignments();
 	std::vector<bool> realign_to_haplotype(num_alleles_, true);
-	HapAligner hap_aligner(haplotype_, realign_to_haplotype);
+	HapAligner hap_aligner(haplotype_, realign_to_haplotype, aligner_workspace_);
 	double* read_LL_ptr = log_aln_probs_;
 	for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
 		if (seed_positions_[read_index] < 0){
@@ -859,6 +901,7 @@ void SeqStutterGenotyper::retrace_alignments(std::vector<AlignmentTrace*>& trace
 		read_LL_ptr += num_alleles_;
 	}
 	total_aln_trace_time_ += (clock() - trace_start)/CLOCKS_PER_SEC;
+	aln_trace_counts_.add_since(trace_counts_start);
 }
 
 void SeqStutterGenotyper::get_stutter_candidate_alleles(int str_block_index, std::ostream& logger, std::vector<std::string>& candidate_seqs){
@@ -904,7 +947,7 @@ void SeqStutterGenotyper::get_stutter_candidate_alleles(int str_block_index, std
    std::vector<AlignmentTrace*> traced_alns;
    std::vector< std::pair<int, int> > haps;
    retrace_alignments(traced_alns);
-   get_optimal_haplotypes(haps);
+   extract_best_haplotypes(haps);
 
    double* read_LL_ptr = log_aln_probs_;
    int min_read_index = 0, read_index;
@@ -983,39 +1026,22 @@ if (candidate_set.size() != 0){
 }
 */
 
-double SeqStutterGenotyper::compute_allele_bias(int hap_a_read_count, int hap_b_read_count){
-	// Compute p-value for allele read depth bias according to the counts of reads uniquely assigned to each haplotype
-	// We use the bdtr(k, N, p) function from the cephes directory, which computes the CDF for a binomial distribution
-	// e.g.: double val = bdtr (24, 50, 0.5);
-	int total = hap_a_read_count + hap_b_read_count;
-
-	// Not applicable
-	if (total == 0)
-		return 1;
-
-	// p-value is 1
-	if (hap_a_read_count == hap_b_read_count)
-		return 0.0;
-
-	int min_count = std::min(hap_a_read_count, hap_b_read_count);
-	double pvalue = 2*bdtr(min_count, total, 0.5); // Two-sided pvalue
-	return log10(std::min(1.0, pvalue));
-}
-
 void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sample_names, const std::string& chrom_seq,
 		bool output_viz, bool viz_left_alns,
-		std::ostream& html_output, VCFWriter* vcf_writer, std::ostream& logger){
+		std::ostream& html_output, VCFWriter* vcf_writer, GenotypeMatrixWriter* gt_matrix_writer, std::ostream& logger,
+		std::vector<GenotypeMatrixLocus>* locus_results){
 	int region_index = 0;
 	for (int block_index = 0; block_index < haplotype_->num_blocks(); block_index++)
 		if (haplotype_->get_block(block_index)->get_repeat_info() != NULL)
 			write_vcf_record(sample_names, block_index, region_group_->regions()[region_index++], chrom_seq,
-					output_viz, viz_left_alns, html_output, vcf_writer, logger);
+					output_viz, viz_left_alns, html_output, vcf_writer, gt_matrix_writer, logger, locus_results);
 	assert(region_index == region_group_->num_regions());
 }
 
 void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sample_names, int hap_block_index, const Region& region, const std::string& chrom_seq,
 		bool output_viz, bool viz_left_alns,
-		std::ostream& html_output, VCFWriter* vcf_writer, std::ostream& logger){
+		std::ostream& html_output, VCFWriter* vcf_writer, GenotypeMatrixWriter* gt_matrix_writer, std::ostream& logger,
+		std::vector<GenotypeMatrixLocus>* locus_results){
 	std::stringstream out;
 	out.precision(2);
 	out.setf(std::ios::fixed, std::ios::floatfield);
@@ -1038,14 +1064,14 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 	std::vector< std::pair<int,int> > haplotypes, gts;
 	std::vector<double> log_phased_posteriors, log_unphased_posteriors, gl_diffs;
 	std::vector<double> hap_log_phased_posteriors, hap_log_unphased_posteriors;
-	std::vector< std::vector<double> > gls, phased_gls;
-	std::vector< std::vector<int> > pls;
+	FlatMatrix<double> gls, phased_gls;
+	FlatMatrix<int> pls;
 	std::vector<int> hap_to_allele;
 	haps_to_alleles(hap_block_index, hap_to_allele);
 	int num_variants = haplotype_->get_block(hap_block_index)->num_options();
 	extract_genotypes_and_likelihoods(num_variants, hap_to_allele, haplotypes, gts, log_phased_posteriors, log_unphased_posteriors,
 			hap_log_phased_posteriors, hap_log_unphased_posteriors,
-			true, gls, gl_diffs, (OUTPUT_PLS == 1), pls, (OUTPUT_PHASED_GLS == 1), phased_gls);
+			true, gls, gl_diffs, (options_.OUTPUT_PLS == 1), pls, (options_.OUTPUT_PHASED_GLS == 1), phased_gls);
 
 	// Extract information about each read and group by sample
 	std::vector<int> num_aligned_reads(num_samples_, 0), num_reads_with_snps(num_samples_, 0);
@@ -1058,9 +1084,15 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 	std::vector<AlnList> max_LL_alns_strand_one(num_samples_), left_alns_strand_one(num_samples_);
 	std::vector<AlnList> max_LL_alns_strand_two(num_samples_), left_alns_strand_two(num_samples_);
 	std::vector<bool> realign_to_haplotype(num_alleles_, true);
-	HapAligner hap_aligner(haplotype_, realign_to_haplotype);
+	HapAligner hap_aligner(haplotype_, realign_to_haplotype, aligner_workspace_);
 	double* read_LL_ptr = log_aln_probs_;
 	int bp_diff; bool got_size;
+	std::vector<CigarElement> cigar_list;
+
+	// Read the performance counters once per locus, as snapshots are system calls that would dominate the cost of cached traces.
+	// The counts therefore also include the per-read bookkeeping below
+	PerfCounts trace_counts_start;
+	PerfCounters::snapshot(trace_counts_start);
 	for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
 		if (seed_positions_[read_index] < 0){
 			read_LL_ptr += num_alleles_;
@@ -1078,15 +1110,15 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		int read_strand = 0;
 		if (!haploid_ && ((hap_a != hap_b) || (std::fabs(log_p1_[read_index]-log_p2_[read_index]) > TOLERANCE))){
 			double v1 = log_p1_[read_index]+read_LL_ptr[hap_a], v2 = log_p2_[read_index]+read_LL_ptr[hap_b];
-			if (std::fabs(v1-v2) > STRAND_TOLERANCE){
+			if (std::fabs(v1-v2) > options_.STRAND_TOLERANCE){
 				read_strand = (v1 > v2 ? 0 : 1);
 				if (read_strand == 0) {
 					unique_reads_hap_one[sample_label_[read_index]]++;
-					if (alns_[read_index].is_from_reverse_strand()) rv_unique_reads_hap_one[sample_label_[read_index]]++;
+					if (alns_.is_from_reverse_strand(read_index)) rv_unique_reads_hap_one[sample_label_[read_index]]++;
 				}
 				else {
 					unique_reads_hap_two[sample_label_[read_index]]++;
-					if (alns_[read_index].is_from_reverse_strand()) rv_unique_reads_hap_two[sample_label_[read_index]]++;
+					if (alns_.is_from_reverse_strand(read_index)) rv_unique_reads_hap_two[sample_label_[read_index]]++;
 				}
 			}
 		}
@@ -1098,7 +1130,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		std::pair<int,int> trace_key(pool_index_[read_index], best_hap);
 		auto trace_iter = trace_cache_.find(trace_key);
 		if (trace_iter == trace_cache_.end()){
-			trace  = hap_aligner.trace_optimal_aln(alns_[read_index], seed_positions_[read_index], best_hap, &base_quality_);
+			trace  = hap_aligner.trace_optimal_aln(alns_.get_read(read_index), seed_positions_[read_index], best_hap, &base_quality_);
 			trace_cache_[trace_key] = trace;
 		}
 		else
@@ -1110,7 +1142,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 			num_reads_with_flank_indels[sample_label_[read_index]]++;
 
 		if (viz_left_alns)
-			(read_strand == 0 ? left_alns_strand_one : left_alns_strand_two)[sample_label_[read_index]].push_back(alns_[read_index]);
+			(read_strand == 0 ? left_alns_strand_one : left_alns_strand_two)[sample_label_[read_index]].push_back(alns_.get_alignment(read_index));
 		(read_strand == 0 ? max_LL_alns_strand_one : max_LL_alns_strand_two)[sample_label_[read_index]].push_back(trace->traced_aln());
 		total_aln_trace_time_ += (clock() - trace_start)/CLOCKS_PER_SEC;
 
@@ -1127,7 +1159,8 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		}
 
 		// Extract the bp difference observed in read from left-alignment
-		got_size = ExtractCigar(alns_[read_index].get_cigar_list(), alns_[read_index].get_start(), region.start()-region.period(), region.stop()+region.period(), bp_diff);
+		alns_.get_cigar_list(read_index, cigar_list);
+		got_size = ExtractCigar(cigar_list, alns_.get_start(read_index), region.start()-region.period(), region.stop()+region.period(), bp_diff);
 		if (got_size) bps_per_sample[sample_label_[read_index]].push_back(bp_diff);
 
 		// Extract the ML bp difference observed in read based on the ML genotype,
@@ -1138,6 +1171,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 
 		read_LL_ptr += num_alleles_;
 	}
+	aln_trace_counts_.add_since(trace_counts_start);
 
 	// Compute allele counts for samples of interest
 	std::set<std::string> samples_of_interest(sample_names.begin(), sample_names.end());
@@ -1149,7 +1183,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		if (num_aligned_reads[sample_index] == 0)
 			continue;
 		if (num_aligned_reads[sample_index] > 0 &&
-				(num_reads_with_flank_indels[sample_index] > MAX_FLANK_INDEL_FRAC*num_aligned_reads[sample_index])){
+				(num_reads_with_flank_indels[sample_index] > options_.MAX_FLANK_INDEL_FRAC*num_aligned_reads[sample_index])){
 			filt_count++;
 			continue;
 		}
@@ -1178,44 +1212,19 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 	for (unsigned int i = 0; i < alleles.size(); i++)
 		logger << "\t" << alleles[new_to_old[i]] << " " << allele_counts[new_to_old[i]] << std::endl;
 
-	//VCF line format = CHROM POS ID REF ALT QUAL FILTER INFO FORMAT SAMPLE_1 SAMPLE_2 ... SAMPLE_N
-	out << region.chrom() << "\t" << pos << "\t" << (region.name().empty() ? "." : region.name());
-
-	// Add reference allele and alternate alleles
-	out << "\t" << alleles[new_to_old[0]] << "\t";
-	if (alleles.size() == 1)
-		out << ".";
-	else {
-		for (int i = 1; i < alleles.size()-1; i++)
-			out << alleles[new_to_old[i]] << ",";
-		out << alleles[new_to_old.back()];
-	}
-
-	// Add QUAL and FILTER fields
-	out << "\t" << "." << "\t" << ".";
-
 	// Obtain relevant stutter model
 	assert(haplotype_->get_block(hap_block_index)->get_repeat_info() != NULL);
 	StutterModel* stutter_model = haplotype_->get_block(hap_block_index)->get_repeat_info()->get_stutter_model();
 
-	// Add INFO field items
-	out << "\tINFRAME_PGEOM=" << stutter_model->get_parameter(true,  'P') << ";"
-		<< "INFRAME_UP="      << stutter_model->get_parameter(true,  'U') << ";"
-		<< "INFRAME_DOWN="    << stutter_model->get_parameter(true,  'D') << ";"
-		<< "OUTFRAME_PGEOM="  << stutter_model->get_parameter(false, 'P') << ";"
-		<< "OUTFRAME_UP="     << stutter_model->get_parameter(false, 'U') << ";"
-		<< "OUTFRAME_DOWN="   << stutter_model->get_parameter(false, 'D') << ";"
-		<< "START="           << region.start()+1 << ";"
-		<< "END="             << region.stop()    << ";"
-		<< "PERIOD="          << region.period()  << ";"
-		<< "NSKIP="           << skip_count       << ";"
-		<< "NFILT="           << filt_count       << ";";
-	if (alleles.size() > 1){
-		out << "BPDIFFS=" << allele_bp_diffs[new_to_old[1]];
-		for (unsigned int i = 2; i < alleles.size(); i++)
-			out << "," << allele_bp_diffs[new_to_old[i]];
-		out << ";";
+	// Arrange the alleles, their bp differences and their counts in VCF order
+	std::vector<std::string> vcf_alleles;
+	std::vector<int> vcf_bp_diffs, vcf_allele_counts;
+	for (unsigned int i = 0; i < alleles.size(); i++){
+		vcf_alleles.push_back(alleles[new_to_old[i]]);
+		vcf_bp_diffs.push_back(allele_bp_diffs[new_to_old[i]]);
+		vcf_allele_counts.push_back(allele_counts[new_to_old[i]]);
 	}
+	write_vcf_site_info(region, pos, vcf_alleles, vcf_bp_diffs, stutter_model, skip_count, filt_count, out);
 
 	// Compute INFO field values for DP, DSTUTTER and DFLANKINDEL and add them to the VCF
 	int32_t tot_dp = 0, tot_dsnp = 0, tot_dstutter = 0, tot_dflankindel = 0;
@@ -1226,7 +1235,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		if (!call_sample_[sample_iter->second].empty())
 			continue;
 		if (num_aligned_reads[sample_iter->second] > 0 &&
-				(num_reads_with_flank_indels[sample_iter->second] > num_aligned_reads[sample_iter->second]*MAX_FLANK_INDEL_FRAC))
+				(num_reads_with_flank_indels[sample_iter->second] > num_aligned_reads[sample_iter->second]*options_.MAX_FLANK_INDEL_FRAC))
 			continue;
 
 		int sample_index = sample_iter->second;
@@ -1239,49 +1248,37 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		<< "DSNP="        << tot_dsnp        << ";"
 		<< "DSTUTTER="    << tot_dstutter    << ";"
 		<< "DFLANKINDEL=" << tot_dflankindel << ";";
-
-	// Add allele counts
-	out << "AN=" << allele_number << ";" << "REFAC=" << allele_counts[0];
-	if (allele_counts.size() > 1){
-		out << ";AC=";
-		for (unsigned int i = 1; i < allele_counts.size()-1; i++)
-			out << allele_counts[new_to_old[i]] << ",";
-		out << allele_counts[new_to_old.back()];
-	}
+	write_vcf_allele_counts(allele_number, vcf_allele_counts, out);
 
 	// If we used all reads during genotyping and performed assembly, we'll output the allele bias and Fisher strand bias
-	bool output_allele_bias = (!haploid_ && reassemble_flanks_);
-	bool output_strand_bias = (!haploid_ && reassemble_flanks_);
+	bool output_bias_stats = (!haploid_ && reassemble_flanks_);
+	std::string empty_str  = write_vcf_format(true, output_bias_stats, true, out);
+
+	// Matrix entries mirror the VCF record, with alleles in the same order and filtered samples marked as missing
+	GenotypeMatrixLocus gt_matrix_locus;
+	bool build_matrix_locus = (gt_matrix_writer != NULL || locus_results != NULL);
+	if (build_matrix_locus){
+		gt_matrix_locus.chrom    = region.chrom();
+		gt_matrix_locus.pos      = pos;
+		gt_matrix_locus.start    = region.start()+1;
+		gt_matrix_locus.stop     = region.stop();
+		gt_matrix_locus.period   = region.period();
+		gt_matrix_locus.alleles  = vcf_alleles;
+		gt_matrix_locus.bp_diffs = vcf_bp_diffs;
+		for (unsigned int i = 0; i < sample_names.size(); i++)
+			gt_matrix_locus.add_missing_sample();
+	}
 
-	// Add FORMAT field
-	int num_fields;
+	// Compute the allele bias and strand bias p-values for all heterozygous samples in a single pass, as
+	// samples frequently share the same read counts. Values > 1 denote that the statistic isn't applicable
+	std::vector<double> allele_biases(num_samples_, 1.01), strand_biases(num_samples_, 1.01);
 	if (!haploid_){
-		out << "\tGT:GB:Q:PQ:DP:DSNP:DSTUTTER:DFLANKINDEL:PDP:PSNP:GLDIFF";
-		num_fields = 11;
+		std::vector<bool> heterozygous(num_samples_, false);
+		for (int i = 0; i < num_samples_; i++)
+			heterozygous[i] = (gts[i].first != gts[i].second);
+		compute_bias_statistics(heterozygous, unique_reads_hap_one, unique_reads_hap_two,
+					rv_unique_reads_hap_one, rv_unique_reads_hap_two, allele_biases, strand_biases);
 	}
-	else {
-		out << "\tGT:GB:Q:DP:DSTUTTER:DFLANKINDEL:GLDIFF";
-		num_fields = 7;
-	}
-	if (output_allele_bias)    out << ":AB:DAB";
-	if (output_strand_bias)    out << ":FS";
-	if (OUTPUT_ALLREADS == 1)  out << ":ALLREADS";
-	if (OUTPUT_MALLREADS == 1) out << ":MALLREADS";
-	if (OUTPUT_GLS == 1)       out << ":GL";
-	if (OUTPUT_PLS == 1)       out << ":PL";
-	if (!haploid_ && (OUTPUT_PHASED_GLS == 1))
-		out << ":PHASEDGL";
-	if (OUTPUT_HAPLOTYPE_DATA) out << ":HQ:PHQ";
-	if (OUTPUT_FILTERS == 1)   out << ":FILTER";
-
-	// Build the missing genotype string
-	// Exclude OUTPUT_FILTERS, as we won't use that to build the missing genotype string
-	num_fields += ((output_allele_bias ? 2 : 0) + (output_strand_bias ? 1 : 0)) + (!haploid_ && (OUTPUT_PHASED_GLS == 1) ? 1 : 0);
-	num_fields += (OUTPUT_ALLREADS + OUTPUT_MALLREADS + OUTPUT_GLS + OUTPUT_PLS + 2*OUTPUT_HAPLOTYPE_DATA);
-	std::stringstream empty_gt;
-	for (int n = 0; n < num_fields; n++)
-		empty_gt << ".:";
-	std::string empty_str = empty_gt.str();
 
 	std::map<std::string, std::string> sample_results;
 	std::map<std::string, int> filter_reasons;
@@ -1289,30 +1286,30 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		out << "\t";
 		auto sample_iter = sample_indices_.find(sample_names[i]);
 		if (sample_iter == sample_indices_.end()){
-			out << (OUTPUT_FILTERS == 0 ? "." : empty_str + "NO_READS");
+			out << (options_.OUTPUT_FILTERS == 0 ? "." : empty_str + "NO_READS");
 			continue;
 		}
 
 		// Don't report information for a sample if none of its reads were successfully realigned
 		if (num_aligned_reads[sample_iter->second] == 0){
 			filter_reasons["NO_READS"]++;
-			out << (OUTPUT_FILTERS == 0 ? "." : empty_str + "NO_READS");
+			out << (options_.OUTPUT_FILTERS == 0 ? "." : empty_str + "NO_READS");
 			continue;
 		}
 
 		// Don't report information for a sample if flag has been set to false
 		if (!call_sample_[sample_iter->second].empty()){
 			filter_reasons[call_sample_[sample_iter->second]]++;
-			out << (OUTPUT_FILTERS == 0 ? "." : empty_str + call_sample_[sample_iter->second]);
+			out << (options_.OUTPUT_FILTERS == 0 ? "." : empty_str + call_sample_[sample_iter->second]);
 			continue;
 		}
 
 		// Don't report genotype for a sample if it exceeds the flank indel fraction
 		if (num_aligned_reads[sample_iter->second] > 0 &&
-				(num_reads_with_flank_indels[sample_iter->second] > num_aligned_reads[sample_iter->second]*MAX_FLANK_INDEL_FRAC)){
+				(num_reads_with_flank_indels[sample_iter->second] > num_aligned_reads[sample_iter->second]*options_.MAX_FLANK_INDEL_FRAC)){
 			call_sample_[sample_iter->second] = "FLANK_INDEL_FRAC";
 			filter_reasons["FLANK_INDEL_FRAC"]++;
-			out << (OUTPUT_FILTERS == 0 ? "." : empty_str + "FLANK_INDEL_FRAC");
+			out << (options_.OUTPUT_FILTERS == 0 ? "." : empty_str + "FLANK_INDEL_FRAC");
 			continue;
 		}
 
@@ -1324,21 +1321,16 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		samp_info << allele_bp_diffs[gts[sample_index].first] << "|" << allele_bp_diffs[gts[sample_index].second];
 		sample_results[sample_names[i]] = samp_info.str();
 
-		double allele_bias = 1.01;
-		if (!haploid_ && (gts[sample_index].first != gts[sample_index].second))
-			allele_bias = compute_allele_bias(unique_reads_hap_one[sample_index], unique_reads_hap_two[sample_index]);
-
-		// Compute the strand bias p-value using the kt_fisher_exact function from htslib
-		// For the bias, we use the two-sided p-value
-		double strand_bias = 1.01;
-		if (!haploid_ && (gts[sample_index].first != gts[sample_index].second)){
-			double left, right, two;
-			kt_fisher_exact(unique_reads_hap_one[sample_index] - rv_unique_reads_hap_one[sample_index], rv_unique_reads_hap_one[sample_index],
-					unique_reads_hap_two[sample_index] - rv_unique_reads_hap_two[sample_index], rv_unique_reads_hap_two[sample_index],
-					&left, &right, &two);
-			strand_bias = log10(std::min(1.0, two));
+		if (build_matrix_locus){
+			gt_matrix_locus.gt_a[i]   = old_to_new[gts[sample_index].first];
+			gt_matrix_locus.gt_b[i]   = old_to_new[gts[sample_index].second];
+			gt_matrix_locus.quals[i]  = exp(log_unphased_posteriors[sample_index]);
+			gt_matrix_locus.depths[i] = num_aligned_reads[sample_index];
 		}
 
+		double allele_bias = allele_biases[sample_index];
+		double strand_bias = strand_biases[sample_index];
+
 		if (!haploid_){
 			out << old_to_new[gts[sample_index].first] << "|" << old_to_new[gts[sample_index].second]     // Genotype
 				<< ":" << allele_bp_diffs[gts[sample_index].first]
@@ -1374,7 +1366,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		}
 
 		// Output the log10 value of the allele bias p-value
-		if (output_allele_bias){
+		if (output_bias_stats){
 			if (allele_bias > 1)
 				out << ":" << 0 << ":.";
 			else
@@ -1382,7 +1374,7 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		}
 
 		// Output the log10 value of the Fisher strand bias p-value
-		if (output_strand_bias){
+		if (output_bias_stats){
 			if (strand_bias > 1)
 				out << ":" << 0;
 			else
@@ -1390,83 +1382,34 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 		}
 
 		// Add bp diffs from regular left-alignment
-		if (OUTPUT_ALLREADS == 1)
+		if (options_.OUTPUT_ALLREADS == 1)
 			out << ":" << condense_read_counts(bps_per_sample[sample_index]);
 
 		// Maximum likelihood base pair differences in each read from alignment probabilites
-		if (OUTPUT_MALLREADS == 1)
+		if (options_.OUTPUT_MALLREADS == 1)
 			out << ":" << condense_read_counts(ml_bps_per_sample[sample_index]);
 
 		// Genotype and phred-scaled likelihoods, taking into account new allele ordering
-		if (haploid_){
-			if (OUTPUT_GLS == 1){
-				out << ":" << gls[sample_index][0];
-				for (int i = 1; i < new_to_old.size(); i++)
-					out << "," << gls[sample_index][new_to_old[i]];
-			}
-
-			if (OUTPUT_PLS == 1){
-				out << ":" << pls[sample_index][0];
-				for (int i = 1; i < new_to_old.size(); i++)
-					out << "," << pls[sample_index][new_to_old[i]];
-			}
-		}
-		else {
-			if (OUTPUT_GLS == 1){
-				out << ":" << gls[sample_index][0];
-				for (int i = 1; i < new_to_old.size(); i++){
-					for (int j = 0; j <= i; j++){
-						int index_a = std::min(new_to_old[i], new_to_old[j]);
-						int index_b = std::max(new_to_old[i], new_to_old[j]);
-						out << "," << gls[sample_index][index_b*(index_b+1)/2 + index_a];
-					}
-				}
-			}
-
-			if (OUTPUT_PLS == 1){
-				out << ":" << pls[sample_index][0];
-				for (int i = 1; i < new_to_old.size(); i++){
-					for (int j = 0; j <= i; j++){
-						int index_a = std::min(new_to_old[i], new_to_old[j]);
-						int index_b = std::max(new_to_old[i], new_to_old[j]);
-						out << "," << pls[sample_index][index_b*(index_b+1)/2 + index_a];
-					}
-				}
-			}
-
-			if (OUTPUT_PHASED_GLS == 1){
-				out << ":" << phased_gls[sample_index][0];
-				for (int i = 0; i < new_to_old.size(); i++){
-					for (int j = 0; j < new_to_old.size(); j++){
-						if (i == 0 && j == 0)
-							continue;
-						out << "," << phased_gls[sample_index][new_to_old[i]*new_to_old.size() + new_to_old[j]];
-					}
-				}
-			}
-		}
+		write_vcf_likelihoods(sample_index, new_to_old, gls, pls, phased_gls, out);
 
-		if (OUTPUT_HAPLOTYPE_DATA)
+		if (options_.OUTPUT_HAPLOTYPE_DATA)
 			out << ":" << exp(hap_log_unphased_posteriors[sample_index]) << ":" << exp(hap_log_phased_posteriors[sample_index]);
 
 		// Reason for filtering the call, which is none if we made it here
-		if (OUTPUT_FILTERS == 1)
+		if (options_.OUTPUT_FILTERS == 1)
 			out << ":PASS";
 	}
 
 	// Write out the record
 	std::string record_text = out.str();
-	vcf_writer->add_vcf_record(region.chrom(), pos, record_text);
-
-	if (!filter_reasons.empty()){
-		int32_t filt_count = 0;
-		for (auto filter_iter = filter_reasons.begin(); filter_iter != filter_reasons.end(); filter_iter++)
-			filt_count += filter_iter->second;
-		logger << "Filtered " << filt_count << " sample genotypes for the following reasons:\t";
-		for (auto filter_iter = filter_reasons.begin(); filter_iter != filter_reasons.end(); filter_iter++)
-			logger << filter_iter->second << "=" << filter_iter->first << "\t";
-		logger << std::endl;
-	}
+	if (vcf_writer != NULL)
+		vcf_writer->add_vcf_record(region.chrom(), pos, record_text);
+	if (gt_matrix_writer != NULL)
+		gt_matrix_writer->add_locus(gt_matrix_locus);
+	if (locus_results != NULL)
+		locus_results->push_back(gt_matrix_locus);
+
+	log_filter_reasons(filter_reasons, logger);
 
 	// Render HTML of Smith-Waterman alignments (or haplotype alignments)
 	if (output_viz){
@@ -1492,41 +1435,76 @@ void SeqStutterGenotyper::write_vcf_record(const std::vector<std::string>& sampl
 
 bool SeqStutterGenotyper::recompute_stutter_models(std::ostream& logger, int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq,
 		int max_em_iter, double abs_ll_converge, double frac_ll_converge){
-	logger << "Retraining EM stutter genotyper using maximum likelihood alignments" << std::endl;
-	std::vector<AlignmentTrace*> traced_alns;
-	retrace_alignments(traced_alns);
-
-	for (int block_index = 0; block_index < haplotype_->num_blocks(); ++block_index){
-		HapBlock* block = haplotype_->get_block(block_index);
-		if (block->get_repeat_info() == NULL)
-			continue;
+	double max_param_diff = 0.0001;
+	std::vector< std::pair<int,int> > prev_haps;
+	extract_best_haplotypes(prev_haps);
+
+	for (int round = 1; round <= options_.MAX_STUTTER_REFIT_ROUNDS; ++round){
+		logger << "Retraining EM stutter genotyper using maximum likelihood alignments (round " << round << ")" << std::endl;
+		std::vector<AlignmentTrace*> traced_alns;
+		retrace_alignments(traced_alns);
+
+		bool models_changed = false;
+		for (int block_index = 0; block_index < haplotype_->num_blocks(); ++block_index){
+			HapBlock* block = haplotype_->get_block(block_index);
+			if (block->get_repeat_info() == NULL)
+				continue;
 
-		std::vector< std::vector<int> > str_num_bps(num_samples_);
-		std::vector< std::vector<double> > str_log_p1s(num_samples_), str_log_p2s(num_samples_);
-		for (unsigned int read_index = 0; read_index < num_reads_; ++read_index){
-			AlignmentTrace* trace = traced_alns[read_index];
-			if (trace != NULL){
-				if (trace->traced_aln().get_start() < block->start()){
-					if (trace->traced_aln().get_stop() > block->end()){
-						str_num_bps[sample_label_[read_index]].push_back(((int)trace->str_seq(block_index).size())+trace->stutter_size(block_index));
-						str_log_p1s[sample_label_[read_index]].push_back(log_p1_[read_index]);
-						str_log_p2s[sample_label_[read_index]].push_back(log_p2_[read_index]);
+			std::vector< std::vector<int> > str_num_bps(num_samples_);
+			std::vector< std::vector<double> > str_log_p1s(num_samples_), str_log_p2s(num_samples_);
+			for (unsigned int read_index = 0; read_index < num_reads_; ++read_index){
+				AlignmentTrace* trace = traced_alns[read_index];
+				if (trace != NULL){
+					if (trace->traced_aln().get_start() < block->start()){
+						if (trace->traced_aln().get_stop() > block->end()){
+							str_num_bps[sample_label_[read_index]].push_back(((int)trace->str_seq(block_index).size())+trace->stutter_size(block_index));
+							str_log_p1s[sample_label_[read_index]].push_back(log_p1_[read_index]);
+							str_log_p2s[sample_label_[read_index]].push_back(log_p2_[read_index]);
+						}
 					}
 				}
 			}
+
+			// Warm-start the EM from the locus' current stutter model, as it's typically close to the optimum
+			StutterModel* current_model = block->get_repeat_info()->get_stutter_model();
+			int period = block->get_repeat_info()->get_period();
+			EMStutterGenotyper length_genotyper(options_, haploid_, period, str_num_bps, str_log_p1s, str_log_p2s, sample_names_, 0);
+			bool trained = length_genotyper.train(max_em_iter, abs_ll_converge, frac_ll_converge, false, logger, current_model);
+			if (!trained){
+				logger << "Retraining stutter model training failed" << std::endl;
+				return false;
+			}
+
+			logger << "Learned stutter model for block #" << block_index << ":" << (*length_genotyper.get_stutter_model()) << std::endl;
+			models_changed |= !length_genotyper.get_stutter_model()->parameters_within_threshold(*current_model, max_param_diff);
+			block->get_repeat_info()->set_stutter_model(length_genotyper.get_stutter_model());
 		}
 
-		int period = block->get_repeat_info()->get_period();
-		EMStutterGenotyper length_genotyper(haploid_, period, str_num_bps, str_log_p1s, str_log_p2s, sample_names_, 0);
-		bool trained = length_genotyper.train(max_em_iter, abs_ll_converge, frac_ll_converge, false, logger);
-		if (!trained){
-			logger << "Retraining stutter model training failed" << std::endl;
-			return false;
+		if (!models_changed){
+			logger << "Stutter models converged. Skipping realignment" << std::endl;
+			break;
 		}
 
-		logger << "Learned stutter model for block #" << block_index << ":" << (*length_genotyper.get_stutter_model()) << std::endl;
-		block->get_repeat_info()->set_stutter_model(length_genotyper.get_stutter_model());
+		// Every read's alignment probabilities depend on the stutter models (e.g. a read supporting one allele of a
+		// heterozygote is also a stutter artifact of the other), so all pools are realigned to keep the posteriors consistent
+		for (auto trace_iter = trace_cache_.begin(); trace_iter != trace_cache_.end(); trace_iter++)
+			delete trace_iter->second;
+		trace_cache_.clear();
+
+		logger << "Realigning reads using the retrained stutter models" << std::endl;
+		std::vector<bool> realign_to_haplotype(num_alleles_, true);
+		calc_hap_aln_probs(realign_to_haplotype);
+		calc_log_sample_posteriors();
+
+		// Stop once the genotype calls are no longer changing
+		std::vector< std::pair<int,int> > haps;
+		extract_best_haplotypes(haps);
+		if (haps == prev_haps){
+			logger << "Genotype calls are stable after " << round << " round(s) of stutter model retraining" << std::endl;
+			break;
+		}
+		prev_haps = haps;
 	}
-	trace_cache_.clear();
-	return genotype(max_total_haplotypes, max_flank_haplotypes, min_flank_freq, logger);
+
+	return refine_candidate_alleles(max_total_haplotypes, max_flank_haplotypes, min_flank_freq, logger);
 }
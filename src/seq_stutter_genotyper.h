@@ -11,6 +11,7 @@
 
 #include "bam_io.h"
 #include "base_quality.h"
+#include "genotype_matrix.h"
 #include "genotyper.h"
 #include "read_pooler.h"
 #include "region.h"
@@ -19,22 +20,21 @@
 #include "vcf_reader.h"
 #include "vcf_writer.h"
 
+#include "SeqAlignment/AlignmentArena.h"
 #include "SeqAlignment/AlignmentData.h"
 #include "SeqAlignment/AlignmentTraceback.h"
+#include "SeqAlignment/HapAligner.h"
 #include "SeqAlignment/Haplotype.h"
 #include "SeqAlignment/HapBlock.h"
 
 class SeqStutterGenotyper : public Genotyper {
  private:
-  int MAX_REF_FLANK_LEN;
-  double STRAND_TOLERANCE;
-
   BaseQuality base_quality_;
   ReadPooler pooler_;
   int* pool_index_;                               // Pool index for each read
 
   typedef std::vector<Alignment> AlnList;
-  AlnList alns_;                                  // Vector of left-aligned alignments
+  AlignmentArena alns_;                           // Compact storage for the left-aligned alignments
   std::vector<HapBlock*> hap_blocks_;             // Haplotype blocks
   Haplotype* haplotype_;                          // Potential STR haplotypes
   std::vector<std::string> call_sample_;          // True iff we should try to genotype the sample with the associated index
@@ -47,7 +47,10 @@ class SeqStutterGenotyper : public Genotyper {
   int* seed_positions_;
 
   // VCF containing STR and SNP genotypes for a reference panel
-  VCF::VCFReader* ref_vcf_;
+  RefVCFCursor* ref_vcf_;
+
+  // Alignment buffers shared with other genotypers. If NULL, each haplotype aligner allocates its own
+  HapAlignerWorkspace* aligner_workspace_;
 
   // If this flag is set, the genotyper will reassemble the flanking sequencesAfter an initial round of genotyping
   bool reassemble_flanks_;
@@ -58,8 +61,14 @@ class SeqStutterGenotyper : public Genotyper {
   double total_aln_trace_time_;
   double total_assembly_time_;
 
+  // Hardware performance counter totals for the same stages (only collected if PerfCounters is enabled)
+  PerfCounts hap_build_counts_, hap_aln_counts_, aln_trace_counts_, assembly_counts_;
+
   // Used to identify candidate haplotypes during flank reassembly
-  int MIN_PATH_WEIGHT, MIN_KMER, MAX_KMER;
+  int MIN_PATH_WEIGHT;
+
+  // Smallest k-mer size for which each reference flank's de Bruijn graph is acyclic (-1 if not yet determined)
+  int flank_kmer_lengths_[2];
 
   // Cache of traced back alignments
   std::map<std::pair<int,int>, AlignmentTrace*> trace_cache_;
@@ -99,6 +108,10 @@ class SeqStutterGenotyper : public Genotyper {
   // containing these alleles and incorporate these alignment probabilities into the relevant data structures
   bool id_and_align_to_stutter_alleles(int max_total_haplotypes, std::ostream& logger);
 
+  // Identify additional stutter alleles, remove unused alleles and reassemble the flanks (if enabled)
+  // after the reads have been aligned to the current set of candidate haplotypes
+  bool refine_candidate_alleles(int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq, std::ostream& logger);
+
   // Exploratory function related to identifying indels in the flanking sequences
   void analyze_flank_indels(std::ostream& logger);
 
@@ -126,11 +139,10 @@ class SeqStutterGenotyper : public Genotyper {
 			      std::vector< std::vector<std::string> >& alleles_to_add,
 			      std::vector<bool>& realign_pool, std::vector<bool>& copy_read);
 
-  double compute_allele_bias(int hap_a_read_count, int hap_b_read_count);
-
   void write_vcf_record(const std::vector<std::string>& sample_names, int hap_block_index, const Region& region, const std::string& chrom_seq,
 			bool output_viz, bool viz_left_alns,
-			std::ostream& html_output, VCFWriter* vcf_writer, std::ostream& logger);
+			std::ostream& html_output, VCFWriter* vcf_writer, GenotypeMatrixWriter* gt_matrix_writer, std::ostream& logger,
+			std::vector<GenotypeMatrixLocus>* locus_results);
 
   RegionGroup* region_group_;
   bool skip_assembly;
@@ -141,26 +153,25 @@ class SeqStutterGenotyper : public Genotyper {
   SeqStutterGenotyper& operator=(const SeqStutterGenotyper& other);
 
  public:
-  SeqStutterGenotyper(const RegionGroup& region_group, bool haploid, bool reassemble_flanks,
-		      std::vector<Alignment>& alignments, std::vector< std::vector<double> >& log_p1, std::vector< std::vector<double> >& log_p2,
+  // The genotyper takes ownership of the left-aligned reads in ALIGNMENTS, leaving the arena empty
+  SeqStutterGenotyper(const GenotyperOptions& options, const RegionGroup& region_group, bool haploid, bool reassemble_flanks,
+		      AlignmentArena& alignments, std::vector< std::vector<double> >& log_p1, std::vector< std::vector<double> >& log_p2,
 		      const std::vector<std::string>& sample_names, const std::string& chrom_seq,
-		      std::vector<StutterModel*>& stutter_models, VCF::VCFReader* ref_vcf, std::ostream& logger, bool skip_assembly_): Genotyper(haploid, sample_names, log_p1, log_p2){
+		      std::vector<StutterModel*>& stutter_models, RefVCFCursor* ref_vcf, std::ostream& logger, bool skip_assembly_): Genotyper(options, haploid, sample_names, log_p1, log_p2){
     region_group_          = region_group.copy();
-    alns_                  = alignments;
     seed_positions_        = NULL;
     pool_index_            = NULL;
     haplotype_             = NULL;
     second_mate_           = NULL;
-    MAX_REF_FLANK_LEN      = 30;
     MIN_PATH_WEIGHT        = 2;
-    MIN_KMER               = 10;
-    MAX_KMER               = 15;
-    STRAND_TOLERANCE       = 0.1;
+    flank_kmer_lengths_[0] = flank_kmer_lengths_[1] = -1;
     initialized_           = false;
     reassemble_flanks_     = reassemble_flanks;
     total_hap_build_time_  = total_hap_aln_time_  = 0;
     total_aln_trace_time_  = total_assembly_time_ = 0;
     ref_vcf_               = ref_vcf;
+    aligner_workspace_     = NULL;
+    alns_.swap(alignments);
     assert(num_reads_ == alns_.size());
     init(stutter_models, chrom_seq, logger);
     skip_assembly = skip_assembly_;
@@ -178,21 +189,33 @@ class SeqStutterGenotyper : public Genotyper {
     delete haplotype_;
   }
   
+  // Records are only written if VCF_WRITER is non-NULL. If LOCUS_RESULTS is non-NULL, the genotypes for each region are also appended to it
   void write_vcf_record(const std::vector<std::string>& sample_names, const std::string& chrom_seq,
 			bool output_viz, bool viz_left_alns,
-			std::ostream& html_output, VCFWriter* vcf_writer, std::ostream& logger);
+			std::ostream& html_output, VCFWriter* vcf_writer, GenotypeMatrixWriter* gt_matrix_writer, std::ostream& logger,
+			std::vector<GenotypeMatrixLocus>* locus_results = NULL);
 
 
+  // Reuse the buffers in WORKSPACE for all subsequent haplotype alignments. The genotyper doesn't take ownership
+  void set_aligner_workspace(HapAlignerWorkspace* workspace){ aligner_workspace_ = workspace; }
+
   double hap_build_time() { return total_hap_build_time_;  }
   double hap_aln_time()   { return total_hap_aln_time_;    }
   double aln_trace_time() { return total_aln_trace_time_;  }
   double assembly_time()  { return total_assembly_time_;   }
 
+  const PerfCounts& hap_build_counts() const { return hap_build_counts_; }
+  const PerfCounts& hap_aln_counts()   const { return hap_aln_counts_;   }
+  const PerfCounts& aln_trace_counts() const { return aln_trace_counts_; }
+  const PerfCounts& assembly_counts()  const { return assembly_counts_;  }
+
   bool genotype(int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq, std::ostream& logger);
 
   /*
    * Recompute the stutter model(s) using the PCR artifacts obtained from the ML alignments
-   * and regenotype the samples using this new model
+   * and regenotype the samples using this new model. The EM is warm-started from each block's current model
+   * and all reads are then realigned using the retrained models. These two steps are
+   * repeated until the genotype calls are stable or the options' MAX_STUTTER_REFIT_ROUNDS is reached
   */
   bool recompute_stutter_models(std::ostream& logger, int max_total_haplotypes, int max_flank_haplotypes, double min_flank_freq,
 				int max_em_iter, double abs_ll_converge, double frac_ll_converge);
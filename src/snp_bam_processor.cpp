@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <map>
 #include <time.h>
 
 #include "snp_bam_processor.h"
@@ -36,9 +37,9 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
 				    std::vector<BamAlnList>& mate_pairs_by_rg,
 				    std::vector<BamAlnList>& unpaired_strs_by_rg,
 				    const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq){
-  // Only use specialized function for 10X genomics BAMs if flag has been set
-  if (bams_from_10x_){
-    process_10x_reads(paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, rg_names, region_group, chrom_seq);
+  // Only use specialized function for BAMs with haplotype tags if flag has been set
+  if (use_hap_tags_){
+    process_hap_tagged_reads(paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, rg_names, region_group, chrom_seq);
     return;
   }
 
@@ -66,9 +67,10 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
 	if (sample_indices.find(rg_names[i]) != sample_indices.end()){
 	  good_samples.insert(rg_names[i]);
 	  std::vector<double> log_p1, log_p2;
-	  SNPTree* snp_tree = snp_trees[sample_indices[rg_names[i]]];
-	  calc_het_snp_factors(paired_strs_by_rg[i], mate_pairs_by_rg[i], base_quality_, snp_tree, log_p1, log_p2, match_count_, mismatch_count_);
-	  calc_het_snp_factors(unpaired_strs_by_rg[i], base_quality_, snp_tree, log_p1, log_p2, match_count_, mismatch_count_);
+	  std::vector<SNP> snps;
+	  snp_trees[sample_indices[rg_names[i]]]->getSorted(snps);
+	  calc_het_snp_factors(paired_strs_by_rg[i], mate_pairs_by_rg[i], base_quality_, snps, log_p1, log_p2, match_count_, mismatch_count_);
+	  calc_het_snp_factors(unpaired_strs_by_rg[i], base_quality_, snps, log_p1, log_p2, match_count_, mismatch_count_);
 	  log_p1s.push_back(log_p1); log_p2s.push_back(log_p2);
 	}
 	else {
@@ -123,79 +125,84 @@ void SNPBamProcessor::process_reads(std::vector<BamAlnList>& paired_strs_by_rg,
   analyze_reads_and_phasing(alignments, log_p1s, log_p2s, rg_names, region_group, chrom_seq);
 }
 
-int SNPBamProcessor::get_haplotype(BamAlignment& aln) const {
-  if (!aln.HasTag(HAPLOTYPE_TAG.c_str()))
-    return -1;
-  int64_t haplotype;
-  if (!aln.GetIntTag(HAPLOTYPE_TAG.c_str(), haplotype))
-    printErrorAndDie("Failed to extract haplotype tag");
-  assert(haplotype == 1 || haplotype == 2);
-  return (int)haplotype;
-}
-
 /*
-** Exploratory function for analyzing data from 10X Genomics BAMs
-** These BAMs contain haplotype tags, which can be used in place of the physical-phasing + VCF approach
-** used in the standard process_reads function
- */
-void SNPBamProcessor::process_10x_reads(std::vector<BamAlnList>& paired_strs_by_rg,
-					std::vector<BamAlnList>& mate_pairs_by_rg,
-					std::vector<BamAlnList>& unpaired_strs_by_rg,
-					const std::vector<std::string>& rg_names, const RegionGroup& region_group,
-					const std::string& chrom_seq){
+** Phase reads using the haplotype (HP) and phase set (PS) tags present in 10X Genomics BAMs and in haplotagged long-read BAMs
+** These tags are used in place of the physical-phasing + VCF approach used in the standard process_reads function
+** The tags are extracted from the raw records in read_and_filter_reads, so no tag lookups are performed here.
+** As haplotype indices are only comparable within a phase set, only each sample's reads in its most common phase set are phased
+*/
+void SNPBamProcessor::process_hap_tagged_reads(std::vector<BamAlnList>& paired_strs_by_rg,
+					       std::vector<BamAlnList>& mate_pairs_by_rg,
+					       std::vector<BamAlnList>& unpaired_strs_by_rg,
+					       const std::vector<std::string>& rg_names, const RegionGroup& region_group,
+					       const std::string& chrom_seq){
   locus_snp_phase_info_time_ = clock();
   assert(paired_strs_by_rg.size() == mate_pairs_by_rg.size() && paired_strs_by_rg.size() == unpaired_strs_by_rg.size());
 
   std::vector<BamAlnList> alignments(paired_strs_by_rg.size());
-  std::vector< std::vector<double> > log_p1s, log_p2s;
-  int32_t phased_reads = 0, total_reads = 0;
+  std::vector< std::vector<double> > log_p1s(paired_strs_by_rg.size()), log_p2s(paired_strs_by_rg.size());
+  int32_t phased_reads = 0, total_reads = 0, phased_samples = 0;
   for (unsigned int i = 0; i < paired_strs_by_rg.size(); i++){
-    // Copy alignments
-    alignments[i].insert(alignments[i].end(), paired_strs_by_rg[i].begin(),   paired_strs_by_rg[i].end());
-    alignments[i].insert(alignments[i].end(), unpaired_strs_by_rg[i].begin(), unpaired_strs_by_rg[i].end());
-
-    log_p1s.push_back(std::vector<double>());
-    log_p2s.push_back(std::vector<double>());
+    std::vector< std::pair<int, int64_t> > read_phases;
+    read_phases.reserve(paired_strs_by_rg[i].size() + unpaired_strs_by_rg[i].size());
     for (unsigned int j = 0; j < paired_strs_by_rg[i].size(); j++){
-      total_reads++;
-      int haplotype_1 = get_haplotype(paired_strs_by_rg[i][j]);
-      int haplotype_2 = get_haplotype(mate_pairs_by_rg[i][j]);
-
-      // If the two mate pairs don't have the same haplotype index, it's possible that
-      // i)  One of them is unmapped (and therefore has a -1)
+      // If the two mate pairs don't have the same haplotype and phase set, it's possible that
+      // i)  One of them is untagged (and therefore has a -1)
       // ii) They map to two different phase sets. This is essentially a phasing breakpoint and we
       //     probably want to avoid using phase information for these reads
-      int haplotype;
-      if (haplotype_1 != haplotype_2)
-	haplotype = -1;
+      BamAlignment& aln_1 = paired_strs_by_rg[i][j];
+      BamAlignment& aln_2 = mate_pairs_by_rg[i][j];
+      if (aln_1.HaplotypeTag() == aln_2.HaplotypeTag() && aln_1.PhaseSetTag() == aln_2.PhaseSetTag())
+	read_phases.push_back(std::pair<int, int64_t>(aln_1.HaplotypeTag(), aln_1.PhaseSetTag()));
       else
-	haplotype = haplotype_1;
-      if (haplotype != -1){
-	phased_reads++;
-	log_p1s[i].push_back(haplotype == 1 ? FROM_HAP_LL : OTHER_HAP_LL);
-	log_p2s[i].push_back(haplotype == 2 ? FROM_HAP_LL : OTHER_HAP_LL);
-      }
-      else {
-	log_p1s[i].push_back(0.0);
-	log_p2s[i].push_back(0.0);
+	read_phases.push_back(std::pair<int, int64_t>(-1, -1));
+    }
+    for (unsigned int j = 0; j < unpaired_strs_by_rg[i].size(); j++)
+      read_phases.push_back(std::pair<int, int64_t>(unpaired_strs_by_rg[i][j].HaplotypeTag(), unpaired_strs_by_rg[i][j].PhaseSetTag()));
+
+    // Identify the phase set containing the most tagged reads
+    std::map<int64_t, int> phase_set_counts;
+    for (auto phase_iter = read_phases.begin(); phase_iter != read_phases.end(); phase_iter++)
+      if (phase_iter->first != -1)
+	phase_set_counts[phase_iter->second]++;
+    int64_t best_phase_set = -1;
+    int best_count         = 0;
+    for (auto count_iter = phase_set_counts.begin(); count_iter != phase_set_counts.end(); count_iter++){
+      if (count_iter->second > best_count){
+	best_phase_set = count_iter->first;
+	best_count     = count_iter->second;
       }
     }
-    for (unsigned int j = 0; j < unpaired_strs_by_rg[i].size(); j++){
+
+    log_p1s[i].reserve(read_phases.size());
+    log_p2s[i].reserve(read_phases.size());
+    for (auto phase_iter = read_phases.begin(); phase_iter != read_phases.end(); phase_iter++){
       total_reads++;
-      int haplotype = get_haplotype(unpaired_strs_by_rg[i][j]);
-      if (haplotype != -1){
+      if (phase_iter->first != -1 && phase_iter->second == best_phase_set){
 	phased_reads++;
-	log_p1s[i].push_back(haplotype == 1 ? FROM_HAP_LL : OTHER_HAP_LL);
-	log_p2s[i].push_back(haplotype == 2 ? FROM_HAP_LL : OTHER_HAP_LL);
+	log_p1s[i].push_back(phase_iter->first == 1 ? FROM_HAP_LL : OTHER_HAP_LL);
+	log_p2s[i].push_back(phase_iter->first == 2 ? FROM_HAP_LL : OTHER_HAP_LL);
       }
       else {
 	log_p1s[i].push_back(0.0);
 	log_p2s[i].push_back(0.0);
       }
     }
+    phased_samples += (best_count > 0);
+
+    // Transfer the alignments instead of copying them, as the per-read group lists aren't used after this point
+    if (unpaired_strs_by_rg[i].empty())
+      alignments[i].swap(paired_strs_by_rg[i]);
+    else if (paired_strs_by_rg[i].empty())
+      alignments[i].swap(unpaired_strs_by_rg[i]);
+    else {
+      alignments[i].swap(paired_strs_by_rg[i]);
+      alignments[i].insert(alignments[i].end(), unpaired_strs_by_rg[i].begin(), unpaired_strs_by_rg[i].end());
+    }
   }
 
-  selective_logger() << "Phased SNPs add info for " << phased_reads << " out of " << total_reads << " reads" << std::endl;
+  selective_logger() << "Haplotype tags add info for " << phased_reads << " out of " << total_reads << " reads"
+		     << " and " << phased_samples << " out of " << rg_names.size() <<  " samples" << std::endl;
   locus_snp_phase_info_time_  = (clock() - locus_snp_phase_info_time_)/CLOCKS_PER_SEC;
   total_snp_phase_info_time_ += locus_snp_phase_info_time_;
 
@@ -13,9 +13,8 @@
 #include "region.h"
 #include "vcf_reader.h"
 
-const std::string HAPLOTYPE_TAG = "HP";
-const double FROM_HAP_LL        = -0.01;   // Log-likelihood read comes from a haplotype if it matches BAM HP tag
-const double OTHER_HAP_LL       = -1000.0; // Log-likelihood read comes from a haplotype if it differs from BAM HP tag
+const double FROM_HAP_LL  = -0.01;   // Log-likelihood read comes from a haplotype if it matches BAM HP tag
+const double OTHER_HAP_LL = -1000.0; // Log-likelihood read comes from a haplotype if it differs from BAM HP tag
 
 class SNPBamProcessor : public BamProcessor {
 private:
@@ -33,15 +32,12 @@ private:
   // Ignore any SNPs that are less than this many bases upstream/downstream of the STR
   int SKIP_PADDING;
 
-  // Process reads from BAM generated by 10X genomics
-  // Requires HP tag, which indicates which haplotype reads came from
-  void process_10x_reads(std::vector<BamAlnList>& paired_strs_by_rg,
-			 std::vector<BamAlnList>& mate_pairs_by_rg,
-			 std::vector<BamAlnList>& unpaired_strs_by_rg,
-			 const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq);
-
-  // Extract the haplotype for an alignment based on the HP tag
-  int get_haplotype(BamAlignment& aln) const;
+  // Process reads from BAMs containing haplotype tags (e.g. 10X Genomics or haplotagged PacBio/ONT BAMs)
+  // Requires HP tags, which indicate which haplotype reads came from, and optionally PS tags denoting their phase sets
+  void process_hap_tagged_reads(std::vector<BamAlnList>& paired_strs_by_rg,
+				std::vector<BamAlnList>& mate_pairs_by_rg,
+				std::vector<BamAlnList>& unpaired_strs_by_rg,
+				const std::vector<std::string>& rg_names, const RegionGroup& region_group, const std::string& chrom_seq);
 
   void verify_vcf_chromosomes(const std::vector<std::string>& chroms);
 
@@ -103,6 +99,18 @@ public:
     haplotype_tracker_ = new HaplotypeTracker(families_, snp_vcf_file, 500000);
   }
 
+  void describe_parameters(std::ostream& out) const {
+    BamProcessor::describe_parameters(out);
+    out << "SKIP_PADDING="      << SKIP_PADDING                << "\n"
+	<< "phase_with_snps="   << (phased_snp_vcf_ != NULL)   << "\n"
+	<< "num_families="      << families_.size()            << "\n";
+  }
+
+  void describe_status(StatusReport& report) const {
+    BamProcessor::describe_status(report);
+    report.add_stage_time("snp_info_extraction", total_snp_phase_info_time_);
+  }
+
   void finish(){
     if (match_count_ + mismatch_count_ > 0)
       selective_logger() << "\nSNP matching statistics: " << match_count_ << "\t" << mismatch_count_ << "\n";
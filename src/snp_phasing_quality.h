@@ -7,17 +7,24 @@
 #include "base_quality.h"
 #include "snp_tree.h"
 
-void extract_bases_and_qualities(BamAlignment& aln, const std::vector<SNP>& snps,
-				 std::vector<char>& bases, std::vector<char>& quals);
+/*
+ * Determine the index of the first position-sorted SNP located at or after the start of each read.
+ * Requires a single merge-join pass over the SNPs and the position-sorted reads
+ */
+void find_first_snp_indices(std::vector<BamAlignment>& reads, const std::vector<SNP>& snps, std::vector<unsigned int>& snp_indices);
 
-void add_log_phasing_probs(BamAlignment& aln, const SNPTree* tree, const BaseQuality& base_qualities,
+/*
+ * Accumulate the log-likelihoods of the read's bases at the SNPs it overlaps under each SNP haplotype.
+ * SNPs are examined starting at the provided index, which must be the first SNP at or after the read's start
+ */
+void add_log_phasing_probs(BamAlignment& aln, const std::vector<SNP>& snps, unsigned int snp_index, const BaseQuality& base_qualities,
 			   double& log_p1, double& log_p2, int32_t& p1_match_count, int32_t& p2_match_count, int32_t& mismatch_count);
 
 void calc_het_snp_factors(std::vector<BamAlignment>& str_reads, std::vector<BamAlignment>& mate_reads,
-			  const BaseQuality& base_qualities, const SNPTree* snp_tree,
+			  const BaseQuality& base_qualities, const std::vector<SNP>& snps,
 			  std::vector<double>& log_p1s, std::vector<double>& log_p2s, int32_t& match_count, int32_t& mismatch_count);
 
-void calc_het_snp_factors(std::vector<BamAlignment>& str_reads, const BaseQuality& base_qualities, const SNPTree* snp_tree,
+void calc_het_snp_factors(std::vector<BamAlignment>& str_reads, const BaseQuality& base_qualities, const std::vector<SNP>& snps,
 			  std::vector<double>& log_p1s, std::vector<double>& log_p2s, int32_t& match_count, int32_t& mismatch_count);
 
 #endif
@@ -47,8 +47,9 @@ bool create_snp_trees(const std::string& chrom, uint32_t start, uint32_t end, co
       continue;
 
     // When performing pedigree-based filtering, we need to identify sites with any Mendelian
-    // inconsistencies or missing genotypes as these won't be detected by the haplotype tracker
-    if (tracker != NULL){
+    // inconsistencies or missing genotypes as these won't be detected by the haplotype tracker.
+    // The tracker evaluates each SNP once as it enters its window, so we only check the families here for SNPs outside of it
+    if (tracker != NULL && !tracker->add_inconsistent_site(chrom, variant.get_position(), bad_sites_by_family)){
       const std::vector<NuclearFamily>& families = tracker->families();
       int family_index = 0;
       for (auto family_iter = families.begin(); family_iter != families.end(); ++family_iter, ++family_index)
@@ -130,6 +130,15 @@ class SNPTree {
      right_->findContained(start, stop, overlapping);
  }
  
+ // Append all of the tree's SNPs to the provided vector in order of increasing position
+ void getSorted(std::vector<SNP>& sorted_snps) const {
+   if (left_)
+     left_->getSorted(sorted_snps);
+   sorted_snps.insert(sorted_snps.end(), snps_.begin(), snps_.end());
+   if (right_)
+     right_->getSorted(sorted_snps);
+ }
+
  ~SNPTree(void) {
    // Traverse the left and right subtrees and delete them all the way down
    if (left_  != NULL) delete left_;
@@ -0,0 +1,169 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "error.h"
+#include "status_reporter.h"
+
+const double StatusReporter::RATE_SMOOTHING = 0.3;
+
+static int parseLine(char* line){
+  int i = strlen(line);
+  while (*line < '0' || *line > '9') line++;
+  line[i-3] = '\0';
+  i = atoi(line);
+  return i;
+}
+
+int getUsedPhysicalMemoryKB(){
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file == NULL)
+    return -1;
+
+  int result = -1;
+  char line[128];
+  while (fgets(line, 128, file) != NULL){
+    if (strncmp(line, "VmRSS:", 6) == 0){
+      result = parseLine(line);
+      break;
+    }
+  }
+  fclose(file);
+  return result;
+}
+
+// Escape a label value according to the Prometheus text format
+static std::string escape_label(const std::string& value){
+  std::string escaped;
+  for (unsigned int i = 0; i < value.size(); i++){
+    if (value[i] == '\\' || value[i] == '"')
+      escaped.push_back('\\');
+    if (value[i] == '\n')
+      escaped.append("\\n");
+    else
+      escaped.push_back(value[i]);
+  }
+  return escaped;
+}
+
+static void write_metric_header(std::ostream& out, const std::string& name, const std::string& type, const std::string& help){
+  out << "# HELP " << name << " " << help << "\n"
+      << "# TYPE " << name << " " << type << "\n";
+}
+
+StatusReporter::StatusReporter(const std::string& path, double interval) : path_(path){
+  if (interval < 0)
+    printErrorAndDie("The status file's update interval must be non-negative");
+  interval_        = interval;
+  total_loci_      = 0;
+  start_time_      = wall_time();
+  last_write_time_ = start_time_;
+  last_loci_       = 0;
+  last_reads_      = 0;
+  loci_rate_       = 0;
+  reads_rate_      = 0;
+  num_updates_     = 0;
+}
+
+double StatusReporter::wall_time(){
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec/1000000.0;
+}
+
+void StatusReporter::start(int64_t total_loci){
+  total_loci_      = total_loci;
+  start_time_      = wall_time();
+  last_write_time_ = start_time_;
+  last_loci_       = 0;
+  last_reads_      = 0;
+  num_updates_     = 0;
+}
+
+bool StatusReporter::due() const {
+  return (num_updates_ == 0 || wall_time() - last_write_time_ >= interval_);
+}
+
+void StatusReporter::write(const StatusReport& report, bool finished){
+  double now = wall_time();
+
+  // Update the moving averages using the throughput since the last update
+  double elapsed = now - last_write_time_;
+  if (num_updates_ == 0 || elapsed > 0){
+    if (num_updates_ > 0){
+      double loci_rate  = (report.loci_processed  - last_loci_)/elapsed;
+      double reads_rate = (report.reads_processed - last_reads_)/elapsed;
+      loci_rate_  = (num_updates_ == 1 ? loci_rate  : RATE_SMOOTHING*loci_rate  + (1-RATE_SMOOTHING)*loci_rate_);
+      reads_rate_ = (num_updates_ == 1 ? reads_rate : RATE_SMOOTHING*reads_rate + (1-RATE_SMOOTHING)*reads_rate_);
+    }
+    last_write_time_ = now;
+    last_loci_       = report.loci_processed;
+    last_reads_      = report.reads_processed;
+  }
+  num_updates_++;
+
+  int64_t remaining = std::max((int64_t)0, total_loci_ - report.loci_processed);
+  double eta        = (finished || remaining == 0) ? 0.0 : (loci_rate_ > 0 ? remaining/loci_rate_ : NAN);
+
+  std::stringstream out;
+  out.precision(10);
+  write_metric_header(out, "hipstr_info", "gauge", "Process ID of the HipSTR run");
+  out << "hipstr_info{pid=\"" << getpid() << "\"} 1\n";
+  write_metric_header(out, "hipstr_finished", "gauge", "Whether all loci have been processed");
+  out << "hipstr_finished " << (finished ? 1 : 0) << "\n";
+  write_metric_header(out, "hipstr_last_update_timestamp_seconds", "gauge", "Unix time at which this file was written");
+  out << "hipstr_last_update_timestamp_seconds " << (int64_t)now << "\n";
+  write_metric_header(out, "hipstr_elapsed_seconds", "gauge", "Wall-clock time since processing began");
+  out << "hipstr_elapsed_seconds " << (now - start_time_) << "\n";
+  write_metric_header(out, "hipstr_loci_total", "gauge", "Number of loci in the region file");
+  out << "hipstr_loci_total " << total_loci_ << "\n";
+  write_metric_header(out, "hipstr_loci_processed", "counter", "Number of loci processed, including those that were skipped");
+  out << "hipstr_loci_processed " << report.loci_processed << "\n";
+
+  write_metric_header(out, "hipstr_loci_outcome", "counter", "Number of loci with each outcome");
+  for (auto outcome_iter = report.outcomes.begin(); outcome_iter != report.outcomes.end(); outcome_iter++)
+    out << "hipstr_loci_outcome{outcome=\"" << escape_label(outcome_iter->first) << "\"} " << outcome_iter->second << "\n";
+
+  write_metric_header(out, "hipstr_reads_processed", "counter", "Number of STR reads provided to the genotyper");
+  out << "hipstr_reads_processed " << report.reads_processed << "\n";
+  write_metric_header(out, "hipstr_loci_per_second", "gauge", "Moving average of the number of loci processed per second");
+  out << "hipstr_loci_per_second " << loci_rate_ << "\n";
+  write_metric_header(out, "hipstr_reads_per_second", "gauge", "Moving average of the number of STR reads processed per second");
+  out << "hipstr_reads_per_second " << reads_rate_ << "\n";
+  write_metric_header(out, "hipstr_eta_seconds", "gauge", "Estimated time until all loci have been processed, based on the moving average");
+  out << "hipstr_eta_seconds ";
+  if (isnan(eta))
+    out << "NaN\n";
+  else
+    out << eta << "\n";
+
+  write_metric_header(out, "hipstr_stage_cpu_seconds", "counter", "Cumulative CPU time spent in each processing stage");
+  for (auto stage_iter = report.stage_seconds.begin(); stage_iter != report.stage_seconds.end(); stage_iter++)
+    out << "hipstr_stage_cpu_seconds{stage=\"" << escape_label(stage_iter->first) << "\"} " << stage_iter->second << "\n";
+
+  write_metric_header(out, "hipstr_resident_memory_bytes", "gauge", "Resident set size of the HipSTR process");
+  int rss_kb = getUsedPhysicalMemoryKB();
+  out << "hipstr_resident_memory_bytes " << (rss_kb < 0 ? -1 : 1024*(int64_t)rss_kb) << "\n";
+
+  if (!finished && !report.current_chrom.empty()){
+    write_metric_header(out, "hipstr_current_locus", "gauge", "Locus currently being processed");
+    out << "hipstr_current_locus{chrom=\"" << escape_label(report.current_chrom) << "\",start=\"" << report.current_start << "\"} 1\n";
+  }
+
+  // Failures to write the status file shouldn't interrupt the run
+  std::string tmp_path = path_ + ".tmp";
+  std::ofstream status(tmp_path.c_str(), std::ios_base::out | std::ios_base::trunc);
+  if (!status.is_open())
+    return;
+  status << out.str();
+  status.close();
+  if (!status.fail())
+    rename(tmp_path.c_str(), path_.c_str());
+}
@@ -0,0 +1,68 @@
+#ifndef STATUS_REPORTER_H_
+#define STATUS_REPORTER_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// Resident set size of the current process (in KB), or -1 if it's unavailable
+int getUsedPhysicalMemoryKB();
+
+/*
+ * Snapshot of a run's progress, assembled by the BamProcessor hierarchy each time the status file is rewritten
+ */
+class StatusReport {
+ public:
+  int64_t loci_processed, reads_processed;
+  std::string current_chrom;
+  int32_t current_start;
+  std::vector< std::pair<std::string, int64_t> > outcomes;      // Number of loci with each outcome (e.g. genotyped, too_many_reads)
+  std::vector< std::pair<std::string, double> >  stage_seconds; // Cumulative CPU time spent in each stage
+
+  StatusReport(){
+    loci_processed  = 0;
+    reads_processed = 0;
+    current_start   = -1;
+  }
+
+  void add_outcome(const std::string& outcome, int64_t count){ outcomes.push_back(std::pair<std::string, int64_t>(outcome, count));   }
+  void add_stage_time(const std::string& stage, double time) { stage_seconds.push_back(std::pair<std::string, double>(stage, time)); }
+};
+
+/*
+ * Periodically rewrites a status file containing the progress of a run in the Prometheus text exposition format,
+ * so that it can be scraped (e.g. by node_exporter's textfile collector) to detect slow or stuck runs.
+ * Each update is written to a temporary file that's then renamed, so readers never observe a partial file
+ */
+class StatusReporter {
+ private:
+  std::string path_;
+  double interval_;              // Minimum wall-clock time (in seconds) between updates
+  int64_t total_loci_;
+  double start_time_, last_write_time_;
+  int64_t last_loci_, last_reads_;
+  double loci_rate_, reads_rate_;  // Exponential moving averages of the throughput between updates
+  int32_t num_updates_;
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  StatusReporter(const StatusReporter& other);
+  StatusReporter& operator=(const StatusReporter& other);
+
+ public:
+  // Weight of the most recent interval in the moving averages
+  static const double RATE_SMOOTHING;
+
+  StatusReporter(const std::string& path, double interval);
+
+  void start(int64_t total_loci);
+
+  // Returns true iff the minimum interval has elapsed since the last update
+  bool due() const;
+
+  void write(const StatusReport& report, bool finished);
+
+  static double wall_time();
+};
+
+#endif
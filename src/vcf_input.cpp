@@ -49,6 +49,72 @@ bool read_vcf_alleles(VCF::VCFReader* ref_vcf, const Region& region, std::vector
     return false;
 }
 
+void RefVCFCursor::seek(const std::string& chrom, int32_t pad_start){
+  entries_.clear();
+  buffer_keys_.clear();
+  chrom_         = chrom;
+  lookahead_pos_ = -1;
+  exhausted_     = !reader_.set_region(chrom, pad_start);
+}
+
+bool RefVCFCursor::read_alleles(const Region& region, std::vector<std::string>& alleles, int32_t& pos){
+  assert(alleles.size() == 0);
+  int32_t pad_start = (region.start() < pad ? 0 : region.start()-pad);
+  if (region.chrom().compare(chrom_) != 0 || region.start() < last_start_)
+    seek(region.chrom(), pad_start);
+  last_start_ = region.start();
+
+  // Discard entries that end before the window. As the loci are sorted, they can't be required by subsequent lookups
+  while (!buffer_keys_.empty()){
+    auto entry_iter = entries_.find(buffer_keys_.front());
+    if (entry_iter != entries_.end()){
+      if (entry_iter->second.end >= pad_start)
+	break;
+      entries_.erase(entry_iter);
+    }
+    buffer_keys_.pop_front();
+  }
+
+  // Buffer the STR entries up to and including the first record beyond the window's upstream padding
+  VCF::Variant variant;
+  while (!exhausted_ && lookahead_pos_ <= region.start()+pad){
+    if (!reader_.get_next_variant(variant)){
+      exhausted_ = true;
+      break;
+    }
+    lookahead_pos_ = variant.get_position()-1;
+
+    // Skip variants without the appropriate INFO fields (as they're not STRs)
+    if (!variant.has_info_field(START_INFO_TAG) || !variant.has_info_field(STOP_INFO_TAG))
+      continue;
+    int32_t str_start, str_stop;
+    variant.get_INFO_value_single_int(START_INFO_TAG, str_start);
+    variant.get_INFO_value_single_int(STOP_INFO_TAG, str_stop);
+
+    // Retain the first entry for each set of coordinates, as a sequential scan would
+    int64_t key = entry_key(str_start, str_stop);
+    if (entries_.find(key) != entries_.end())
+      continue;
+    Entry& entry  = entries_[key];
+    entry.pos     = lookahead_pos_;
+    entry.end     = lookahead_pos_ + variant.get_allele(0).size();
+    entry.alleles = variant.get_alleles();
+    buffer_keys_.push_back(key);
+  }
+
+  // Only accept entries within the window that read_vcf_alleles would have scanned. Its scan stops after the first record beyond
+  // the upstream padding, but as a record never starts after its STR, such a record can't match the locus
+  auto entry_iter = entries_.find(entry_key(region.start()+1, region.stop()));
+  if (entry_iter != entries_.end() && entry_iter->second.end >= pad_start && entry_iter->second.pos <= region.start()+pad){
+    pos = entry_iter->second.pos;
+    alleles.insert(alleles.end(), entry_iter->second.alleles.begin(), entry_iter->second.alleles.end());
+    return true;
+  }
+
+  pos = -1;
+  return false;
+}
+
 bool UnphasedGL::build(const VCF::Variant& variant){
   std::vector< std::vector<float> > values;
   variant.get_FORMAT_value_multiple_floats(UNPHASED_GL_KEY, values);
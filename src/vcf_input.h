@@ -2,9 +2,11 @@
 #define VCF_INPUT_H_
 
 #include <assert.h>
+#include <deque>
 #include <iostream>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "error.h"
@@ -20,6 +22,50 @@ extern const int32_t pad;
 
 bool read_vcf_alleles(VCF::VCFReader* ref_vcf, const Region& region, std::vector<std::string>& alleles, int32_t& pos);
 
+/*
+ * Streaming cursor over a reference VCF whose lookups must be made in sorted order, as they are when
+ * loci are genotyped in the order produced by process_regions. Instead of a tabix seek per locus,
+ * each chromosome's records are read sequentially and the STR entries near the current locus are
+ * buffered and looked up by their exact START/END coordinates. Lookups for a different chromosome or an
+ * earlier position fall back to a single seek, after which streaming resumes from the new position
+ */
+class RefVCFCursor {
+ private:
+  struct Entry {
+    int32_t pos;  // 0-based position of the record
+    int32_t end;  // 0-based position just past the record's reference allele
+    std::vector<std::string> alleles;
+  };
+
+  VCF::VCFReader reader_;
+  std::string chrom_;
+  int32_t last_start_;
+  bool exhausted_;
+  int32_t lookahead_pos_;                         // 0-based position of the most recently buffered record
+  std::deque<int64_t> buffer_keys_;               // Keys of the buffered entries, in file order
+  std::unordered_map<int64_t, Entry> entries_;    // Buffered entries, keyed by their START/END coordinates
+
+  static int64_t entry_key(int32_t str_start, int32_t str_stop){
+    return (((int64_t)str_start) << 32) | (uint32_t)str_stop;
+  }
+
+  void seek(const std::string& chrom, int32_t pad_start);
+
+  // Private unimplemented copy constructor and assignment operator to prevent operations
+  RefVCFCursor(const RefVCFCursor& other);
+  RefVCFCursor& operator=(const RefVCFCursor& other);
+
+ public:
+  explicit RefVCFCursor(const std::string& filename) : reader_(filename){
+    last_start_    = -1;
+    exhausted_     = true;
+    lookahead_pos_ = -1;
+  }
+
+  // Equivalent to the read_vcf_alleles function above, but without a per-locus index query
+  bool read_alleles(const Region& region, std::vector<std::string>& alleles, int32_t& pos);
+};
+
 class GL {
  protected:
   int num_alleles_;
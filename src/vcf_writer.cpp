@@ -19,7 +19,7 @@ void VCFWriter::add_vcf_record(const std::string& chrom, int32_t record_pos, con
       std::pop_heap(record_heap_.begin(), record_heap_.end(), tuple_comparator);
       RecordTuple* best = record_heap_.back(); record_heap_.pop_back();
       if (best->pos() < record_pos - MAX_RECORD_PAD){
-	str_vcf_ << best->text() << std::endl;
+	str_vcf_ << best->text() << "\n";
 	delete best;
       }
       else {
@@ -30,6 +30,9 @@ void VCFWriter::add_vcf_record(const std::string& chrom, int32_t record_pos, con
     }
   }
 
+  if (captured_records_ != NULL)
+    captured_records_->push_back(std::pair<int32_t, std::string>(record_pos, record_text));
+
   // Add the newest record to the heap
   record_heap_.push_back(new RecordTuple(record_pos, record_text));
   std::push_heap(record_heap_.begin(), record_heap_.end(), tuple_comparator);
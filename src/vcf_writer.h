@@ -30,6 +30,9 @@ class VCFWriter {
   std::string chrom_;
   std::vector<RecordTuple*> record_heap_;
 
+  // If non-NULL, a copy of each newly added record is appended to this vector
+  std::vector< std::pair<int32_t, std::string> >* captured_records_;
+
   // We assume regions are processed in sorted order, but that regions
   // can end up with start positions minus this amount of padding at the most
   int32_t MAX_RECORD_PAD;
@@ -38,7 +41,7 @@ class VCFWriter {
     while (!record_heap_.empty()){
       std::pop_heap(record_heap_.begin(), record_heap_.end(), tuple_comparator);
       RecordTuple* best = record_heap_.back(); record_heap_.pop_back();
-      str_vcf_ << best->text() << std::endl;
+      str_vcf_ << best->text() << "\n";
       delete best;
     }
   }
@@ -50,8 +53,9 @@ class VCFWriter {
  public:
   VCFWriter(){
     open_          = false;
-    MAX_RECORD_PAD = 50;
-    chrom_         = "";
+    MAX_RECORD_PAD    = 50;
+    chrom_            = "";
+    captured_records_ = NULL;
   }
 
   ~VCFWriter(){
@@ -67,6 +71,13 @@ class VCFWriter {
     str_vcf_.open(vcf_file.c_str());
   }
 
+  // Compress the VCF using a pool of NUM_THREADS threads
+  void set_compression_threads(int num_threads){
+    if (!open_)
+      printErrorAndDie("Cannot invoke set_compression_threads() on a non-open VCFWriter");
+    str_vcf_.set_threads(num_threads);
+  }
+
   void write_header(const std::string& header_text){
     if (!open_)
       printErrorAndDie("Cannot invoke write_header() on a non-open VCFWriter");
@@ -75,6 +86,11 @@ class VCFWriter {
 
   void add_vcf_record(const std::string& chrom, int32_t record_pos, const std::string& record_text);
 
+  // Copy all subsequently added records into the provided vector. Supply NULL to stop capturing records
+  void capture_records(std::vector< std::pair<int32_t, std::string> >* captured_records){
+    captured_records_ = captured_records;
+  }
+
   void close(){
     write_all_records();
     open_ = false;
@@ -0,0 +1,144 @@
+#include <assert.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/SeqAlignment/AlignmentArena.h"
+#include "../src/SeqAlignment/AlignmentData.h"
+
+const int NUM_READS   = 50;
+const int READ_LENGTH = 100;
+
+std::string randomString(std::mt19937& rng, const std::string& alphabet, int length){
+  std::uniform_int_distribution<int> char_dist(0, alphabet.size()-1);
+  std::string str;
+  for (int i = 0; i < length; i++)
+    str += alphabet[char_dist(rng)];
+  return str;
+}
+
+// Simulate a read with a deletion and an insertion, whose mate shares its name
+Alignment randomAlignment(std::mt19937& rng, int index){
+  std::uniform_int_distribution<int> start_dist(1000, 5000), len_dist(1, 5), strand_dist(0, 1);
+  int del_len = len_dist(rng), ins_len = len_dist(rng);
+  int left_len = 40, right_len = READ_LENGTH - left_len - ins_len;
+  int32_t start = start_dist(rng);
+  std::string sequence  = randomString(rng, "ACGT", READ_LENGTH);
+  std::string alignment = sequence.substr(0, left_len) + std::string(del_len, '-') + sequence.substr(left_len);
+
+  Alignment aln(start, start + left_len + del_len + right_len - 1, strand_dist(rng) == 1, "READ_" + std::to_string(index/2),
+		randomString(rng, "#+5?I", READ_LENGTH), sequence, alignment);
+  std::vector<CigarElement> cigar_list;
+  cigar_list.push_back(CigarElement('M', left_len));
+  cigar_list.push_back(CigarElement('D', del_len));
+  cigar_list.push_back(CigarElement('I', ins_len));
+  cigar_list.push_back(CigarElement('M', right_len));
+  aln.set_cigar_list(cigar_list);
+
+  std::vector<bool> hap_gen_info;
+  for (int i = 0; i < index%4; i++)
+    hap_gen_info.push_back(strand_dist(rng) == 1);
+  aln.set_hap_gen_info(hap_gen_info);
+  return aln;
+}
+
+void checkAlignment(const Alignment& expected, const Alignment& observed){
+  assert(expected.get_start() == observed.get_start() && expected.get_stop() == observed.get_stop());
+  assert(expected.is_from_reverse_strand() == observed.is_from_reverse_strand());
+  assert(expected.get_name().compare(observed.get_name()) == 0);
+  assert(expected.get_sequence().compare(observed.get_sequence()) == 0);
+  assert(expected.get_base_qualities().compare(observed.get_base_qualities()) == 0);
+  assert(expected.get_alignment().compare(observed.get_alignment()) == 0);
+  assert(expected.get_hap_gen_info() == observed.get_hap_gen_info());
+  const std::vector<CigarElement>& expected_cigar = expected.get_cigar_list();
+  const std::vector<CigarElement>& observed_cigar = observed.get_cigar_list();
+  assert(expected_cigar.size() == observed_cigar.size());
+  for (unsigned int i = 0; i < expected_cigar.size(); i++)
+    assert(expected_cigar[i].get_type() == observed_cigar[i].get_type() && expected_cigar[i].get_num() == observed_cigar[i].get_num());
+}
+
+// Every accessor must agree with the alignment that was stored at each index
+void checkArena(const AlignmentArena& arena, const std::vector<Alignment>& expected){
+  assert(arena.size() == expected.size());
+  for (unsigned int i = 0; i < expected.size(); i++){
+    checkAlignment(expected[i], arena.get_alignment(i));
+    assert(arena.get_start(i) == expected[i].get_start() && arena.get_stop(i) == expected[i].get_stop());
+    assert(arena.is_from_reverse_strand(i) == expected[i].is_from_reverse_strand());
+    assert(arena.get_name(i).compare(expected[i].get_name()) == 0);
+    for (unsigned int j = 0; j < expected[i].get_hap_gen_info().size(); j++)
+      assert(arena.use_for_hap_generation(i, j) == expected[i].get_hap_gen_info()[j]);
+
+    // The in-place views must cover exactly the read's sequence and base qualities
+    assert(arena.get_sequence_length(i) == expected[i].get_sequence().size());
+    assert(arena.get_base_qualities_length(i) == expected[i].get_base_qualities().size());
+    assert(expected[i].get_sequence().compare(0, std::string::npos, arena.get_sequence(i), arena.get_sequence_length(i)) == 0);
+    assert(expected[i].get_base_qualities().compare(0, std::string::npos, arena.get_base_qualities(i), arena.get_base_qualities_length(i)) == 0);
+
+    // Reads materialized for realignment only contain the position, strand, sequence and base qualities
+    Alignment read = arena.get_read(i);
+    assert(read.get_start() == expected[i].get_start() && read.get_stop() == expected[i].get_stop());
+    assert(read.is_from_reverse_strand() == expected[i].is_from_reverse_strand());
+    assert(read.get_sequence().compare(expected[i].get_sequence()) == 0);
+    assert(read.get_base_qualities().compare(expected[i].get_base_qualities()) == 0);
+    assert(read.get_name().empty() && read.get_alignment().empty() && read.get_cigar_list().empty() && read.get_hap_gen_info().empty());
+  }
+}
+
+int main(){
+  std::mt19937 rng(1357);
+  AlignmentArena arena;
+  std::vector<Alignment> expected;
+  std::uniform_int_distribution<int> strand_dist(0, 1);
+  for (int i = 0; i < NUM_READS; i++){
+    if (i%3 == 2){
+      // Reuse an earlier read's alignment with a new sequence, strand, base qualities and haplotype generation flags. The new sequence
+      // keeps the source's insertion, so the reused alignment and CIGAR operations remain properly formatted
+      int32_t source = i-1;
+      const Alignment& source_aln = expected[source];
+      std::string sequence  = source_aln.get_sequence();
+      sequence[0] = (sequence[0] == 'A' ? 'C' : 'A');
+      std::string qualities = randomString(rng, "#+5?I", sequence.size());
+      std::vector<bool> hap_gen_info(2, true);
+      bool rev_strand = !source_aln.is_from_reverse_strand();
+      std::string name = "READ_" + std::to_string(i/2);
+      assert(arena.add_with_alignment_of(source, name, rev_strand, qualities, sequence, hap_gen_info) == i);
+
+      Alignment aln(source_aln.get_start(), source_aln.get_stop(), rev_strand, name, qualities, sequence, source_aln.get_alignment());
+      aln.set_cigar_list(source_aln.get_cigar_list());
+      aln.set_hap_gen_info(hap_gen_info);
+      expected.push_back(aln);
+    }
+    else {
+      expected.push_back(randomAlignment(rng, i));
+      assert(arena.add(expected.back()) == i);
+    }
+  }
+  checkArena(arena, expected);
+
+  // Mates share a single interned copy of their name
+  assert(&arena.get_name(0) == &arena.get_name(1));
+  assert(&arena.get_name(0) != &arena.get_name(2));
+
+  // Swapping exchanges the contents, including the interned names, and clearing the arena allows it to be reused
+  AlignmentArena other;
+  std::vector<Alignment> other_expected;
+  other_expected.push_back(randomAlignment(rng, 100));
+  other.add(other_expected.back());
+  arena.swap(other);
+  checkArena(arena, other_expected);
+  checkArena(other, expected);
+
+  other.clear();
+  assert(other.size() == 0);
+  std::vector<Alignment> reused;
+  for (int i = 0; i < 4; i++){
+    reused.push_back(randomAlignment(rng, 200+i));
+    assert(other.add(reused.back()) == i);
+  }
+  checkArena(other, reused);
+  assert(&other.get_name(0) == &other.get_name(1));
+
+  std::cerr << "All alignment arena tests passed" << std::endl;
+  return 0;
+}
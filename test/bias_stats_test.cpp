@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <assert.h>
+#include <iostream>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+#include "cephes/cephes.h"
+#include "htslib/htslib/kfunc.h"
+
+#include "../src/bias_stats.h"
+
+const int MAX_TEST_DEPTH = 300; // Exceeds the tabulated depths, so both code paths are tested
+const int NUM_THREADS    = 4;
+
+// Two-sided binomial p-value computed directly using cephes
+double directAlleleBias(int hap_a_read_count, int hap_b_read_count){
+  int total = hap_a_read_count + hap_b_read_count;
+  if (total == 0)
+    return 1;
+  if (hap_a_read_count == hap_b_read_count)
+    return 0.0;
+  double pvalue = 2*bdtr(std::min(hap_a_read_count, hap_b_read_count), total, 0.5);
+  return log10(std::min(1.0, pvalue));
+}
+
+// Two-sided Fisher's exact test p-value computed directly using htslib
+double directStrandBias(int fw_hap_a, int rv_hap_a, int fw_hap_b, int rv_hap_b){
+  double left, right, two;
+  kt_fisher_exact(fw_hap_a, rv_hap_a, fw_hap_b, rv_hap_b, &left, &right, &two);
+  return log10(std::min(1.0, two));
+}
+
+void checkAlleleBiases(int max_depth, int* num_mismatches){
+  for (int total = 0; total <= max_depth; total++)
+    for (int a = 0; a <= total; a++)
+      if (log10_allele_bias_pvalue(a, total-a) != directAlleleBias(a, total-a))
+	(*num_mismatches)++;
+}
+
+int main(){
+  // Every tabulated and untabulated entry should match the direct computation, including when the table is
+  // first filled by several threads at once
+  std::vector<int> mismatches(NUM_THREADS, 0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; i++)
+    threads.push_back(std::thread(checkAlleleBiases, MAX_TEST_DEPTH, &mismatches[i]));
+  for (unsigned int i = 0; i < threads.size(); i++)
+    threads[i].join();
+  for (int i = 0; i < NUM_THREADS; i++)
+    assert(mismatches[i] == 0);
+  assert(log10_allele_bias_pvalue(0, 0) == 1);
+  assert(log10_allele_bias_pvalue(7, 7) == 0);
+  assert(log10_allele_bias_pvalue(3, 20) == log10_allele_bias_pvalue(20, 3));
+  assert(log10_allele_bias_pvalue(600, 400) == directAlleleBias(600, 400));
+
+  // Memoized strand bias p-values should match the direct computation, both for the first lookup and for repeated lookups
+  StrandBiasCache strand_bias_cache;
+  for (int pass = 0; pass < 2; pass++)
+    for (int fw_a = 0; fw_a <= 12; fw_a += 3)
+      for (int rv_a = 0; rv_a <= 12; rv_a += 2)
+	for (int fw_b = 0; fw_b <= 12; fw_b += 4)
+	  for (int rv_b = 0; rv_b <= 12; rv_b++)
+	    assert(strand_bias_cache.log10_pvalue(fw_a, rv_a, fw_b, rv_b) == directStrandBias(fw_a, rv_a, fw_b, rv_b));
+
+  // Counts that are too large to pack into a key are computed directly, and must not collide with cached entries
+  assert(strand_bias_cache.log10_pvalue(70000, 3, 2, 70001) == directStrandBias(70000, 3, 2, 70001));
+  assert(strand_bias_cache.log10_pvalue(65536+4, 3, 2, 1)   == directStrandBias(65536+4, 3, 2, 1));
+  assert(strand_bias_cache.log10_pvalue(4, 3, 2, 1)         == directStrandBias(4, 3, 2, 1));
+
+  // Only the requested samples' statistics should be computed
+  std::vector<bool> compute      = {true, false, true, true};
+  std::vector<int> reads_hap_a   = {10, 5, 0, 30};
+  std::vector<int> reads_hap_b   = {4,  5, 0, 31};
+  std::vector<int> rv_reads_hap_a = {3, 2, 0, 29};
+  std::vector<int> rv_reads_hap_b = {4, 1, 0, 2};
+  std::vector<double> allele_biases(compute.size(), -99), strand_biases(compute.size(), -99);
+  compute_bias_statistics(compute, reads_hap_a, reads_hap_b, rv_reads_hap_a, rv_reads_hap_b, allele_biases, strand_biases);
+  for (unsigned int i = 0; i < compute.size(); i++){
+    if (!compute[i]){
+      assert(allele_biases[i] == -99 && strand_biases[i] == -99);
+      continue;
+    }
+    assert(allele_biases[i] == directAlleleBias(reads_hap_a[i], reads_hap_b[i]));
+    assert(strand_biases[i] == directStrandBias(reads_hap_a[i]-rv_reads_hap_a[i], rv_reads_hap_a[i],
+						reads_hap_b[i]-rv_reads_hap_b[i], rv_reads_hap_b[i]));
+  }
+
+  std::cerr << "All bias statistic tests passed" << std::endl;
+  return 0;
+}
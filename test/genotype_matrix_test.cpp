@@ -0,0 +1,109 @@
+#include <iostream>
+#include <stdio.h>
+#include <assert.h>
+
+#include "../src/genotype_matrix.h"
+
+GenotypeMatrixLocus makeLocus(const std::string& chrom, int32_t start, int num_samples){
+  GenotypeMatrixLocus locus;
+  locus.chrom  = chrom;
+  locus.pos    = start-1;
+  locus.start  = start;
+  locus.stop   = start+19;
+  locus.period = 2;
+  locus.alleles.push_back("ACACACACACACACACACAC");
+  locus.bp_diffs.push_back(0);
+  locus.alleles.push_back("ACACACACACACACACACACAC");
+  locus.bp_diffs.push_back(2);
+  for (int i = 0; i < num_samples; i++){
+    if ((start + i) % 7 == 0)
+      locus.add_missing_sample();
+    else
+      locus.add_sample(i%2, (start+i)%2, 0.5f + i*0.01f, start%100 + i);
+  }
+  return locus;
+}
+
+void checkLocus(const GenotypeMatrixLocus& expected, const GenotypeMatrixLocus& observed, const std::vector<int>& sample_indices){
+  assert(expected.chrom.compare(observed.chrom) == 0);
+  assert(expected.pos    == observed.pos);
+  assert(expected.start  == observed.start);
+  assert(expected.stop   == observed.stop);
+  assert(expected.alleles == observed.alleles);
+  assert(expected.bp_diffs == observed.bp_diffs);
+  assert(observed.num_samples() == (int)sample_indices.size());
+  for (unsigned int i = 0; i < sample_indices.size(); i++){
+    int j = sample_indices[i];
+    assert(expected.gt_a[j]   == observed.gt_a[i]);
+    assert(expected.gt_b[j]   == observed.gt_b[i]);
+    assert(expected.quals[j]  == observed.quals[i]);
+    assert(expected.depths[j] == observed.depths[i]);
+    if (!observed.is_missing(i))
+      assert(observed.gb_b(i) == 2*observed.gt_b[i]);
+  }
+}
+
+int main(){
+  const int num_samples = 13;
+  std::vector<std::string> samples;
+  for (int i = 0; i < num_samples; i++)
+    samples.push_back("SAMPLE_" + std::to_string(i));
+
+  // Span multiple chunks on the first chromosome and a partial chunk on the second
+  std::vector<GenotypeMatrixLocus> chr1_loci, chr2_loci;
+  for (int i = 0; i < 2500; i++)
+    chr1_loci.push_back(makeLocus("chr1", 1000 + 50*i, num_samples));
+  for (int i = 0; i < 10; i++)
+    chr2_loci.push_back(makeLocus("chr2", 500 + 100*i, num_samples));
+
+  std::string filename = "genotype_matrix_test.gtm";
+  GenotypeMatrixWriter writer;
+  writer.open(filename, samples);
+  for (unsigned int i = 0; i < chr1_loci.size(); i++)
+    writer.add_locus(chr1_loci[i]);
+  for (unsigned int i = 0; i < chr2_loci.size(); i++)
+    writer.add_locus(chr2_loci[i]);
+  writer.close();
+
+  GenotypeMatrixReader reader(filename);
+  assert(reader.get_samples() == samples);
+  assert(reader.num_chunks() == 4);
+  assert(reader.get_sample_index("SAMPLE_5") == 5);
+  assert(reader.get_sample_index("MISSING") == -1);
+
+  // Full retrieval of all samples
+  std::vector<int> all_samples;
+  for (int i = 0; i < num_samples; i++)
+    all_samples.push_back(i);
+  std::vector<GenotypeMatrixLocus> loci;
+  reader.get_loci("chr1", 0, 1000000000, std::vector<int>(), loci);
+  assert(loci.size() == chr1_loci.size());
+  for (unsigned int i = 0; i < loci.size(); i++)
+    checkLocus(chr1_loci[i], loci[i], all_samples);
+
+  // Range query spanning a chunk boundary for a subset of the samples
+  std::vector<int> subset;
+  subset.push_back(11);
+  subset.push_back(0);
+  subset.push_back(7);
+  loci.clear();
+  int32_t start = chr1_loci[1000].start+5, stop = chr1_loci[1100].start;
+  reader.get_loci("chr1", start, stop, subset, loci);
+  assert(loci.size() == 101);
+  for (unsigned int i = 0; i < loci.size(); i++)
+    checkLocus(chr1_loci[1000+i], loci[i], subset);
+
+  loci.clear();
+  reader.get_loci("chr2", 0, 1000000000, subset, loci);
+  assert(loci.size() == chr2_loci.size());
+  for (unsigned int i = 0; i < loci.size(); i++)
+    checkLocus(chr2_loci[i], loci[i], subset);
+
+  loci.clear();
+  reader.get_loci("chr3", 0, 1000000000, subset, loci);
+  assert(loci.empty());
+
+  remove(filename.c_str());
+  std::cerr << "All genotype matrix tests passed" << std::endl;
+  return 0;
+}
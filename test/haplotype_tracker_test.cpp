@@ -0,0 +1,119 @@
+#include <assert.h>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../src/error.h"
+#include "../src/haplotype_tracker.h"
+#include "../src/pedigree.h"
+#include "../src/vcf_reader.h"
+
+const std::string CHROM    = "1";
+const int32_t FIRST_POS    = 7000000;
+const int32_t LAST_POS     = 15000000;
+const int32_t JUMP_POS     = 10000000; // Positions skipped over entirely, forcing the window to be rebuilt
+
+// Build trios and quartets from consecutive samples. They're unrelated, so Mendelian inconsistencies are common
+std::vector<NuclearFamily> buildFamilies(const std::vector<std::string>& samples){
+  std::vector<NuclearFamily> families;
+  unsigned int index = 0;
+  for (int i = 0; i < 6; i++){
+    std::vector<std::string> children;
+    int num_children = 1 + (i%2);
+    for (int j = 0; j < num_children; j++)
+      children.push_back(samples[index+2+j]);
+    families.push_back(NuclearFamily("FAMILY_" + std::to_string(i), samples[index], samples[index+1], children));
+    index += 2 + num_children;
+  }
+  return families;
+}
+
+// The edit distances maintained as SNPs enter and leave the window must match those recomputed from the stored haplotypes,
+// as well as those of a tracker that loaded the window from scratch
+void checkDistances(const HaplotypeTracker& tracker, const HaplotypeTracker& fresh_tracker){
+  const std::vector<NuclearFamily>& families = tracker.families();
+  for (auto family_iter = families.begin(); family_iter != families.end(); family_iter++){
+    for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); child_iter++){
+      for (int parent = 0; parent < 2; parent++){
+	const std::string& parent_name  = (parent == 0 ? family_iter->get_mother() : family_iter->get_father());
+	DiploidEditDistance incremental = tracker.pair_edit_distances(*child_iter, parent_name);
+	DiploidEditDistance recomputed  = tracker.edit_distances(*child_iter, parent_name);
+	DiploidEditDistance fresh       = fresh_tracker.edit_distances(*child_iter, parent_name);
+	for (int i = 0; i < 2; i++){
+	  for (int j = 0; j < 2; j++){
+	    assert(incremental.distance(i, j) == recomputed.distance(i, j));
+	    assert(incremental.distance(i, j) == fresh.distance(i, j));
+	  }
+	}
+      }
+    }
+  }
+}
+
+// The inconsistent sites stored for each SNP strictly inside the window must match those determined directly from the VCF
+void checkInconsistentSites(const HaplotypeTracker& tracker, VCF::VCFReader& vcf_reader, const std::vector<NuclearFamily>& families,
+			    int32_t start, int32_t end){
+  assert(vcf_reader.set_region(CHROM, start));
+
+  VCF::Variant variant;
+  while (vcf_reader.get_next_variant(variant) && variant.get_position() < end){
+    int32_t position = variant.get_position();
+    if (position <= start)
+      continue;
+    std::vector< std::set<int32_t> > expected(families.size()), observed(families.size());
+    if (variant.is_biallelic_snp())
+      for (unsigned int i = 0; i < families.size(); i++)
+	if (families[i].is_missing_genotype(variant) || !families[i].is_mendelian(variant))
+	  expected[i].insert(position);
+    assert(tracker.add_inconsistent_site(CHROM, position, observed));
+    assert(expected == observed);
+  }
+
+  // Positions outside of the window or on other chromosomes can't be resolved using the stored SNPs
+  std::vector< std::set<int32_t> > bad_sites(families.size());
+  assert(!tracker.add_inconsistent_site(CHROM, end, bad_sites));
+  assert(!tracker.add_inconsistent_site("2", (start+end)/2, bad_sites));
+}
+
+int main(int argc, char* argv[]){
+  if (argc != 2)
+    printErrorAndDie("Script requires exactly 1 argument");
+  std::string vcf_file = std::string(argv[1]);
+
+  VCF::VCFReader vcf_reader(vcf_file);
+  std::vector<NuclearFamily> families = buildFamilies(vcf_reader.get_samples());
+  for (auto family_iter = families.begin(); family_iter != families.end(); family_iter++)
+    family_iter->load_vcf_indices(vcf_reader);
+  std::set<std::string> no_sites;
+
+  // A small window and one spanning more than 63 SNPs, so that removals cross the haplotypes' 64-bit blocks
+  int32_t window_sizes[2] = {500000, 2500000};
+  for (int w = 0; w < 2; w++){
+    int32_t window_size = window_sizes[w];
+    HaplotypeTracker tracker(families, vcf_file, window_size);
+    for (int32_t pos = FIRST_POS; pos <= LAST_POS; pos += window_size/5){
+      if (pos > JUMP_POS && pos < JUMP_POS + 3*window_size)
+	continue;
+      tracker.advance(CHROM, pos, no_sites);
+      HaplotypeTracker fresh_tracker(families, vcf_file, window_size);
+      fresh_tracker.advance(CHROM, pos, no_sites);
+      assert(tracker.num_stored_snps() == fresh_tracker.num_stored_snps());
+      checkDistances(tracker, fresh_tracker);
+      checkInconsistentSites(tracker, vcf_reader, families, pos - window_size, pos + window_size);
+    }
+  }
+
+  // Skipping a site means the window no longer contains every SNP, so callers must check the families themselves
+  HaplotypeTracker tracker(families, vcf_file, 500000);
+  VCF::Variant variant;
+  assert(vcf_reader.set_region(CHROM, FIRST_POS) && vcf_reader.get_next_variant(variant));
+  std::set<std::string> sites_to_skip;
+  sites_to_skip.insert(CHROM + ":" + std::to_string(variant.get_position()));
+  tracker.advance(CHROM, variant.get_position(), sites_to_skip);
+  std::vector< std::set<int32_t> > bad_sites(families.size());
+  assert(!tracker.add_inconsistent_site(CHROM, variant.get_position()+1, bad_sites));
+
+  std::cerr << "All haplotype tracker tests passed" << std::endl;
+  return 0;
+}
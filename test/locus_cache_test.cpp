@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../src/locus_cache.h"
+#include "../src/region.h"
+
+const std::string CACHE_DIR  = "locus_cache_test_dir";
+const std::string INPUT_FILE = "locus_cache_test_input.txt";
+
+std::string entryPath(const LocusCacheKey& key){
+  return CACHE_DIR + "/" + key.digest + ".locus";
+}
+
+void writeInputFile(const std::string& contents){
+  std::ofstream output(INPUT_FILE.c_str());
+  output << contents;
+  output.close();
+}
+
+// Build a cache with a fixed fingerprint, so that separate instances emulate separate runs with the same inputs
+LocusCache* createCache(const std::string& parameters){
+  LocusCache* cache = new LocusCache(CACHE_DIR);
+  cache->add_to_fingerprint("parameters", parameters);
+  cache->add_input_file(INPUT_FILE);
+  return cache;
+}
+
+LocusCacheEntry makeEntry(){
+  LocusCacheEntry entry;
+  entry.vcf_records.push_back(std::pair<int32_t, std::string>(1000, "chr1\t1001\t.\tACACAC\tACACACAC"));
+  entry.vcf_records.push_back(std::pair<int32_t, std::string>(1000, "chr1\t1001\t.\tACACAC\tACAC\t\n"));  // Text containing newlines
+  entry.stutter_text = "chr1\t1000\t1020\t0.9\t0.05\t0.05\n";
+  entry.viz_text     = "chr1\t1000\t1020\t<html>\n</html>\n";
+  entry.outcome_counts["genotype_success"] = 1;
+  entry.outcome_counts["em_converge"]      = 1;
+  return entry;
+}
+
+void checkEntry(const LocusCacheEntry& expected, const LocusCacheEntry& observed){
+  assert(expected.vcf_records    == observed.vcf_records);
+  assert(expected.stutter_text   == observed.stutter_text);
+  assert(expected.viz_text       == observed.viz_text);
+  assert(expected.outcome_counts == observed.outcome_counts);
+}
+
+int main(){
+  std::string chrom_seq;
+  for (int i = 0; i < 3000; i++)
+    chrom_seq += "ACGTTGCA"[(i*7 + i/3) % 8];
+  RegionGroup region_group(Region("chr1", 1000, 1020, 2, "STR_1"));
+  const int32_t padding = 100;
+  writeInputFile("reads");
+
+  // An entry stored by one run should be reused by a subsequent run with identical inputs
+  LocusCacheEntry entry = makeEntry(), loaded;
+  LocusCacheKey key;
+  LocusCache* cache = createCache("A");
+  cache->get_key(region_group, chrom_seq, padding, "", key);
+  assert(!cache->load(key, loaded));
+  cache->store(key, entry);
+  assert(cache->num_stores() == 1);
+  delete cache;
+
+  cache = createCache("A");
+  LocusCacheKey rerun_key;
+  cache->get_key(region_group, chrom_seq, padding, "", rerun_key);
+  assert(rerun_key.digest.compare(key.digest) == 0);
+  assert(cache->load(rerun_key, loaded));
+  assert(cache->num_hits() == 1);
+  checkEntry(entry, loaded);
+
+  // Entries must be invalidated by changes to the region, the surrounding reference sequence, the locus description,
+  // the run's parameters or its input files
+  LocusCacheKey other_key;
+  cache->get_key(RegionGroup(Region("chr1", 1000, 1022, 2, "STR_1")), chrom_seq, padding, "", other_key);
+  assert(!cache->load(other_key, loaded) && loaded.vcf_records.empty());
+
+  std::string mutated_seq = chrom_seq;
+  mutated_seq[region_group.start()-padding+1] = 'N';
+  cache->get_key(region_group, mutated_seq, padding, "", other_key);
+  assert(!cache->load(other_key, loaded));
+  mutated_seq = chrom_seq;
+  mutated_seq[region_group.start()-padding-1] = 'N';  // Outside of the padded window, so the entry remains valid
+  cache->get_key(region_group, mutated_seq, padding, "", other_key);
+  assert(cache->load(other_key, loaded));
+
+  cache->get_key(region_group, chrom_seq, padding, "STUTTER_MODEL", other_key);
+  assert(!cache->load(other_key, loaded));
+  delete cache;
+
+  cache = createCache("B");
+  cache->get_key(region_group, chrom_seq, padding, "", other_key);
+  assert(!cache->load(other_key, loaded));
+  delete cache;
+
+  writeInputFile("modified reads");
+  cache = createCache("A");
+  cache->get_key(region_group, chrom_seq, padding, "", other_key);
+  assert(!cache->load(other_key, loaded));
+  delete cache;
+  writeInputFile("reads");
+
+  // An entry whose stored key data differs from the key must never be returned, even if the digests collide
+  cache = createCache("A");
+  LocusCacheKey colliding_key = key;
+  colliding_key.data[colliding_key.data.size()-2] = 'X';
+  assert(!cache->load(colliding_key, loaded));
+  assert(cache->load(key, loaded));
+
+  // Truncated entries are treated as cache misses
+  std::ifstream input(entryPath(key).c_str(), std::ios_base::in | std::ios_base::binary);
+  std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  input.close();
+  std::ofstream output(entryPath(key).c_str(), std::ios_base::out | std::ios_base::binary);
+  output << contents.substr(0, contents.size()-10);
+  output.close();
+  assert(!cache->load(key, loaded) && loaded.vcf_records.empty() && loaded.outcome_counts.empty());
+  delete cache;
+
+  remove(entryPath(key).c_str());
+  remove(INPUT_FILE.c_str());
+  rmdir(CACHE_DIR.c_str());
+  std::cerr << "All locus cache tests passed" << std::endl;
+  return 0;
+}
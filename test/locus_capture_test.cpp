@@ -0,0 +1,224 @@
+#include <assert.h>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "htslib/sam.h"
+
+#include "../src/bam_io.h"
+#include "../src/locus_capture.h"
+#include "../src/locus_genotyper.h"
+#include "../src/region.h"
+
+const std::string CAPTURE_FILE = "locus_capture_test.capture";
+const std::string CHROM        = "chr1";
+const int32_t CHROM_LENGTH     = 6000;
+const int32_t READ_LENGTH      = 110;
+const int32_t REF_PADDING      = 50;
+const int NUM_SAMPLES          = 4;
+const int READS_PER_ALLELE     = 10;
+
+// Parse a single SAM record into an alignment, setting the fields that BamCramReader sets for records read from a BAM
+BamAlignment parseAlignment(bam_hdr_t* header, const std::string& sam_line){
+  std::vector<char> buffer(sam_line.begin(), sam_line.end());
+  buffer.push_back('\0');
+  kstring_t str;
+  str.l = sam_line.size();
+  str.m = buffer.size();
+  str.s = buffer.data();
+
+  BamAlignment aln;
+  int ret = sam_parse1(&str, header, aln.b_);
+  assert(ret >= 0);
+  aln.ref_     = CHROM;
+  aln.length_  = aln.b_->core.l_qseq;
+  aln.pos_     = aln.b_->core.pos;
+  aln.end_pos_ = bam_endpos(aln.b_);
+  return aln;
+}
+
+// Simulate error-free reads for both of each sample's alleles, along with random phasing log-likelihoods.
+// The first read of each sample is trimmed, so that its sequence fields no longer match the underlying record
+void simulateReads(const std::string& chrom_seq, bam_hdr_t* header, std::mt19937& rng, const Region& region, const std::string& motif,
+		   LocusReads& reads){
+  int32_t ref_len = region.stop() - region.start();
+  std::uniform_int_distribution<int> diff_dist(-2, 2), offset_dist(30, 45);
+  std::uniform_real_distribution<double> log_p_dist(-3, 0);
+  for (int sample = 0; sample < NUM_SAMPLES; sample++){
+    reads.sample_names.push_back("SAMPLE_" + std::to_string(sample));
+    reads.alignments.push_back(std::vector<BamAlignment>());
+    reads.log_p1s.push_back(std::vector<double>());
+    reads.log_p2s.push_back(std::vector<double>());
+
+    int diffs[2] = {diff_dist(rng)*region.period(), diff_dist(rng)*region.period()};
+    for (int hap = 0; hap < 2; hap++){
+      for (int i = 0; i < READS_PER_ALLELE; i++){
+	int allele_len = ref_len + diffs[hap];
+	std::string allele;
+	while ((int)allele.size() < allele_len)
+	  allele += motif;
+	allele = allele.substr(0, allele_len);
+
+	int32_t left_len  = offset_dist(rng);
+	int32_t right_len = READ_LENGTH - left_len - allele_len;
+	int32_t start     = region.start() - left_len;
+	std::string seq   = chrom_seq.substr(start, left_len) + allele + chrom_seq.substr(region.stop(), right_len);
+
+	std::stringstream cigar;
+	if (diffs[hap] > 0)
+	  cigar << left_len + ref_len << "M" << diffs[hap] << "I" << right_len << "M";
+	else if (diffs[hap] < 0)
+	  cigar << left_len + allele_len << "M" << -diffs[hap] << "D" << right_len << "M";
+	else
+	  cigar << READ_LENGTH << "M";
+
+	std::stringstream sam_line;
+	sam_line << region.name() << "_" << sample << "_" << hap << "_" << i << "\t" << (i%2 == 0 ? 0 : 16) << "\t"
+		 << CHROM << "\t" << start+1 << "\t60\t" << cigar.str() << "\t*\t0\t0\t" << seq << "\t" << std::string(seq.size(), 'I');
+	BamAlignment aln = parseAlignment(header, sam_line.str());
+	if (hap == 0 && i == 0)
+	  aln.TrimAlignment(aln.Position()+5, aln.GetEndPosition()-5);
+	reads.alignments.back().push_back(aln);
+	reads.log_p1s.back().push_back(log_p_dist(rng));
+	reads.log_p2s.back().push_back(log_p_dist(rng));
+      }
+    }
+  }
+}
+
+void checkAlignment(BamAlignment& expected, BamAlignment& observed){
+  assert(expected.Name().compare(observed.Name()) == 0);
+  assert(expected.Ref().compare(observed.Ref())   == 0);
+  assert(expected.Position()        == observed.Position());
+  assert(expected.GetEndPosition()  == observed.GetEndPosition());
+  assert(expected.Length()          == observed.Length());
+  assert(expected.MapQuality()      == observed.MapQuality());
+  assert(expected.IsReverseStrand() == observed.IsReverseStrand());
+  assert(expected.HaplotypeTag()    == observed.HaplotypeTag());
+  assert(expected.QueryBases().compare(observed.QueryBases()) == 0);
+  assert(expected.Qualities().compare(observed.Qualities())   == 0);
+  const std::vector<CigarOp>& expected_cigar = expected.CigarData();
+  const std::vector<CigarOp>& observed_cigar = observed.CigarData();
+  assert(expected_cigar.size() == observed_cigar.size());
+  for (unsigned int i = 0; i < expected_cigar.size(); i++)
+    assert(expected_cigar[i].Type == observed_cigar[i].Type && expected_cigar[i].Length == observed_cigar[i].Length);
+}
+
+// Genotype the locus and summarize the calls as a single line of text
+std::string genotypeLocus(const RegionGroup& region_group, const std::string& chrom_seq, const LocusReads& reads){
+  LocusGenotyperOptions options;
+  options.min_total_reads = 20;
+  LocusGenotyper genotyper(options);
+  LocusReads reads_copy = reads;
+  LocusGenotypes results;
+  std::stringstream ss;
+  if (!genotyper.genotype(region_group, chrom_seq, reads_copy, results))
+    ss << "FAILED " << results.failure_reason;
+  for (auto result_iter = results.loci.begin(); result_iter != results.loci.end(); result_iter++){
+    ss << result_iter->chrom << ":" << result_iter->start;
+    for (int i = 0; i < result_iter->num_samples(); i++){
+      if (result_iter->is_missing(i))
+	ss << " .";
+      else
+	ss << " " << result_iter->gb_a(i) << "|" << result_iter->gb_b(i) << ":" << result_iter->depths[i] << ":" << result_iter->quals[i];
+    }
+  }
+  return ss.str();
+}
+
+int main(){
+  std::mt19937 rng(4321);
+  std::uniform_int_distribution<int> base_dist(0, 3);
+  std::string chrom_seq;
+  for (int32_t i = 0; i < CHROM_LENGTH; i++)
+    chrom_seq += "ACGT"[base_dist(rng)];
+
+  std::vector<Region> regions;
+  std::vector<std::string> motifs;
+  regions.push_back(Region(CHROM, 1500, 1524, 2, "STR_1")); motifs.push_back("AC");
+  regions.push_back(Region(CHROM, 4000, 4032, 4, "STR_2")); motifs.push_back("AGAT");
+  for (unsigned int i = 0; i < regions.size(); i++){
+    std::string repeat;
+    while (repeat.size() < (size_t)(regions[i].stop() - regions[i].start()))
+      repeat += motifs[i];
+    chrom_seq.replace(regions[i].start(), repeat.size(), repeat);
+  }
+
+  std::string header_text = "@SQ\tSN:" + CHROM + "\tLN:" + std::to_string(CHROM_LENGTH) + "\n";
+  bam_hdr_t* header = sam_hdr_parse(header_text.size(), header_text.c_str());
+  assert(header != NULL);
+  std::vector<LocusReads> reads(regions.size());
+  for (unsigned int i = 0; i < regions.size(); i++)
+    simulateReads(chrom_seq, header, rng, regions[i], motifs[i], reads[i]);
+  bam_hdr_destroy(header);
+
+  std::vector<std::string> param_args;
+  param_args.push_back("--min-reads");
+  param_args.push_back("20");
+  std::string vcf_header = "##fileformat=VCFv4.1\n";
+  std::string stutter_text = CHROM + "\t4001\t4032\t0.9\t0.05\t0.05\t0.9\t0.01\t0.01\n";
+  LocusCaptureWriter writer(CAPTURE_FILE, param_args);
+  writer.write_header(true, vcf_header, reads[0].sample_names);
+  for (unsigned int i = 0; i < regions.size(); i++)
+    writer.write_locus(RegionGroup(regions[i]), chrom_seq, REF_PADDING, (i == 1), false, (i == 1 ? stutter_text : ""),
+		       reads[i].sample_names, reads[i].alignments, reads[i].log_p1s, reads[i].log_p2s);
+  assert(writer.num_loci() == (int32_t)regions.size());
+  writer.close();
+
+  // The header and every locus' inputs should be read back unchanged
+  LocusCaptureReader reader(CAPTURE_FILE);
+  assert(reader.param_args() == param_args);
+  assert(reader.samples() == reads[0].sample_names);
+  assert(reader.vcf_header().compare(vcf_header) == 0);
+  assert(reader.read_stutter_models());
+  for (unsigned int i = 0; i < regions.size(); i++){
+    LocusCapture locus;
+    assert(reader.next_locus(locus));
+    assert(locus.regions.size() == 1);
+    assert(locus.regions[0].chrom().compare(CHROM) == 0 && locus.regions[0].start() == regions[i].start());
+    assert(locus.regions[0].stop() == regions[i].stop() && locus.regions[0].period() == regions[i].period());
+    assert(locus.regions[0].name().compare(regions[i].name()) == 0);
+    assert(locus.haploid == (i == 1) && !locus.too_many_reads);
+    assert(locus.stutter_text.compare(i == 1 ? stutter_text : "") == 0);
+    assert(locus.rg_names == reads[i].sample_names);
+    assert(locus.log_p1s == reads[i].log_p1s && locus.log_p2s == reads[i].log_p2s);
+    assert(locus.alignments.size() == reads[i].alignments.size());
+    for (unsigned int j = 0; j < locus.alignments.size(); j++){
+      assert(locus.alignments[j].size() == reads[i].alignments[j].size());
+      for (unsigned int k = 0; k < locus.alignments[j].size(); k++)
+	checkAlignment(reads[i].alignments[j][k], locus.alignments[j][k]);
+    }
+
+    // The captured reference must cover the reads and the padding surrounding them
+    std::string replay_seq;
+    locus.fill_chrom_seq(replay_seq);
+    assert(replay_seq.size() == chrom_seq.size());
+    int32_t ref_start = locus.ref_start, ref_stop = locus.ref_start + locus.ref_seq.size();
+    assert(replay_seq.compare(ref_start, ref_stop-ref_start, chrom_seq, ref_start, ref_stop-ref_start) == 0);
+    for (unsigned int j = 0; j < locus.alignments.size(); j++){
+      for (unsigned int k = 0; k < locus.alignments[j].size(); k++){
+	assert(locus.alignments[j][k].Position() - REF_PADDING >= ref_start);
+	assert(locus.alignments[j][k].GetEndPosition() + REF_PADDING <= ref_stop);
+      }
+    }
+
+    // Replaying the captured locus should yield the same calls as genotyping the original inputs
+    LocusReads replay_reads;
+    replay_reads.sample_names = locus.rg_names;
+    replay_reads.alignments   = locus.alignments;
+    replay_reads.log_p1s      = locus.log_p1s;
+    replay_reads.log_p2s      = locus.log_p2s;
+    std::string expected = genotypeLocus(RegionGroup(regions[i]), chrom_seq, reads[i]);
+    assert(expected.find("FAILED") == std::string::npos);
+    assert(expected.compare(genotypeLocus(locus.region_group(), replay_seq, replay_reads)) == 0);
+  }
+  LocusCapture locus;
+  assert(!reader.next_locus(locus));
+
+  remove(CAPTURE_FILE.c_str());
+  std::cerr << "All locus capture tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <assert.h>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "htslib/sam.h"
+
+#include "../src/bam_io.h"
+#include "../src/em_stutter_genotyper.h"
+#include "../src/locus_genotyper.h"
+#include "../src/region.h"
+
+const std::string CHROM     = "chr1";
+const int32_t CHROM_LENGTH  = 4000;
+const int32_t READ_LENGTH   = 110;
+const int NUM_SAMPLES       = 4;
+const int READS_PER_ALLELE  = 10;
+const int STUTTER_READS     = 2;
+const int NUM_THREADS       = 4;
+const int PASSES_PER_THREAD = 3;
+
+class SimulatedLocus {
+ public:
+  Region region;
+  std::string motif;
+  std::vector< std::pair<int,int> > bp_diffs;  // Each sample's pair of bp differences from the reference allele
+  LocusReads reads;
+
+  SimulatedLocus(int32_t start, const std::string& repeat_motif, int num_copies)
+    : region(CHROM, start, start + num_copies*repeat_motif.size(), repeat_motif.size(), "STR"), motif(repeat_motif){}
+};
+
+// Parse a single SAM record into an alignment, setting the fields that BamCramReader sets for records read from a BAM
+BamAlignment parseAlignment(bam_hdr_t* header, const std::string& sam_line){
+  std::vector<char> buffer(sam_line.begin(), sam_line.end());
+  buffer.push_back('\0');
+  kstring_t str;
+  str.l = sam_line.size();
+  str.m = buffer.size();
+  str.s = buffer.data();
+
+  BamAlignment aln;
+  int ret = sam_parse1(&str, header, aln.b_);
+  assert(ret >= 0);
+  aln.ref_     = CHROM;
+  aln.length_  = aln.b_->core.l_qseq;
+  aln.pos_     = aln.b_->core.pos;
+  aln.end_pos_ = bam_endpos(aln.b_);
+  return aln;
+}
+
+// Simulate error-free reads for both of each sample's alleles. Insertions and deletions are placed at the end of the repeat,
+// so each read's CIGAR is consistent with its sequence but still requires left alignment. The first few reads of each allele
+// can contain a stutter artifact that alternately adds or removes one copy of the motif
+void simulateReads(const std::string& chrom_seq, bam_hdr_t* header, std::mt19937& rng, int stutter_reads, SimulatedLocus& locus){
+  const Region& region = locus.region;
+  int32_t ref_len      = region.stop() - region.start();
+  std::uniform_int_distribution<int> diff_dist(-2, 2), offset_dist(30, 45);
+  for (int sample = 0; sample < NUM_SAMPLES; sample++){
+    int diff_a = diff_dist(rng)*region.period(), diff_b = diff_dist(rng)*region.period();
+    locus.bp_diffs.push_back(std::pair<int,int>(std::min(diff_a, diff_b), std::max(diff_a, diff_b)));
+    locus.reads.sample_names.push_back("SAMPLE_" + std::to_string(sample));
+    locus.reads.alignments.push_back(std::vector<BamAlignment>());
+
+    for (int hap = 0; hap < 2; hap++){
+      for (int i = 0; i < READS_PER_ALLELE; i++){
+	int diff       = (hap == 0 ? diff_a : diff_b);
+	if (i < stutter_reads)
+	  diff += (i%2 == 0 ? region.period() : -region.period());
+	int allele_len = ref_len + diff;
+	std::string allele;
+	while ((int)allele.size() < allele_len)
+	  allele += locus.motif;
+	allele = allele.substr(0, allele_len);
+
+	int32_t left_len  = offset_dist(rng);
+	int32_t right_len = READ_LENGTH - left_len - allele_len;
+	int32_t start     = region.start() - left_len;
+	std::string seq   = chrom_seq.substr(start, left_len) + allele + chrom_seq.substr(region.stop(), right_len);
+
+	std::stringstream cigar;
+	if (diff > 0)
+	  cigar << left_len + ref_len << "M" << diff << "I" << right_len << "M";
+	else if (diff < 0)
+	  cigar << left_len + allele_len << "M" << -diff << "D" << right_len << "M";
+	else
+	  cigar << READ_LENGTH << "M";
+
+	std::stringstream sam_line;
+	sam_line << region.name() << "_" << region.start() << "_" << sample << "_" << hap << "_" << i << "\t" << (i%2 == 0 ? 0 : 16) << "\t"
+		 << CHROM << "\t" << start+1 << "\t60\t" << cigar.str() << "\t*\t0\t0\t" << seq << "\t" << std::string(seq.size(), 'I');
+	locus.reads.alignments.back().push_back(parseAlignment(header, sam_line.str()));
+      }
+    }
+  }
+}
+
+// Genotype each locus and summarize the calls as a single line of text
+void genotypeLoci(const LocusGenotyperOptions* options, const std::string* chrom_seq, const std::vector<SimulatedLocus>* loci, int num_passes,
+		  std::vector<std::string>* output){
+  LocusGenotyper genotyper(*options);
+  for (int pass = 0; pass < num_passes; pass++){
+    for (auto locus_iter = loci->begin(); locus_iter != loci->end(); locus_iter++){
+      LocusReads reads = locus_iter->reads;
+      LocusGenotypes results;
+      std::stringstream ss;
+      if (!genotyper.genotype(RegionGroup(locus_iter->region), *chrom_seq, reads, results))
+	ss << "FAILED " << results.failure_reason;
+      for (auto result_iter = results.loci.begin(); result_iter != results.loci.end(); result_iter++){
+	ss << result_iter->chrom << ":" << result_iter->start;
+	for (int i = 0; i < result_iter->num_samples(); i++){
+	  if (result_iter->is_missing(i))
+	    ss << " .";
+	  else
+	    ss << " " << result_iter->gb_a(i) << "|" << result_iter->gb_b(i) << ":" << result_iter->depths[i] << ":" << result_iter->quals[i];
+	}
+      }
+      output->push_back(ss.str());
+    }
+  }
+}
+
+// Simulate bp differences with stutter for a population of diploid samples and return each sample's ML genotype after training the
+// length-based EM, optionally warm-started from an initial stutter model. The generator is copied, so repeated calls simulate identical data
+void trainLengthGenotyper(std::mt19937 rng, const StutterModel* init_model, std::vector< std::pair<int,int> >& gts, StutterModel*& stutter_model){
+  const int period = 2, num_samples = 40, reads_per_allele = 8;
+  std::uniform_int_distribution<int> diff_dist(-3, 3);
+  std::uniform_real_distribution<double> stutter_dist(0.0, 1.0);
+  std::vector<std::string> sample_names;
+  std::vector< std::vector<int> > num_bps(num_samples);
+  std::vector< std::vector<double> > log_p1s(num_samples), log_p2s(num_samples);
+  std::set<int> allele_sizes;
+  allele_sizes.insert(0);
+  for (int sample = 0; sample < num_samples; sample++){
+    sample_names.push_back("SAMPLE_" + std::to_string(sample));
+    for (int hap = 0; hap < 2; hap++){
+      int diff = diff_dist(rng)*period;
+      for (int i = 0; i < reads_per_allele; i++){
+	double draw = stutter_dist(rng);
+	num_bps[sample].push_back(diff + (draw < 0.1 ? period : (draw < 0.2 ? -period : 0)));
+	log_p1s[sample].push_back(0.0);
+	log_p2s[sample].push_back(0.0);
+	allele_sizes.insert(num_bps[sample].back());
+      }
+    }
+  }
+
+  GenotyperOptions options;
+  EMStutterGenotyper genotyper(options, false, period, num_bps, log_p1s, log_p2s, sample_names, 0);
+  NullOstream null_log;
+  assert(genotyper.train(100, 0.01, 0.001, false, null_log, init_model));
+
+  int num_alleles = allele_sizes.size();
+  std::vector<int> hap_to_allele;
+  for (int i = 0; i < num_alleles; i++)
+    hap_to_allele.push_back(i);
+  std::vector< std::pair<int,int> > haps;
+  std::vector<double> log_phased_posteriors, log_unphased_posteriors, hap_log_phased_posteriors, hap_log_unphased_posteriors, gl_diffs;
+  FlatMatrix<double> gls, phased_gls;
+  FlatMatrix<int> pls;
+  genotyper.extract_genotypes_and_likelihoods(num_alleles, hap_to_allele, haps, gts, log_phased_posteriors, log_unphased_posteriors,
+					      hap_log_phased_posteriors, hap_log_unphased_posteriors, false, gls, gl_diffs, false, pls, false, phased_gls);
+  stutter_model = genotyper.get_stutter_model()->copy();
+}
+
+// Verify that each sample's call for the locus matches its simulated genotype
+void checkCalls(const std::string& calls, const SimulatedLocus& locus){
+  std::stringstream ss(calls);
+  std::string region_str, sample_call;
+  ss >> region_str;
+  assert(region_str.compare(CHROM + ":" + std::to_string(locus.region.start()+1)) == 0);
+  for (int sample = 0; sample < NUM_SAMPLES; sample++){
+    ss >> sample_call;
+    int gb_a, gb_b;
+    char sep;
+    std::stringstream call_ss(sample_call);
+    call_ss >> gb_a >> sep >> gb_b;
+    assert(std::min(gb_a, gb_b) == locus.bp_diffs[sample].first);
+    assert(std::max(gb_a, gb_b) == locus.bp_diffs[sample].second);
+  }
+}
+
+int main(){
+  std::mt19937 rng(12345);
+  std::uniform_int_distribution<int> base_dist(0, 3);
+  std::string chrom_seq;
+  for (int32_t i = 0; i < CHROM_LENGTH; i++)
+    chrom_seq += "ACGT"[base_dist(rng)];
+
+  std::vector<SimulatedLocus> loci;
+  loci.push_back(SimulatedLocus(1000, "AC",   12));
+  loci.push_back(SimulatedLocus(1800, "AGAT",  8));
+  loci.push_back(SimulatedLocus(2600, "TTG",   9));
+  for (auto locus_iter = loci.begin(); locus_iter != loci.end(); locus_iter++){
+    const Region& region = locus_iter->region;
+    std::string repeat;
+    while (repeat.size() < (size_t)(region.stop() - region.start()))
+      repeat += locus_iter->motif;
+    chrom_seq.replace(region.start(), repeat.size(), repeat);
+  }
+
+  std::string header_text = "@SQ\tSN:" + CHROM + "\tLN:" + std::to_string(CHROM_LENGTH) + "\n";
+  bam_hdr_t* header = sam_hdr_parse(header_text.size(), header_text.c_str());
+  assert(header != NULL);
+  std::vector<SimulatedLocus> stutter_loci(loci);
+  for (auto locus_iter = loci.begin(); locus_iter != loci.end(); locus_iter++)
+    simulateReads(chrom_seq, header, rng, 0, *locus_iter);
+  for (auto locus_iter = stutter_loci.begin(); locus_iter != stutter_loci.end(); locus_iter++)
+    simulateReads(chrom_seq, header, rng, STUTTER_READS, *locus_iter);
+  bam_hdr_destroy(header);
+
+  // Each locus should be genotyped correctly using a single genotyper
+  LocusGenotyperOptions options;
+  options.min_total_reads = 20;
+  std::vector<std::string> expected;
+  genotypeLoci(&options, &chrom_seq, &loci, 1, &expected);
+  assert(expected.size() == loci.size());
+  for (unsigned int i = 0; i < loci.size(); i++)
+    checkCalls(expected[i], loci[i]);
+
+  // Separate genotypers running concurrently on the same loci must produce identical results
+  std::vector< std::vector<std::string> > outputs(NUM_THREADS);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < NUM_THREADS; i++)
+    threads.push_back(std::thread(genotypeLoci, &options, &chrom_seq, &loci, PASSES_PER_THREAD, &outputs[i]));
+  for (unsigned int i = 0; i < threads.size(); i++)
+    threads[i].join();
+  for (int i = 0; i < NUM_THREADS; i++){
+    assert(outputs[i].size() == PASSES_PER_THREAD*loci.size());
+    for (unsigned int j = 0; j < outputs[i].size(); j++)
+      assert(outputs[i][j].compare(expected[j%loci.size()]) == 0);
+  }
+
+  // A single warm-started refit of the stutter models should yield the same calls as refitting until the models converge
+  LocusGenotyperOptions refit_options(options);
+  refit_options.recalc_stutter_model = true;
+  std::vector<std::string> single_refit, multi_refit;
+  genotypeLoci(&refit_options, &chrom_seq, &stutter_loci, 1, &single_refit);
+  refit_options.genotyper.MAX_STUTTER_REFIT_ROUNDS = 10;
+  genotypeLoci(&refit_options, &chrom_seq, &stutter_loci, 1, &multi_refit);
+  assert(single_refit.size() == stutter_loci.size() && multi_refit.size() == stutter_loci.size());
+  for (unsigned int i = 0; i < stutter_loci.size(); i++){
+    checkCalls(single_refit[i], stutter_loci[i]);
+    checkCalls(multi_refit[i],  stutter_loci[i]);
+  }
+
+  // Warm-starting the length-based EM from a stutter model, as done when the stutter models are refit, should converge
+  // to the same calls and stutter model as training it from the default initial parameters
+  std::vector< std::pair<int,int> > cold_gts, warm_gts;
+  StutterModel* cold_model = NULL, *warm_model = NULL;
+  StutterModel init_model(0.7, 0.02, 0.03, 0.9, 0.02, 0.02, 2);
+  trainLengthGenotyper(rng, NULL, cold_gts, cold_model);
+  trainLengthGenotyper(rng, &init_model, warm_gts, warm_model);
+  assert(cold_gts == warm_gts);
+  assert(cold_model->parameters_within_threshold(*warm_model, 0.01));
+  delete cold_model;
+  delete warm_model;
+
+  std::cerr << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <assert.h>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "../src/bam_processor.h"
+#include "../src/locus_plan.h"
+#include "../src/region.h"
+
+const std::string PLAN_FILE = "locus_plan_test.plan";
+const int32_t CHROM_LENGTH  = 5000;
+
+std::string randomSequence(std::mt19937& rng, int32_t length){
+  std::uniform_int_distribution<int> base_dist(0, 3);
+  std::string seq;
+  for (int32_t i = 0; i < length; i++)
+    seq += "ACGT"[base_dist(rng)];
+  return seq;
+}
+
+void insertRepeat(const Region& region, const std::string& motif, std::string& chrom_seq){
+  std::string repeat;
+  while (repeat.size() < (size_t)(region.stop() - region.start()))
+    repeat += motif;
+  chrom_seq.replace(region.start(), region.stop()-region.start(), repeat.substr(0, region.stop()-region.start()));
+}
+
+void checkLocus(const PlannedLocus& expected, const PlannedLocus& observed){
+  assert(expected.region.chrom().compare(observed.region.chrom()) == 0);
+  assert(expected.region.start()  == observed.region.start());
+  assert(expected.region.stop()   == observed.region.stop());
+  assert(expected.region.period() == observed.region.period());
+  assert(expected.region.name().compare(observed.region.name()) == 0);
+  assert(expected.motif.compare(observed.motif)     == 0);
+  assert(expected.ref_start == observed.ref_start);
+  assert(expected.ref_seq.compare(observed.ref_seq) == 0);
+  assert(expected.near_contig_end        == observed.near_contig_end);
+  assert(expected.left_flank_repetitive  == observed.left_flank_repetitive);
+  assert(expected.right_flank_repetitive == observed.right_flank_repetitive);
+}
+
+int main(){
+  std::mt19937 rng(2468);
+  std::vector<std::string> chroms;
+  chroms.push_back("chr1");
+  chroms.push_back("chr2");
+  std::vector<std::string> chrom_seqs;
+  chrom_seqs.push_back(randomSequence(rng, CHROM_LENGTH));
+  chrom_seqs.push_back(randomSequence(rng, CHROM_LENGTH));
+
+  // A typical locus, a locus whose upstream flank is a homopolymer that extends up to the repeat and a locus at the end of a contig
+  Region typical(chroms[0], 1000, 1024, 2, "STR_1");
+  Region poly_flank(chroms[0], 3000, 3032, 4, "STR_2");
+  Region contig_end(chroms[1], CHROM_LENGTH-40, CHROM_LENGTH-22, 3, "STR_3");
+  insertRepeat(typical,    "AC",   chrom_seqs[0]);
+  insertRepeat(poly_flank, "AGAT", chrom_seqs[0]);
+  insertRepeat(contig_end, "TTG",  chrom_seqs[1]);
+  chrom_seqs[0].replace(poly_flank.start()-100, 100, std::string(100, 'C'));
+
+  std::vector<PlannedLocus> loci;
+  loci.push_back(PlannedLocus(typical));
+  loci.push_back(PlannedLocus(poly_flank));
+  loci.push_back(PlannedLocus(contig_end));
+  LocusPlan::plan_locus(chrom_seqs[0], loci[0]);
+  LocusPlan::plan_locus(chrom_seqs[0], loci[1]);
+  LocusPlan::plan_locus(chrom_seqs[1], loci[2]);
+
+  assert(loci[0].motif.compare("AC") == 0 && loci[1].motif.compare("AGAT") == 0 && loci[2].motif.compare("TTG") == 0);
+  assert(!loci[0].near_contig_end && !loci[0].left_flank_repetitive && !loci[0].right_flank_repetitive);
+  assert(!loci[1].near_contig_end &&  loci[1].left_flank_repetitive && !loci[1].right_flank_repetitive);
+  assert(loci[2].near_contig_end && loci[2].ref_seq.empty());
+  for (unsigned int i = 0; i < 2; i++){
+    assert(loci[i].ref_start < loci[i].region.start() && loci[i].ref_start + (int32_t)loci[i].ref_seq.size() > loci[i].region.stop());
+    assert(loci[i].matches_reference(chrom_seqs[0]));
+  }
+
+  // Each locus should be read back unchanged, optionally restricted to a single chromosome or a maximum number of loci
+  LocusPlanWriter writer(PLAN_FILE, "ref.fa");
+  for (unsigned int i = 0; i < loci.size(); i++)
+    writer.write_locus(loci[i]);
+  assert(writer.num_loci() == (int32_t)loci.size());
+  writer.close();
+
+  std::stringstream log;
+  LocusPlanReader reader(PLAN_FILE);
+  assert(reader.fasta_path().compare("ref.fa") == 0);
+  std::vector<PlannedLocus> read_loci;
+  reader.read_loci(1000, "", read_loci, log);
+  assert(read_loci.size() == loci.size());
+  for (unsigned int i = 0; i < loci.size(); i++)
+    checkLocus(loci[i], read_loci[i]);
+
+  reader.read_loci(1000, chroms[1], read_loci, log);
+  assert(read_loci.size() == 1);
+  checkLocus(loci[2], read_loci[0]);
+
+  reader.read_loci(1, "", read_loci, log);
+  assert(read_loci.size() == 1);
+  checkLocus(loci[0], read_loci[0]);
+
+  // A plan must be rejected if the reference has changed within a locus' window, but not if it only changed outside of it
+  reader.read_loci(1000, chroms[0], read_loci, log);
+  const PlannedLocus& locus = read_loci[0];
+  std::string mutated_seq = chrom_seqs[0];
+  mutated_seq[locus.ref_start + locus.ref_seq.size()/2] = (mutated_seq[locus.ref_start + locus.ref_seq.size()/2] == 'A' ? 'C' : 'A');
+  assert(!locus.matches_reference(mutated_seq));
+  mutated_seq = chrom_seqs[0];
+  mutated_seq[locus.ref_start-1] = (mutated_seq[locus.ref_start-1] == 'A' ? 'C' : 'A');
+  mutated_seq[locus.ref_start + locus.ref_seq.size()] = 'N';
+  assert(locus.matches_reference(mutated_seq));
+  assert(!locus.matches_reference(chrom_seqs[0].substr(0, locus.ref_start + locus.ref_seq.size() - 1)));
+  assert(!locus.matches_reference(chrom_seqs[1]));
+
+  remove(PLAN_FILE.c_str());
+  std::cerr << "All locus plan tests passed" << std::endl;
+  return 0;
+}
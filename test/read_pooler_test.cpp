@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "../src/base_quality.h"
+#include "../src/read_pooler.h"
+#include "../src/stutter_model.h"
+#include "../src/SeqAlignment/AlignmentData.h"
+#include "../src/SeqAlignment/AlignmentModel.h"
+#include "../src/SeqAlignment/AlignmentTraceback.h"
+#include "../src/SeqAlignment/HapAligner.h"
+#include "../src/SeqAlignment/HapBlock.h"
+#include "../src/SeqAlignment/Haplotype.h"
+#include "../src/SeqAlignment/RepeatBlock.h"
+
+const int32_t READ_START = 2;
+
+// Construct an ungapped alignment for the sequence, marking each base that differs from the reference as a mismatch
+Alignment makeAlignment(const std::string& ref_seq, const std::string& seq, const std::string& quals){
+  Alignment aln(READ_START, READ_START+seq.size()-1, false, "READ", quals, seq, seq);
+  std::vector<CigarElement> cigar_list;
+  for (unsigned int i = 0; i < seq.size(); i++){
+    char type = (seq[i] == ref_seq[READ_START+i] ? '=' : 'X');
+    if (!cigar_list.empty() && cigar_list.back().get_type() == type)
+      cigar_list.back().set_num(cigar_list.back().get_num()+1);
+    else
+      cigar_list.push_back(CigarElement(type, 1));
+  }
+  aln.set_cigar_list(cigar_list);
+  return aln;
+}
+
+std::string mutate(const std::string& seq, int32_t ref_pos){
+  std::string mut_seq = seq;
+  int32_t index       = ref_pos - READ_START;
+  mut_seq[index]      = (seq[index] == 'T' ? 'G' : 'T');
+  return mut_seq;
+}
+
+int main(){
+  init_alignment_model();
+  BaseQuality base_quality;
+
+  std::string l1  = "ACGGTATCGATTCGAGCTTGACCTAGGACT";
+  std::string rep = "CACACACACACACACACACA";
+  std::string r1  = "GAATCCCTGTAGCTTACGGATCATTGCAGT";
+  std::string ref_seq = l1 + rep + r1;
+
+  // The alternate left flank carries the mismatched base, so the bound is also exercised for haplotypes that match the read
+  std::string l2 = l1;
+  l2[10] = mutate(ref_seq.substr(READ_START), 10)[10-READ_START];
+
+  StutterModel stutter_model(0.9,  0.01,  0.02, 0.7, 0.001, 0.001, 2);
+  HapBlock left_flank(0, 30, l1);
+  left_flank.add_alternate(l2);
+  RepeatBlock rep_block(30, 50, rep, 2, &stutter_model);
+  rep_block.add_alternate(rep.substr(2));
+  rep_block.add_alternate(rep + "CA");
+  HapBlock right_flank(50, 80, r1);
+  std::vector<HapBlock*> hap_blocks;
+  hap_blocks.push_back(&left_flank);
+  hap_blocks.push_back(&rep_block);
+  hap_blocks.push_back(&right_flank);
+  Haplotype haplotype(hap_blocks);
+
+  // Every read has high quality bases, apart from two low quality bases in the flanks
+  std::string seq   = ref_seq.substr(READ_START, 76);
+  std::string quals(seq.size(), 'I');
+  quals[10-READ_START] = '#';
+  quals[65-READ_START] = '#';
+  std::string one_mismatch  = mutate(seq, 10);
+  std::string two_mismatch  = mutate(one_mismatch, 65);
+  std::string high_mismatch = mutate(seq, 20);
+  std::string str_mismatch  = mutate(seq, 40);
+  std::string str_quals     = quals;
+  str_quals[40-READ_START]  = '#';
+
+  ReadPooler pooler;
+  std::vector<Alignment> alns;
+  for (int i = 0; i < 3; i++)
+    alns.push_back(makeAlignment(ref_seq, seq, quals));
+  alns.push_back(makeAlignment(ref_seq, one_mismatch,  quals));
+  alns.push_back(makeAlignment(ref_seq, two_mismatch,  quals));
+  alns.push_back(makeAlignment(ref_seq, high_mismatch, quals));
+  alns.push_back(makeAlignment(ref_seq, str_mismatch,  str_quals));
+  std::vector<int32_t> pools;
+  for (unsigned int i = 0; i < alns.size(); i++)
+    pools.push_back(pooler.add_alignment(alns[i]));
+  assert(pooler.num_pools() == 5);
+
+  const double MAX_ERROR = 1.5;
+  pooler.enable_near_identical_pooling(MAX_ERROR, 30, 50);
+  pooler.pool(base_quality);
+
+  // Only the reads with low quality mismatches outside of the STR reuse the reference read's alignments
+  int32_t ref_pool = pools[0];
+  assert(pooler.representative(ref_pool) == ref_pool);
+  assert(pooler.representative(pools[3]) == ref_pool);
+  assert(pooler.representative(pools[4]) == ref_pool);
+  assert(pooler.representative(pools[5]) == pools[5]);
+  assert(pooler.representative(pools[6]) == pools[6]);
+  assert(pooler.num_aligned_pools() == 3);
+  assert(pooler.max_error(pools[4]) > pooler.max_error(pools[3]));
+  assert(pooler.max_error(pools[4]) <= MAX_ERROR);
+
+  // The corrected log-likelihoods must lie within the bound of those obtained by aligning each read directly
+  std::vector<bool> realign_to_haplotype(haplotype.num_combs(), true);
+  HapAligner hap_aligner(&haplotype, realign_to_haplotype);
+  std::vector<Alignment>& pooled_alns = pooler.get_alignments();
+  int seed_base = hap_aligner.calc_seed_base(pooled_alns[ref_pool]);
+  assert(seed_base >= 0);
+
+  AlignmentTrace trace(haplotype.num_blocks());
+  std::vector<double> ref_LLs(haplotype.num_combs()), read_LLs(haplotype.num_combs());
+  hap_aligner.process_read(pooled_alns[ref_pool], seed_base, &base_quality, false, &ref_LLs[0], trace);
+  for (int i = 3; i <= 4; i++){
+    int32_t pool = pools[i];
+    hap_aligner.process_read(pooled_alns[pool], seed_base, &base_quality, false, &read_LLs[0], trace);
+    for (int j = 0; j < haplotype.num_combs(); j++){
+      double error = fabs(read_LLs[j] - (ref_LLs[j] + pooler.log_correction(pool)));
+      std::cout << "POOL=" << pool << "\tHAP=" << j << "\tLL=" << read_LLs[j] << "\tCORRECTED_LL=" << ref_LLs[j] + pooler.log_correction(pool)
+		<< "\tERROR=" << error << "\tBOUND=" << pooler.max_error(pool) << std::endl;
+      assert(error <= pooler.max_error(pool) + 1e-8);
+    }
+  }
+
+  // Without near-identical pooling, every pool is aligned
+  ReadPooler exact_pooler;
+  for (unsigned int i = 0; i < alns.size(); i++)
+    exact_pooler.add_alignment(alns[i]);
+  exact_pooler.pool(base_quality);
+  assert(exact_pooler.num_aligned_pools() == exact_pooler.num_pools());
+  for (int32_t i = 0; i < exact_pooler.num_pools(); i++)
+    assert(exact_pooler.representative(i) == i && exact_pooler.log_correction(i) == 0);
+  return 0;
+}
@@ -18,11 +18,19 @@ int main(int argc, char* argv[]){
   readRegions(region_file, 1000, "", regions, std::cerr);
 
   VCF::VCFReader ref_vcf(vcf_file);
+  RefVCFCursor ref_cursor(vcf_file);
 
-  std::vector<std::string> alleles;
-  int32_t pos;
+  std::vector<std::string> alleles, cursor_alleles;
+  int32_t pos, cursor_pos;
   for (unsigned int i = 0; i < regions.size(); i++){
     bool success = read_vcf_alleles(&ref_vcf, regions[i], alleles, pos);
+
+    // The streaming cursor must agree with the per-locus index queries
+    bool cursor_success = ref_cursor.read_alleles(regions[i], cursor_alleles, cursor_pos);
+    if (cursor_success != success || cursor_pos != pos || cursor_alleles != alleles)
+      printErrorAndDie("Reference VCF cursor disagreed with read_vcf_alleles for region " + regions[i].str());
+    cursor_alleles.clear();
+
     if (success){
       std::cerr << "Position=" << pos << std::endl;
       std::cerr << "Alleles:" << std::endl;
@@ -3,3 +3,5 @@
 
 ./read_vcf_priors_test input/chr1_regions.bed input/1kg.chr1.imputed.vcf.gz
 ./read_vcf_priors_test input/chr1_regions_v2.bed input/1kg.chr1.imputed.vcf.gz
+
+./haplotype_tracker_test input/1kg.chr1.imputed.vcf.gz
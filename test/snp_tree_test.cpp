@@ -87,6 +87,13 @@ int main() {
   for (auto tree_iter = treecounts.begin(); tree_iter != treecounts.end(); ++tree_iter, ++bfc_iter)
     assert(*bfc_iter == *tree_iter);
 
+  // check that the tree's SNPs are reported in sorted order
+  std::vector<SNP> sorted_snps;
+  tree.getSorted(sorted_snps);
+  assert(sorted_snps.size() == snps.size());
+  for (unsigned int i = 1; i < sorted_snps.size(); ++i)
+    assert(sorted_snps[i-1].pos() <= sorted_snps[i].pos());
+
   return 0;
 }
 